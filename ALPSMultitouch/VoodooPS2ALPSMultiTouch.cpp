@@ -40,9 +40,6 @@ enum {
     kTapEnabled  = 0x01
 };
 
-int ScrollDelayCount = 0;
-int tfsfactor = 2; //TwoFingerScroll Factor
-
 // =============================================================================
 // ApplePS2ALPSMultiTouch Class Implementation
 //
@@ -58,7 +55,7 @@ IOFixed     ApplePS2ALPSMultiTouch::resolution()  { return _resolution; };
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 // Added for Loading Tap Settings at boot.
-bool TapSettingsLoaded = false;
+static bool TapSettingsLoaded = false;
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
@@ -72,46 +69,47 @@ bool ApplePS2ALPSMultiTouch::init( OSDictionary * properties )
     if (!super::init(properties))  return false;
     _device                    = 0;
     _interruptHandlerInstalled = false;
-    _packetByteCount           = 0;
+    _clickScheduler.init();
+    _events.init();
+    _packets.init(4);
+    _ecRegisters.invalidate();
     _resolution                = (100) << 16; // (100 dpi, 4 counts/mm) On init should be on default
     _touchPadModeByte          = kTapEnabled;
-    _scrolling                 = SCROLL_NONE;
-    _zscrollpos                = 0;
-    z_finger=30;
-    divisor=1; // Standard was 23, changed for high res fix
-    ledge=1700;
-    redge=5200;
-    tedge=4200;
-    bedge=1700;
-    vscrolldivisor=30;
-    hscrolldivisor=30;
-    cscrolldivisor=0;
-    ctrigger=0;
-    centerx=3000;
-    centery=3000;
-    lastx=0;
-    lasty=0;
-    xrest=0; 
-    yrest=0; 
-    scrollrest=0;
-    inited=0;
-    maxtaptime=200000000;
-    clicking=true;
-    maxdragtime=300000000;
-    dragging=false;
-    draglock=false;
-    hscroll=false;
-    scroll=true;
-    hsticky=0;
-    vsticky=0;
-    wsticky=1;
-    tapstable=1;
-    wlimit=9;
-    wvdivisor=30;
-    whdivisor=30;
-    xmoved=ymoved=xscrolled=yscrolled=0;
-    touchmode=MODE_NOTOUCH;
-    wasdouble=false;
+
+    //
+    // Scroll zones: vertical along the right edge, horizontal along the
+    // bottom (y flipped, see kALPSMaxY).
+    //
+
+    _gestures.init();
+    _hardwareTap = false;
+    PS2GestureSettings & settings = _gestures.settings();
+    settings.fingerZ=10;
+    settings.divisor=1;
+    settings.leftEdge=kPS2RegionNoEdgeMin;
+    settings.rightEdge=900;
+    settings.topEdge=kPS2RegionNoEdgeMax;
+    settings.bottomEdge=kALPSMaxY-650;
+    settings.vscrollDivisor=30;
+    settings.hscrollDivisor=30;
+    settings.cscrollDivisor=0;
+    settings.cscrollTrigger=0;
+    settings.centerX=512;
+    settings.centerY=kALPSMaxY/2;
+    settings.maxTapTime=200000000;
+    settings.clicking=true;
+    settings.maxDragTime=300000000;
+    settings.dragging=false;
+    settings.dragLock=false;
+    settings.hscroll=false;
+    settings.scroll=true;
+    settings.stickyHScroll=0;
+    settings.stickyVScroll=0;
+    settings.stickyMultiFinger=1;
+    settings.stableTap=1;
+    settings.wvDivisor=30;
+    settings.whDivisor=30;
+    _gestures.configure();
 
     return true;
 }
@@ -137,71 +135,90 @@ ApplePS2ALPSMultiTouch::probe( IOService * provider, SInt32 * score )
 
     _device = (ApplePS2MouseDevice *) provider;
 
-    PS2Request * request = _device->allocateRequest();
+    //
+    // Use the E6/E7 reports the controller fetched at start, if it got both.
+    //
 
-    if ( !request ) return 0;
+    PS2MouseIdentity identity;
+    if (_device->getIdentity(&identity) && identity.e6Valid && identity.e7Valid)
+    {
+        Byte1 = identity.e6[0];
+        Byte2 = identity.e6[1];
+        Byte3 = identity.e6[2];
+        DEBUG_LOG("E6 Report: [ 0x%02x, 0x%02x, 0x%02x ]\n", Byte1, Byte2, Byte3);
+
+        Byte1 = identity.e7[0];
+        Byte2 = identity.e7[1];
+        Byte3 = identity.e7[2];
+    }
+    else
+    {
+        PS2Request * request = _device->allocateRequest();
 
-    // "E6 report"
-    request->commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[0].inOrOut = kDP_SetMouseResolution;
-    request->commands[1].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[1].inOrOut = 0;
+        if ( !request ) return 0;
 
-    // 3X set mouse scaling 1 to 1
-    request->commands[2].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[2].inOrOut = kDP_SetMouseScaling1To1;
-    request->commands[3].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[3].inOrOut = kDP_SetMouseScaling1To1;
-    request->commands[4].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[4].inOrOut = kDP_SetMouseScaling1To1;
-    request->commands[5].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[5].inOrOut = kDP_GetMouseInformation;
-    request->commands[6].command = kPS2C_ReadDataPort;
-    request->commands[6].inOrOut = 0;
-    request->commands[7].command = kPS2C_ReadDataPort;
-    request->commands[7].inOrOut = 0;
-    request->commands[8].command = kPS2C_ReadDataPort;
-    request->commands[8].inOrOut = 0;
-    request->commandsCount = 9;
-    _device->submitRequestAndBlock(request);
+        // "E6 report"
+        request->commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[0].inOrOut = kDP_SetMouseResolution;
+        request->commands[1].command = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[1].inOrOut = 0;
 
-    // result is "E6 Report"
-    Byte1 = request->commands[6].inOrOut;
-    Byte2 = request->commands[7].inOrOut;
-    Byte3 = request->commands[8].inOrOut;
-    _device->freeRequest(request);
-    DEBUG_LOG("E6 Report: [ 0x%02x, 0x%02x, 0x%02x ]\n", Byte1, Byte2, Byte3);
+        // 3X set mouse scaling 1 to 1
+        request->commands[2].command = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[2].inOrOut = kDP_SetMouseScaling1To1;
+        request->commands[3].command = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[3].inOrOut = kDP_SetMouseScaling1To1;
+        request->commands[4].command = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[4].inOrOut = kDP_SetMouseScaling1To1;
+        request->commands[5].command = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[5].inOrOut = kDP_GetMouseInformation;
+        request->commands[6].command = kPS2C_ReadDataPort;
+        request->commands[6].inOrOut = 0;
+        request->commands[7].command = kPS2C_ReadDataPort;
+        request->commands[7].inOrOut = 0;
+        request->commands[8].command = kPS2C_ReadDataPort;
+        request->commands[8].inOrOut = 0;
+        request->commandsCount = 9;
+        _device->submitRequestAndBlock(request);
+
+        // result is "E6 Report"
+        Byte1 = request->commands[6].inOrOut;
+        Byte2 = request->commands[7].inOrOut;
+        Byte3 = request->commands[8].inOrOut;
+        _device->freeRequest(request);
+        DEBUG_LOG("E6 Report: [ 0x%02x, 0x%02x, 0x%02x ]\n", Byte1, Byte2, Byte3);
  
-    request = _device->allocateRequest();
-    if (!request) return 0;
+        request = _device->allocateRequest();
+        if (!request) return 0;
 
-    // Now fetch "E7 Report"
-    request->commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[0].inOrOut = kDP_SetMouseResolution;
-    request->commands[1].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[1].inOrOut = 0;
+        // Now fetch "E7 Report"
+        request->commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[0].inOrOut = kDP_SetMouseResolution;
+        request->commands[1].command = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[1].inOrOut = 0;
 
-    // 3X set mouse scaling 2 to 1
-    request->commands[2].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[2].inOrOut = kDP_SetMouseScaling2To1;
-    request->commands[3].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[3].inOrOut = kDP_SetMouseScaling2To1;
-    request->commands[4].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[4].inOrOut = kDP_SetMouseScaling2To1;
-    request->commands[5].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[5].inOrOut = kDP_GetMouseInformation;
-    request->commands[6].command = kPS2C_ReadDataPort;
-    request->commands[6].inOrOut = 0;
-    request->commands[7].command = kPS2C_ReadDataPort;
-    request->commands[7].inOrOut = 0;
-    request->commands[8].command = kPS2C_ReadDataPort;
-    request->commands[8].inOrOut = 0;
-    request->commandsCount = 9;
-    _device->submitRequestAndBlock(request);
-    Byte1 = request->commands[6].inOrOut;
-    Byte2 = request->commands[7].inOrOut;
-    Byte3 = request->commands[8].inOrOut;
-    _device->freeRequest(request);
+        // 3X set mouse scaling 2 to 1
+        request->commands[2].command = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[2].inOrOut = kDP_SetMouseScaling2To1;
+        request->commands[3].command = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[3].inOrOut = kDP_SetMouseScaling2To1;
+        request->commands[4].command = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[4].inOrOut = kDP_SetMouseScaling2To1;
+        request->commands[5].command = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[5].inOrOut = kDP_GetMouseInformation;
+        request->commands[6].command = kPS2C_ReadDataPort;
+        request->commands[6].inOrOut = 0;
+        request->commands[7].command = kPS2C_ReadDataPort;
+        request->commands[7].inOrOut = 0;
+        request->commands[8].command = kPS2C_ReadDataPort;
+        request->commands[8].inOrOut = 0;
+        request->commandsCount = 9;
+        _device->submitRequestAndBlock(request);
+        Byte1 = request->commands[6].inOrOut;
+        Byte2 = request->commands[7].inOrOut;
+        Byte3 = request->commands[8].inOrOut;
+        _device->freeRequest(request);
+    }
 
     DEBUG_LOG("E7 Report: [ 0x%02x, 0x%02x, 0x%02x ]\n", Byte1, Byte2, Byte3);
 
@@ -327,7 +344,7 @@ bool ApplePS2ALPSMultiTouch::start( IOService * provider )
 
     // Enable Absolute Mode
 
-    if(_packetByteCount == 6)
+    if(_packets.count() == 6)
     {
         setAbsoluteMode();
     }
@@ -340,6 +357,14 @@ bool ApplePS2ALPSMultiTouch::start( IOService * provider )
 
     setProperty(kIOHIDPointerAccelerationTypeKey, kIOHIDTrackpadAccelerationType);
 
+    //
+    // Set up the timer that reports the button release after a tap click.
+    //
+
+    if ( !_clickScheduler.start(this, getWorkLoop(),
+            OSMemberFunctionCast(IOTimerEventSource::Action, this, &ApplePS2ALPSMultiTouch::clickReleaseOccurred)) )
+        return false;
+
     //
     // Install our driver's interrupt handler, for asynchronous data delivery.
     //
@@ -352,7 +377,7 @@ bool ApplePS2ALPSMultiTouch::start( IOService * provider )
     // Enable the mouse clock (should already be so) and the mouse IRQ line.
     //
 
-    setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
+    _device->updateCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
 
     //
     // Finally, we enable the trackpad itself, so that it may start reporting
@@ -394,7 +419,7 @@ void ApplePS2ALPSMultiTouch::stop( IOService * provider )
     // Disable the mouse clock and the mouse IRQ line.
     //
 
-    setCommandByte( kCB_DisableMouseClock, kCB_EnableMouseIRQ );
+    _device->updateCommandByte( kCB_DisableMouseClock, kCB_EnableMouseIRQ );
 
     //
     // Uninstall the interrupt handler.
@@ -403,6 +428,12 @@ void ApplePS2ALPSMultiTouch::stop( IOService * provider )
     if ( _interruptHandlerInstalled )  _device->uninstallInterruptAction();
     _interruptHandlerInstalled = false;
 
+    //
+    // Drop any pending click release along with its timer.
+    //
+
+    _clickScheduler.stop();
+
     //
     // Uninstall the power control handler.
     //
@@ -441,55 +472,15 @@ void ApplePS2ALPSMultiTouch::interruptOccurred( UInt8 data )
     //
     // Ignore all bytes until we see the start of a packet, otherwise the
     // packets may get out of sequence and things will get very confusing.
+    // The packet assembler takes care of that, and hands out the 4 byte
+    // IntelliMouse mode packets the trackpad is left in.
     //
-		
-    if (_packetByteCount == 0 && ((data == kSC_Acknowledge) || !(data & 0x08)))
-    {
-        return;
-    }
 
-    _packetBuffer[_packetByteCount++] = data;
-    /*
-	if((_packetBuffer[0] & 0xc8) == 0x08) {
-		if(_packetByteCount == 3) {
-        dispatchRelativePointerEventWithPacket(_packetBuffer, 3);
-        _packetByteCount = 0;
-			return;
-		}
-		return;
+    if (_packets.add(data) == kPS2PacketComplete)
+    {
+        dispatchRelativePointerEventWithPacket(_packets.packet(), 4);
+        _packets.publishStatistics(this);
     }
-	if((_packetBuffer[0] & 0xf8) != 0xf8) {
-		IOLog("Bad data: %d bytes\n",(int)_packetByteCount);
-		_packetByteCount = 0;
-		return; //bad data.
-	}
-	if(_packetByteCount >= 2 && _packetByteCount <=6 && _packetBuffer[_packetByteCount-1] == 0x80)
-	{
-		IOLog("Bad data2: %d bytes\n",(int)_packetByteCount);
-		_packetByteCount = 0;
-		return; //bad data
-	}
-	if(_packetByteCount == 3) // Normal PS/2 mouse mode
-	{
-		dispatchRelativePointerEventWithPacket(_packetBuffer,3);
-		_packetByteCount = 0;
-		return;
-	}
-	*/
-	if(_packetByteCount == 4) // IntelliMouse Mode
-	{
-		dispatchRelativePointerEventWithPacket(_packetBuffer,4);
-		_packetByteCount = 0;
-		return;
-	}
-	
-	if(_packetByteCount == 6) // Absolute mode
-	{
-		dispatchAbsolutePointerEventWithPacket(_packetBuffer,6);
-		_packetByteCount = 0;
-		return;
-	}
-	return;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -532,307 +523,141 @@ void ApplePS2ALPSMultiTouch::dispatchAbsolutePointerEventWithPacket(UInt8* packe
     // on a dualpoint, etc.
     //
     
-    UInt32 buttons = 0;
-    int left = 0, right = 0, middle = 0;
-	int tap = 0, tapclick = 0;
-    int xdiff, ydiff, scroll, s_xdiff, s_ydiff, s_ref_x, s_ref_y, tfsf2;
-
-    //uint64_t now;
-	AbsoluteTime now;
-    bool wasNotScrolling, willScroll = false, twoFingerScroll;
-
-	twoFingerScroll = false;
-	s_ref_x =950;
-	s_ref_y =950;
+    PS2GestureSample sample;
+    UInt32 buttons = 0, result;
+    int left, right, middle, finger, gesture;
 
     int x = (packet[1] & 0x7f) | ((packet[2] & 0x78) << (7-3));
     int y = (packet[4] & 0x7f) | ((packet[3] & 0x70) << (7-4));
     int z = packet[5]; // touch pression
-	
-	xdiff = x - _xpos;
-	ydiff = y - _ypos;
 
 	DEBUG_LOG("Packets: 0x%02x - 0x%02x - 0x%02x - 0x%02x - 0x%02x - 0x%02x\n",
 			  (unsigned int)packet[0], (unsigned int)packet[1], (unsigned int)packet[2], 
 			  (unsigned int)packet[3], (unsigned int)packet[4], (unsigned int)packet[5]);
-	//IOSleep(20);
 
 #if APPLESDK
-	clock_get_uptime(&now);
+	clock_get_uptime(&sample.time);
 #else 
-	clock_get_uptime((uint64_t*)&now);
+	clock_get_uptime((uint64_t*)&sample.time);
 #endif
+
+	// The packet reports the button state itself, a pending release is moot.
+	_clickScheduler.cancel();
     
-    left  |= (packet[3]) & 1;
-    right |= (packet[3] >> 1) & 1;
-	middle |= left & right;
-	tap = (packet[2] >> 1) & 1;
-	tapclick = packet[2] & 1;
+    left    = packet[3] & 1;
+    right   = (packet[3] >> 1) & 1;
+	middle  = left & right;
+	finger  = (packet[2] >> 1) & 1;
+	gesture = packet[2] & 1;
     buttons |= left ? 0x01 : 0;
     buttons |= right ? 0x02 : 0;
     buttons |= middle ? 0x04 : 0;
 
-    DEBUG_LOG("Absolute packet: x: %d, y: %d, xpos: %d, ypos: %d, buttons: %x, "
-              "z: %d, zpos: %d\n", x, y, (int)_xpos, (int)_ypos, (int)buttons, 
-              (int)z, (int)_zpos);
-//	scroll = false;
-
-    wasNotScrolling = _scrolling == SCROLL_NONE;
-    scroll = insideScrollArea(x, y);
+	//
+	// A tap the pad recognized itself comes without the finger bit, and
+	// maybe without pressure; make it a touch for the gesture engine.
+	//
 
-    if ((z >= 100) && (_edgehscroll || _edgevscroll)) //Z value increases as more trackpad area is touched 
-	{												  //I've determined this value using my fingers.	
-		twoFingerScroll = true;
-		s_ref_x = x;
-		s_ref_y = y;
-	}
-//Slice
-/*	z=
- 30..55 - left edge
- 60..80 - bottom edge
- 70..90 - centre
- >100 - two finger
-	
-*/	
-	if ((z>20) && (z<69)) {
-		//willScroll = true;
-		willScroll = ((scroll & SCROLL_VERT)  && _edgevscroll) || 
-					 ((scroll & SCROLL_HORIZ) && _edgehscroll) ;
+	if (gesture && !finger)
+		z = kALPSTapZ;
 
-	} 
-	DEBUG_LOG("Absolute packet: tap: %d  tapclick: %d scroll: %d willScroll: %d\n", tap, tapclick, scroll, willScroll);
+	sample.x = x;
+	sample.y = kALPSMaxY - y;
+	sample.z = z;
+	sample.w = 0;
+	sample.fingers = z >= kALPSTwoFingerZ ? 2 : 1;
+	sample.buttons = buttons;
 
-#if VOODOO 
-	
-    /*willScroll = ((scroll & SCROLL_VERT) && _edgevscroll) || 
-                    ((scroll & SCROLL_HORIZ) && _edgehscroll);*/
-	willScroll = _zpos > 0;
+	//
+	// A finger following a tap, which is how the pad reports tap and drag,
+	// comes without a lift in between.  Give the engine one first, so the
+	// tap is over and the drag can start, as Linux does.
+	//
 
-	willScroll &= ((scroll & SCROLL_VERT) && _edgevscroll) || 
-		((scroll & SCROLL_HORIZ) && _edgehscroll) ;
+	if (_hardwareTap && finger)
+	{
+		PS2GestureSample lift = sample;
+		lift.z = 0;
+		_gestures.process(this, lift);
+	}
+	_hardwareTap = gesture && !finger;
 
-	if (willScroll)
-		ScrollDelayCount++;   //Inc the delay count this stops scrolling from accidental scroll region touches
+	result = _gestures.process(this, sample);
 
-    // Make sure we are still relative
-    if (z == 0 || (_zpos >= 1 && z != 0 && !willScroll && !twoFingerScroll))
-    {
-        _xpos = x;
-        _ypos = y;
-    }
-    
-	// I added this for tapping but it didn't work	
-	//	if ((wasNotScrolling) && (willScroll) && (!twoFingerScroll) && ((x > 950) && (y < 100)))  ScrollDelayCount = 21; //tap
-
-    // Are we scrolling?
-    if (((willScroll) && (ScrollDelayCount > 20)) || (!wasNotScrolling)) // Only scroll when delay count reached
-    {
-        if (_zscrollpos <= 0 || wasNotScrolling)
-        {
-            _xscrollpos = x;
-            _yscrollpos = y;
-        }
-        
-        xdiff = x - _xscrollpos;
-        ydiff = y - _yscrollpos;
+	//
+	// The trackpad stops reporting soon after the finger lifts, so the release
+	// of a tap click (or of a tap waiting to become a drag) can't wait for the
+	// next packet.  Have the click timer report it instead.
+	//
 
-		s_ydiff = (scroll == SCROLL_VERT) ? -((int)((double)ydiff * _edgeaccellvalue)) : 0;
-        s_xdiff = (scroll == SCROLL_HORIZ) ? -((int)((double)xdiff * _edgeaccellvalue)) : 0;
+	if (result & kPS2GestureRelease)
+		_clickScheduler.schedule(sample.buttons, _gestures.releaseDelay());
+}
 
-		_xscrollpos = x;
-		_yscrollpos = y;
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-		ydiff = -((int)((double)ydiff * _edgeaccellvalue));
-        xdiff = -((int)((double)xdiff * _edgeaccellvalue));
-		DEBUG_LOG(" ABmod : Sensed EdgeScrolling z:%d,_zpos:%d: s_xdiff:%d, s_ydiff:%d, x:%d, y:%d, xdiff:%d, ydiff:%d\n",
-				  (int)z,(int)_zpos, s_xdiff, s_ydiff,(int)x,(int)y, (int) xdiff, (int) ydiff);
-		
-        dispatchScrollWheelEvent( ((scroll & SCROLL_VERT) ? ydiff : 0), ((scroll & SCROLL_HORIZ) ? xdiff : 0), 0, time);
-        _zscrollpos = z;
-		ScrollDelayCount = 21; //set to 21 so we don't increment out of integer range.
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-        return;
-    }
+void ApplePS2ALPSMultiTouch::clickReleaseOccurred(IOTimerEventSource * sender)
+{
+	UInt32 buttons;
+	AbsoluteTime now;
 
-	if (twoFingerScroll) {   //Now we have the two finger scroll code	
-		ScrollDelayCount++;
-		
-		xdiff = x - _xpos;
-		ydiff = y - _ypos;
-		_xpos = x;
-		_ypos = y;
+	//
+	// Report the button release for the last tap, unless a packet arrived in
+	// the meantime.  A tap that was waiting to become a drag has now expired.
+	//
 
-		s_xdiff = 0; //reset
-		s_ydiff = 0; //reset
-		
-		if (xdiff > 0)
-			s_xdiff = -1;	//Not very good code but it works, sorry devs ;)
+	if (!_clickScheduler.fire(&buttons))
+		return;
 
-		if (xdiff < 0)
-			s_xdiff = 1;		//
-										//
-		if (ydiff > 0)
-			s_ydiff = -1;	//
+	_gestures.expireTap();
 
-		if (ydiff < 0)
-			s_ydiff = 1;		//Crude, yes
-		
-		if (!_edgevscroll)
-			s_ydiff = 0;  //is Vertical Scrolling on in Trackpad.prefpane?
-		
-		if (!_edgehscroll)
-			s_xdiff = 0; //is Horizontal Scrolling on in Trackpad.prefpane?
-			
-		//IOLog for debug use only
+#if APPLESDK
+	clock_get_uptime(&now);
+#else 
+	clock_get_uptime((uint64_t*)&now);
+#endif
+	postRelativePointerEvent(0, 0, buttons, now);
+}
 
-		DEBUG_LOG("ABmod : Sensed 2 Fingerscrolling z:%d,_zpos:%d: s_xdiff:%d, s_ydiff:%d, x:%d, y:%d, xdiff:%d, ydiff:%d\n",
-				  (int)z,(int)_zpos, s_xdiff, s_ydiff,(int)x,(int)y, (int) xdiff, (int) ydiff);
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-		if (ScrollDelayCount>3)  //We have a delay in this also, just incase of accidental two finger presses
-		{
-			tfsf2 = (int)(tfsfactor + (int)((int)_edgeaccell/(256*16)));  //Value from Trackpad.prefpanes
-			dispatchScrollWheelEvent(s_ydiff*tfsf2, s_xdiff*tfsf2, 0, time);  //Multiply with a factor
-			ScrollDelayCount = 0;												//Reset Delay
-		}
-		_scrolling = SCROLL_VERT;	//Had to assign a scroll value.
-		_zscrollpos = z;			//report we are scrolling
-		
-		return;						//Return
-	}
+void ApplePS2ALPSMultiTouch::postRelativePointerEvent(int dx, int dy, UInt32 buttons, AbsoluteTime now)
+{
+	//
+	// All pointer events go through the event filter, which drops the ones
+	// that change nothing and merges motion within the coalescing window.
+	//
 
-    _zpos = z == 0 ? _zpos + 1 : 0;
-    _scrolling = SCROLL_NONE;
-    
-    xdiff = x - _xpos;
-    ydiff = y - _ypos;
-    
-    _xpos = x;
-    _ypos = y;
-    
-    DEBUG_LOG("Sending event: %d,%d,%d\n",xdiff,ydiff,(int)buttons);
-    //dispatchRelativePointerEvent(xdiff, ydiff, buttons, time);
+	if (_events.addPointer(&dx, &dy, buttons, *(uint64_t*)&now))
+		dispatchRelativePointerEvent(dx, dy, buttons, now);
+}
 
-	if ((willScroll) || (twoFingerScroll)) {
-		xdiff = 0;
-		ydiff = 0;
-	}
-	
-	if (ScrollDelayCount < 5)  //Just works??	
-		dispatchRelativePointerEvent(xdiff, ydiff, buttons, now);
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-	if (!willScroll)
-		ScrollDelayCount = 0;
-#else
-	if (willScroll)
-		ScrollDelayCount++;   //Inc the delay count this stops scrolling from accidental scroll region touches
-	_movedelay++;
-	if (tap && (!willScroll) && !tapclick) {
-		if (_movedelay > 3) {
-			xdiff = x - _xpos;
-			ydiff = y - _ypos;
-			_movedelay = 4;
-		} else {
-			xdiff = 0;
-			ydiff = 0;
-		}
-		
-		_xpos = x;
-		_ypos = y;	
-		touchmode = MODE_MOVE;
-		dispatchRelativePointerEvent(xdiff, ydiff, buttons, now);
-		_time = now;
-	}
-		
-	if (tap && (willScroll) && (ScrollDelayCount>10)){
-		ScrollDelayCount=11;
-		
-		xdiff = x - _xpos;
-		ydiff = y - _ypos;
-		_xpos = x;
-		_ypos = y;
-		
-		s_xdiff = 0; //reset
-		s_ydiff = 0; //reset
-		if (xdiff && (scroll & SCROLL_HORIZ) && _edgehscroll) { //is Horizontal Scrolling on in Trackpad.prefpane?
-			s_xdiff = (xdiff > 0)?(-1):1;
-		}
-		if (ydiff && (scroll & SCROLL_VERT) && _edgevscroll){ //is Vertical Scrolling on in Trackpad.prefpane?
-			s_ydiff = (ydiff > 0)?(-1):1;
-		}
-		
-		tfsf2 = (int)(tfsfactor + (int)((int)_edgeaccell/(256*16)));  //Value from Trackpad.prefpanes
-		dispatchScrollWheelEvent(s_ydiff*tfsf2, s_xdiff*tfsf2, 0, now);  //Multiply with a factor	
-		touchmode = MODE_VSCROLL;
-	}
-	
-	if (!tap) {
-		/*if ((touchmode == MODE_MOVE) && ((*(uint64_t*)&now -*(uint64_t*)&time)<maxtaptime)) {
-			dispatchRelativePointerEvent(0,0,1,now);
-			IODelay(1000);
-			clock_get_uptime((uint64_t*)&now);
-			dispatchRelativePointerEvent(0,0,0,now);
-		}*/
-		_movedelay = 0;
-		touchmode = MODE_NOTOUCH;
-	}
-	
-	if (tapclick) {
-		touchmode = MODE_MTOUCH;
-		dispatchRelativePointerEvent(0,0,1,now);
-#if DEBUG		
-		uint64_t diff = (*(uint64_t*)&now -*(uint64_t*)&_time);
-#endif		
-		DEBUG_LOG(" tapclick with diff=%ld while max=%ld\n", (long int)diff, (long int)maxtaptime);
-		IODelay(1000);
-#if APPLESDK
-		clock_get_uptime(&now);
-#else 
-		clock_get_uptime((uint64_t*)&now);
-#endif
-		dispatchRelativePointerEvent(0,0,0,now);					
-		_time = now;
-	}
-	if (!tapclick && (touchmode == MODE_MTOUCH)) {
-		uint64_t diff = (*(uint64_t*)&now -*(uint64_t*)&_time);
-		DEBUG_LOG(" tapclick with diff=%ld while max=%ld\n", (long int)diff, (long int)maxtaptime);
-		if (diff < maxtaptime) {
-			dispatchRelativePointerEvent(0,0,1,now);
-			IODelay(1000);
-#if APPLESDK
-			clock_get_uptime(&now);
-#else 
-			clock_get_uptime((uint64_t*)&now);
-#endif
-			dispatchRelativePointerEvent(0,0,0,now);			
-		}
-		touchmode = MODE_NOTOUCH;
-	}
-		
-	if (!willScroll)
-		ScrollDelayCount = 0;
-	
-#endif	
-	return;
+void ApplePS2ALPSMultiTouch::postScrollWheelEvent(int deltaVert, int deltaHoriz, AbsoluteTime now)
+{
+	if (_events.addScroll(&deltaVert, &deltaHoriz, *(uint64_t*)&now))
+		dispatchScrollWheelEvent(deltaVert, deltaHoriz, 0, now);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-int ApplePS2ALPSMultiTouch::insideScrollArea(int x, int y)
+void ApplePS2ALPSMultiTouch::flushEvents(AbsoluteTime now)
 {
-    int scroll = SCROLL_NONE;
-    if (x > 900) scroll |= SCROLL_VERT;
-    if (y > 650) scroll |= SCROLL_HORIZ;
-    
-    if (x > 900 && y > 650)
-    {
-        if (_scrolling == SCROLL_VERT)
-            scroll = SCROLL_VERT;
-        else
-            scroll = SCROLL_HORIZ;
-    }
-    
-    _scrolling = scroll;
-    return scroll;
+	int deltaVert, deltaHoriz, dx, dy;
+	UInt32 buttons;
+
+	//
+	// Report whatever the filter still holds back; called when the finger
+	// lifts, as no more events may follow to carry it.
+	//
+
+	if (_events.flushScroll(&deltaVert, &deltaHoriz))
+		dispatchScrollWheelEvent(deltaVert, deltaHoriz, 0, now);
+	if (_events.flushPointer(&dx, &dy, &buttons))
+		dispatchRelativePointerEvent(dx, dy, buttons, now);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -879,11 +704,11 @@ void ApplePS2ALPSMultiTouch::dispatchRelativePointerEventWithPacket( UInt8 * pac
 #else 
 	clock_get_uptime((uint64_t*)&now);
 #endif
-    dispatchRelativePointerEvent(dx, dy, buttons, now);
+    postRelativePointerEvent(dx, dy, buttons, now);
 
   if ( packetSize > 3 )
   {
-    dispatchRelativePointerEvent(dx, dy, buttons, now);
+    postRelativePointerEvent(dx, dy, buttons, now);
 
     //
     // We treat the 4th byte in the packet as a 8-bit signed Z value.
@@ -901,12 +726,12 @@ void ApplePS2ALPSMultiTouch::dispatchRelativePointerEventWithPacket( UInt8 * pac
       // and positive when scrolling downwards. Invert this before passing to
       // HID/CG.
       //
-      dispatchScrollWheelEvent(-dz, 0, 0, now);
+      postScrollWheelEvent(-dz, 0, now);
     }
   }
   else
   {
-      dispatchRelativePointerEvent(dx, dy, buttons, now);
+      postRelativePointerEvent(dx, dy, buttons, now);
   }
 
     return;
@@ -1085,6 +910,7 @@ void ApplePS2ALPSMultiTouch::setTouchPadEnable( bool enable )
     request->commands[4].command = kPS2C_SendMouseCommandAndCompareAck;
     request->commands[4].inOrOut = (enable)?kDP_Enable:kDP_SetDefaultsAndDisable;
     request->commandsCount = 5;
+    request->coalesceKey   = kPS2CoalesceEnable;
     _device->submitRequest(request); // asynchronous, auto-free'd
 }
 
@@ -1115,63 +941,6 @@ void ApplePS2ALPSMultiTouch::setSampleRateAndResolution( void )
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2ALPSMultiTouch::setCommandByte( UInt8 setBits, UInt8 clearBits )
-{
-    //
-    // Sets the bits setBits and clears the bits clearBits "atomically" in the
-    // controller's Command Byte.   Since the controller does not provide such
-    // a read-modify-write primitive, we resort to a test-and-set try loop.
-    //
-    // Do NOT issue this request from the interrupt/completion context.
-    //
-
-    UInt8        commandByte;
-    UInt8        commandByteNew;
-    PS2Request * request = _device->allocateRequest();
-
-    if ( !request ) return;
-
-    do
-    {
-        // (read command byte)
-        request->commands[0].command = kPS2C_WriteCommandPort;
-        request->commands[0].inOrOut = kCP_GetCommandByte;
-        request->commands[1].command = kPS2C_ReadDataPort;
-        request->commands[1].inOrOut = 0;
-        request->commandsCount = 2;
-        _device->submitRequestAndBlock(request);
-
-        //
-        // Modify the command byte as requested by caller.
-        //
-
-        commandByte    = request->commands[1].inOrOut;
-        commandByteNew = (commandByte | setBits) & (~clearBits);
-
-        // ("test-and-set" command byte)
-        request->commands[0].command = kPS2C_WriteCommandPort;
-        request->commands[0].inOrOut = kCP_GetCommandByte;
-        request->commands[1].command = kPS2C_ReadDataPortAndCompare;
-        request->commands[1].inOrOut = commandByte;
-        request->commands[2].command = kPS2C_WriteCommandPort;
-        request->commands[2].inOrOut = kCP_SetCommandByte;
-        request->commands[3].command = kPS2C_WriteDataPort;
-        request->commands[3].inOrOut = commandByteNew;
-        request->commandsCount = 4;
-        _device->submitRequestAndBlock(request);
-
-        //
-        // Repeat this loop if last command failed, that is, if the
-        // old command byte was modified since we first read it.
-        //
-
-    } while (request->commandsCount != 4);  
-
-    _device->freeRequest(request);
-}
-
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-
 IOReturn ApplePS2ALPSMultiTouch::setParamProperties( OSDictionary * dict )
 {
     OSNumber * clicking = OSDynamicCast( OSNumber, dict->getObject("Clicking") );
@@ -1181,6 +950,11 @@ IOReturn ApplePS2ALPSMultiTouch::setParamProperties( OSDictionary * dict )
     OSNumber * vscroll  = OSDynamicCast( OSNumber, dict->getObject("TrackpadScroll") );
     OSNumber * eaccell  = OSDynamicCast( OSNumber, dict->getObject("HIDTrackpadScrollAcceleration") );
 	OSNumber * accell   = OSDynamicCast( OSNumber, dict->getObject("HIDTrackpadAcceleration") );
+	OSNumber * coalesce = OSDynamicCast( OSNumber, dict->getObject("EventCoalesceTime") );
+	OSNumber * taptime  = OSDynamicCast( OSNumber, dict->getObject("MaxTapTime") );
+	OSNumber * clicktime = OSDynamicCast( OSNumber, dict->getObject("HIDClickTime") );
+	OSNumber * righttap = OSDynamicCast( OSNumber, dict->getObject("TrackpadRightClick") );
+	PS2GestureSettings & settings = _gestures.settings();
 
 	dict->removeObject("HIDPointerAcceleration");
 
@@ -1209,6 +983,8 @@ IOReturn ApplePS2ALPSMultiTouch::setParamProperties( OSDictionary * dict )
                                   kTapEnabled :
                                   0;
 
+        settings.clicking = newModeByteValue ? true : false;
+
         if (!TapSettingsLoaded) {
 			DEBUG_LOG(" ABmod, Loading Clicking Settings at Boot: %d, %d, %d", clicking->unsigned32BitValue() ,kTapEnabled,newModeByteValue);
 		}
@@ -1217,7 +993,7 @@ IOReturn ApplePS2ALPSMultiTouch::setParamProperties( OSDictionary * dict )
             _touchPadModeByte = newModeByteValue;
 			setTapEnable(_touchPadModeByte);
 			setProperty("Clicking", clicking);
-			if(_packetByteCount == 6)
+			if(_packets.count() == 6)
 			{
 				setAbsoluteMode(); //restart the mouse...
 			}
@@ -1232,35 +1008,56 @@ IOReturn ApplePS2ALPSMultiTouch::setParamProperties( OSDictionary * dict )
 
 	if (dragging)
 	{
-		_dragging = dragging->unsigned32BitValue() & 0x1 ? true : false;
+		settings.dragging = dragging->unsigned32BitValue() & 0x1 ? true : false;
 		setProperty("Dragging", dragging);
 	}
 
 	if (draglock)
 	{
-		_draglock = draglock->unsigned32BitValue() & 0x1 ? true : false;
+		settings.dragLock = draglock->unsigned32BitValue() & 0x1 ? true : false;
 		setProperty("DragLock", draglock);
 	}
 
     if (hscroll)
     {
-        _edgehscroll = hscroll->unsigned32BitValue() & 0x1 ? true : false;
+        settings.hscroll = hscroll->unsigned32BitValue() & 0x1 ? true : false;
         setProperty("TrackpadHorizScroll", hscroll);
     }
 
     if (vscroll)
     {
-        _edgevscroll = vscroll->unsigned32BitValue() & 0x1 ? true : false;
+        settings.scroll = vscroll->unsigned32BitValue() & 0x1 ? true : false;
         setProperty("TrackpadScroll", vscroll);
         }
+    if (coalesce)
+    {
+        _events.setWindow(coalesce->unsigned64BitValue());
+        setProperty("EventCoalesceTime", coalesce);
+    }
+
     if (eaccell)
     {
-        _edgeaccell = eaccell->unsigned32BitValue();
-        _edgeaccellvalue = (((double)(_edgeaccell / 1966.08)) / 375.0);  //Slice was 75 - too fast
-        _edgeaccellvalue = _edgeaccellvalue == 0 ? 0.01 : _edgeaccellvalue;
+        // Scroll deltas used to be scaled by accell * 4 / 45 in 16.16; as a
+        // divisor of the finger motion that is 737280 / accell.
+        UInt32 edgeaccell = eaccell->unsigned32BitValue();
+        int divisor = edgeaccell ? (int)(737280 / edgeaccell) : 100;
+        if (divisor < 1)
+            divisor = 1;
+        settings.vscrollDivisor = settings.hscrollDivisor = divisor;
+        settings.wvDivisor = settings.whDivisor = divisor;
         setProperty("HIDTrackpadScrollAcceleration", eaccell);
     }
 
+	if (taptime)
+		settings.maxTapTime = taptime->unsigned64BitValue();
+	if (clicktime)
+		settings.maxDragTime = clicktime->unsigned64BitValue();
+	if (righttap)
+		settings.rightTap = righttap->unsigned32BitValue() & 0x1 ? true : false;
+
+	_gestures.reset();
+	_gestures.configure();
+
     return super::setParamProperties(dict);
 }
 
@@ -1277,12 +1074,15 @@ void ApplePS2ALPSMultiTouch::setDevicePowerState( UInt32 whatToDo )
             //
 
             setTouchPadEnable( false );
+            _ecRegisters.invalidate();      // lost while powered off
+            _gestures.reset();
+            _hardwareTap = false;
             break;
 
         case kPS2C_EnableDevice:
 		case 2:  //Slice :)
 			
-			IOSleep(1000);
+			// (the controller holds off this call until the device answers)
 
             setTapEnable( _touchPadModeByte );
 
@@ -1292,7 +1092,7 @@ void ApplePS2ALPSMultiTouch::setDevicePowerState( UInt32 whatToDo )
             // mouse IRQ line.
             //
 
-            setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
+            _device->updateCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
 
 			DEBUG_LOG(" ABMod Waking up Touchpad setting setTapEnable to %d\n",_touchPadModeByte);
 
@@ -1311,7 +1111,7 @@ void ApplePS2ALPSMultiTouch::setDevicePowerState( UInt32 whatToDo )
             //
 			
 			setTapEnable( _touchPadModeByte );
-			if(_packetByteCount == 6)
+			if(_packets.count() == 6)
 			{
 				setAbsoluteMode();
 			}
@@ -1428,36 +1228,39 @@ void ApplePS2ALPSMultiTouch::setMisc( UInt16 val )
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+// Commands (and their parameters) sending one nibble in EC mode
+
+static const int alpsNibbleCommands[] = {
+    kDP_SetMousePoll,           // 0xF0
+    kDP_SetDefaults,            // 0xF6
+    kDP_SetMouseScaling2To1,    // 0xE7
+    kDP_SetMouseSampleRate,     // 0xF3
+    kDP_SetMouseSampleRate,     // 0xF3
+    kDP_SetMouseSampleRate,     // 0xF3
+    kDP_SetMouseSampleRate,     // 0xF3
+    kDP_SetMouseSampleRate,     // 0xF3
+    kDP_SetMouseSampleRate,     // 0xF3
+    kDP_SetMouseSampleRate,     // 0xF3
+    kDP_GetMouseInformation,    // 0xE9
+    kDP_SetMouseResolution,     // 0xE8
+    kDP_SetMouseResolution,     // 0xE8
+    kDP_SetMouseResolution,     // 0xE8
+    kDP_SetMouseResolution,     // 0xE8
+    kDP_SetMouseScaling1To1 };  // 0xE6
+
+static const unsigned char alpsNibbleParams[] = {
+    0xff, 0xff, 0xff, 10, 20, 40, 60, 80, 100, 200, 0xff, 0, 1, 2, 3, 0xff };
+
 void ApplePS2ALPSMultiTouch::AlpsECNibble(PS2Request * request, int * index, uint8_t nibble)
 {
     unsigned char param;
-    static const int cmds[] = {
-        kDP_SetMousePoll,           // 0xF0
-        kDP_SetDefaults,            // 0xF6
-        kDP_SetMouseScaling2To1,    // 0xE7
-        kDP_SetMouseSampleRate,     // 0xF3
-        kDP_SetMouseSampleRate,     // 0xF3
-        kDP_SetMouseSampleRate,     // 0xF3
-        kDP_SetMouseSampleRate,     // 0xF3
-        kDP_SetMouseSampleRate,     // 0xF3
-        kDP_SetMouseSampleRate,     // 0xF3
-        kDP_SetMouseSampleRate,     // 0xF3
-        kDP_GetMouseInformation,    // 0xE9
-        kDP_SetMouseResolution,     // 0xE8
-        kDP_SetMouseResolution,     // 0xE8
-        kDP_SetMouseResolution,     // 0xE8
-        kDP_SetMouseResolution,     // 0xE8
-        kDP_SetMouseScaling1To1 };  // 0xE6
-
-    static const unsigned char params[] = {
-        0xff, 0xff, 0xff, 10, 20, 40, 60, 80, 100, 200, 0xff, 0, 1, 2, 3, 0xff };
 
     nibble &= 0xf;
     request->commands[*index].command  = kPS2C_SendMouseCommandAndCompareAck;  
-    request->commands[(*index)++].inOrOut =  cmds[nibble]; 
-    DEBUG_LOG("EC Nibble: index:%d cmd:%x param:%x\n", *index, cmds[nibble], params[nibble]);
+    request->commands[(*index)++].inOrOut =  alpsNibbleCommands[nibble]; 
+    DEBUG_LOG("EC Nibble: index:%d cmd:%x param:%x\n", *index, alpsNibbleCommands[nibble], alpsNibbleParams[nibble]);
     
-	param = params[nibble];
+	param = alpsNibbleParams[nibble];
     if (param != 0xFF)
     {
         request->commands[*index].command  = kPS2C_SendMouseCommandAndCompareAck;  
@@ -1467,53 +1270,56 @@ void ApplePS2ALPSMultiTouch::AlpsECNibble(PS2Request * request, int * index, uin
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2ALPSMultiTouch::AlpsECNibble(PS2CommandBatch * batch, uint8_t nibble)
+{
+    nibble &= 0xf;
+    batch->addMouseCommand(alpsNibbleCommands[nibble]);
+    if (alpsNibbleParams[nibble] != 0xFF)
+        batch->addMouseCommand(alpsNibbleParams[nibble]);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 int ApplePS2ALPSMultiTouch::AlpsECWrite(uint16_t addr, uint8_t value)
 {
-    UInt16 AddrH, AddrL;
-    UInt8 Val;
-    PS2Request * request = _device->allocateRequest();
-    
-    if ( !request ) return 0;
-
-    // Select new address: EC addr3 addr2 addr1 addr0 (nibble3 nibble2 nibble1 nibble0)
-    request->commands[0].command  = kPS2C_SendMouseCommandAndCompareAck;  //4
-    request->commands[0].inOrOut =  kDP_MouseResetWrap; //sync.. EC
-
-    int index = 1;
-    AlpsECNibble(request, &index, addr >> 12);
-    AlpsECNibble(request, &index, addr >> 8);
-    AlpsECNibble(request, &index, addr >> 4);
-    AlpsECNibble(request, &index, addr);
-
-    // 0xE9 Read byte from current register, reply: 2-byte address + 1-byte data,
-    // { addr_high, addr_low, value }
-    request->commands[index].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[index++].inOrOut = kDP_GetMouseInformation;
-    int indRead = index;
-    request->commands[index].command  = kPS2C_ReadDataPort;
-    request->commands[index++].inOrOut  = 0;
-    request->commands[index].command = kPS2C_ReadDataPort;
-    request->commands[index++].inOrOut = 0;
-    request->commands[index].command = kPS2C_ReadDataPort;
-    request->commands[index++].inOrOut = 0;
-    // Write byte: value1 value0
-    if (value) {
-        AlpsECNibble(request, &index, value >> 4);
-        AlpsECNibble(request, &index, value);
-    }
+    PS2CommandBatch batch;
 
-    request->commandsCount = index;
-    _device->submitRequestAndBlock(request);
+    batch.init(_device);
+    AlpsECWrite(&batch, addr, value);
+    if (batch.commit())
+        return 0;
 
-    AddrH = request->commands[indRead++].inOrOut;
-    AddrL = request->commands[indRead++].inOrOut;
-    Val = request->commands[indRead].inOrOut;
+    _ecRegisters.invalidate();
+    return -1;
+}
 
-    DEBUG_LOG("EC Write Response: { addr_high: 0x%04x, addr_low: 0x%04x, value: 0x%02x }\n",
-        AddrH, AddrL, Val);
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-    _device->freeRequest(request);
-    return 0;
+void ApplePS2ALPSMultiTouch::AlpsECWrite(PS2CommandBatch * batch, uint16_t addr, uint8_t value)
+{
+    //
+    // Queues the write of one register, in EC mode, unless the register is
+    // known to hold the value already.  The caller commits the batch, and
+    // must invalidate _ecRegisters should the commit fail.
+    //
+
+    if (_ecRegisters.matches(addr, value))
+        return;
+
+    DEBUG_LOG("EC Write: { addr: 0x%04x, value: 0x%02x }\n", addr, value);
+
+    // Select new address: EC addr3 addr2 addr1 addr0 (nibble3 nibble2 nibble1 nibble0),
+    // then write byte: value1 value0.  Kept in one request.
+    batch->reserve(1 + 6 * 2);
+    batch->addMouseCommand(kDP_MouseResetWrap);                         // 0xEC
+    AlpsECNibble(batch, addr >> 12);
+    AlpsECNibble(batch, addr >> 8);
+    AlpsECNibble(batch, addr >> 4);
+    AlpsECNibble(batch, addr);
+    AlpsECNibble(batch, value >> 4);
+    AlpsECNibble(batch, value);
+
+    _ecRegisters.store(addr, value);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef _APPLEPS2CLICKSCHEDULER_H
+#define _APPLEPS2CLICKSCHEDULER_H
+
+#include <IOKit/IOTimerEventSource.h>
+#include <IOKit/IOWorkLoop.h>
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PS2ClickScheduler Class Description
+//
+// Deferred button release for the trackpad drivers.  Rather than reporting a
+// synthesized click (tap, drag) as button down, spinning, then button up in
+// its interrupt routine, a driver reports the button down and schedules the
+// release.  A timer on the driver's work loop then calls the driver back to
+// report it, so the timer action is serialized with the interrupt routine.
+//
+// o  init:
+//    o  Description:  Clear all state.  Call from the driver's init.
+//
+// o  start:
+//    o  Description:  Create the timer on the given work loop.
+//    o  In Fields:    Owner and action of the timer, the driver's work loop.
+//    o  Result:       False if the timer could not be set up.
+//
+// o  stop:
+//    o  Description:  Cancel any pending release and free the timer.
+//
+// o  schedule:
+//    o  Description:  Arrange for the given button state to be reported after
+//                     delayUS microseconds, replacing any pending release.
+//
+// o  cancel:
+//    o  Description:  Cancel the pending release, if any.
+//    o  Out Fields:   Button state the release would have reported (optional).
+//    o  Result:       True if a release was pending.
+//
+// o  fire:
+//    o  Description:  Called from the timer action to claim the release.
+//    o  Out Fields:   Button state to report.
+//    o  Result:       False if the release was cancelled in the meantime.
+//
+
+#define kPS2ClickReleaseDelay 1000      // usec between click down and up
+
+class PS2ClickScheduler
+{
+public:
+    void init()
+    {
+        _timer    = 0;
+        _workLoop = 0;
+        _pending  = false;
+        _buttons  = 0;
+    }
+
+    bool start(OSObject * owner, IOWorkLoop * workLoop,
+               IOTimerEventSource::Action action)
+    {
+        if (!workLoop)  return false;
+
+        _timer = IOTimerEventSource::timerEventSource(owner, action);
+        if (!_timer)  return false;
+
+        if (workLoop->addEventSource(_timer) != kIOReturnSuccess)
+        {
+            _timer->release();
+            _timer = 0;
+            return false;
+        }
+        _workLoop = workLoop;
+        return true;
+    }
+
+    void stop()
+    {
+        _pending = false;
+        if (_timer)
+        {
+            _timer->cancelTimeout();
+            _workLoop->removeEventSource(_timer);
+            _timer->release();
+            _timer = 0;
+        }
+        _workLoop = 0;
+    }
+
+    void schedule(UInt32 buttons, UInt32 delayUS)
+    {
+        if (!_timer)  return;
+
+        _buttons = buttons;
+        _pending = true;
+        _timer->setTimeoutUS(delayUS);
+    }
+
+    bool cancel(UInt32 * buttons = 0)
+    {
+        if (!_pending)  return false;
+
+        _timer->cancelTimeout();
+        _pending = false;
+        if (buttons)  *buttons = _buttons;
+        return true;
+    }
+
+    bool fire(UInt32 * buttons)
+    {
+        if (!_pending)  return false;
+
+        _pending = false;
+        *buttons = _buttons;
+        return true;
+    }
+
+private:
+    IOTimerEventSource * _timer;
+    IOWorkLoop *         _workLoop;
+    bool                 _pending;
+    UInt32               _buttons;
+};
+
+#endif /* !_APPLEPS2CLICKSCHEDULER_H */
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#ifndef _APPLEPS2COMMANDBATCH_H
+#define _APPLEPS2COMMANDBATCH_H
+
+#include "ApplePS2MouseDevice.h"
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PS2CommandBatch Class Description
+//
+// Builds a sequence of mouse commands longer than one request holds, such as
+// a run of register writes, without the caller counting slots.  Commands go
+// into the current request until it is full, then it is submitted and the
+// batch carries on in a fresh one.  Requests complete in submission order,
+// so the device sees one continuous sequence; should a command fail, the rest
+// of the batch is dropped, as it would be within a single request.
+//
+// o  init:
+//    o  Description:  Start an empty batch for the device.
+//
+// o  reserve:
+//    o  Description:  Make sure the next count commands go into the same
+//                     request, so a unit such as one register write is not
+//                     split between requests.
+//
+// o  addCommand:
+//    o  Description:  Append a command (kPS2C_* and its In Field).
+//
+// o  addMouseCommand:
+//    o  Description:  Append a kPS2C_SendMouseCommandAndCompareAck.
+//
+// o  commit:
+//    o  Description:  Submit what is left and wait for all of it.
+//    o  In Fields:    Where to copy the bytes the kPS2C_ReadDataPort commands
+//                     of the last request read, in order, if wanted.  Only
+//                     the last request's are kept, so reserve() the reads
+//                     together with the command that they answer.
+//    o  Result:       True if every command was acknowledged.
+//    o  Comments:     Blocks.  Do NOT commit from the interrupt/completion
+//                     context.
+//
+
+class PS2CommandBatch
+{
+public:
+    void init(ApplePS2MouseDevice * device)
+    {
+        _device  = device;
+        _request = 0;
+        _failed  = false;
+    }
+
+    void reserve(UInt32 count)
+    {
+        if ( _request && _request->commandsCount + count > kMaxCommands )
+            flush();
+    }
+
+    void addCommand(PS2CommandEnum command, UInt8 inOrOut)
+    {
+        reserve(1);
+        if ( !_request )
+            _request = _device->allocateRequest();
+
+        _request->commands[_request->commandsCount].command = command;
+        _request->commands[_request->commandsCount].inOrOut = inOrOut;
+        _request->commandsCount++;
+    }
+
+    void addMouseCommand(UInt8 command)
+    {
+        addCommand(kPS2C_SendMouseCommandAndCompareAck, command);
+    }
+
+    bool commit(UInt8 * data = 0)
+    {
+        bool failed;
+
+        flush(data);
+        failed  = _failed;
+        _failed = false;
+        return !failed;
+    }
+
+private:
+    void flush(UInt8 * data = 0)
+    {
+        if ( !_request )
+            return;
+
+        if ( !_failed )
+        {
+            UInt8 count = _request->commandsCount;
+            _device->submitRequestAndBlock(_request);
+            _failed = (_request->commandsCount != count);
+
+            for (UInt32 index = 0; data && index < count; index++)
+                if ( _request->commands[index].command == kPS2C_ReadDataPort )
+                    *data++ = _request->commands[index].inOrOut;
+        }
+        _device->freeRequest(_request);
+        _request = 0;
+    }
+
+    ApplePS2MouseDevice * _device;
+    PS2Request *          _request;
+    bool                  _failed;
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PS2RegisterCache Class Description
+//
+// Remembers the last value written to up to N device registers, so that a
+// configuration pass can skip the writes that would not change anything.
+// Once the cache is full, further registers are simply not remembered (and
+// always written).  Whatever may have reset the device -- a reset command,
+// sleep -- must invalidate() the cache.
+//
+// o  invalidate:
+//    o  Description:  Forget all values.  Call from driver's init too.
+//
+// o  matches:
+//    o  Result:       True if value is known to be in the register already.
+//
+// o  store:
+//    o  Description:  Note a value written to the register.
+//
+
+template <UInt32 N>
+class PS2RegisterCache
+{
+public:
+    void invalidate()                  { _count = 0; }
+
+    bool matches(UInt16 reg, UInt8 value) const
+    {
+        for (UInt32 index = 0; index < _count; index++)
+            if ( _reg[index] == reg )
+                return _value[index] == value;
+        return false;
+    }
+
+    void store(UInt16 reg, UInt8 value)
+    {
+        UInt32 index;
+
+        for (index = 0; index < _count; index++)
+            if ( _reg[index] == reg )
+                break;
+        if ( index == _count )
+        {
+            if ( _count == N )
+                return;
+            _reg[_count++] = reg;
+        }
+        _value[index] = value;
+    }
+
+private:
+    UInt16  _reg[N];
+    UInt8   _value[N];
+    UInt32  _count;
+};
+
+#endif /* !_APPLEPS2COMMANDBATCH_H */
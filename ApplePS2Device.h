@@ -168,6 +168,15 @@
 //    o  Description: Writes the byte in the In Field to the command port (64h).
 //    o  In Field:    Holds byte that should be written.
 //
+// o  kPS2C_ModifyCommandByte:
+//    o  Description: Sets and clears bits in the controller's command byte,
+//                    in one step.  The controller keeps the command byte it
+//                    last wrote, so no read is needed, and the byte is only
+//                    written when the bits actually change it.  Takes two
+//                    command slots; the second slot's command is ignored.
+//    o  In Field:    Holds bits to set (first slot) and bits to clear
+//                    (second slot).
+//
 
 enum PS2CommandEnum
 {
@@ -175,7 +184,8 @@ enum PS2CommandEnum
   kPS2C_ReadDataPortAndCompare,
   kPS2C_WriteDataPort,
   kPS2C_WriteCommandPort,
-  kPS2C_SendMouseCommandAndCompareAck
+  kPS2C_SendMouseCommandAndCompareAck,
+  kPS2C_ModifyCommandByte
 };
 typedef enum PS2CommandEnum PS2CommandEnum;
 
@@ -239,9 +249,53 @@ typedef struct PS2Command PS2Command;
 //                     any request sent down to your device from the completion
 //                     routine.  Obey, or deadlock.
 //
+// o  priority:
+//    o  Description:  Scheduling class of the request, kPS2Request* below.
+//                     The controller keeps a queue per device and class; it
+//                     runs the interactive class first and the background
+//                     class last, and alternates between the keyboard and
+//                     the mouse within a class.  Requests are only run in
+//                     the order they were submitted relative to requests of
+//                     the same device and class.
+//    o  Comments:     Zero (the default) is the configuration class.
+//
+// o  coalesceKey:
+//    o  Description:  Nonzero for a request that fully supersedes any earlier
+//                     one of the same device, class and key, such as setting
+//                     the LEDs.  If a request still waiting in its queue has
+//                     the same key and no completion routine, it is dropped
+//                     before this one is queued at the end.
+//    o  Comments:     Use the kPS2Coalesce* keys below.  Never set one on a
+//                     request that is part of a knock sequence (such as the
+//                     sample rates that unlock the Intellimouse mode), where
+//                     every step counts, nor on one sent with
+//                     submitRequestAndBlock, which has a completion routine
+//                     and so is never dropped.
+//
+// o  device, submitTime:
+//    o  Description:  Filled in on submission, for use by the controller.
+//
 
 #define kMaxCommands 20
 
+enum PS2RequestPriority
+{
+  kPS2RequestConfiguration,       // device setup, the default
+  kPS2RequestInteractive,         // user-visible feedback (LEDs)
+  kPS2RequestBackground,          // polling, recovery, housekeeping
+  kPS2RequestPriorityCount
+};
+typedef enum PS2RequestPriority PS2RequestPriority;
+
+enum PS2CoalesceKey
+{
+  kPS2CoalesceNone,
+  kPS2CoalesceLEDs,
+  kPS2CoalesceEnable,
+  kPS2CoalesceModeByte
+};
+typedef enum PS2CoalesceKey PS2CoalesceKey;
+
 typedef void (*PS2CompletionAction)(void * target, void * param);
 
 struct PS2Request
@@ -251,10 +305,39 @@ struct PS2Request
   void *              completionTarget;
   PS2CompletionAction completionAction;
   void *              completionParam;
+  UInt8               priority;          // PS2RequestPriority
+  UInt8               coalesceKey;       // PS2CoalesceKey
+  UInt8               device;            // PS2DeviceType, set by the nub
+  UInt64              submitTime;        // uptime, set by the controller
   queue_chain_t       chain;
 };
 typedef struct PS2Request PS2Request;
 
+//
+// Results of the standard identification queries sent to the mouse port,
+// each answered with the three status bytes of kDP_GetMouseInformation:
+//
+// o  synaptics:  Synaptics "Identify TouchPad" (query 0x00 encoded with four
+//                kDP_SetMouseResolution commands), 0x47 in byte 1 if so.
+// o  e6:         ALPS "E6 report" (resolution 0, three scaling 1:1 commands).
+// o  e7:         ALPS "E7 report" (resolution 0, three scaling 2:1 commands).
+//
+// A failed query leaves its bytes zero and its valid flag clear.  Drivers use
+// the bytes of a query only with its flag set, and send the query themselves
+// otherwise.
+//
+
+struct PS2MouseIdentity
+{
+  bool  synapticsValid;
+  UInt8 synaptics[3];
+  bool  e6Valid;
+  UInt8 e6[3];
+  bool  e7Valid;
+  UInt8 e7[3];
+};
+typedef struct PS2MouseIdentity PS2MouseIdentity;
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 // ApplePS2KeyboardDevice and ApplePS2MouseDevice Class Descriptions
 //
@@ -282,6 +365,29 @@ typedef struct PS2Request PS2Request;
 // o  uninstallInterruptHandler:
 //    o  Description:  Ask the device to stop delivering asynchronous data.
 //
+// o  installBatchInterruptAction:
+//    o  Description:  Ask the device to deliver asynchronous data to driver
+//                     in contiguous runs of bytes rather than one at a time.
+//    o  In Fields:    Target/action of batch interrupt routine.
+//    o  Comments:     Optional.  Must be installed alongside (after) the
+//                     regular interrupt action, which still controls whether
+//                     the device interrupt is enabled.   While installed, it
+//                     takes precedence over the regular interrupt action.
+//
+// o  installBatchInterruptAction Interrupt Routine:
+//    o  Description:  Delivers the bytes read from the input data stream for
+//                     this device during one drain of the controller, in the
+//                     order they were received.
+//    o  Prototype:    void packetsOccurred(void * target, const UInt8 * data,
+//                                          UInt32 count);
+//    o  In Fields:    Pointer to, and number of, bytes that were read.  The
+//                     buffer is only valid for the duration of the call.
+//    o  Comments:     Same restrictions as the regular interrupt routine.
+//
+// o  uninstallBatchInterruptAction:
+//    o  Description:  Ask the device to resume per-byte delivery through the
+//                     regular interrupt action.
+//
 // o  allocateRequest:
 //    o  Description:  Allocate a request structure, blocks until successful.
 //    o  Result:       Request structure pointer.
@@ -296,14 +402,35 @@ typedef struct PS2Request PS2Request;
 //    o  In Fields:    Request structure pointer.
 //    o  Result:       kern_return_t queueing status.
 //
+// o  submitRequest (with completion routine):
+//    o  Description:  Fill in the request's completion routine fields, then
+//                     submit the request to the controller for processing.
+//    o  In Fields:    Request structure pointer, completion routine target,
+//                     action and param.
+//    o  Result:       kern_return_t queueing status.
+//    o  Comments:     The completion routine may submit the next request of a
+//                     sequence with this same call, so that drivers can
+//                     pipeline commands instead of blocking on each of them.
+//
 // o  submitRequestAndBlock:
 //    o  Description:  Submit the request to the controller for processing, then
 //                     block the calling thread until the request completes.
 //    o  In Fields:    Request structure pointer.
 //
+// o  getIdentity (mouse only):
+//    o  Description:  Fetch the results of the standard identification queries
+//                     the controller sends to the mouse port once, at start.
+//    o  In Fields:    Identity structure pointer.
+//    o  Result:       False if the controller did not identify the device, in
+//                     which case the driver has to send the queries itself.
+//    o  Comments:     Trackpad drivers should use these in their probe rather
+//                     than sending the same command sequences again.
+//
 
 typedef void (*PS2InterruptAction)(void * target, UInt8 data);
 
+typedef void (*PS2BatchInterruptAction)(void * target, const UInt8 * data, UInt32 count);
+
 //
 // Defines the prototype of an action registered by a PS/2 device driver to
 // intercept power changes on the PS/2 controller, and to manage the device
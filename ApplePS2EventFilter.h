@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#ifndef _APPLEPS2EVENTFILTER_H
+#define _APPLEPS2EVENTFILTER_H
+
+#include <libkern/OSTypes.h>
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PS2EventFilter Class Description
+//
+// Output stage between a trackpad driver and IOHIPointing.  The drivers
+// report pointer and scroll events for every packet, most of them with
+// nothing in them while the finger rests, scrolls or is lifted; each one
+// costs a trip through IOHIPointing and the window server's event queue.
+// The filter drops events that change nothing, and optionally merges the
+// deltas of events closer together than a merge window into one event.
+// A change of button state always goes out at once, carrying the motion
+// merged before it, so clicks are neither delayed nor reordered.
+//
+// The filter keeps the button state last reported, so every pointer event
+// of the driver must go through it.  Not locked; call from the work loop.
+//
+// o  init:
+//    o  Description:  Clear all state; the merge window is off.
+//
+// o  setWindow:
+//    o  Description:  Set the merge window, in absolute time (nanoseconds),
+//                     0 to report every event that changes something.
+//
+// o  addPointer:
+//    o  Description:  Offer a pointer event.
+//    o  In Fields:    Deltas, button state, time of the event.
+//    o  Out Fields:   Deltas to report.
+//    o  Result:       True if the event (with the deltas returned) is to be
+//                     dispatched now, false if it was dropped or merged.
+//
+// o  addScroll:
+//    o  Description:  Offer a scroll event, as addPointer.
+//
+// o  flushPointer, flushScroll:
+//    o  Description:  Claim the deltas held for merging, for instance when
+//                     the finger lifts and no more events will follow.
+//    o  Result:       True if there is anything to dispatch.
+//
+
+class PS2EventFilter
+{
+public:
+    void init()
+    {
+        _window      = 0;
+        _buttons     = 0;
+        _dx          = 0;
+        _dy          = 0;
+        _dv          = 0;
+        _dh          = 0;
+        _lastPointer = 0;
+        _lastScroll  = 0;
+    }
+
+    void setWindow(UInt64 window)  { _window = window; }
+
+    bool addPointer(int * dx, int * dy, UInt32 buttons, UInt64 now)
+    {
+        _dx += *dx;
+        _dy += *dy;
+        if (buttons == _buttons)
+        {
+            if (_dx == 0 && _dy == 0)          return false;
+            if (now - _lastPointer < _window)  return false;
+        }
+
+        *dx          = _dx;
+        *dy          = _dy;
+        _dx          = 0;
+        _dy          = 0;
+        _buttons     = buttons;
+        _lastPointer = now;
+        return true;
+    }
+
+    bool addScroll(int * dv, int * dh, UInt64 now)
+    {
+        _dv += *dv;
+        _dh += *dh;
+        if (_dv == 0 && _dh == 0)              return false;
+        if (now - _lastScroll < _window)       return false;
+
+        _lastScroll = now;
+        return flushScroll(dv, dh);
+    }
+
+    bool flushPointer(int * dx, int * dy, UInt32 * buttons)
+    {
+        *dx      = _dx;
+        *dy      = _dy;
+        *buttons = _buttons;
+        _dx      = 0;
+        _dy      = 0;
+        return *dx != 0 || *dy != 0;
+    }
+
+    bool flushScroll(int * dv, int * dh)
+    {
+        *dv = clamp(_dv);
+        *dh = clamp(_dh);
+        _dv = 0;
+        _dh = 0;
+        return *dv != 0 || *dh != 0;
+    }
+
+private:
+    static int clamp(int delta)
+    {
+        // dispatchScrollWheelEvent takes shorts.
+        return delta > 32767 ? 32767 : delta < -32767 ? -32767 : delta;
+    }
+
+    UInt64  _window;
+    UInt32  _buttons;
+    int     _dx;
+    int     _dy;
+    int     _dv;
+    int     _dh;
+    UInt64  _lastPointer;
+    UInt64  _lastScroll;
+};
+
+#endif /* !_APPLEPS2EVENTFILTER_H */
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef _APPLEPS2FIXEDSCALE_H
+#define _APPLEPS2FIXEDSCALE_H
+
+#include <libkern/OSTypes.h>
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PS2FixedDivider Class Description
+//
+// Divides motion deltas by a divisor the user sets (Divisor, scroll divisors)
+// without a hardware divide per packet.  setDivisor() precomputes a 32 bit
+// reciprocal, and divide() multiplies by it and corrects the quotient, so the
+// result is exactly that of C's / and % for any int delta.  The remainder is
+// carried between calls in *rest, so slow motion still adds up.
+//
+// o  setDivisor:
+//    o  Description:  Precompute the reciprocal.  Call whenever the divisor
+//                     changes, off the interrupt path.  A divisor of 0 (or
+//                     less) makes divide() return 0.
+//
+// o  divide:
+//    o  Description:  Compute (delta + *rest) / divisor and leave the
+//                     remainder in *rest.
+//    o  Result:       The quotient.
+//
+
+class PS2FixedDivider
+{
+public:
+    void setDivisor(int divisor)
+    {
+        _divisor    = divisor > 0 ? divisor : 0;
+        _reciprocal = _divisor > 1 ? (UInt32)(0x100000000ULL / _divisor) : 0;
+    }
+
+    int divisor() const  { return _divisor; }
+
+    int divide(int delta, int * rest) const
+    {
+        if (_divisor == 0)
+        {
+            *rest = 0;
+            return 0;
+        }
+
+        int    value    = delta + *rest;
+        bool   negative = value < 0;
+        UInt32 n        = negative ? 0U - (UInt32) value : (UInt32) value;
+        UInt32 q, r;
+
+        if (_divisor == 1)
+        {
+            q = n;
+            r = 0;
+        }
+        else
+        {
+            // The estimate is at most one short; fix it up.
+            q = (UInt32)(((UInt64) n * _reciprocal) >> 32);
+            r = n - q * (UInt32) _divisor;
+            if (r >= (UInt32) _divisor)
+            {
+                q++;
+                r -= _divisor;
+            }
+        }
+
+        *rest = negative ? -(int) r : (int) r;
+        return negative ? -(int) q : (int) q;
+    }
+
+private:
+    int     _divisor;
+    UInt32  _reciprocal;
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PS2FixedScale Class Description
+//
+// Scales motion deltas by a fractional factor in 16.16 fixed point, where
+// the drivers used to go through double.  The fraction lost by each scaled
+// delta is carried in *rest (in 1/65536 units) and added to the next one,
+// so sub-pixel motion is not dropped.  Results are truncated toward zero.
+//
+// o  setFactor:
+//    o  Description:  Set the factor, kPS2FixedOne being 1.0.  Call whenever
+//                     the setting behind it changes, off the interrupt path.
+//
+// o  scale:
+//    o  Description:  Compute delta * factor + *rest and leave the fraction
+//                     in *rest.
+//    o  Result:       The whole part.
+//
+
+#define kPS2FixedShift  16
+#define kPS2FixedOne    (1 << kPS2FixedShift)
+
+class PS2FixedScale
+{
+public:
+    void setFactor(SInt32 factor)  { _factor = factor; }
+
+    SInt32 factor() const          { return _factor; }
+
+    int scale(int delta, int * rest) const
+    {
+        SInt64 value    = (SInt64) delta * _factor + *rest;
+        bool   negative = value < 0;
+        UInt64 n        = negative ? 0ULL - (UInt64) value : (UInt64) value;
+        int    whole    = (int)(n >> kPS2FixedShift);
+        int    fraction = (int)(n & (kPS2FixedOne - 1));
+
+        *rest = negative ? -fraction : fraction;
+        return negative ? -whole : whole;
+    }
+
+private:
+    SInt32  _factor;
+};
+
+#endif /* !_APPLEPS2FIXEDSCALE_H */
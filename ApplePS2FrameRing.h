@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#ifndef _APPLEPS2FRAMERING_H
+#define _APPLEPS2FRAMERING_H
+
+#include <libkern/OSTypes.h>
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Frame Ring Layout
+//
+// Raw touch frames for a gesture daemon in user space.  A trackpad driver can
+// hand its decoded packets over, one frame per packet with the position of
+// each finger it reports, instead of running its own gesture recognition.
+// The daemon maps the ring through the driver's user client (memory type
+// kPS2FrameMemoryType).  It holds a PS2FrameHeader followed by frameCount
+// PS2Frames, frameCount being a power of two.  Frames are written round robin
+// just like trace records (see ApplePS2Trace.h): frame n goes into slot
+// n & (frameCount - 1) and has sequence n + 1 once it is complete, and a reader
+// keeps a copy if its sequence was the expected one before and after copying.
+// A reader that falls behind by more than frameCount frames loses the oldest.
+//
+// Frame mode is off until the daemon calls the user client's asynchronous
+// kPS2FrameMethodStart method.  From then on until kPS2FrameMethodStop (or the
+// connection closes) the driver publishes frames and reports only the buttons
+// pressed physically; pointer motion, scrolling and tap clicks are up to the
+// daemon, which posts its own events.
+//
+// Rather than a notification per frame, the doorbell rings once per wait:
+// having drained the ring, the daemon sets the header's doorbell to 1, checks
+// next once more, and waits on the port it passed to kPS2FrameMethodStart.
+// The driver clears doorbell with the next frame it publishes and sends an
+// async result to that port, with next as its only argument.
+//
+// The doorbell is the only field a reader writes, and the only one the driver
+// reads back; frameCount and next are copies of the driver's own.  Frame mode
+// takes the pointer away from the driver, so the user clients only start it
+// (and hand out the ring) for administrators.
+//
+
+#define kPS2FrameMagic          0x50533246      // 'PS2F'
+#define kPS2FrameVersion        1
+#define kPS2FrameMemoryType     1               // clientMemoryForType type
+#define kPS2FrameMaxFingers     5
+
+#define kPS2FrameMethodStart    0               // user client selectors
+#define kPS2FrameMethodStop     1
+
+enum                                            // coordinates as reported
+{
+    kPS2FrameSourceSynaptics = 1,               // y up, width is W
+    kPS2FrameSourceALPS      = 2,               // y down, no width
+    kPS2FrameSourceElan      = 3                // y up, fingers tracked by id
+};
+
+typedef struct PS2FrameHeader PS2FrameHeader;
+struct PS2FrameHeader
+{
+    UInt32           magic;
+    UInt16           version;
+    UInt16           frameSize;         // sizeof(PS2Frame)
+    UInt32           frameCount;        // power of two
+    volatile UInt32  next;              // next frame number to write
+    volatile UInt32  doorbell;          // set by a reader about to wait
+    UInt16           source;            // protocol the frames come from
+    UInt16           reserved0;
+    UInt32           reserved[2];
+};
+
+typedef struct PS2FrameFinger PS2FrameFinger;
+struct PS2FrameFinger
+{
+    SInt16           x;
+    SInt16           y;
+    UInt16           z;                 // pressure, 0 if not reported
+    UInt8            width;             // 0 if not reported
+    UInt8            id;                // slot of the finger, if tracked
+};
+
+typedef struct PS2Frame PS2Frame;
+struct PS2Frame
+{
+    volatile UInt32  sequence;          // frame number + 1, 0 while written
+    UInt8            fingers;           // fingers down, as far as known
+    UInt8            points;            // valid entries in finger
+    UInt8            buttons;           // bit 0 left, 1 right, 2 middle
+    UInt8            reserved;
+    UInt64           timestamp;         // uptime, absolute time units
+    PS2FrameFinger   finger[kPS2FrameMaxFingers];
+};
+
+#ifdef KERNEL
+
+#include <IOKit/IOBufferMemoryDescriptor.h>
+#include <IOKit/IOLocks.h>
+#include <IOKit/IOUserClient.h>
+#include <libkern/OSAtomic.h>
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PS2FrameChannel Class Description
+//
+// Kernel side of the frame ring.  Only the driver's packet path writes
+// frames, so there is no locking between writers; the lock only guards the
+// doorbell's async reference against the user client, and is taken when the
+// doorbell actually rings.  With frame mode off, active() is one load and
+// test for the packet path.  The frame count and next frame number are kept
+// here, so a reader writing to the header cannot move where frames go.
+//
+// o  init:
+//    o  Description:  Clear all state.  active() is false until allocate()
+//                     and start().
+//
+// o  allocate:
+//    o  Description:  Allocate the ring for (at least) the given number of
+//                     frames, rounded up to a power of two, and its lock.
+//    o  Result:       False on allocation failure.
+//
+// o  free:
+//    o  Description:  Release the ring.  Users must be gone by then.
+//
+// o  start:
+//    o  Description:  Turn frame mode on, with the doorbell ringing the given
+//                     async reference.  Replaces an earlier reader's.
+//    o  Result:       kIOReturnNotReady if the ring was not allocated.
+//
+// o  stop:
+//    o  Description:  Turn frame mode off.
+//
+// o  active:
+//    o  Result:       True in frame mode.
+//
+// o  begin:
+//    o  Description:  Claim the next slot for a frame of the given time, with
+//                     no fingers and buttons.  Only call in frame mode.
+//    o  Result:       Frame to fill in.
+//
+// o  commit:
+//    o  Description:  Publish the frame begin() returned, ringing the doorbell
+//                     if the reader waits for it.
+//
+
+class PS2FrameChannel
+{
+public:
+    void init()
+    {
+        _memory = 0;
+        _header = 0;
+        _frames = 0;
+        _lock   = 0;
+        _count  = 0;
+        _next   = 0;
+        _active = false;
+        _armed  = false;
+    }
+
+    bool allocate(UInt32 frames, UInt16 source)
+    {
+        UInt32 count = 1;
+        while (count < frames && count < 0x1000)
+            count <<= 1;
+
+        _lock = IOLockAlloc();
+        if (!_lock)
+            return false;
+
+        _memory = IOBufferMemoryDescriptor::withOptions(
+                        kIODirectionInOut | kIOMemoryKernelUserShared,
+                        sizeof(PS2FrameHeader) + count * sizeof(PS2Frame),
+                        page_size);
+        if (!_memory)
+        {
+            free();
+            return false;
+        }
+
+        _header = (PS2FrameHeader *) _memory->getBytesNoCopy();
+        bzero(_header, _memory->getLength());
+        _header->magic      = kPS2FrameMagic;
+        _header->version    = kPS2FrameVersion;
+        _header->frameSize  = sizeof(PS2Frame);
+        _header->frameCount = count;
+        _header->source     = source;
+        _count = count;
+        _next  = 0;
+        OSMemoryBarrier();
+        _frames = (PS2Frame *) (_header + 1);
+        return true;
+    }
+
+    void free()
+    {
+        _active = false;
+        _frames = 0;
+        _header = 0;
+        _count  = 0;
+        if (_memory)
+        {
+            _memory->release();
+            _memory = 0;
+        }
+        if (_lock)
+        {
+            IOLockFree(_lock);
+            _lock = 0;
+        }
+    }
+
+    IOMemoryDescriptor * memory() const  { return _memory; }
+
+    bool active() const  { return _active; }
+
+    IOReturn start(const io_user_reference_t * reference, UInt32 count)
+    {
+        if (!_frames)
+            return kIOReturnNotReady;
+        if (count > kOSAsyncRef64Count)
+            count = kOSAsyncRef64Count;
+
+        IOLockLock(_lock);
+        bzero(_reference, sizeof(_reference));
+        bcopy(reference, _reference, count * sizeof(io_user_reference_t));
+        _armed = count != 0;
+        IOLockUnlock(_lock);
+
+        _active = true;
+        return kIOReturnSuccess;
+    }
+
+    void stop()
+    {
+        _active = false;
+        if (!_lock)
+            return;
+
+        IOLockLock(_lock);
+        _armed = false;
+        IOLockUnlock(_lock);
+    }
+
+    PS2Frame * begin(UInt64 timestamp)
+    {
+        PS2Frame * frame = &_frames[_next & (_count - 1)];
+
+        frame->sequence = 0;
+        OSMemoryBarrier();
+        frame->fingers   = 0;
+        frame->points    = 0;
+        frame->buttons   = 0;
+        frame->timestamp = timestamp;
+        return frame;
+    }
+
+    void commit(PS2Frame * frame)
+    {
+        UInt32 number = _next++;
+
+        OSMemoryBarrier();
+        frame->sequence = number + 1;
+        _header->next   = number + 1;
+        OSMemoryBarrier();
+
+        if (_header->doorbell && OSCompareAndSwap(1, 0, &_header->doorbell))
+            ring(number + 1);
+    }
+
+private:
+    void ring(UInt32 next)
+    {
+        io_user_reference_t args[1] = { next };
+
+        IOLockLock(_lock);
+        if (_armed)
+            IOUserClient::sendAsyncResult64(_reference, kIOReturnSuccess, args, 1);
+        IOLockUnlock(_lock);
+    }
+
+    IOBufferMemoryDescriptor * _memory;
+    PS2FrameHeader *           _header;
+    PS2Frame *                 _frames;
+    IOLock *                   _lock;
+    UInt32                     _count;          // frameCount
+    UInt32                     _next;           // next frame number
+    volatile bool              _active;
+    bool                       _armed;          // _reference valid
+    OSAsyncReference64         _reference;      // doorbell
+};
+
+#endif /* KERNEL */
+
+#endif /* !_APPLEPS2FRAMERING_H */
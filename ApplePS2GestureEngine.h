@@ -0,0 +1,430 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#ifndef _APPLEPS2GESTUREENGINE_H
+#define _APPLEPS2GESTUREENGINE_H
+
+#include "ApplePS2ClickScheduler.h"
+#include "ApplePS2FixedScale.h"
+#include "ApplePS2RegionClassifier.h"
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PS2GestureEngine Class Description
+//
+// The absolute mode touch state machine of the trackpad drivers: pointer
+// motion, edge, circular and multi finger scrolling, tap clicks, tap drags and
+// drag lock.  A driver decodes each packet of its protocol into a sample and
+// hands it to process(), which reports the resulting events through the
+// driver's own postRelativePointerEvent, postScrollWheelEvent and flushEvents
+// (the driver declares PS2GestureEngine a friend if they are private).
+//
+// What process() touches on every packet is kept together up front: the touch
+// state (one cache line, flags as bitfields), then the precomputed dividers
+// and touch regions.  The settings are only read on touch and lift, and the
+// driver writes them directly, from its init and setParamProperties, and
+// calls configure() afterwards.
+//
+// o  init:
+//    o  Description:  Clear the touch state and zero all settings.  Call from
+//                     the driver's init, then fill in the settings.
+//
+// o  configure:
+//    o  Description:  Rebuild the dividers and the touch regions from the
+//                     settings.  Call whenever they change, off the interrupt
+//                     path or between two packets.
+//
+// o  reset:
+//    o  Description:  Forget the current touch, such as after the pad was
+//                     reprogrammed.
+//
+// o  touching:
+//    o  Result:       True if a sample with this pressure is a finger down.
+//
+// o  holdsButton:
+//    o  Result:       True while the finger is off the pad but a drag still
+//                     holds the button down (resumes with the next touch).
+//
+// o  expireTap:
+//    o  Description:  A tap waiting to become a drag timed out.  Call when the
+//                     click release the driver scheduled fires.
+//
+// o  process:
+//    o  Description:  Run one sample through the state machine, reporting its
+//                     events through target.
+//    o  Result:       kPS2GestureLifted if the finger lifted with this sample.
+//                     kPS2GestureRelease if a synthesized click needs its
+//                     release reported (the sample's own buttons) after
+//                     releaseDelay() microseconds, since the pad stops
+//                     reporting soon after the finger lifts.
+//
+
+enum PS2GestureMode
+{
+    kPS2GestureNoTouch,
+    kPS2GestureMove,
+    kPS2GestureVScroll,
+    kPS2GestureHScroll,
+    kPS2GestureCScroll,
+    kPS2GestureMultiTouch,
+    kPS2GesturePreDrag,
+    kPS2GestureDrag,
+    kPS2GestureDragNoTouch,
+    kPS2GestureDragLock
+};
+
+#define kPS2GestureLifted       0x01
+#define kPS2GestureRelease      0x02
+
+struct PS2GestureSample
+{
+    int           x, y, z, w;
+    int           fingers;              // as the pad counts them, 0 if only w tells
+    UInt32        buttons;
+    AbsoluteTime  time;
+};
+
+struct PS2GestureSettings
+{
+    int     fingerZ;                // pressure of a finger down
+    int     divisor;                // pointer motion
+    int     leftEdge, rightEdge, topEdge, bottomEdge;
+    int     vscrollDivisor, hscrollDivisor, cscrollDivisor;
+    int     cscrollTrigger;         // 1-8 clockwise from top, 9 any edge
+    int     centerX, centerY;       // circular scroll center
+    int     wLimit;                 // w at or above is more than one finger
+    int     wvDivisor, whDivisor;   // multi finger scrolling
+    int     stickyHScroll, stickyVScroll, stickyMultiFinger;
+    int     stableTap;              // undo motion of a tap
+    UInt64  maxTapTime;             // ns
+    UInt64  maxDragTime;            // ns
+    UInt32  clicking:1;
+    UInt32  dragging:1;
+    UInt32  dragLock:1;
+    UInt32  hscroll:1;
+    UInt32  scroll:1;
+    UInt32  rightTap:1;             // two finger tap is a right click
+};
+
+struct PS2GestureState
+{
+    UInt64  touchTime;
+    UInt64  untouchTime;
+    int     lastX, lastY;
+    int     xRest, yRest, scrollRest;
+    int     xMoved, yMoved, xScrolled, yScrolled;
+    UInt32  mode:4;
+    UInt32  wasDouble:1;
+};
+
+class PS2GestureEngine
+{
+public:
+    void init()
+    {
+        bzero(&_state, sizeof(_state));
+        bzero(&_settings, sizeof(_settings));
+        _releaseDelay = 0;
+        _regions.init(kPS2GestureMove);
+        configure();
+    }
+
+    PS2GestureSettings & settings()      { return _settings; }
+
+    void reset()                         { _state.mode = kPS2GestureNoTouch; }
+
+    bool touching(int z) const           { return z > _settings.fingerZ; }
+
+    bool holdsButton() const
+    {
+        return _state.mode == kPS2GesturePreDrag ||
+               _state.mode == kPS2GestureDragNoTouch;
+    }
+
+    void expireTap()
+    {
+        if (_state.mode == kPS2GesturePreDrag)
+            _state.mode = kPS2GestureNoTouch;
+    }
+
+    UInt32 releaseDelay() const          { return _releaseDelay; }
+
+    void configure()
+    {
+        _moveDivider.setDivisor(_settings.divisor);
+        _vscrollDivider.setDivisor(_settings.vscrollDivisor);
+        _hscrollDivider.setDivisor(_settings.hscrollDivisor);
+        _cscrollDivider.setDivisor(_settings.cscrollDivisor);
+        _wvDivider.setDivisor(_settings.wvDivisor);
+        _whDivider.setDivisor(_settings.whDivisor);
+        buildRegions();
+    }
+
+    template <class T>
+    UInt32 process(T * target, const PS2GestureSample & sample)
+    {
+        PS2GestureState &          s = _state;
+        const PS2GestureSettings & c = _settings;
+        UInt64 now     = *(const UInt64 *) &sample.time;
+        UInt32 buttons = sample.buttons;
+        UInt32 result  = 0;
+        int    x       = sample.x;
+        int    y       = sample.y;
+        bool   down    = sample.z > c.fingerZ;
+
+        if (sample.z < c.fingerZ && s.mode != kPS2GestureNoTouch &&
+            s.mode != kPS2GesturePreDrag && s.mode != kPS2GestureDragNoTouch)
+        {
+            target->flushEvents(sample.time);
+            result |= kPS2GestureLifted;
+            s.xRest = s.yRest = s.scrollRest = 0;
+            s.untouchTime = now;
+            if (now - s.touchTime < c.maxTapTime && c.clicking)
+                switch (s.mode)
+                {
+                    case kPS2GestureDrag:
+                        buttons &= ~0x3;
+                        target->postRelativePointerEvent(0, 0, buttons | 0x1, sample.time);
+                        target->postRelativePointerEvent(0, 0, buttons, sample.time);
+                        if (s.wasDouble && c.rightTap)
+                            buttons |= 0x2;
+                        else
+                            buttons |= 0x1;
+                        s.mode = kPS2GestureNoTouch;
+                        break;
+                    case kPS2GestureDragLock:
+                        s.mode = kPS2GestureNoTouch;
+                        break;
+                    default:
+                        if (s.wasDouble && c.rightTap)
+                        {
+                            buttons |= 0x2;
+                            s.mode = kPS2GestureNoTouch;
+                        }
+                        else
+                        {
+                            buttons |= 0x1;
+                            s.mode = c.dragging ? kPS2GesturePreDrag : kPS2GestureNoTouch;
+                        }
+                }
+            else
+            {
+                s.xMoved = s.yMoved = s.xScrolled = s.yScrolled = 0;
+                if ((s.mode == kPS2GestureDrag || s.mode == kPS2GestureDragLock) && c.dragLock)
+                    s.mode = kPS2GestureDragNoTouch;
+                else
+                    s.mode = kPS2GestureNoTouch;
+            }
+            s.wasDouble = 0;
+        }
+        if (s.mode == kPS2GesturePreDrag && now - s.untouchTime > c.maxDragTime)
+            s.mode = kPS2GestureNoTouch;
+
+        switch (s.mode)
+        {
+            case kPS2GestureDrag:
+            case kPS2GestureDragLock:
+                buttons |= 0x1;
+            case kPS2GestureMove:
+                if (!c.divisor)
+                    break;
+            {
+                int dx = _moveDivider.divide(x - s.lastX, &s.xRest);
+                int dy = _moveDivider.divide(s.lastY - y, &s.yRest);
+                target->postRelativePointerEvent(dx, dy, buttons, sample.time);
+                s.xMoved += dx;
+                s.yMoved += dy;
+            }
+                break;
+
+            case kPS2GestureMultiTouch:
+                if (!c.stickyMultiFinger && !multiple(sample))
+                {
+                    s.mode = kPS2GestureMove;
+                    break;
+                }
+            {
+                int dv = _wvDivider.divide(y - s.lastY, &s.yRest);
+                int dh = _whDivider.divide(s.lastX - x, &s.xRest);
+                target->postScrollWheelEvent(dv, c.hscroll ? dh : 0, sample.time);
+                s.xScrolled += dv;
+                s.yScrolled += dh;
+            }
+                target->postRelativePointerEvent(0, 0, buttons, sample.time);
+                break;
+
+            case kPS2GestureVScroll:
+                if (!c.stickyVScroll && x < c.rightEdge)
+                {
+                    s.mode = kPS2GestureMove;
+                    break;
+                }
+            {
+                int dv = _vscrollDivider.divide(y - s.lastY, &s.scrollRest);
+                target->postScrollWheelEvent(dv, 0, sample.time);
+                s.xScrolled += dv;
+            }
+                target->postRelativePointerEvent(0, 0, buttons, sample.time);
+                break;
+
+            case kPS2GestureHScroll:
+                if (!c.stickyHScroll && y > c.bottomEdge)
+                {
+                    s.mode = kPS2GestureMove;
+                    break;
+                }
+            {
+                int dh = _hscrollDivider.divide(s.lastX - x, &s.scrollRest);
+                target->postScrollWheelEvent(0, dh, sample.time);
+                s.yScrolled += dh;
+            }
+                target->postRelativePointerEvent(0, 0, buttons, sample.time);
+                break;
+
+            case kPS2GestureCScroll:
+            {
+                int mov = y < c.centerY ? x - s.lastX : s.lastX - x;
+                mov += x < c.centerX ? s.lastY - y : y - s.lastY;
+
+                mov = _cscrollDivider.divide(mov, &s.scrollRest);
+                target->postScrollWheelEvent(mov, 0, sample.time);
+                s.xScrolled += mov;
+            }
+                target->postRelativePointerEvent(0, 0, buttons, sample.time);
+                break;
+
+            case kPS2GesturePreDrag:
+            case kPS2GestureDragNoTouch:
+                buttons |= 0x1;
+            case kPS2GestureNoTouch:
+                if (!c.stableTap)
+                    s.xMoved = s.yMoved = s.xScrolled = s.yScrolled = 0;
+                target->postScrollWheelEvent(-s.xScrolled, -s.yScrolled, sample.time);
+                target->postRelativePointerEvent(-s.xMoved, -s.yMoved, buttons, sample.time);
+                s.xMoved = s.yMoved = s.xScrolled = s.yScrolled = 0;
+                break;
+        }
+        s.lastX = x;
+        s.lastY = y;
+
+        if (down)
+        {
+            if (s.mode == kPS2GestureNoTouch || holdsButton())
+                s.touchTime = now;
+            if (multiple(sample))
+            {
+                s.wasDouble = 1;
+                if (c.scroll && (c.wvDivisor || (c.hscroll && c.whDivisor)))
+                    s.mode = kPS2GestureMultiTouch;
+            }
+            if (s.mode == kPS2GesturePreDrag)
+                s.mode = kPS2GestureDrag;
+            else if (s.mode == kPS2GestureDragNoTouch)
+                s.mode = kPS2GestureDragLock;
+            else if (s.mode == kPS2GestureNoTouch)
+                s.mode = _regions.lookup(x, y);
+        }
+
+        if (s.mode == kPS2GesturePreDrag)
+        {
+            UInt64 held = now - s.untouchTime;
+            _releaseDelay = held < c.maxDragTime ? (UInt32)((c.maxDragTime - held) / 1000) : 0;
+            result |= kPS2GestureRelease;
+        }
+        else if (s.mode == kPS2GestureNoTouch && buttons != sample.buttons)
+        {
+            _releaseDelay = kPS2ClickReleaseDelay;
+            result |= kPS2GestureRelease;
+        }
+        return result;
+    }
+
+private:
+    bool multiple(const PS2GestureSample & sample) const
+    {
+        //
+        // More than one finger down.  Pads that count fingers say so; for the
+        // rest, a W below 3 or at least wLimit is taken as more than one,
+        // which also catches a flat or heavy single finger.
+        //
+
+        if (sample.fingers)
+            return sample.fingers > 1;
+        return sample.w >= _settings.wLimit || sample.w < 3;
+    }
+
+    void buildRegions()
+    {
+        //
+        // Work out once, for every combination of edge zones, which mode a
+        // finger touching down there enters.  Circular scroll triggers take
+        // precedence, then the vertical and the horizontal scroll zones;
+        // anywhere else the finger just moves.
+        //
+
+        _regions.setEdges(_settings.leftEdge, _settings.rightEdge,
+                          _settings.topEdge, _settings.bottomEdge);
+
+        for (UInt32 region = 0; region < kPS2RegionCount; region++)
+        {
+            bool  left     = (region & kPS2RegionLeft) != 0;
+            bool  right    = (region & kPS2RegionRight) != 0;
+            bool  top      = (region & kPS2RegionTop) != 0;
+            bool  bottom   = (region & kPS2RegionBottom) != 0;
+            bool  circular = false;
+            UInt8 mode     = kPS2GestureMove;
+
+            if (_settings.scroll && _settings.cscrollDivisor)
+                switch (_settings.cscrollTrigger)
+                {
+                    case 1: circular = top;                             break;
+                    case 2: circular = top && right;                    break;
+                    case 3: circular = right;                           break;
+                    case 4: circular = right && bottom;                 break;
+                    case 5: circular = bottom;                          break;
+                    case 6: circular = bottom && left;                  break;
+                    case 7: circular = left;                            break;
+                    case 8: circular = left && top;                     break;
+                    case 9: circular = top || right || bottom || left;  break;
+                }
+
+            if (circular)
+                mode = kPS2GestureCScroll;
+            else if (right && _settings.vscrollDivisor && _settings.scroll)
+                mode = kPS2GestureVScroll;
+            else if (bottom && _settings.hscrollDivisor && _settings.hscroll && _settings.scroll)
+                mode = kPS2GestureHScroll;
+
+            _regions.setValue(region, mode);
+        }
+    }
+
+    PS2GestureState      _state;
+    UInt32               _releaseDelay;
+    PS2FixedDivider      _moveDivider;
+    PS2FixedDivider      _vscrollDivider, _hscrollDivider, _cscrollDivider;
+    PS2FixedDivider      _wvDivider, _whDivider;
+    PS2RegionClassifier  _regions;
+    PS2GestureSettings   _settings;
+};
+
+#endif /* !_APPLEPS2GESTUREENGINE_H */
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef _APPLEPS2HISTOGRAM_H
+#define _APPLEPS2HISTOGRAM_H
+
+#include <libkern/c++/OSContainers.h>
+
+// Enable collection of hot-path statistics (input latency, drain sizes,
+// port wait times, packet resyncs) in the controller and the drivers, which
+// then export them through the registry.  Off unless the build defines it.
+
+#ifndef PS2_STATISTICS
+#define PS2_STATISTICS 0
+#endif
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PS2Histogram Class Description
+//
+// Power-of-two histogram for the statistics above, cheap enough to update
+// from the interrupt paths: bucket 0 counts zero values, bucket i counts
+// values from 2^(i-1) up to 2^i - 1, and the last bucket everything larger.
+// Updates are not locked; the owner serializes them (normally by only adding
+// from its work loop) and must serialize copyDictionary() the same way.
+//
+// o  init:
+//    o  Description:  Clear all samples.
+//
+// o  add:
+//    o  Description:  Count one sample.
+//
+// o  copyDictionary:
+//    o  Description:  Describe the histogram for the registry, as a dictionary
+//                     of Buckets (array of counts), Count and Max.
+//    o  Result:       Retained dictionary, or 0 on allocation failure.
+//
+
+#define kPS2HistogramBuckets 16
+
+class PS2Histogram
+{
+public:
+    void init()
+    {
+        for (int index = 0; index < kPS2HistogramBuckets; index++)
+            _bucket[index] = 0;
+        _count = 0;
+        _max   = 0;
+    }
+
+    void add(UInt32 value)
+    {
+        int index = value ? 32 - __builtin_clz(value) : 0;
+        if (index >= kPS2HistogramBuckets)  index = kPS2HistogramBuckets - 1;
+
+        _bucket[index]++;
+        _count++;
+        if (value > _max)  _max = value;
+    }
+
+    UInt32 count() const  { return _count; }
+
+    OSDictionary * copyDictionary() const
+    {
+        OSDictionary * dict    = OSDictionary::withCapacity(3);
+        OSArray *      buckets = OSArray::withCapacity(kPS2HistogramBuckets);
+        OSNumber *     number;
+
+        if (!dict || !buckets)
+        {
+            if (dict)     dict->release();
+            if (buckets)  buckets->release();
+            return 0;
+        }
+
+        for (int index = 0; index < kPS2HistogramBuckets; index++)
+        {
+            if ((number = OSNumber::withNumber(_bucket[index], 32)))
+            {
+                buckets->setObject(number);
+                number->release();
+            }
+        }
+        dict->setObject("Buckets", buckets);
+        buckets->release();
+
+        if ((number = OSNumber::withNumber(_count, 32)))
+        {
+            dict->setObject("Count", number);
+            number->release();
+        }
+        if ((number = OSNumber::withNumber(_max, 32)))
+        {
+            dict->setObject("Max", number);
+            number->release();
+        }
+        return dict;
+    }
+
+private:
+    UInt32 _bucket[kPS2HistogramBuckets];
+    UInt32 _count;
+    UInt32 _max;
+};
+
+#endif /* !_APPLEPS2HISTOGRAM_H */
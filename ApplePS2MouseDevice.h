@@ -26,6 +26,7 @@
 #include "ApplePS2Device.h"
 
 class ApplePS2Controller;
+class PS2TraceBuffer;
 
 class ApplePS2MouseDevice : public IOService
 {
@@ -33,6 +34,8 @@ class ApplePS2MouseDevice : public IOService
 
 private:
   ApplePS2Controller * _controller;
+  PS2MouseIdentity     _identity;
+  bool                 _identityValid;
 
 protected:
   struct ExpansionData { /* */ };
@@ -46,19 +49,35 @@ public:
 
   virtual void installInterruptAction(OSObject *, PS2InterruptAction);
   virtual void uninstallInterruptAction();
+  virtual void installBatchInterruptAction(OSObject *, PS2BatchInterruptAction);
+  virtual void uninstallBatchInterruptAction();
 
   // Request Submission Routines
 
   virtual PS2Request * allocateRequest();
   virtual void         freeRequest(PS2Request * request);
   virtual bool         submitRequest(PS2Request * request);
+  virtual bool         submitRequest(PS2Request *        request,
+                                     void *              target,
+                                     PS2CompletionAction action,
+                                     void *              param = 0);
   virtual void         submitRequestAndBlock(PS2Request * request);
+  virtual void         updateCommandByte(UInt8 setBits, UInt8 clearBits);
 
   // Power Control Handling Routines
 
   virtual void installPowerControlAction(OSObject *, PS2PowerControlAction);
   virtual void uninstallPowerControlAction();
 
+  // Diagnostics Routines
+
+  virtual PS2TraceBuffer * getTraceBuffer();
+
+  // Identification Routines
+
+  virtual bool getIdentity(PS2MouseIdentity * identity);
+  virtual void setIdentity(const PS2MouseIdentity * identity);
+
   OSMetaClassDeclareReservedUnused(ApplePS2MouseDevice, 0);
   OSMetaClassDeclareReservedUnused(ApplePS2MouseDevice, 1);
   OSMetaClassDeclareReservedUnused(ApplePS2MouseDevice, 2);
@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef _APPLEPS2PACKETASSEMBLER_H
+#define _APPLEPS2PACKETASSEMBLER_H
+
+#include "ApplePS2Device.h"
+#include "ApplePS2Histogram.h"
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PS2PacketAssembler Class Description
+//
+// Collects the bytes a pointing device delivers through its interrupt action
+// into fixed length packets of up to N bytes.  The Validator class supplies
+// the protocol's framing rules as two functions, which the compiler inlines
+// into add().  They are usually static; a protocol whose framing depends on
+// the device keeps that state in the assembler's validator():
+//
+//   bool isPacketStart(UInt8 byte);
+//     True if the byte may be the first byte of a packet.
+//
+//   bool isPacketByte(const UInt8 * packet, UInt32 index, UInt8 byte);
+//     True if the byte may follow packet[0..index-1] at the given index.
+//
+// A byte failing either test drops the first byte of the partial packet and
+// assembly restarts from the next of its bytes that still makes a valid
+// start, the failing byte included; bytes that end up starting nothing are
+// thrown away.  Either way the stream resyncs without the driver's help, and
+// a single lost byte costs no more than the packet it was in.  Every time
+// the stream goes from in sync to out of sync the resync count goes up once,
+// however many bytes it then takes to find the next packet start.
+//
+// o  init:
+//    o  Description:  Clear all state and counters.  Call from driver's init.
+//    o  In Fields:    Packet length, N if not given.
+//
+// o  setLength:
+//    o  Description:  Change the packet length (at most N), for devices that
+//                     have more than one packet format.
+//
+// o  reset:
+//    o  Description:  Drop a partial packet, for instance after the device
+//                     was reset or reprogrammed and stale fragments may exist.
+//
+// o  add:
+//    o  Description:  Add one byte from the input stream.
+//    o  Result:       kPS2PacketComplete when a packet is ready in packet(),
+//                     until the next call.  kPS2PacketDiscarded if the byte
+//                     was thrown away.  kPS2PacketIncomplete otherwise.
+//
+// o  addBytes:
+//    o  Description:  Add a run of bytes, as delivered by a batch interrupt
+//                     action, calling target->action(packet, length) for each
+//                     packet completed.
+//    o  Result:       Number of packets completed.
+//
+// o  noteBadPacket:
+//    o  Description:  Record that a completed packet failed a check only the
+//                     driver can make, such as a parity check, and assemble
+//                     again from the first of its later bytes that may start
+//                     a packet, in case the stream had slipped.
+//    o  Comments:     Call right after add() completed the packet, once done
+//                     with packet(), as the bytes are moved.
+//
+// o  publishStatistics:
+//    o  Description:  With PS2_STATISTICS set, export the resync and discard
+//                     counts as the driver's PacketResyncs and PacketDiscards
+//                     properties, if they changed.  Does nothing otherwise.
+//    o  Comments:     Call from the interrupt routine once a packet is
+//                     complete, so the cost stays at one compare per packet.
+//
+
+enum PS2PacketStatus
+{
+    kPS2PacketIncomplete,
+    kPS2PacketComplete,
+    kPS2PacketDiscarded
+};
+
+template <UInt32 N, class Validator>
+class PS2PacketAssembler
+{
+public:
+    void init(UInt32 length = N)
+    {
+        _length    = length <= N ? length : N;
+        _count     = 0;
+        _inSync    = true;
+        _resyncs   = 0;
+        _discarded = 0;
+#if PS2_STATISTICS
+        _publishedResyncs = 0;
+#endif
+    }
+
+    void setLength(UInt32 length)
+    {
+        _length = length <= N ? length : N;
+        _count  = 0;
+    }
+
+    void reset()                      { _count = 0; }
+
+    UInt32  length() const            { return _length; }
+    UInt32  count() const             { return _count; }
+    UInt8 * packet()                  { return _buffer; }
+    UInt32  resyncCount() const       { return _resyncs; }
+    UInt32  discardCount() const      { return _discarded; }
+
+    void noteBadPacket()
+    {
+        lostSync();
+        _count = _length;
+        shift();
+    }
+
+    Validator & validator()           { return _validator; }
+
+#if PS2_STATISTICS
+    void publishStatistics(IOService * service)
+    {
+        if ( _resyncs == _publishedResyncs )
+            return;
+
+        _publishedResyncs = _resyncs;
+        service->setProperty("PacketResyncs", _resyncs, 32);
+        service->setProperty("PacketDiscards", _discarded, 32);
+    }
+#else
+    void publishStatistics(IOService *) {}
+#endif
+
+    PS2PacketStatus add(UInt8 byte)
+    {
+        if ( _count == 0 )
+        {
+            if ( !_validator.isPacketStart(byte) )
+            {
+                lostSync();
+                _discarded++;
+                return kPS2PacketDiscarded;
+            }
+        }
+        else if ( !_validator.isPacketByte(_buffer, _count, byte) )
+        {
+            lostSync();
+            shift();
+            return add(byte);
+        }
+
+        _buffer[_count++] = byte;
+        if ( _count < _length )
+            return kPS2PacketIncomplete;
+
+        _count  = 0;
+        _inSync = true;
+        return kPS2PacketComplete;
+    }
+
+    template <class T>
+    UInt32 addBytes(const UInt8 * data, UInt32 count,
+                    T * target, void (T::*action)(UInt8 *, UInt32))
+    {
+        UInt32 packets = 0;
+
+        for (UInt32 index = 0; index < count; index++)
+        {
+            if ( add(data[index]) == kPS2PacketComplete )
+            {
+                (target->*action)(_buffer, _length);
+                packets++;
+            }
+        }
+        return packets;
+    }
+
+private:
+    void shift()
+    {
+        //
+        // Assemble the bytes after the first of the packet again.  They are
+        // fewer than a packet, so none completes one, and each nested shift
+        // has fewer bytes still.
+        //
+
+        UInt8  rest[N];
+        UInt32 count = _count - 1;
+
+        for (UInt32 index = 0; index < count; index++)
+            rest[index] = _buffer[index + 1];
+        _count = 0;
+        for (UInt32 index = 0; index < count; index++)
+            add(rest[index]);
+    }
+
+    void lostSync()
+    {
+        if ( _inSync )
+        {
+            _inSync = false;
+            _resyncs++;
+        }
+    }
+
+    Validator _validator;
+    UInt8   _buffer[N];
+    UInt32  _length;
+    UInt32  _count;
+    bool    _inSync;
+    UInt32  _resyncs;
+    UInt32  _discarded;
+#if PS2_STATISTICS
+    UInt32  _publishedResyncs;
+#endif
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PS2StandardPacketValidator
+//
+// Standard PS/2 mouse framing, also used by devices which keep it in their
+// own formats: the first byte has bit 3 set (and is no command ack).  There
+// is nothing to check in the following bytes.
+//
+
+struct PS2StandardPacketValidator
+{
+    static bool isPacketStart(UInt8 byte)
+    {
+        return byte != kSC_Acknowledge && (byte & 0x08);
+    }
+
+    static bool isPacketByte(const UInt8 *, UInt32, UInt8)
+    {
+        return true;
+    }
+};
+
+#endif /* !_APPLEPS2PACKETASSEMBLER_H */
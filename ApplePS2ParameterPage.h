@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef _APPLEPS2PARAMETERPAGE_H
+#define _APPLEPS2PARAMETERPAGE_H
+
+#include <libkern/OSTypes.h>
+#include <libkern/OSAtomic.h>
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Parameter Page Layout
+//
+// A page of trackpad settings shared between a driver and the prefpane, so
+// that dragging a slider does not cost a setProperties round trip (and a
+// full settings pass) for every step.  The prefpane maps it through the
+// driver's user client (memory type kPS2ParameterMemoryType).
+//
+// To change a setting, the writer stores value[index], sets bit (1 << index)
+// in changed with an atomic or, then increments generation.  The driver picks
+// the changes up at its next packet: it notices the new generation, clears
+// changed atomically and applies the values whose bits were set.  The driver
+// also keeps the values current when the settings are changed through
+// setProperties.  The registry properties of the settings follow the page.
+//
+
+#define kPS2ParameterMagic      0x50533250      // 'PS2P'
+#define kPS2ParameterVersion    1
+#define kPS2ParameterMemoryType 0               // clientMemoryForType type
+
+enum
+{
+    kPS2ParamDivisor,                           // same as the property names
+    kPS2ParamFingerZ,
+    kPS2ParamTopEdge,
+    kPS2ParamBottomEdge,
+    kPS2ParamLeftEdge,
+    kPS2ParamRightEdge,
+    kPS2ParamCenterX,
+    kPS2ParamCenterY,
+    kPS2ParamCount                              // at most 32
+};
+
+typedef struct PS2ParameterPage PS2ParameterPage;
+struct PS2ParameterPage
+{
+    UInt32           magic;
+    UInt16           version;
+    UInt16           count;                     // kPS2ParamCount
+    volatile UInt32  generation;
+    volatile UInt32  changed;                   // bit per value written
+    SInt32           value[kPS2ParamCount];
+};
+
+#ifdef KERNEL
+
+#include <IOKit/IOBufferMemoryDescriptor.h>
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PS2ParameterChannel Class Description
+//
+// Kernel side of the parameter page.  pending() is one load and compare, for
+// the packet path; take() is only called when it returns true.
+//
+// o  init:
+//    o  Description:  Clear all state.  pending() is false until allocate().
+//
+// o  allocate:
+//    o  Description:  Allocate the page.
+//    o  Result:       False on allocation failure.
+//
+// o  free:
+//    o  Description:  Release the page.  Users must be gone by then.
+//
+// o  pending:
+//    o  Result:       True if the writer changed values since last take().
+//
+// o  take:
+//    o  Description:  Copy the changed values out and mark them seen.
+//    o  Result:       Bits of the values copied.
+//
+// o  publish:
+//    o  Description:  Store a value set otherwise, for the writer to see.
+//
+
+class PS2ParameterChannel
+{
+public:
+    void init()
+    {
+        _memory = 0;
+        _page   = 0;
+        _seen   = 0;
+    }
+
+    bool allocate()
+    {
+        _memory = IOBufferMemoryDescriptor::withOptions(
+                        kIODirectionInOut | kIOMemoryKernelUserShared,
+                        page_size, page_size);
+        if (!_memory)
+            return false;
+
+        _page = (PS2ParameterPage *) _memory->getBytesNoCopy();
+        bzero(_page, _memory->getLength());
+        _page->magic   = kPS2ParameterMagic;
+        _page->version = kPS2ParameterVersion;
+        _page->count   = kPS2ParamCount;
+        _seen          = 0;
+        return true;
+    }
+
+    void free()
+    {
+        _page = 0;
+        if (_memory)
+        {
+            _memory->release();
+            _memory = 0;
+        }
+    }
+
+    IOMemoryDescriptor * memory() const  { return _memory; }
+
+    bool pending() const
+    {
+        return _page && _page->generation != _seen;
+    }
+
+    UInt32 take(SInt32 values[kPS2ParamCount])
+    {
+        UInt32 changed;
+
+        _seen = _page->generation;
+        do
+            changed = _page->changed;
+        while (!OSCompareAndSwap(changed, 0, &_page->changed));
+
+        for (int index = 0; index < kPS2ParamCount; index++)
+            if (changed & (1 << index))
+                values[index] = _page->value[index];
+        return changed;
+    }
+
+    void publish(UInt32 index, SInt32 value)
+    {
+        if (_page && index < kPS2ParamCount)
+            _page->value[index] = value;
+    }
+
+private:
+    IOBufferMemoryDescriptor * _memory;
+    PS2ParameterPage *         _page;
+    UInt32                     _seen;           // generation last taken
+};
+
+#endif /* KERNEL */
+
+#endif /* !_APPLEPS2PARAMETERPAGE_H */
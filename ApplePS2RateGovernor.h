@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#ifndef _APPLEPS2RATEGOVERNOR_H
+#define _APPLEPS2RATEGOVERNOR_H
+
+#include <IOKit/IOTimerEventSource.h>
+#include <IOKit/IOWorkLoop.h>
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PS2RateGovernor Class Description
+//
+// Keeps track of when a trackpad may drop from its high report rate to its
+// low one.  The driver tells the governor about every packet with a finger
+// down and about the finger lifting; once the pad has been left alone for
+// the idle time, a timer on the driver's work loop calls the driver back to
+// switch to the low rate.  The first touch after that has the driver switch
+// back.  The governor only does the bookkeeping: the driver reprograms the
+// pad itself, asynchronously, so the interrupt path never blocks on it.
+//
+// o  init:
+//    o  Description:  Clear all state; the governor is off.
+//
+// o  start:
+//    o  Description:  Create the idle timer on the given work loop.
+//    o  In Fields:    Owner and action of the timer, the driver's work loop.
+//    o  Result:       False if the timer could not be set up.
+//
+// o  stop:
+//    o  Description:  Cancel the idle timer and free it.
+//
+// o  setIdleTime:
+//    o  Description:  Set how long (in milliseconds) the pad must be idle to
+//                     drop to the low rate, 0 to keep the high rate always.
+//
+// o  reset:
+//    o  Description:  Forget the rate the pad was left at, for instance after
+//                     the driver reprogrammed it at the high rate itself.
+//
+// o  touch:
+//    o  Description:  Note a packet with the finger down.
+//    o  Result:       True if the driver must switch to the high rate now.
+//
+// o  release:
+//    o  Description:  Note the finger lifting; starts the idle time.
+//
+// o  expire:
+//    o  Description:  Called from the timer action to claim the switch.
+//    o  Result:       True if the driver must switch to the low rate now.
+//
+
+class PS2RateGovernor
+{
+public:
+    void init()
+    {
+        _timer    = 0;
+        _workLoop = 0;
+        _idleTime = 0;
+        _armed    = false;
+        _low      = false;
+    }
+
+    bool start(OSObject * owner, IOWorkLoop * workLoop,
+               IOTimerEventSource::Action action)
+    {
+        if (!workLoop)  return false;
+
+        _timer = IOTimerEventSource::timerEventSource(owner, action);
+        if (!_timer)  return false;
+
+        if (workLoop->addEventSource(_timer) != kIOReturnSuccess)
+        {
+            _timer->release();
+            _timer = 0;
+            return false;
+        }
+        _workLoop = workLoop;
+        return true;
+    }
+
+    void stop()
+    {
+        _armed = false;
+        if (_timer)
+        {
+            _timer->cancelTimeout();
+            _workLoop->removeEventSource(_timer);
+            _timer->release();
+            _timer = 0;
+        }
+        _workLoop = 0;
+    }
+
+    void setIdleTime(UInt32 idleTime)  { _idleTime = idleTime; }
+
+    void reset()
+    {
+        disarm();
+        _low = false;
+    }
+
+    bool touch()
+    {
+        disarm();
+        if (!_low)  return false;
+
+        _low = false;
+        return true;
+    }
+
+    void release()
+    {
+        if (!_timer || !_idleTime || _low)  return;
+
+        _armed = true;
+        _timer->setTimeoutMS(_idleTime);
+    }
+
+    bool expire()
+    {
+        if (!_armed)  return false;
+
+        _armed = false;
+        _low   = true;
+        return true;
+    }
+
+private:
+    void disarm()
+    {
+        if (_armed)
+        {
+            _timer->cancelTimeout();
+            _armed = false;
+        }
+    }
+
+    IOTimerEventSource * _timer;
+    IOWorkLoop *         _workLoop;
+    UInt32               _idleTime;
+    bool                 _armed;
+    bool                 _low;
+};
+
+#endif /* !_APPLEPS2RATEGOVERNOR_H */
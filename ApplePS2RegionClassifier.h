@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef _APPLEPS2REGIONCLASSIFIER_H
+#define _APPLEPS2REGIONCLASSIFIER_H
+
+#include <libkern/OSTypes.h>
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PS2RegionClassifier Class Description
+//
+// Maps a trackpad position to a driver-defined value (scroll zone, mode to
+// enter, ...) by the edge zones the position falls in.  The four edges split
+// the surface into up to sixteen regions, one per combination of the region
+// bits below, and the driver fills in the value of each region whenever its
+// edges or zone settings change.  Classifying a position then costs four
+// compares and one table lookup, however many zones the driver has.
+//
+// A position is in the left zone when x < left, the right zone when x > right,
+// the top zone when y > top and the bottom zone when y < bottom (y grows
+// upwards).  Edges that are not used are left at their kPS2RegionNoEdge
+// defaults, so no position is ever in their zone.
+//
+// o  init:
+//    o  Description:  Clear the edges (no zones) and set every region's value.
+//
+// o  setEdges:
+//    o  Description:  Move the zone boundaries.  Region values are kept.
+//
+// o  setValue:
+//    o  Description:  Set the value of one region (combination of bits).
+//
+// o  classify:
+//    o  Result:       Region bits of the position.
+//
+// o  lookup:
+//    o  Result:       Value of the region the position is in.
+//
+
+#define kPS2RegionLeft          0x01
+#define kPS2RegionRight         0x02
+#define kPS2RegionTop           0x04
+#define kPS2RegionBottom        0x08
+#define kPS2RegionCount         16
+
+#define kPS2RegionNoEdgeMin     ((int) 0x80000000)     // left, bottom unused
+#define kPS2RegionNoEdgeMax     ((int) 0x7fffffff)     // right, top unused
+
+class PS2RegionClassifier
+{
+public:
+    void init(UInt8 value = 0)
+    {
+        setEdges(kPS2RegionNoEdgeMin, kPS2RegionNoEdgeMax,
+                 kPS2RegionNoEdgeMax, kPS2RegionNoEdgeMin);
+        for (int region = 0; region < kPS2RegionCount; region++)
+            _value[region] = value;
+    }
+
+    void setEdges(int left, int right, int top, int bottom)
+    {
+        _left   = left;
+        _right  = right;
+        _top    = top;
+        _bottom = bottom;
+    }
+
+    void setValue(UInt32 region, UInt8 value)
+    {
+        _value[region & (kPS2RegionCount - 1)] = value;
+    }
+
+    UInt32 classify(int x, int y) const
+    {
+        return (x < _left   ? kPS2RegionLeft   : 0) |
+               (x > _right  ? kPS2RegionRight  : 0) |
+               (y > _top    ? kPS2RegionTop    : 0) |
+               (y < _bottom ? kPS2RegionBottom : 0);
+    }
+
+    UInt8 lookup(int x, int y) const
+    {
+        return _value[classify(x, y)];
+    }
+
+private:
+    int    _left;
+    int    _right;
+    int    _top;
+    int    _bottom;
+    UInt8  _value[kPS2RegionCount];
+};
+
+#endif /* !_APPLEPS2REGIONCLASSIFIER_H */
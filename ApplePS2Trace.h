@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef _APPLEPS2TRACE_H
+#define _APPLEPS2TRACE_H
+
+#include <libkern/OSTypes.h>
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Trace Buffer Layout
+//
+// The controller keeps one trace buffer, which user space maps through the
+// controller's user client (memory type kPS2TraceMemoryType).  It holds a
+// PS2TraceHeader followed by recordCount PS2TraceRecords, recordCount being
+// a power of two.  Records are written round robin, oldest first overwritten;
+// record n (counting from 0 since the buffer was allocated) goes into slot
+// n & (recordCount - 1) and has sequence n + 1 once it is complete.
+//
+// Nothing is recorded until tracing of a record type is turned on, by setting
+// its bit (1 << type) in the mask, either with the controller's TraceMask
+// property or with the user client's kPS2TraceMethodSetMask method.  The
+// mapping is read only; the header's mask and next are copies of the
+// controller's own, kept for readers.  A reader walks the slots from
+// next - recordCount up to next, copies each record, and keeps it if its
+// sequence was the expected one both before and after the copy.
+//
+// Keyboard bytes include keystrokes, so the user client is only handed out
+// to administrators.
+//
+// A capture of raw byte records can be fed back to the drivers with the user
+// client's kPS2TraceMethodReplay method, which takes an array of records as
+// its structure input.  The controller dispatches each record's bytes to the
+// driver at the same offset from the first record as they were captured, on
+// the work loop between real input, and traces them again with code
+// kPS2TraceCodeReplay.  Records of other types are skipped.  Once done, the
+// controller's ReplayStatistics property tells what the dispatches cost the
+// drivers.  kPS2TraceMethodStopReplay cancels a replay.
+//
+
+#define kPS2TraceMagic          0x50533254      // 'PS2T'
+#define kPS2TraceVersion        1
+#define kPS2TraceMemoryType     0               // clientMemoryForType type
+#define kPS2TraceDataSize       16              // bytes of data per record
+#define kPS2TraceCodeReplay     1               // code of replayed raw bytes
+
+#define kPS2TraceMethodReplay       0           // user client selectors
+#define kPS2TraceMethodStopReplay   1
+#define kPS2TraceMethodSetMask      2
+
+enum
+{
+    kPS2TraceKeyboardByte = 1,      // raw bytes from the keyboard port
+    kPS2TraceMouseByte    = 2,      // raw bytes from the mouse port
+    kPS2TracePacket       = 3,      // packet decoded by a driver, code is
+                                    // driver defined (eg. packet type)
+    kPS2TraceState        = 4       // state transition, code is driver
+                                    // defined, data the old and new state
+};
+
+typedef struct PS2TraceHeader PS2TraceHeader;
+struct PS2TraceHeader
+{
+    UInt32           magic;
+    UInt16           version;
+    UInt16           recordSize;        // sizeof(PS2TraceRecord)
+    UInt32           recordCount;       // power of two
+    volatile UInt32  mask;              // record types traced
+    volatile UInt32  next;              // next record number to write
+    UInt32           reserved[3];
+};
+
+typedef struct PS2TraceRecord PS2TraceRecord;
+struct PS2TraceRecord
+{
+    volatile UInt32  sequence;          // record number + 1, 0 while written
+    UInt8            type;
+    UInt8            length;            // valid bytes in data
+    UInt16           code;
+    UInt64           timestamp;         // uptime, absolute time units
+    UInt8            data[kPS2TraceDataSize];
+};
+
+#ifdef KERNEL
+
+#include <IOKit/IOBufferMemoryDescriptor.h>
+#include <libkern/OSAtomic.h>
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PS2TraceBuffer Class Description
+//
+// Kernel side of the trace buffer.  add() may be called from any context
+// except primary interrupt handlers (it reads the clock): writers reserve
+// their slot with one atomic increment and never wait on each other or on
+// readers.  With a record type not traced, add() costs one load and test, so
+// the calls can stay in the hot paths.  The record count, next record number
+// and mask are kept here and only copied into the header, so nothing user
+// space could write to the buffer ever decides where the kernel writes.
+//
+// o  init:
+//    o  Description:  Clear all state.  add() does nothing until allocate().
+//
+// o  allocate:
+//    o  Description:  Allocate the buffer for (at least) the given number of
+//                     records, rounded up to a power of two.
+//    o  Result:       False on allocation failure.
+//
+// o  free:
+//    o  Description:  Release the buffer.  Users must be gone by then.
+//
+// o  add:
+//    o  Description:  Record data of the given type, over several records if
+//                     it does not fit in one, if that type is traced.
+//
+// o  addState:
+//    o  Description:  Record a transition from one state to another.
+//
+// o  setMask:
+//    o  Description:  Change the record types traced.
+//
+
+class PS2TraceBuffer
+{
+public:
+    void init()
+    {
+        _memory  = 0;
+        _header  = 0;
+        _records = 0;
+        _count   = 0;
+        _next    = 0;
+        _mask    = 0;
+    }
+
+    bool allocate(UInt32 records, UInt32 mask)
+    {
+        UInt32 count = 1;
+        while (count < records && count < 0x10000)
+            count <<= 1;
+
+        _memory = IOBufferMemoryDescriptor::withOptions(
+                        kIODirectionInOut | kIOMemoryKernelUserShared,
+                        sizeof(PS2TraceHeader) + count * sizeof(PS2TraceRecord),
+                        page_size);
+        if (!_memory)
+            return false;
+
+        _header = (PS2TraceHeader *) _memory->getBytesNoCopy();
+        bzero(_header, _memory->getLength());
+        _header->magic       = kPS2TraceMagic;
+        _header->version     = kPS2TraceVersion;
+        _header->recordSize  = sizeof(PS2TraceRecord);
+        _header->recordCount = count;
+        _header->mask        = mask;
+        _count = count;
+        _next  = 0;
+        _mask  = mask;
+        OSMemoryBarrier();
+        _records = (PS2TraceRecord *) (_header + 1);
+        return true;
+    }
+
+    void free()
+    {
+        _records = 0;
+        _header  = 0;
+        _count   = 0;
+        if (_memory)
+        {
+            _memory->release();
+            _memory = 0;
+        }
+    }
+
+    IOMemoryDescriptor * memory() const  { return _memory; }
+
+    bool enabled(UInt8 type) const
+    {
+        return _records && (_mask & (1 << type));
+    }
+
+    UInt32 mask() const  { return _mask; }
+
+    void setMask(UInt32 mask)
+    {
+        _mask = mask;
+        if (_header)  _header->mask = mask;
+    }
+
+    void add(UInt8 type, UInt16 code, const UInt8 * data, UInt32 length)
+    {
+        if (!enabled(type))
+            return;
+
+        UInt64 now;
+        clock_get_uptime(&now);
+
+        do
+        {
+            UInt32 chunk = length < kPS2TraceDataSize ? length : kPS2TraceDataSize;
+            UInt32 number = (UInt32) OSIncrementAtomic((volatile SInt32 *) &_next);
+            PS2TraceRecord * record = &_records[number & (_count - 1)];
+
+            record->sequence = 0;
+            OSMemoryBarrier();
+            record->type      = type;
+            record->length    = chunk;
+            record->code      = code;
+            record->timestamp = now;
+            for (UInt32 index = 0; index < chunk; index++)
+                record->data[index] = data[index];
+            OSMemoryBarrier();
+            record->sequence = number + 1;
+            _header->next    = _next;
+
+            data   += chunk;
+            length -= chunk;
+        } while (length);
+    }
+
+    void addState(UInt16 code, UInt32 from, UInt32 to)
+    {
+        if (!enabled(kPS2TraceState))
+            return;
+
+        UInt32 states[2] = { from, to };
+        add(kPS2TraceState, code, (const UInt8 *) states, sizeof(states));
+    }
+
+private:
+    IOBufferMemoryDescriptor * _memory;
+    PS2TraceHeader *           _header;
+    PS2TraceRecord *           _records;
+    UInt32                     _count;          // recordCount
+    volatile UInt32            _next;           // next record number
+    volatile UInt32            _mask;           // record types traced
+};
+
+#endif /* KERNEL */
+
+#endif /* !_APPLEPS2TRACE_H */
@@ -0,0 +1,584 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef _PS2BENCHKERNEL_H
+#define _PS2BENCHKERNEL_H
+
+//
+// Just enough of the kernel, libkern and IOKit interfaces, in user space, to
+// build the pointing drivers unmodified into the decoder benchmark.  Every
+// header the drivers include from the kernel framework resolves, through the
+// Kernel directory, to this one.
+//
+// The objects behave like their kernel counterparts where the drivers can
+// tell: memory from operator new is zeroed, release() frees at a retain count
+// of zero, OSMemberFunctionCast resolves virtual functions.  Everything else
+// is reduced to what the benchmark measures:
+//
+// o  Time:        clock_get_uptime reads a virtual clock in nanoseconds, set
+//                 by the benchmark from the stream being replayed.  IOSleep
+//                 advances it.
+// o  Timers:      IOTimerEventSource only records its deadline; the benchmark
+//                 fires the timers due before delivering the next bytes.
+// o  Events:      IOHIPointing counts the events dispatched to it, and the
+//                 button presses among them.
+// o  Allocations: IOMalloc, operator new and the buffer memory descriptors
+//                 are counted while gPS2BenchCounting is set.
+// o  Logging:     IOLog is counted, and only printed in verbose mode.
+//
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// libkern/OSTypes.h
+//
+
+typedef uint8_t  UInt8;
+typedef int8_t   SInt8;
+typedef uint16_t UInt16;
+typedef int16_t  SInt16;
+typedef uint32_t UInt32;
+typedef int32_t  SInt32;
+typedef uint64_t UInt64;
+typedef int64_t  SInt64;
+typedef unsigned int UInt;
+typedef signed int   SInt;
+typedef UInt64   AbsoluteTime;
+
+typedef int          IOReturn;
+typedef int          kern_return_t;
+typedef SInt32       IOFixed;
+typedef UInt32       IOItemCount;
+typedef UInt32       IOOptionBits;
+typedef size_t       IOByteCount;
+typedef unsigned int boolean_t;
+
+#ifndef TRUE
+#define TRUE  1
+#define FALSE 0
+#endif
+
+#define kIOReturnSuccess       0
+#define kIOReturnError         ((IOReturn) 0xe00002bc)
+#define kIOReturnNoMemory      ((IOReturn) 0xe00002bd)
+#define kIOReturnNoResources   ((IOReturn) 0xe00002be)
+#define kIOReturnBadArgument   ((IOReturn) 0xe00002c2)
+#define kIOReturnUnsupported   ((IOReturn) 0xe00002c7)
+#define kIOReturnNotPrivileged ((IOReturn) 0xe00002c1)
+#define kIOReturnNotReady      ((IOReturn) 0xe00002d8)
+#define kIOReturnBusy          ((IOReturn) 0xe00002d5)
+
+#define assert(ex)  ((void) 0)
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Benchmark accounting
+//
+
+struct PS2BenchCounters
+{
+    UInt64 allocations;         // IOMalloc, operator new, memory descriptors
+    UInt64 allocatedBytes;
+    UInt64 logs;                // IOLog calls
+    UInt64 relativeEvents;      // dispatchRelativePointerEvent calls
+    UInt64 scrollEvents;        // dispatchScrollWheelEvent calls
+    UInt64 absoluteEvents;      // dispatchAbsolutePointerEvent calls
+    UInt64 clicks;              // buttons going down, over all three calls
+    UInt64 motion;              // sum of |dx| + |dy| of relative events
+    UInt64 timers;              // timer actions fired
+};
+
+extern PS2BenchCounters gPS2BenchCounters;
+extern bool             gPS2BenchCounting;
+extern bool             gPS2BenchVerbose;
+extern UInt64           gPS2BenchClock;     // virtual uptime, nanoseconds
+
+void * PS2BenchAllocate(size_t size);
+void   PS2BenchFree(void * address);
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// IOKit/IOLib.h, libkern/OSAtomic.h, kern/clock.h
+//
+
+extern "C"
+{
+void   IOLog(const char * format, ...) __attribute__((format(printf, 1, 2)));
+void   IOSleep(unsigned milliseconds);
+void   IODelay(unsigned microseconds);
+void * IOMalloc(size_t size);
+void   IOFree(void * address, size_t size);
+void   clock_get_uptime(uint64_t * result);
+void   absolutetime_to_nanoseconds(uint64_t abstime, uint64_t * result);
+void   nanoseconds_to_absolutetime(uint64_t nanoseconds, uint64_t * result);
+}
+
+extern unsigned long page_size;
+
+inline bool OSCompareAndSwap(UInt32 oldValue, UInt32 newValue, volatile UInt32 * address)
+{
+    return __sync_bool_compare_and_swap(address, oldValue, newValue);
+}
+
+inline SInt32 OSIncrementAtomic(volatile SInt32 * address)
+{
+    return __sync_fetch_and_add(address, 1);
+}
+
+inline SInt32 OSDecrementAtomic(volatile SInt32 * address)
+{
+    return __sync_fetch_and_sub(address, 1);
+}
+
+inline SInt32 OSAddAtomic(SInt32 amount, volatile SInt32 * address)
+{
+    return __sync_fetch_and_add(address, amount);
+}
+
+inline void OSMemoryBarrier()
+{
+    __sync_synchronize();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// libkern/c++/OSObject.h, OSMetaClass.h
+//
+
+class OSMetaClassBase
+{
+public:
+    virtual ~OSMetaClassBase() {}
+    virtual void retain() const = 0;
+    virtual void release() const = 0;
+    virtual bool isEqualTo(const OSMetaClassBase * object) const  { return object == this; }
+
+    typedef void (OSMetaClassBase::*_ptf_t)(void);
+    typedef void (*_ptf_function_t)(void);
+    static _ptf_function_t _ptmf2ptf(const OSMetaClassBase * self, _ptf_t function);
+};
+
+class OSObject : public OSMetaClassBase
+{
+public:
+    OSObject() : _retainCount(1) {}
+    virtual ~OSObject() {}
+
+    static void * operator new(size_t size);
+    static void   operator delete(void * address, size_t size);
+
+    virtual bool init()                 { return true; }
+    virtual void free()                 { delete this; }
+    virtual void retain() const         { _retainCount++; }
+    virtual void release() const;
+    int          getRetainCount() const { return _retainCount; }
+
+private:
+    mutable int _retainCount;
+};
+
+#define OSDeclareDefaultStructors(className)                                \
+    public:                                                                 \
+        className();                                                        \
+        virtual ~className();                                               \
+    private:
+
+#define OSDeclareAbstractStructors(className)  OSDeclareDefaultStructors(className)
+
+#define OSDefineMetaClassAndStructors(className, superclassName)            \
+    className::className() {}                                               \
+    className::~className() {}
+
+#define OSDefineMetaClassAndAbstractStructors(className, superclassName)    \
+    OSDefineMetaClassAndStructors(className, superclassName)
+
+#define OSMetaClassDeclareReservedUnused(className, index)                  \
+    private:                                                                \
+        virtual void _RESERVED ## className ## index()
+
+#define OSMetaClassDefineReservedUnused(className, index)                   \
+    void className::_RESERVED ## className ## index() {}
+
+#define OSDynamicCast(type, object)                                         \
+    (dynamic_cast<type *>((OSMetaClassBase *) (object)))
+
+#define OSMemberFunctionCast(cptrtype, self, func)                          \
+    ((cptrtype) OSMetaClassBase::_ptmf2ptf(self,                            \
+                    (void (OSMetaClassBase::*)(void)) (func)))
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// libkern/c++/OSContainers.h
+//
+
+class OSString : public OSObject
+{
+public:
+    static OSString * withCString(const char * cString);
+
+    const char * getCStringNoCopy() const  { return _string; }
+    unsigned     getLength() const         { return (unsigned) strlen(_string); }
+    bool         isEqualTo(const char * cString) const;
+    virtual bool isEqualTo(const OSMetaClassBase * object) const;
+    virtual void free();
+
+protected:
+    char * _string;
+};
+
+class OSSymbol : public OSString
+{
+public:
+    static const OSSymbol * withCString(const char * cString);
+    static const OSSymbol * withCStringNoCopy(const char * cString)  { return withCString(cString); }
+};
+
+class OSNumber : public OSObject
+{
+public:
+    static OSNumber * withNumber(unsigned long long value, unsigned int numberOfBits);
+
+    UInt8  unsigned8BitValue() const   { return (UInt8) _value; }
+    UInt16 unsigned16BitValue() const  { return (UInt16) _value; }
+    UInt32 unsigned32BitValue() const  { return (UInt32) _value; }
+    UInt64 unsigned64BitValue() const  { return _value; }
+    void   setValue(unsigned long long value);
+
+private:
+    UInt64   _value;
+    unsigned _size;
+};
+
+class OSBoolean : public OSObject
+{
+public:
+    OSBoolean(bool value) : _value(value) {}
+
+    bool isTrue() const    { return _value; }
+    bool isFalse() const   { return !_value; }
+    bool getValue() const  { return _value; }
+
+    // Shared constants, never freed.
+    virtual void retain() const   {}
+    virtual void release() const  {}
+
+private:
+    bool _value;
+};
+
+extern OSBoolean * const kOSBooleanTrue;
+extern OSBoolean * const kOSBooleanFalse;
+
+class OSData : public OSObject
+{
+public:
+    static OSData * withBytes(const void * bytes, unsigned int length);
+
+    const void * getBytesNoCopy() const  { return _bytes; }
+    unsigned     getLength() const       { return _length; }
+    virtual void free();
+
+private:
+    void *   _bytes;
+    unsigned _length;
+};
+
+class OSCollection : public OSObject
+{
+public:
+    virtual unsigned int getCount() const = 0;
+    virtual OSObject *   getObjectAt(unsigned int index) const = 0;
+};
+
+class OSArray : public OSCollection
+{
+public:
+    static OSArray * withCapacity(unsigned int capacity);
+
+    virtual unsigned int getCount() const  { return _count; }
+    virtual OSObject *   getObjectAt(unsigned int index) const  { return getObject(index); }
+    OSObject *           getObject(unsigned int index) const;
+    bool                 setObject(const OSMetaClassBase * object);
+    virtual void         free();
+
+private:
+    OSObject **  _objects;
+    unsigned int _count;
+    unsigned int _capacity;
+};
+
+class OSDictionary : public OSCollection
+{
+public:
+    static OSDictionary * withCapacity(unsigned int capacity);
+
+    virtual unsigned int getCount() const  { return _count; }
+    virtual OSObject *   getObjectAt(unsigned int index) const;
+
+    OSObject * getObject(const char * key) const;
+    OSObject * getObject(const OSString * key) const;
+    OSObject * getObject(const OSSymbol * key) const  { return getObject((const OSString *) key); }
+    bool       setObject(const char * key, const OSMetaClassBase * object);
+    bool       setObject(const OSString * key, const OSMetaClassBase * object);
+    bool       setObject(const OSSymbol * key, const OSMetaClassBase * object)  { return setObject((const OSString *) key, object); }
+    void       removeObject(const char * key);
+    void       removeObject(const OSString * key);
+    void       removeObject(const OSSymbol * key)  { removeObject((const OSString *) key); }
+    virtual void free();
+
+private:
+    int find(const char * key) const;
+
+    const OSSymbol ** _keys;
+    OSObject **       _objects;
+    unsigned int      _count;
+    unsigned int      _capacity;
+};
+
+class OSIterator : public OSObject
+{
+public:
+    virtual OSObject * getNextObject() = 0;
+    virtual void       reset() = 0;
+};
+
+class OSCollectionIterator : public OSIterator
+{
+public:
+    static OSCollectionIterator * withCollection(const OSCollection * collection);
+
+    virtual OSObject * getNextObject();
+    virtual void       reset()  { _index = 0; }
+    virtual void       free();
+
+private:
+    const OSCollection * _collection;
+    unsigned int         _index;
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// IOKit/IOService.h
+//
+
+class IOWorkLoop;
+
+class IORegistryEntry : public OSObject
+{
+public:
+    OSObject * getProperty(const char * key) const;
+    OSObject * getProperty(const OSString * key) const;
+    OSObject * getProperty(const OSSymbol * key) const  { return getProperty((const OSString *) key); }
+    bool       setProperty(const char * key, OSObject * object);
+    bool       setProperty(const OSString * key, OSObject * object);
+    bool       setProperty(const OSSymbol * key, OSObject * object)  { return setProperty((const OSString *) key, object); }
+    bool       setProperty(const char * key, const char * string);
+    bool       setProperty(const char * key, bool value);
+    bool       setProperty(const char * key, unsigned long long value, unsigned int numberOfBits);
+    void       removeProperty(const char * key);
+
+    virtual IOReturn setProperties(OSObject * properties)  { return kIOReturnUnsupported; }
+
+    const char * getName() const           { return _name ? _name : "IORegistryEntry"; }
+    void         setName(const char * name) { _name = name; }
+
+    virtual void free();
+
+private:
+    OSDictionary * _properties;
+    const char *   _name;
+};
+
+class IOService : public IORegistryEntry
+{
+public:
+    virtual bool        init(OSDictionary * dictionary = 0);
+    virtual IOService * probe(IOService * provider, SInt32 * score)  { return this; }
+    virtual bool        start(IOService * provider)                  { return true; }
+    virtual void        stop(IOService * provider)                   {}
+    virtual bool        attach(IOService * provider);
+    virtual void        detach(IOService * provider);
+    virtual IOWorkLoop * getWorkLoop() const;
+    IOService *         getProvider() const  { return _provider; }
+    void                registerService(IOOptionBits options = 0)  {}
+
+private:
+    IOService * _provider;
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// IOKit/IOWorkLoop.h, IOKit/IOTimerEventSource.h
+//
+
+class IOEventSource : public OSObject
+{
+public:
+    virtual void enable()   {}
+    virtual void disable()  {}
+};
+
+class IOTimerEventSource : public IOEventSource
+{
+public:
+    typedef void (*Action)(OSObject * owner, IOTimerEventSource * sender);
+
+    static IOTimerEventSource * timerEventSource(OSObject * owner, Action action = 0);
+
+    IOReturn setTimeoutUS(UInt32 microseconds);
+    IOReturn setTimeoutMS(UInt32 milliseconds);
+    void     cancelTimeout()  { _deadline = 0; }
+
+    // Benchmark interface, driven by IOWorkLoop::runTimers.
+    UInt64   deadline() const  { return _deadline; }
+    void     fire();
+
+private:
+    OSObject * _owner;
+    Action     _action;
+    UInt64     _deadline;               // virtual uptime, zero if not armed
+};
+
+class IOWorkLoop : public OSObject
+{
+public:
+    static IOWorkLoop * workLoop();
+
+    IOReturn addEventSource(IOEventSource * source);
+    IOReturn removeEventSource(IOEventSource * source);
+
+    //
+    // Benchmark interface: fire, in deadline order, the timers due before the
+    // given uptime, with the virtual clock set to each one's deadline.
+    //
+
+    void     runTimers(UInt64 until);
+    virtual void free();
+
+private:
+    IOTimerEventSource ** _timers;
+    unsigned int          _count;
+    unsigned int          _capacity;
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// IOKit/IOLocks.h, IOKit/IOBufferMemoryDescriptor.h, IOKit/IOUserClient.h
+//
+
+struct IOLock { int held; };
+
+IOLock * IOLockAlloc();
+void     IOLockFree(IOLock * lock);
+inline void IOLockLock(IOLock * lock)    { lock->held++; }
+inline void IOLockUnlock(IOLock * lock)  { lock->held--; }
+
+#define kIODirectionIn            0x1
+#define kIODirectionOut           0x2
+#define kIODirectionInOut         (kIODirectionIn | kIODirectionOut)
+#define kIOMemoryKernelUserShared 0x00000200
+
+class IOMemoryDescriptor : public OSObject
+{
+public:
+    IOByteCount getLength() const  { return _length; }
+
+protected:
+    IOByteCount _length;
+};
+
+class IOBufferMemoryDescriptor : public IOMemoryDescriptor
+{
+public:
+    static IOBufferMemoryDescriptor * withOptions(IOOptionBits options,
+                                                  size_t       capacity,
+                                                  size_t       alignment = 1);
+
+    void *       getBytesNoCopy()  { return _buffer; }
+    virtual void free();
+
+private:
+    void * _buffer;
+};
+
+typedef UInt64 io_user_reference_t;
+enum { kOSAsyncRef64Count = 8 };
+typedef io_user_reference_t OSAsyncReference64[kOSAsyncRef64Count];
+
+class IOUserClient : public IOService
+{
+public:
+    static IOReturn sendAsyncResult64(OSAsyncReference64    reference,
+                                      IOReturn              result,
+                                      io_user_reference_t * args,
+                                      UInt32                numArgs)  { return kIOReturnSuccess; }
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// IOKit/hidsystem/IOHIDParameter.h, IOKit/hidsystem/IOHIPointing.h
+//
+
+#define kIOHIDPointerResolutionKey          "HIDPointerResolution"
+#define kIOHIDPointerAccelerationTypeKey    "HIDPointerAccelerationType"
+#define kIOHIDMouseAccelerationType         "HIDMouseAcceleration"
+#define kIOHIDTrackpadAccelerationType      "HIDTrackpadAcceleration"
+#define kIOHIDScrollAccelerationTypeKey     "HIDScrollAccelerationType"
+#define kIOHIDTrackpadScrollAccelerationKey "HIDTrackpadScrollAcceleration"
+#define kIOHIDScrollResolutionKey           "HIDScrollResolution"
+
+#define NX_EVS_DEVICE_TYPE_MOUSE            1
+#define NX_EVS_DEVICE_INTERFACE_BUS_ACE     3
+
+struct IOGPoint  { SInt16 x, y; };
+struct IOGBounds { SInt16 minx, maxx, miny, maxy; };
+
+class IOHIDevice : public IOService
+{
+public:
+    virtual UInt32   deviceType()   { return 0; }
+    virtual UInt32   interfaceID()  { return 0; }
+    virtual IOReturn setParamProperties(OSDictionary * dictionary)  { return kIOReturnSuccess; }
+    virtual IOReturn setProperties(OSObject * properties);
+};
+
+class IOHIPointing : public IOHIDevice
+{
+public:
+    virtual IOItemCount buttonCount()  { return 1; }
+    virtual IOFixed     resolution()   { return 100 << 16; }
+
+protected:
+    void dispatchRelativePointerEvent(int dx, int dy, UInt32 buttonState, AbsoluteTime ts);
+    void dispatchAbsolutePointerEvent(IOGPoint *   newLoc,
+                                      IOGBounds *  bounds,
+                                      UInt32       buttonState,
+                                      bool         proximity,
+                                      int          pressure,
+                                      int          pressureMin,
+                                      int          pressureMax,
+                                      int          stylusAngle,
+                                      AbsoluteTime ts);
+    void dispatchScrollWheelEvent(short deltaAxis1, short deltaAxis2, short deltaAxis3, AbsoluteTime ts);
+
+private:
+    void countButtons(UInt32 buttonState);
+
+    UInt32 _buttonState;
+};
+
+#endif /* !_PS2BENCHKERNEL_H */
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include "VoodooPS2ALPSGlidePoint.h"
+#include "PS2BenchProfile.h"
+
+// =============================================================================
+// PS2BenchALPSGlidePointMouse Class Implementation
+//
+// A GlidePoint answering the E6 and E7 reports of a 63, 02, 50 model.
+//
+
+class PS2BenchALPSGlidePointMouse : public PS2BenchMouse
+{
+protected:
+    virtual void status(UInt8 reply[3]);
+};
+
+void PS2BenchALPSGlidePointMouse::status(UInt8 reply[3])
+{
+    static const UInt8 e6Report[] = { kDP_SetMouseScaling1To1,
+                                      kDP_SetMouseScaling1To1,
+                                      kDP_SetMouseScaling1To1 };
+    static const UInt8 e7Report[] = { kDP_SetMouseScaling2To1,
+                                      kDP_SetMouseScaling2To1,
+                                      kDP_SetMouseScaling2To1 };
+
+    if (follows(e7Report, sizeof(e7Report)))
+    {
+        reply[0] = 0x63;
+        reply[1] = 0x02;
+        reply[2] = 0x50;
+    }
+    else if (follows(e6Report, sizeof(e6Report)))
+    {
+        reply[0] = 0x00;
+        reply[1] = 0x00;
+        reply[2] = 0x64;
+    }
+    else
+        PS2BenchMouse::status(reply);
+}
+
+// =============================================================================
+// PS2BenchALPSGlidePointProfile Class Implementation
+//
+// Packets of absolute mode, x from 0 to 1000 and y from the top at 0, with
+// the pressure of two fingers above kALPSTwoFingerZ.
+//
+
+class PS2BenchALPSGlidePointProfile : public PS2BenchProfile
+{
+public:
+    virtual const char *    name() const  { return "alpsglidepoint"; }
+    virtual UInt32          packetLength() const  { return 6; }
+    virtual IOService *     createDriver() const  { return new ApplePS2ALPSGlidePoint; }
+    virtual PS2BenchMouse * createMouse() const  { return new PS2BenchALPSGlidePointMouse; }
+    virtual UInt32          encode(const PS2BenchTouch & touch, UInt8 * packet);
+};
+
+UInt32 PS2BenchALPSGlidePointProfile::encode(const PS2BenchTouch & touch, UInt8 * packet)
+{
+    int x = touch.x * 1000 / kPS2BenchTouchRange;
+    int y = kALPSMaxY - touch.y * 767 / kPS2BenchTouchRange;
+    int z = !touch.fingers ? 0 : touch.fingers >= 2 ? kALPSTwoFingerZ + 10 : touch.z;
+
+    packet[0] = 0x88;
+    packet[1] = x & 0x7f;
+    packet[2] = ((x >> 4) & 0x78) | (z ? 0x02 : 0);
+    packet[3] = ((y >> 3) & 0x70) | 0x08 | (touch.buttons & 3);
+    packet[4] = y & 0x7f;
+    packet[5] = z & 0x7f;
+    return 6;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+PS2BenchProfile * PS2BenchCreateALPSGlidePointProfile()
+{
+    return new PS2BenchALPSGlidePointProfile;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include "VoodooPS2ALPSMultiTouch.h"
+#include "PS2BenchProfile.h"
+
+// =============================================================================
+// PS2BenchALPSMultiTouchMouse Class Implementation
+//
+// A MultiTouch pad answering the E7 report of a 73, 02, 64 model.
+//
+
+class PS2BenchALPSMultiTouchMouse : public PS2BenchMouse
+{
+protected:
+    virtual void status(UInt8 reply[3]);
+};
+
+void PS2BenchALPSMultiTouchMouse::status(UInt8 reply[3])
+{
+    static const UInt8 e7Report[] = { kDP_SetMouseScaling2To1,
+                                      kDP_SetMouseScaling2To1,
+                                      kDP_SetMouseScaling2To1 };
+
+    if (follows(e7Report, sizeof(e7Report)))
+    {
+        reply[0] = 0x73;
+        reply[1] = 0x02;
+        reply[2] = 0x64;
+    }
+    else
+        PS2BenchMouse::status(reply);
+}
+
+// =============================================================================
+// PS2BenchALPSMultiTouchProfile Class Implementation
+//
+
+class PS2BenchALPSMultiTouchProfile : public PS2BenchRelativeProfile
+{
+public:
+    virtual const char *    name() const  { return "alpsmultitouch"; }
+    virtual IOService *     createDriver() const  { return new ApplePS2ALPSMultiTouch; }
+    virtual PS2BenchMouse * createMouse() const  { return new PS2BenchALPSMultiTouchMouse; }
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+PS2BenchProfile * PS2BenchCreateALPSMultiTouchProfile()
+{
+    return new PS2BenchALPSMultiTouchProfile;
+}
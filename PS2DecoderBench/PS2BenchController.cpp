@@ -0,0 +1,539 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <IOKit/IOLib.h>
+#include "PS2BenchController.h"
+
+// =============================================================================
+// PS2BenchMouse Class Implementation
+//
+
+PS2BenchMouse::PS2BenchMouse()
+{
+    bzero(_history, sizeof(_history));
+    _historyNext = 0;
+    _outputHead  = 0;
+    _outputTail  = 0;
+    _argumentOf  = 0;
+    _rates[0]    = _rates[1] = _rates[2] = 100;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void PS2BenchMouse::write(UInt8 byte)
+{
+    answer(kSC_Acknowledge);
+
+    if (_argumentOf)
+    {
+        if (_argumentOf == kDP_SetMouseSampleRate)
+        {
+            _rates[0] = _rates[1];
+            _rates[1] = _rates[2];
+            _rates[2] = byte;
+        }
+        _argumentOf = 0;
+    }
+    else
+    {
+        switch (byte)
+        {
+            case kDP_GetMouseInformation:
+            {
+                UInt8 reply[3];
+                status(reply);
+                answer(reply[0]);
+                answer(reply[1]);
+                answer(reply[2]);
+                break;
+            }
+
+            case kDP_GetId:
+                answer(deviceId());
+                break;
+
+            case kDP_Reset:
+                answer(kSC_Reset);
+                answer(0x00);
+                break;
+        }
+
+        if (takesArgument(byte))
+            _argumentOf = byte;
+        command(byte);
+    }
+
+    _history[_historyNext++ & (kHistorySize - 1)] = byte;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool PS2BenchMouse::read(UInt8 * byte)
+{
+    if (_outputHead == _outputTail)  return false;
+
+    *byte = _output[_outputTail++ & (kOutputSize - 1)];
+    return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void PS2BenchMouse::answer(UInt8 byte)
+{
+    if (_outputHead - _outputTail < kOutputSize)
+        _output[_outputHead++ & (kOutputSize - 1)] = byte;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool PS2BenchMouse::follows(const UInt8 * bytes, unsigned int count) const
+{
+    for (unsigned int index = 0; index < count; index++)
+        if (written(count - 1 - index) != bytes[index])
+            return false;
+    return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void PS2BenchMouse::status(UInt8 reply[3])
+{
+    // Stream mode, reporting disabled, 4 counts/mm, 100 reports/s.
+    reply[0] = 0x00;
+    reply[1] = 0x02;
+    reply[2] = 0x64;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool PS2BenchMouse::takesArgument(UInt8 byte) const
+{
+    return byte == kDP_SetMouseResolution || byte == kDP_SetMouseSampleRate;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+UInt8 PS2BenchMouse::deviceId() const
+{
+    // The Intellimouse knocks: 200, 100, 80 for the wheel, 200, 200, 80 for
+    // the five button (Explorer) mode.
+
+    if (_rates[0] == 200 && _rates[1] == 100 && _rates[2] == 80)  return 3;
+    if (_rates[0] == 200 && _rates[1] == 200 && _rates[2] == 80)  return 4;
+    return 0;
+}
+
+// =============================================================================
+// ApplePS2Controller Class Implementation
+//
+
+#define super IOService
+OSDefineMetaClassAndStructors(ApplePS2Controller, IOService);
+
+bool ApplePS2Controller::init(OSDictionary * dictionary)
+{
+    if (!super::init(dictionary))  return false;
+
+    _commandByte = kCB_EnableKeyboardIRQ | kCB_SystemFlag | kCB_TranslateMode;
+    _trace.init();
+
+    for (unsigned int index = 0; index < kRequestPoolSize; index++)
+        _requestFree[index] = &_requestPool[index];
+    _requestFreeCount  = kRequestPoolSize;
+    _requestQueueCount = 0;
+
+    setName("ApplePS2Controller");
+    return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::free()
+{
+    _trace.free();
+    super::free();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2Controller::allocateTrace(UInt32 records, UInt32 mask)
+{
+    return _trace.allocate(records, mask);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::identifyMouse(ApplePS2MouseDevice * nub)
+{
+    //
+    // The queries of the real controller's identifyMouse, on the same model,
+    // so the drivers' probes see the identity they see on the machine.
+    //
+
+    static const UInt8 synapticsKnock[] = { kDP_SetMouseResolution, 0,
+                                            kDP_SetMouseResolution, 0,
+                                            kDP_SetMouseResolution, 0,
+                                            kDP_SetMouseResolution, 0 };
+    static const UInt8 e6Knock[]        = { kDP_SetMouseResolution, 0,
+                                            kDP_SetMouseScaling1To1,
+                                            kDP_SetMouseScaling1To1,
+                                            kDP_SetMouseScaling1To1 };
+    static const UInt8 e7Knock[]        = { kDP_SetMouseResolution, 0,
+                                            kDP_SetMouseScaling2To1,
+                                            kDP_SetMouseScaling2To1,
+                                            kDP_SetMouseScaling2To1 };
+    static const struct { const UInt8 * knock; unsigned count; } queries[] =
+    {
+        { synapticsKnock, sizeof(synapticsKnock) },
+        { e6Knock,        sizeof(e6Knock)        },
+        { e7Knock,        sizeof(e7Knock)        }
+    };
+
+    PS2MouseIdentity identity;
+    bool *           valid[3] = { &identity.synapticsValid, &identity.e6Valid, &identity.e7Valid };
+    UInt8 *          info[3]  = { identity.synaptics, identity.e6, identity.e7 };
+
+    bzero(&identity, sizeof(identity));
+
+    for (unsigned int query = 0; query < 3; query++)
+    {
+        PS2Request request;
+        unsigned   index;
+
+        bzero(&request, sizeof(request));
+        for (index = 0; index < queries[query].count; index++)
+        {
+            request.commands[index].command = kPS2C_SendMouseCommandAndCompareAck;
+            request.commands[index].inOrOut = queries[query].knock[index];
+        }
+        request.commands[index].command   = kPS2C_SendMouseCommandAndCompareAck;
+        request.commands[index++].inOrOut = kDP_GetMouseInformation;
+        request.commands[index++].command = kPS2C_ReadDataPort;
+        request.commands[index++].command = kPS2C_ReadDataPort;
+        request.commands[index++].command = kPS2C_ReadDataPort;
+        request.commandsCount = index;
+
+        processRequest(&request);
+
+        *valid[query] = (request.commandsCount == index);
+        if (*valid[query])
+        {
+            info[query][0] = request.commands[index - 3].inOrOut;
+            info[query][1] = request.commands[index - 2].inOrOut;
+            info[query][2] = request.commands[index - 1].inOrOut;
+        }
+    }
+
+    PS2Request request;
+    bzero(&request, sizeof(request));
+    request.commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
+    request.commands[0].inOrOut = kDP_SetDefaultsAndDisable;
+    request.commandsCount = 1;
+    processRequest(&request);
+
+    nub->setIdentity(&identity);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::dispatch(const UInt8 * data, UInt32 count)
+{
+    //
+    // Hand bytes read from the mouse port to the driver, as dispatchDriverInterrupt
+    // does on the machine, tracing them first.
+    //
+
+    _trace.add(kPS2TraceMouseByte, 0, data, count);
+
+    _dispatching = true;
+    if (_batchAction && !_perByte)
+    {
+        (*_batchAction)(_batchTarget, data, count);
+    }
+    else if (_interruptAction)
+    {
+        for (UInt32 index = 0; index < count; index++)
+            (*_interruptAction)(_interruptTarget, data[index]);
+    }
+    _dispatching = false;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::installInterruptAction(OSObject *         target,
+                                                PS2InterruptAction action)
+{
+    target->retain();
+    _interruptTarget = target;
+    _interruptAction = action;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::uninstallInterruptAction()
+{
+    if (!_interruptAction)  return;
+
+    _interruptAction = 0;
+    _interruptTarget->release();
+    _interruptTarget = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::installBatchInterruptAction(OSObject *              target,
+                                                     PS2BatchInterruptAction action)
+{
+    target->retain();
+    _batchTarget = target;
+    _batchAction = action;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::uninstallBatchInterruptAction()
+{
+    if (!_batchAction)  return;
+
+    _batchAction = 0;
+    _batchTarget->release();
+    _batchTarget = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::installPowerControlAction(OSObject *            target,
+                                                   PS2PowerControlAction action)
+{
+    // (the benchmark never changes power state)
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::uninstallPowerControlAction()
+{
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+PS2Request * ApplePS2Controller::allocateRequest()
+{
+    PS2Request * request;
+
+    if (_requestFreeCount)
+        request = _requestFree[--_requestFreeCount];
+    else
+        request = (PS2Request *) IOMalloc(sizeof(PS2Request));
+
+    bzero(request, sizeof(PS2Request));
+    return request;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::freeRequest(PS2Request * request)
+{
+    if (request >= _requestPool && request < _requestPool + kRequestPoolSize)
+        _requestFree[_requestFreeCount++] = request;
+    else
+        IOFree(request, sizeof(PS2Request));
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2Controller::submitRequest(PS2Request * request)
+{
+    //
+    // Queue the request for processRequests, dropping a superseded one as the
+    // real controller's scheduler does.
+    //
+
+    for (unsigned int index = 0; request->coalesceKey && index < _requestQueueCount; index++)
+    {
+        PS2Request * queued = _requestQueue[index];
+        if (queued->coalesceKey == request->coalesceKey &&
+            queued->priority == request->priority &&
+            !queued->completionAction)
+        {
+            freeRequest(queued);
+            _requestQueueCount--;
+            for (; index < _requestQueueCount; index++)
+                _requestQueue[index] = _requestQueue[index + 1];
+            break;
+        }
+    }
+
+    if (_requestQueueCount == kRequestQueueSize)
+        processRequests();
+
+    _requestQueue[_requestQueueCount++] = request;
+    return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2Controller::submitRequest(PS2Request *        request,
+                                       void *              target,
+                                       PS2CompletionAction action,
+                                       void *              param)
+{
+    request->completionTarget = target;
+    request->completionAction = action;
+    request->completionParam  = param;
+    return submitRequest(request);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::submitRequestAndBlock(PS2Request * request)
+{
+    // Behind whatever is queued already, like on the machine.
+    processRequests();
+    processRequest(request);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::processRequests()
+{
+    unsigned int index = 0;
+
+    // (completion routines may queue more requests meanwhile)
+    while (index < _requestQueueCount)
+    {
+        PS2Request * request = _requestQueue[index++];
+        processRequest(request);
+        completeRequest(request);
+    }
+    _requestQueueCount = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::completeRequest(PS2Request * request)
+{
+    if (request->completionAction)
+        (*request->completionAction)(request->completionTarget, request->completionParam);
+    else
+        freeRequest(request);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::updateCommandByte(UInt8 setBits, UInt8 clearBits)
+{
+    _commandByte = (_commandByte | setBits) & ~clearBits;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::processRequest(PS2Request * request)
+{
+    //
+    // Run the request's commands against the mouse model.  Only what the
+    // pointing drivers send is understood: bytes for the mouse, through
+    // kCP_TransmitToMouse or kPS2C_SendMouseCommandAndCompareAck, and the
+    // controller's command byte.
+    //
+
+    bool  toMouse       = false;
+    bool  toCommandByte = false;
+    bool  commandByte   = false;
+    UInt8 byte;
+    UInt8 index;
+
+    for (index = 0; index < request->commandsCount; index++)
+    {
+        PS2Command * command = &request->commands[index];
+        bool         failed  = false;
+
+        switch (command->command)
+        {
+            case kPS2C_ReadDataPort:
+            case kPS2C_ReadDataPortAndCompare:
+                if (commandByte)
+                {
+                    byte = _commandByte;
+                    commandByte = false;
+                }
+                else if (!_mouse->read(&byte))
+                {
+                    failed = true;
+                    break;
+                }
+                if (command->command == kPS2C_ReadDataPort)
+                    command->inOrOut = byte;
+                else if (byte != command->inOrOut)
+                    failed = true;
+                break;
+
+            case kPS2C_WriteDataPort:
+                if (toMouse)
+                    _mouse->write(command->inOrOut);
+                else if (toCommandByte)
+                    _commandByte = command->inOrOut;
+                toMouse = toCommandByte = false;
+                break;
+
+            case kPS2C_WriteCommandPort:
+                toMouse       = (command->inOrOut == kCP_TransmitToMouse);
+                toCommandByte = (command->inOrOut == kCP_SetCommandByte);
+                commandByte   = (command->inOrOut == kCP_GetCommandByte);
+                break;
+
+            case kPS2C_SendMouseCommandAndCompareAck:
+                _mouse->write(command->inOrOut);
+                failed = !_mouse->read(&byte) || byte != kSC_Acknowledge;
+                break;
+
+            case kPS2C_ModifyCommandByte:
+                if (index + 1 < request->commandsCount)
+                {
+                    updateCommandByte(command->inOrOut, request->commands[index + 1].inOrOut);
+                    index++;
+                }
+                break;
+        }
+
+        if (failed)  break;
+    }
+    request->commandsCount = index;
+
+    flushMouseOutput();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::flushMouseOutput()
+{
+    //
+    // Whatever the mouse said that the request did not read arrives as input.
+    //
+
+    UInt8 byte;
+
+    while (_mouse->read(&byte))
+    {
+        if (!_dispatching)
+            dispatch(&byte, 1);
+    }
+}
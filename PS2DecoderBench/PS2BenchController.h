@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef _PS2BENCHCONTROLLER_H
+#define _PS2BENCHCONTROLLER_H
+
+#include "ApplePS2MouseDevice.h"
+#include "ApplePS2Trace.h"
+
+// As in VoodooPS2Controller.h, for the request's device field.
+typedef enum { kDT_Keyboard, kDT_Mouse } PS2DeviceType;
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PS2BenchMouse Class Description
+//
+// Model of the device on the mouse port, as far as the drivers talk to it
+// before streaming: every byte written is acknowledged, kDP_SetMouseResolution
+// and kDP_SetMouseSampleRate take an argument byte, kDP_GetId answers after
+// the Intellimouse knocks, and kDP_Reset answers the self test.  Subclasses
+// answer the kDP_GetMouseInformation queries of their protocol.
+//
+// o  write:
+//    o  Description:  A byte written to the mouse (after kCP_TransmitToMouse).
+//
+// o  read:
+//    o  Description:  Take the next byte of the mouse's answers.
+//    o  Result:       False if there is none (the real port would time out).
+//
+// o  status:
+//    o  Description:  Answer kDP_GetMouseInformation, looking back at the bytes
+//                     written before it with written().  The default is the
+//                     standard status of a stream mode mouse.
+//
+// o  command:
+//    o  Description:  Called for every byte written that is not an argument,
+//                     after it is acknowledged, so subclasses can track
+//                     register writes and similar sequences.
+//
+// o  takesArgument:
+//    o  Description:  Whether the next byte after this command is its argument.
+//
+
+class PS2BenchMouse
+{
+public:
+    PS2BenchMouse();
+    virtual ~PS2BenchMouse() {}
+
+    void  write(UInt8 byte);
+    bool  read(UInt8 * byte);
+    bool  pending() const  { return _outputHead != _outputTail; }
+
+protected:
+    virtual void  status(UInt8 reply[3]);
+    virtual void  command(UInt8 byte)  {}
+    virtual bool  takesArgument(UInt8 byte) const;
+    virtual UInt8 deviceId() const;
+
+    // Byte written before the current one, 0 being the latest.
+    UInt8 written(unsigned int back) const
+    {
+        return _history[(_historyNext - 1 - back) & (kHistorySize - 1)];
+    }
+
+    // Whether the bytes written just before the current one are these.
+    bool  follows(const UInt8 * bytes, unsigned int count) const;
+
+    void  answer(UInt8 byte);
+
+private:
+    enum { kHistorySize = 32, kOutputSize = 64 };
+
+    UInt8        _history[kHistorySize];
+    unsigned int _historyNext;
+    UInt8        _output[kOutputSize];
+    unsigned int _outputHead;
+    unsigned int _outputTail;
+    UInt8        _argumentOf;           // command awaiting its argument, or 0
+    UInt8        _rates[3];             // last sample rates set
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// ApplePS2Controller Class Description
+//
+// Stand-in for the controller behind the mouse nub.  Keeps the interface the
+// nub forwards to, without the device type argument since there is only the
+// mouse.  Requests are run against the PS2BenchMouse model: blocking ones at
+// once, the others from processRequests(), which the benchmark calls after
+// every delivery as the work loop would.  Any bytes the mouse answered that a
+// request did not read are delivered to the driver as input, like the real
+// port would.  Requests come from a small pool, so the steady state costs no
+// allocation unless the driver holds on to more than the pool.
+//
+// o  identifyMouse:
+//    o  Description:  Send the controller's identification queries and pass
+//                     their results to the nub, as the real controller does
+//                     before registering it.
+//
+// o  dispatch:
+//    o  Description:  Deliver bytes read from the mouse port to the driver,
+//                     through its batch action if it installed one.
+//
+// o  setDeliverPerByte:
+//    o  Description:  Ignore the batch action, to measure per-byte delivery.
+//
+
+class ApplePS2Controller : public IOService
+{
+    OSDeclareDefaultStructors(ApplePS2Controller);
+
+public:
+    void setMouse(PS2BenchMouse * mouse)  { _mouse = mouse; }
+    bool allocateTrace(UInt32 records, UInt32 mask);
+    void identifyMouse(ApplePS2MouseDevice * nub);
+    void dispatch(const UInt8 * data, UInt32 count);
+    void processRequests();
+    void setDeliverPerByte(bool perByte)  { _perByte = perByte; }
+    bool batchInstalled() const  { return _batchAction != 0; }
+
+    // The interface of ApplePS2MouseDevice, as forwarded by it.
+
+    void installInterruptAction(OSObject * target, PS2InterruptAction action);
+    void uninstallInterruptAction();
+    void installBatchInterruptAction(OSObject * target, PS2BatchInterruptAction action);
+    void uninstallBatchInterruptAction();
+    void installPowerControlAction(OSObject * target, PS2PowerControlAction action);
+    void uninstallPowerControlAction();
+
+    PS2Request * allocateRequest();
+    void         freeRequest(PS2Request * request);
+    bool         submitRequest(PS2Request * request);
+    bool         submitRequest(PS2Request *        request,
+                               void *              target,
+                               PS2CompletionAction action,
+                               void *              param);
+    void         submitRequestAndBlock(PS2Request * request);
+    void         updateCommandByte(UInt8 setBits, UInt8 clearBits);
+
+    PS2TraceBuffer * getTraceBuffer()  { return &_trace; }
+
+    virtual bool init(OSDictionary * dictionary = 0);
+    virtual void free();
+
+private:
+    enum { kRequestPoolSize = 8, kRequestQueueSize = 32 };
+
+    void processRequest(PS2Request * request);
+    void completeRequest(PS2Request * request);
+    void flushMouseOutput();
+
+    PS2BenchMouse *         _mouse;
+    OSObject *              _interruptTarget;
+    PS2InterruptAction      _interruptAction;
+    OSObject *              _batchTarget;
+    PS2BatchInterruptAction _batchAction;
+    bool                    _perByte;
+    bool                    _dispatching;
+    UInt8                   _commandByte;
+    PS2TraceBuffer          _trace;
+
+    PS2Request              _requestPool[kRequestPoolSize];
+    PS2Request *            _requestFree[kRequestPoolSize];
+    unsigned int            _requestFreeCount;
+    PS2Request *            _requestQueue[kRequestQueueSize];
+    unsigned int            _requestQueueCount;
+};
+
+#endif /* !_PS2BENCHCONTROLLER_H */
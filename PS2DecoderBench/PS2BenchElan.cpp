@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include "VoodooPS2ElanTrackpad.h"
+#include "PS2BenchProfile.h"
+
+// =============================================================================
+// PS2BenchElanMouse Class Implementation
+//
+// A hardware version 3 pad (firmware 0x450f01) of 1470 by 700, answering the
+// magic knock, the Synaptics style firmware query, the ETP_PS2_CUSTOM_COMMAND
+// queries and its register file.
+//
+
+class PS2BenchElanMouse : public PS2BenchMouse
+{
+public:
+    PS2BenchElanMouse();
+
+protected:
+    virtual void status(UInt8 reply[3]);
+    virtual void command(UInt8 byte);
+    virtual bool takesArgument(UInt8 byte) const;
+
+private:
+    static void reply3(UInt8 reply[3], UInt8 byte0, UInt8 byte1, UInt8 byte2);
+
+    UInt8 _registers[256];
+};
+
+PS2BenchElanMouse::PS2BenchElanMouse()
+{
+    bzero(_registers, sizeof(_registers));
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void PS2BenchElanMouse::reply3(UInt8 reply[3], UInt8 byte0, UInt8 byte1, UInt8 byte2)
+{
+    reply[0] = byte0;
+    reply[1] = byte1;
+    reply[2] = byte2;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool PS2BenchElanMouse::takesArgument(UInt8 byte) const
+{
+    return byte == ETP_PS2_CUSTOM_COMMAND || PS2BenchMouse::takesArgument(byte);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void PS2BenchElanMouse::status(UInt8 reply[3])
+{
+    static const UInt8 magicKnock[] = { kDP_SetDefaults,
+                                        kDP_SetDefaultsAndDisable,
+                                        kDP_SetMouseScaling1To1,
+                                        kDP_SetMouseScaling1To1,
+                                        kDP_SetMouseScaling1To1 };
+    static const UInt8 registerRead[] = { ETP_PS2_CUSTOM_COMMAND,
+                                          ETP_REGISTER_READWRITE,
+                                          ETP_PS2_CUSTOM_COMMAND };
+
+    if (follows(magicKnock, sizeof(magicKnock)))
+    {
+        reply3(reply, 0x3c, 0x03, 0xc8);
+    }
+    else if (written(8) == kDP_SetMouseScaling1To1 &&
+             written(7) == kDP_SetMouseResolution && written(5) == kDP_SetMouseResolution &&
+             written(3) == kDP_SetMouseResolution && written(1) == kDP_SetMouseResolution)
+    {
+        // psmouse_sliced_command, of which only the version is asked.
+        UInt8 query = ((written(6) & 3) << 6) | ((written(4) & 3) << 4) |
+                      ((written(2) & 3) << 2) |  (written(0) & 3);
+        if (query == ETP_FW_VERSION_QUERY)
+            reply3(reply, 0x45, 0x0f, 0x01);
+        else
+            PS2BenchMouse::status(reply);
+    }
+    else if (written(3) == registerRead[0] && written(2) == registerRead[1] &&
+             written(1) == registerRead[2])
+    {
+        reply3(reply, _registers[written(0)], 0x00, 0x00);
+    }
+    else if (written(1) == ETP_PS2_CUSTOM_COMMAND)
+    {
+        switch (written(0))
+        {
+            case ETP_FW_ID_QUERY:           // x_max 1470, y_max 700
+                reply3(reply, 0x25, 0xbe, 0xbc);
+                break;
+            case ETP_CAPABILITIES_QUERY:
+                reply3(reply, 0x00, 0x15, 0x0c);
+                break;
+            default:
+                PS2BenchMouse::status(reply);
+                break;
+        }
+    }
+    else
+        PS2BenchMouse::status(reply);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void PS2BenchElanMouse::command(UInt8 byte)
+{
+    // F8 00 F8 <register> F8 <value> E6 writes on version 3.
+    if (byte == kDP_SetMouseScaling1To1 &&
+        written(5) == ETP_PS2_CUSTOM_COMMAND && written(4) == ETP_REGISTER_READWRITE &&
+        written(3) == ETP_PS2_CUSTOM_COMMAND && written(1) == ETP_PS2_CUSTOM_COMMAND)
+    {
+        _registers[written(2)] = written(0);
+    }
+}
+
+// =============================================================================
+// PS2BenchElanProfile Class Implementation
+//
+// Version 3 packets: a head packet for one finger, or for none, and a head
+// and tail packet for two.  The pad reports y from the bottom.
+//
+
+#define kPS2BenchElanMaxX  1470
+#define kPS2BenchElanMaxY  700
+
+class PS2BenchElanProfile : public PS2BenchProfile
+{
+public:
+    virtual const char *    name() const  { return "elan"; }
+    virtual UInt32          packetLength() const  { return 6; }
+    virtual IOService *     createDriver() const  { return new ApplePS2ElanTrackpad; }
+    virtual PS2BenchMouse * createMouse() const  { return new PS2BenchElanMouse; }
+    virtual UInt32          encode(const PS2BenchTouch & touch, UInt8 * packet);
+
+private:
+    static void encodeFinger(UInt8 * packet, UInt8 type, int fingers, int x, int y,
+                             int pressure, UInt32 buttons);
+};
+
+void PS2BenchElanProfile::encodeFinger(UInt8 * packet, UInt8 type, int fingers, int x, int y,
+                                       int pressure, UInt32 buttons)
+{
+    packet[0] = (fingers << 6) | type | (buttons & 3);
+    packet[1] = (pressure & 0xf0) | ((x >> 8) & 0x0f);
+    packet[2] = x & 0xff;
+    packet[3] = type == 0x04 ? 0x02 : 0x0c;
+    packet[4] = ((pressure & 0x0f) << 4) | ((y >> 8) & 0x0f);
+    packet[5] = y & 0xff;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+UInt32 PS2BenchElanProfile::encode(const PS2BenchTouch & touch, UInt8 * packet)
+{
+    int fingers = touch.fingers > 2 ? 2 : touch.fingers;
+
+    if (!fingers)
+    {
+        encodeFinger(packet, 0x04, 0, 0, 0, 0, touch.buttons);
+        return 6;
+    }
+
+    // (the driver takes a coordinate of 0 for no finger)
+    int x = 1 + touch.x * (kPS2BenchElanMaxX - 2) / kPS2BenchTouchRange;
+    int y = 1 + touch.y * (kPS2BenchElanMaxY - 2) / kPS2BenchTouchRange;
+
+    encodeFinger(packet, 0x04, fingers, x, y, touch.z, touch.buttons);
+    if (fingers == 1)
+        return 6;
+
+    x = x + 200 < kPS2BenchElanMaxX ? x + 200 : x - 200;
+    encodeFinger(packet + 6, 0x0c, fingers, x, y, touch.z, touch.buttons);
+    return 12;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+PS2BenchProfile * PS2BenchCreateElanProfile()
+{
+    return new PS2BenchElanProfile;
+}
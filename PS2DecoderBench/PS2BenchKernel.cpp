@@ -0,0 +1,840 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include "PS2BenchKernel.h"
+
+// =============================================================================
+// Benchmark Accounting
+//
+
+PS2BenchCounters gPS2BenchCounters;
+bool             gPS2BenchCounting = false;
+bool             gPS2BenchVerbose  = false;
+UInt64           gPS2BenchClock    = 0;
+unsigned long    page_size         = 4096;
+
+static IOWorkLoop * gPS2BenchWorkLoop = 0;
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void * PS2BenchAllocate(size_t size)
+{
+    if (gPS2BenchCounting)
+    {
+        gPS2BenchCounters.allocations++;
+        gPS2BenchCounters.allocatedBytes += size;
+    }
+    return calloc(1, size ? size : 1);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void PS2BenchFree(void * address)
+{
+    free(address);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Any allocation made with the C++ operators is a driver-side one too, so the
+// global operators count as well.
+
+void * operator new(size_t size) throw(std::bad_alloc)
+{
+    return PS2BenchAllocate(size);
+}
+
+void * operator new[](size_t size) throw(std::bad_alloc)
+{
+    return PS2BenchAllocate(size);
+}
+
+void operator delete(void * address) throw()
+{
+    PS2BenchFree(address);
+}
+
+void operator delete[](void * address) throw()
+{
+    PS2BenchFree(address);
+}
+
+// =============================================================================
+// IOLib
+//
+
+extern "C" void IOLog(const char * format, ...)
+{
+    gPS2BenchCounters.logs++;
+    if (!gPS2BenchVerbose)  return;
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+extern "C" void IOSleep(unsigned milliseconds)
+{
+    gPS2BenchClock += (UInt64) milliseconds * 1000000;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+extern "C" void IODelay(unsigned microseconds)
+{
+    gPS2BenchClock += (UInt64) microseconds * 1000;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+extern "C" void * IOMalloc(size_t size)
+{
+    return PS2BenchAllocate(size);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+extern "C" void IOFree(void * address, size_t size)
+{
+    PS2BenchFree(address);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+extern "C" void clock_get_uptime(uint64_t * result)
+{
+    *result = gPS2BenchClock;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+extern "C" void absolutetime_to_nanoseconds(uint64_t abstime, uint64_t * result)
+{
+    *result = abstime;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+extern "C" void nanoseconds_to_absolutetime(uint64_t nanoseconds, uint64_t * result)
+{
+    *result = nanoseconds;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOLock * IOLockAlloc()
+{
+    return (IOLock *) PS2BenchAllocate(sizeof(IOLock));
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void IOLockFree(IOLock * lock)
+{
+    PS2BenchFree(lock);
+}
+
+// =============================================================================
+// OSMetaClassBase, OSObject
+//
+
+OSMetaClassBase::_ptf_function_t
+OSMetaClassBase::_ptmf2ptf(const OSMetaClassBase * self, _ptf_t function)
+{
+    //
+    // Itanium C++ ABI member function pointer: the function address, or one
+    // plus the offset of its slot in the vtable if it is virtual, and the
+    // adjustment to add to the object pointer.
+    //
+
+    union
+    {
+        _ptf_t function;
+        struct
+        {
+            uintptr_t address;
+            ptrdiff_t adjustment;
+        } parts;
+    } map;
+
+    map.function = function;
+    if (map.parts.address & 1)
+    {
+        const char *      object = (const char *) self + map.parts.adjustment;
+        const char *      vtable = *(const char * const *) object;
+        return *(const _ptf_function_t *) (vtable + map.parts.address - 1);
+    }
+    return (_ptf_function_t) map.parts.address;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void * OSObject::operator new(size_t size)
+{
+    // Kernel objects start out zeroed; the drivers rely on it.
+    return PS2BenchAllocate(size);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void OSObject::operator delete(void * address, size_t size)
+{
+    PS2BenchFree(address);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void OSObject::release() const
+{
+    if (--_retainCount == 0)
+        const_cast<OSObject *>(this)->free();
+}
+
+// =============================================================================
+// OSString, OSSymbol, OSNumber, OSBoolean, OSData
+//
+
+OSString * OSString::withCString(const char * cString)
+{
+    OSString * string = new OSString;
+    size_t     length = strlen(cString) + 1;
+
+    string->_string = (char *) PS2BenchAllocate(length);
+    memcpy(string->_string, cString, length);
+    return string;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool OSString::isEqualTo(const char * cString) const
+{
+    return strcmp(_string, cString) == 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool OSString::isEqualTo(const OSMetaClassBase * object) const
+{
+    const OSString * string = OSDynamicCast(const OSString, object);
+    return string && isEqualTo(string->_string);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void OSString::free()
+{
+    PS2BenchFree(_string);
+    OSObject::free();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+const OSSymbol * OSSymbol::withCString(const char * cString)
+{
+    OSSymbol * symbol = new OSSymbol;
+    size_t     length = strlen(cString) + 1;
+
+    symbol->_string = (char *) PS2BenchAllocate(length);
+    memcpy(symbol->_string, cString, length);
+    return symbol;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+OSNumber * OSNumber::withNumber(unsigned long long value, unsigned int numberOfBits)
+{
+    OSNumber * number = new OSNumber;
+
+    number->_size = numberOfBits;
+    number->setValue(value);
+    return number;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void OSNumber::setValue(unsigned long long value)
+{
+    _value = _size < 64 ? value & ((1ULL << _size) - 1) : value;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static OSBoolean gPS2BenchTrue(true);
+static OSBoolean gPS2BenchFalse(false);
+
+OSBoolean * const kOSBooleanTrue  = &gPS2BenchTrue;
+OSBoolean * const kOSBooleanFalse = &gPS2BenchFalse;
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+OSData * OSData::withBytes(const void * bytes, unsigned int length)
+{
+    OSData * data = new OSData;
+
+    data->_bytes  = PS2BenchAllocate(length);
+    data->_length = length;
+    memcpy(data->_bytes, bytes, length);
+    return data;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void OSData::free()
+{
+    PS2BenchFree(_bytes);
+    OSObject::free();
+}
+
+// =============================================================================
+// OSArray, OSDictionary, OSCollectionIterator
+//
+
+OSArray * OSArray::withCapacity(unsigned int capacity)
+{
+    OSArray * array = new OSArray;
+
+    array->_capacity = capacity ? capacity : 1;
+    array->_objects  = (OSObject **) PS2BenchAllocate(array->_capacity * sizeof(OSObject *));
+    return array;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+OSObject * OSArray::getObject(unsigned int index) const
+{
+    return index < _count ? _objects[index] : 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool OSArray::setObject(const OSMetaClassBase * object)
+{
+    OSObject * entry = OSDynamicCast(OSObject, object);
+    if (!entry)  return false;
+
+    if (_count == _capacity)
+    {
+        OSObject ** objects = (OSObject **) PS2BenchAllocate(2 * _capacity * sizeof(OSObject *));
+        memcpy(objects, _objects, _count * sizeof(OSObject *));
+        PS2BenchFree(_objects);
+        _objects   = objects;
+        _capacity *= 2;
+    }
+    entry->retain();
+    _objects[_count++] = entry;
+    return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void OSArray::free()
+{
+    for (unsigned int index = 0; index < _count; index++)
+        _objects[index]->release();
+    PS2BenchFree(_objects);
+    OSObject::free();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+OSDictionary * OSDictionary::withCapacity(unsigned int capacity)
+{
+    OSDictionary * dictionary = new OSDictionary;
+
+    dictionary->_capacity = capacity ? capacity : 1;
+    dictionary->_keys     = (const OSSymbol **) PS2BenchAllocate(dictionary->_capacity * sizeof(OSSymbol *));
+    dictionary->_objects  = (OSObject **) PS2BenchAllocate(dictionary->_capacity * sizeof(OSObject *));
+    return dictionary;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+int OSDictionary::find(const char * key) const
+{
+    for (unsigned int index = 0; index < _count; index++)
+        if (_keys[index]->isEqualTo(key))
+            return (int) index;
+    return -1;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+OSObject * OSDictionary::getObjectAt(unsigned int index) const
+{
+    return index < _count ? (OSObject *) _keys[index] : 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+OSObject * OSDictionary::getObject(const char * key) const
+{
+    int index = find(key);
+    return index < 0 ? 0 : _objects[index];
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+OSObject * OSDictionary::getObject(const OSString * key) const
+{
+    return key ? getObject(key->getCStringNoCopy()) : 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool OSDictionary::setObject(const char * key, const OSMetaClassBase * object)
+{
+    OSObject * entry = OSDynamicCast(OSObject, object);
+    if (!key || !entry)  return false;
+
+    entry->retain();
+
+    int index = find(key);
+    if (index >= 0)
+    {
+        _objects[index]->release();
+        _objects[index] = entry;
+        return true;
+    }
+
+    if (_count == _capacity)
+    {
+        const OSSymbol ** keys    = (const OSSymbol **) PS2BenchAllocate(2 * _capacity * sizeof(OSSymbol *));
+        OSObject **       objects = (OSObject **) PS2BenchAllocate(2 * _capacity * sizeof(OSObject *));
+        memcpy(keys, _keys, _count * sizeof(OSSymbol *));
+        memcpy(objects, _objects, _count * sizeof(OSObject *));
+        PS2BenchFree(_keys);
+        PS2BenchFree(_objects);
+        _keys      = keys;
+        _objects   = objects;
+        _capacity *= 2;
+    }
+    _keys[_count]    = OSSymbol::withCString(key);
+    _objects[_count] = entry;
+    _count++;
+    return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool OSDictionary::setObject(const OSString * key, const OSMetaClassBase * object)
+{
+    return key && setObject(key->getCStringNoCopy(), object);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void OSDictionary::removeObject(const char * key)
+{
+    int index = find(key);
+    if (index < 0)  return;
+
+    _keys[index]->release();
+    _objects[index]->release();
+    _count--;
+    for (unsigned int next = index; next < _count; next++)
+    {
+        _keys[next]    = _keys[next + 1];
+        _objects[next] = _objects[next + 1];
+    }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void OSDictionary::removeObject(const OSString * key)
+{
+    if (key)  removeObject(key->getCStringNoCopy());
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void OSDictionary::free()
+{
+    for (unsigned int index = 0; index < _count; index++)
+    {
+        _keys[index]->release();
+        _objects[index]->release();
+    }
+    PS2BenchFree(_keys);
+    PS2BenchFree(_objects);
+    OSObject::free();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+OSCollectionIterator * OSCollectionIterator::withCollection(const OSCollection * collection)
+{
+    if (!collection)  return 0;
+
+    OSCollectionIterator * iterator = new OSCollectionIterator;
+    collection->retain();
+    iterator->_collection = collection;
+    return iterator;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+OSObject * OSCollectionIterator::getNextObject()
+{
+    return _collection->getObjectAt(_index++);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void OSCollectionIterator::free()
+{
+    _collection->release();
+    OSObject::free();
+}
+
+// =============================================================================
+// IORegistryEntry, IOService
+//
+
+OSObject * IORegistryEntry::getProperty(const char * key) const
+{
+    return _properties ? _properties->getObject(key) : 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+OSObject * IORegistryEntry::getProperty(const OSString * key) const
+{
+    return _properties ? _properties->getObject(key) : 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool IORegistryEntry::setProperty(const char * key, OSObject * object)
+{
+    if (!_properties)
+        _properties = OSDictionary::withCapacity(8);
+    return _properties->setObject(key, object);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool IORegistryEntry::setProperty(const OSString * key, OSObject * object)
+{
+    return key && setProperty(key->getCStringNoCopy(), object);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool IORegistryEntry::setProperty(const char * key, const char * string)
+{
+    OSString * object = OSString::withCString(string);
+    bool       result = setProperty(key, object);
+    object->release();
+    return result;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool IORegistryEntry::setProperty(const char * key, bool value)
+{
+    return setProperty(key, value ? kOSBooleanTrue : kOSBooleanFalse);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool IORegistryEntry::setProperty(const char * key, unsigned long long value, unsigned int numberOfBits)
+{
+    OSNumber * object = OSNumber::withNumber(value, numberOfBits);
+    bool       result = setProperty(key, object);
+    object->release();
+    return result;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void IORegistryEntry::removeProperty(const char * key)
+{
+    if (_properties)  _properties->removeObject(key);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void IORegistryEntry::free()
+{
+    if (_properties)
+    {
+        _properties->release();
+        _properties = 0;
+    }
+    OSObject::free();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool IOService::init(OSDictionary * dictionary)
+{
+    if (!OSObject::init())  return false;
+
+    //
+    // Like the kernel, start from the personality's properties.
+    //
+
+    if (dictionary)
+    {
+        OSCollectionIterator * iterator = OSCollectionIterator::withCollection(dictionary);
+        OSString *             key;
+
+        while ((key = OSDynamicCast(OSString, iterator->getNextObject())))
+            setProperty(key, dictionary->getObject(key));
+        iterator->release();
+    }
+    return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool IOService::attach(IOService * provider)
+{
+    if (_provider)  return false;
+
+    provider->retain();
+    _provider = provider;
+    return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void IOService::detach(IOService * provider)
+{
+    if (_provider != provider)  return;
+
+    _provider->release();
+    _provider = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOWorkLoop * IOService::getWorkLoop() const
+{
+    //
+    // A single work loop, owning every timer, so the benchmark can fire them
+    // in order from one place.
+    //
+
+    if (!gPS2BenchWorkLoop)
+        gPS2BenchWorkLoop = IOWorkLoop::workLoop();
+    return gPS2BenchWorkLoop;
+}
+
+// =============================================================================
+// IOTimerEventSource, IOWorkLoop
+//
+
+IOTimerEventSource * IOTimerEventSource::timerEventSource(OSObject * owner, Action action)
+{
+    IOTimerEventSource * timer = new IOTimerEventSource;
+
+    timer->_owner  = owner;
+    timer->_action = action;
+    return timer;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn IOTimerEventSource::setTimeoutUS(UInt32 microseconds)
+{
+    _deadline = gPS2BenchClock + (UInt64) microseconds * 1000;
+    if (!_deadline)  _deadline = 1;
+    return kIOReturnSuccess;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn IOTimerEventSource::setTimeoutMS(UInt32 milliseconds)
+{
+    return setTimeoutUS(milliseconds * 1000);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void IOTimerEventSource::fire()
+{
+    _deadline = 0;
+    gPS2BenchCounters.timers++;
+    if (_action)
+        _action(_owner, this);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOWorkLoop * IOWorkLoop::workLoop()
+{
+    IOWorkLoop * workLoop = new IOWorkLoop;
+
+    workLoop->_capacity = 8;
+    workLoop->_timers   = (IOTimerEventSource **) PS2BenchAllocate(workLoop->_capacity * sizeof(IOTimerEventSource *));
+    return workLoop;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn IOWorkLoop::addEventSource(IOEventSource * source)
+{
+    IOTimerEventSource * timer = OSDynamicCast(IOTimerEventSource, source);
+    if (!timer)  return kIOReturnSuccess;
+
+    if (_count == _capacity)
+    {
+        IOTimerEventSource ** timers = (IOTimerEventSource **) PS2BenchAllocate(2 * _capacity * sizeof(IOTimerEventSource *));
+        memcpy(timers, _timers, _count * sizeof(IOTimerEventSource *));
+        PS2BenchFree(_timers);
+        _timers    = timers;
+        _capacity *= 2;
+    }
+    timer->retain();
+    _timers[_count++] = timer;
+    return kIOReturnSuccess;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn IOWorkLoop::removeEventSource(IOEventSource * source)
+{
+    for (unsigned int index = 0; index < _count; index++)
+    {
+        if (_timers[index] != source)  continue;
+
+        _timers[index]->release();
+        _timers[index] = _timers[--_count];
+        break;
+    }
+    return kIOReturnSuccess;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void IOWorkLoop::runTimers(UInt64 until)
+{
+    for (;;)
+    {
+        IOTimerEventSource * next = 0;
+
+        for (unsigned int index = 0; index < _count; index++)
+        {
+            UInt64 deadline = _timers[index]->deadline();
+            if (deadline && deadline <= until &&
+                (!next || deadline < next->deadline()))
+                next = _timers[index];
+        }
+        if (!next)  break;
+
+        if (next->deadline() > gPS2BenchClock)
+            gPS2BenchClock = next->deadline();
+        next->fire();
+    }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void IOWorkLoop::free()
+{
+    for (unsigned int index = 0; index < _count; index++)
+        _timers[index]->release();
+    PS2BenchFree(_timers);
+    if (gPS2BenchWorkLoop == this)
+        gPS2BenchWorkLoop = 0;
+    OSObject::free();
+}
+
+// =============================================================================
+// IOBufferMemoryDescriptor
+//
+
+IOBufferMemoryDescriptor *
+IOBufferMemoryDescriptor::withOptions(IOOptionBits options, size_t capacity, size_t alignment)
+{
+    IOBufferMemoryDescriptor * memory = new IOBufferMemoryDescriptor;
+
+    memory->_buffer = PS2BenchAllocate(capacity);
+    memory->_length = capacity;
+    return memory;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void IOBufferMemoryDescriptor::free()
+{
+    PS2BenchFree(_buffer);
+    OSObject::free();
+}
+
+// =============================================================================
+// IOHIDevice, IOHIPointing
+//
+
+IOReturn IOHIDevice::setProperties(OSObject * properties)
+{
+    OSDictionary * dictionary = OSDynamicCast(OSDictionary, properties);
+    return dictionary ? setParamProperties(dictionary) : kIOReturnBadArgument;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void IOHIPointing::countButtons(UInt32 buttonState)
+{
+    for (UInt32 pressed = buttonState & ~_buttonState; pressed; pressed &= pressed - 1)
+        gPS2BenchCounters.clicks++;
+    _buttonState = buttonState;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void IOHIPointing::dispatchRelativePointerEvent(int dx, int dy, UInt32 buttonState, AbsoluteTime ts)
+{
+    gPS2BenchCounters.relativeEvents++;
+    gPS2BenchCounters.motion += (dx < 0 ? -dx : dx) + (dy < 0 ? -dy : dy);
+    countButtons(buttonState);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void IOHIPointing::dispatchAbsolutePointerEvent(IOGPoint *   newLoc,
+                                                IOGBounds *  bounds,
+                                                UInt32       buttonState,
+                                                bool         proximity,
+                                                int          pressure,
+                                                int          pressureMin,
+                                                int          pressureMax,
+                                                int          stylusAngle,
+                                                AbsoluteTime ts)
+{
+    gPS2BenchCounters.absoluteEvents++;
+    countButtons(buttonState);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void IOHIPointing::dispatchScrollWheelEvent(short deltaAxis1, short deltaAxis2, short deltaAxis3, AbsoluteTime ts)
+{
+    gPS2BenchCounters.scrollEvents++;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include "PS2BenchProfile.h"
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+UInt32 PS2BenchEncodeIntellimouse(int dx, int dy, int dz, UInt32 buttons, UInt8 * packet)
+{
+    //
+    // Byte 0 has the buttons, bit 3 always set and the signs of the deltas,
+    // then dx, dy (up positive) and the wheel in the low nibble of byte 3.
+    //
+
+    if (dx >  127)  dx =  127;
+    if (dx < -127)  dx = -127;
+    if (dy >  127)  dy =  127;
+    if (dy < -127)  dy = -127;
+
+    packet[0] = 0x08 | (buttons & 7) | (dx < 0 ? 0x10 : 0) | (dy < 0 ? 0x20 : 0);
+    packet[1] = dx & 0xff;
+    packet[2] = dy & 0xff;
+    packet[3] = dz & 0x0f;
+    return 4;
+}
+
+// =============================================================================
+// PS2BenchRelativeProfile Class Implementation
+//
+
+// Touch units per count, and the longest touch without motion taken as a tap.
+#define kPS2BenchRelativeScale   8
+#define kPS2BenchTapSamples      8
+
+PS2BenchRelativeProfile::PS2BenchRelativeProfile()
+{
+    _lastX        = 0;
+    _lastY        = 0;
+    _lastButtons  = 0;
+    _touchSamples = 0;
+    _touchMoved   = false;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+UInt32 PS2BenchRelativeProfile::encode(const PS2BenchTouch & touch, UInt8 * packet)
+{
+    UInt32 length = 0;
+
+    if (!touch.fingers)
+    {
+        if (_touchSamples && _touchSamples <= kPS2BenchTapSamples && !_touchMoved)
+        {
+            length += PS2BenchEncodeIntellimouse(0, 0, 0, touch.buttons | 1, packet);
+            length += PS2BenchEncodeIntellimouse(0, 0, 0, touch.buttons, packet + length);
+        }
+        else if (touch.buttons != _lastButtons)
+            length += PS2BenchEncodeIntellimouse(0, 0, 0, touch.buttons, packet);
+
+        _touchSamples = 0;
+        _lastButtons  = touch.buttons;
+        return length;
+    }
+
+    if (!_touchSamples++)
+    {
+        _lastX      = touch.x;
+        _lastY      = touch.y;
+        _touchMoved = false;
+    }
+
+    int dx = 0, dy = 0, dz = 0;
+
+    if (touch.fingers >= 2)
+        dz = touch.wheel;
+    else
+    {
+        dx = (touch.x - _lastX) / kPS2BenchRelativeScale;
+        dy = (touch.y - _lastY) / kPS2BenchRelativeScale;
+        _lastX += dx * kPS2BenchRelativeScale;
+        _lastY += dy * kPS2BenchRelativeScale;
+    }
+
+    if (dx || dy || dz)
+        _touchMoved = true;
+
+    _lastButtons = touch.buttons;
+    return PS2BenchEncodeIntellimouse(dx, dy, dz, touch.buttons, packet);
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef _PS2BENCHPROFILE_H
+#define _PS2BENCHPROFILE_H
+
+#include "PS2BenchController.h"
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PS2BenchTouch Structure
+//
+// One sample of the synthetic script, in device independent units: positions
+// span 0 to kPS2BenchTouchRange - 1 on both axes, with y growing upwards, and
+// the pressure is for a light touch at 60.  Each profile scales and encodes
+// it in the packets of its protocol.
+//
+
+#define kPS2BenchTouchRange 4096
+
+struct PS2BenchTouch
+{
+    UInt64 gap;             // nanoseconds since the previous sample
+    int    x;
+    int    y;
+    int    z;               // zero when lifted
+    int    fingers;         // zero when lifted
+    UInt32 buttons;         // physical buttons, bit 0 left
+    int    wheel;           // wheel detents, for pads reporting scrolls
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PS2BenchProfile Class Description
+//
+// Everything the benchmark knows about one driver: how to create it, the
+// device on the mouse port it expects to find, and its packet encoding.
+//
+// o  name:
+//    o  Description:  Name selecting the profile on the command line.
+//
+// o  packetLength:
+//    o  Description:  Bytes in one packet of the protocol, to count packets in
+//                     a captured stream.
+//
+// o  createDriver:
+//    o  Description:  Allocate the driver, not yet initialized.
+//
+// o  createMouse:
+//    o  Description:  Allocate the model answering the driver's queries.
+//
+// o  encode:
+//    o  Description:  Encode one sample in the packet bytes the pad would send.
+//                     Called in stream order, so relative protocols can keep
+//                     the last position.
+//    o  Result:       Number of bytes written, up to kPS2BenchMaxEncoding, and
+//                     zero if the pad would send nothing.
+//
+
+#define kPS2BenchMaxEncoding 16
+
+class PS2BenchProfile
+{
+public:
+    virtual ~PS2BenchProfile() {}
+
+    virtual const char *    name() const = 0;
+    virtual UInt32          packetLength() const = 0;
+    virtual IOService *     createDriver() const = 0;
+    virtual PS2BenchMouse * createMouse() const = 0;
+    virtual UInt32          encode(const PS2BenchTouch & touch, UInt8 * packet) = 0;
+};
+
+PS2BenchProfile * PS2BenchCreateSynapticsProfile();
+PS2BenchProfile * PS2BenchCreateALPSGlidePointProfile();
+PS2BenchProfile * PS2BenchCreateALPSMultiTouchProfile();
+PS2BenchProfile * PS2BenchCreateElanProfile();
+PS2BenchProfile * PS2BenchCreateSentelicProfile();
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PS2BenchRelativeProfile Class Description
+//
+// The encoding of pads in Intellimouse mode (ALPS MultiTouch, Sentelic),
+// which do their gestures themselves: motion as deltas of the last position,
+// a short touch without motion as a click, and two fingers as the wheel.
+// Nothing is sent while nothing is touched or pressed.
+//
+
+class PS2BenchRelativeProfile : public PS2BenchProfile
+{
+public:
+    PS2BenchRelativeProfile();
+
+    virtual UInt32 packetLength() const  { return 4; }
+    virtual UInt32 encode(const PS2BenchTouch & touch, UInt8 * packet);
+
+protected:
+    int          _lastX;
+    int          _lastY;
+    UInt32       _lastButtons;
+    unsigned int _touchSamples;         // samples of the current touch
+    bool         _touchMoved;
+};
+
+UInt32 PS2BenchEncodeIntellimouse(int dx, int dy, int dz, UInt32 buttons, UInt8 * packet);
+
+#endif /* !_PS2BENCHPROFILE_H */
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include "VoodooPS2SentelicFSP.h"
+#include "PS2BenchProfile.h"
+
+// =============================================================================
+// PS2BenchSentelicMouse Class Implementation
+//
+// A Finger Sensing Pad with its register file, read and written through the
+// kDP_SetMouseSampleRate sequences of fsp_reg_read and fsp_reg_write.
+//
+
+class PS2BenchSentelicMouse : public PS2BenchMouse
+{
+public:
+    PS2BenchSentelicMouse();
+
+protected:
+    virtual void status(UInt8 reply[3]);
+    virtual void command(UInt8 byte);
+
+private:
+    static UInt8 unmangle(UInt8 select, UInt8 value, const UInt8 selects[3]);
+
+    UInt8 _registers[256];
+};
+
+PS2BenchSentelicMouse::PS2BenchSentelicMouse()
+{
+    bzero(_registers, sizeof(_registers));
+    _registers[0x00] = 0x01;                // device id, the FSP magic
+    _registers[0x01] = 0xd0;                // version
+    _registers[0x04] = 0x02;                // revision
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+UInt8 PS2BenchSentelicMouse::unmangle(UInt8 select, UInt8 value, const UInt8 selects[3])
+{
+    // Values clashing with commands or rates come nibble swapped or inverted.
+    if (select == selects[1])  return (value >> 4) | (value << 4);
+    if (select == selects[2])  return ~value;
+    return value;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void PS2BenchSentelicMouse::status(UInt8 reply[3])
+{
+    static const UInt8 readSelects[3] = { 0x66, 0xcc, 0x68 };
+
+    // F3 66 88 F3 <select> <register> before the status request reads.
+    if (written(5) == kDP_SetMouseSampleRate && written(4) == 0x66 &&
+        written(3) == 0x88 && written(2) == kDP_SetMouseSampleRate)
+    {
+        reply[0] = 0x00;
+        reply[1] = 0x00;
+        reply[2] = _registers[unmangle(written(1), written(0), readSelects)];
+    }
+    else
+        PS2BenchMouse::status(reply);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void PS2BenchSentelicMouse::command(UInt8 byte)
+{
+    static const UInt8 registerSelects[3] = { 0x55, 0x77, 0x74 };
+    static const UInt8 valueSelects[3]    = { 0x33, 0x44, 0x47 };
+
+    // F3 <select> <register> F3 <select> <value> writes.
+    if (written(4) == kDP_SetMouseSampleRate && written(1) == kDP_SetMouseSampleRate &&
+        (written(3) == 0x55 || written(3) == 0x77 || written(3) == 0x74) &&
+        (written(0) == 0x33 || written(0) == 0x44 || written(0) == 0x47))
+    {
+        _registers[unmangle(written(3), written(2), registerSelects)] =
+            unmangle(written(0), byte, valueSelects);
+    }
+}
+
+// =============================================================================
+// PS2BenchSentelicProfile Class Implementation
+//
+
+class PS2BenchSentelicProfile : public PS2BenchRelativeProfile
+{
+public:
+    virtual const char *    name() const  { return "sentelic"; }
+    virtual IOService *     createDriver() const  { return new ApplePS2SentelicFSP; }
+    virtual PS2BenchMouse * createMouse() const  { return new PS2BenchSentelicMouse; }
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+PS2BenchProfile * PS2BenchCreateSentelicProfile()
+{
+    return new PS2BenchSentelicProfile;
+}
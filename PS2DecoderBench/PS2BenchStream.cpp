@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "PS2BenchStream.h"
+
+// Time between samples of the script, for a pad reporting at 80 Hz.
+#define kPS2BenchSampleInterval  12500000ULL
+
+// =============================================================================
+// PS2BenchStream Class Implementation
+//
+
+PS2BenchStream::PS2BenchStream()
+{
+    _chunks        = 0;
+    _chunkCapacity = 0;
+    _bytes         = 0;
+    _byteCapacity  = 0;
+    clear();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+PS2BenchStream::~PS2BenchStream()
+{
+    ::free(_chunks);
+    ::free(_bytes);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void PS2BenchStream::clear()
+{
+    _chunkCount = 0;
+    _byteCount  = 0;
+    _time       = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool PS2BenchStream::append(UInt64 time, const UInt8 * data, UInt32 length)
+{
+    if (_chunkCount == _chunkCapacity)
+    {
+        UInt32          capacity = _chunkCapacity ? _chunkCapacity * 2 : 4096;
+        PS2BenchChunk * chunks   = (PS2BenchChunk *) realloc(_chunks, capacity * sizeof(PS2BenchChunk));
+        if (!chunks)  return false;
+        _chunks        = chunks;
+        _chunkCapacity = capacity;
+    }
+
+    if (_byteCount + length > _byteCapacity)
+    {
+        UInt32  capacity = _byteCapacity ? _byteCapacity * 2 : 65536;
+        while (capacity < _byteCount + length)
+            capacity *= 2;
+        UInt8 * bytes = (UInt8 *) realloc(_bytes, capacity);
+        if (!bytes)  return false;
+        _bytes        = bytes;
+        _byteCapacity = capacity;
+    }
+
+    _chunks[_chunkCount].time   = time;
+    _chunks[_chunkCount].offset = _byteCount;
+    _chunks[_chunkCount].length = length;
+    _chunkCount++;
+
+    memcpy(_bytes + _byteCount, data, length);
+    _byteCount += length;
+    return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void PS2BenchStream::touch(PS2BenchProfile * profile, const PS2BenchTouch & sample)
+{
+    UInt8  packet[kPS2BenchMaxEncoding];
+    UInt32 length;
+
+    // A sample the pad sends nothing for still takes its time.
+    _time += sample.gap;
+    length = profile->encode(sample, packet);
+    if (length)
+        append(_time, packet, length);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void PS2BenchStream::lift(PS2BenchProfile * profile, UInt64 gap)
+{
+    // Pads keep reporting for a few samples after the finger is gone.
+    PS2BenchTouch sample;
+
+    bzero(&sample, sizeof(sample));
+    for (int index = 0; index < 3; index++)
+    {
+        sample.gap = index ? kPS2BenchSampleInterval : gap;
+        touch(profile, sample);
+    }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool PS2BenchStream::generate(PS2BenchProfile * profile, UInt32 packets)
+{
+    const int     center = kPS2BenchTouchRange / 2;
+    PS2BenchTouch sample;
+    int           index;
+
+    clear();
+
+    while (_byteCount < packets * profile->packetLength())
+    {
+        UInt32 before = _byteCount;
+
+        bzero(&sample, sizeof(sample));
+        sample.z       = 60;
+        sample.fingers = 1;
+
+        // A circle, after the pause since the last touch.
+        for (index = 0; index < 160; index++)
+        {
+            double angle = 2 * M_PI * index / 160;
+            sample.gap = index ? kPS2BenchSampleInterval : 200000000ULL;
+            sample.x   = center + (int) (800 * cos(angle));
+            sample.y   = center + (int) (800 * sin(angle));
+            touch(profile, sample);
+        }
+        lift(profile, kPS2BenchSampleInterval);
+
+        // A tap.
+        for (index = 0; index < 4; index++)
+        {
+            sample.gap = index ? kPS2BenchSampleInterval : 300000000ULL;
+            sample.x   = 1000;
+            sample.y   = 1000;
+            touch(profile, sample);
+        }
+        lift(profile, kPS2BenchSampleInterval);
+
+        // Down the right edge.
+        for (index = 0; index < 96; index++)
+        {
+            sample.gap = index ? kPS2BenchSampleInterval : 300000000ULL;
+            sample.x   = 4000;
+            sample.y   = 3200 - index * 25;
+            touch(profile, sample);
+        }
+        lift(profile, kPS2BenchSampleInterval);
+
+        // Two fingers scrolling, a wheel detent every four samples.
+        sample.fingers = 2;
+        for (index = 0; index < 96; index++)
+        {
+            sample.gap   = index ? kPS2BenchSampleInterval : 300000000ULL;
+            sample.x     = center;
+            sample.y     = 3000 - index * 20;
+            sample.wheel = (index & 3) == 3 ? 1 : 0;
+            touch(profile, sample);
+        }
+        sample.fingers = 1;
+        sample.wheel   = 0;
+        lift(profile, kPS2BenchSampleInterval);
+
+        // A drag with the button held, then the release.
+        sample.buttons = 1;
+        for (index = 0; index < 80; index++)
+        {
+            sample.gap = index ? kPS2BenchSampleInterval : 300000000ULL;
+            sample.x   = 1000 + index * 25;
+            sample.y   = 2000;
+            touch(profile, sample);
+        }
+        lift(profile, kPS2BenchSampleInterval);
+
+        // And the pad idles for half a second before the next round.
+        _time += 500000000ULL;
+
+        if (_byteCount == before)
+            return false;
+    }
+
+    return _chunkCount != 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool PS2BenchStream::load(const char * path)
+{
+    FILE *           file;
+    long             size;
+    UInt8 *          contents;
+    PS2TraceRecord * records;
+    UInt32           count;
+    UInt32           first = 0;
+    UInt32           next;
+    UInt64           start = 0;
+    bool             started = false;
+    bool             ring;
+
+    clear();
+
+    file = fopen(path, "rb");
+    if (!file)  return false;
+
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    contents = (UInt8 *) malloc(size > 0 ? size : 1);
+    if (!contents || fread(contents, 1, size, file) != (size_t) size)
+    {
+        ::free(contents);
+        fclose(file);
+        return false;
+    }
+    fclose(file);
+
+    //
+    // A buffer dump is the header and a ring of records, of which the ones
+    // before next (at most recordCount of them) are written.  Without the
+    // header it is a plain array, in order.
+    //
+
+    PS2TraceHeader * header = (PS2TraceHeader *) contents;
+
+    ring = (size_t) size >= sizeof(PS2TraceHeader) && header->magic == kPS2TraceMagic;
+    if (ring)
+    {
+        if (header->recordSize != sizeof(PS2TraceRecord) || !header->recordCount ||
+            (header->recordCount & (header->recordCount - 1)) ||
+            (size_t) size < sizeof(PS2TraceHeader) + header->recordCount * sizeof(PS2TraceRecord))
+        {
+            ::free(contents);
+            return false;
+        }
+        records = (PS2TraceRecord *) (header + 1);
+        count   = header->recordCount;
+        next    = header->next;
+        if (next > count)
+            first = next - count;
+    }
+    else
+    {
+        records = (PS2TraceRecord *) contents;
+        count   = size / sizeof(PS2TraceRecord);
+        next    = count;
+    }
+
+    for (UInt32 number = first; number < next; number++)
+    {
+        PS2TraceRecord * record = &records[ring ? number & (count - 1) : number];
+
+        // (a record is being written over while its sequence does not match)
+        if (ring && record->sequence != number + 1)
+            continue;
+
+        if (record->type != kPS2TraceMouseByte || !record->length ||
+            record->length > kPS2TraceDataSize)
+            continue;
+
+        if (!started)
+        {
+            start   = record->timestamp;
+            started = true;
+        }
+
+        // (timestamps are absolute time, nanoseconds on the machines traced)
+        append(record->timestamp >= start ? record->timestamp - start : 0,
+               record->data, record->length);
+    }
+
+    ::free(contents);
+    return _chunkCount != 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef _PS2BENCHSTREAM_H
+#define _PS2BENCHSTREAM_H
+
+#include "PS2BenchProfile.h"
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PS2BenchStream Class Description
+//
+// The bytes the benchmark delivers, in chunks as the port would hand them to
+// the controller: one packet of the synthetic script, or one record of a
+// capture.  Chunk times are nanoseconds from the start of the stream.
+//
+// o  generate:
+//    o  Description:  Encode the synthetic script with the profile, repeated
+//                     until it holds (at least) the given number of packets.
+//                     The script moves, taps, edge scrolls, scrolls with two
+//                     fingers, drags with the button down and idles.
+//
+// o  load:
+//    o  Description:  Read the mouse port bytes of a capture: a dump of the
+//                     controller's trace buffer (starting with its
+//                     PS2TraceHeader), or an array of PS2TraceRecord as taken
+//                     by kPS2TraceMethodReplay.  Torn records are skipped.
+//    o  Result:       False if the file can't be read or holds no mouse bytes.
+//
+
+struct PS2BenchChunk
+{
+    UInt64 time;
+    UInt32 offset;
+    UInt32 length;
+};
+
+class PS2BenchStream
+{
+public:
+    PS2BenchStream();
+    ~PS2BenchStream();
+
+    bool generate(PS2BenchProfile * profile, UInt32 packets);
+    bool load(const char * path);
+
+    UInt32                chunkCount() const  { return _chunkCount; }
+    const PS2BenchChunk & chunk(UInt32 index) const  { return _chunks[index]; }
+    const UInt8 *         bytes(const PS2BenchChunk & chunk) const  { return _bytes + chunk.offset; }
+    UInt32                byteCount() const  { return _byteCount; }
+
+private:
+    void clear();
+    bool append(UInt64 time, const UInt8 * data, UInt32 length);
+    void touch(PS2BenchProfile * profile, const PS2BenchTouch & sample);
+    void lift(PS2BenchProfile * profile, UInt64 gap);
+
+    PS2BenchChunk * _chunks;
+    UInt32          _chunkCount;
+    UInt32          _chunkCapacity;
+    UInt8 *         _bytes;
+    UInt32          _byteCount;
+    UInt32          _byteCapacity;
+    UInt64          _time;              // of the last sample generated
+};
+
+#endif /* !_PS2BENCHSTREAM_H */
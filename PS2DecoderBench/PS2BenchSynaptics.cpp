@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include "VoodooPS2SynapticsTouchPad.h"
+#include "PS2BenchProfile.h"
+
+// =============================================================================
+// PS2BenchSynapticsMouse Class Implementation
+//
+// A TouchPad of version 7.8 with W mode and finger counting: queries are
+// answered for the selector of the sliced command (four kDP_SetMouseResolution
+// with two bits each) before kDP_GetMouseInformation.
+//
+
+class PS2BenchSynapticsMouse : public PS2BenchMouse
+{
+protected:
+    virtual void status(UInt8 reply[3]);
+};
+
+void PS2BenchSynapticsMouse::status(UInt8 reply[3])
+{
+    if (written(7) != kDP_SetMouseResolution || written(5) != kDP_SetMouseResolution ||
+        written(3) != kDP_SetMouseResolution || written(1) != kDP_SetMouseResolution)
+    {
+        PS2BenchMouse::status(reply);
+        return;
+    }
+
+    UInt8 selector = ((written(6) & 3) << 6) | ((written(4) & 3) << 4) |
+                     ((written(2) & 3) << 2) |  (written(0) & 3);
+
+    switch (selector)
+    {
+        case 0x00:                              // identify: version 7.8
+            reply[0] = 0x08;
+            reply[1] = 0x47;
+            reply[2] = 0x07;
+            break;
+
+        case kSynapticsQueryCapabilities:     // W mode, multi finger
+            reply[0] = 0x80;
+            reply[1] = 0x47;
+            reply[2] = 0x02;
+            break;
+
+        default:
+            reply[0] = 0x00;
+            reply[1] = 0x47;
+            reply[2] = 0x00;
+            break;
+    }
+}
+
+// =============================================================================
+// PS2BenchSynapticsProfile Class Implementation
+//
+// Absolute packets of W mode, on the pad's usual 1472-5472 by 1408-4448 area.
+//
+
+class PS2BenchSynapticsProfile : public PS2BenchProfile
+{
+public:
+    virtual const char *    name() const  { return "synaptics"; }
+    virtual UInt32          packetLength() const  { return 6; }
+    virtual IOService *     createDriver() const  { return new ApplePS2SynapticsTouchPad; }
+    virtual PS2BenchMouse * createMouse() const  { return new PS2BenchSynapticsMouse; }
+    virtual UInt32          encode(const PS2BenchTouch & touch, UInt8 * packet);
+};
+
+UInt32 PS2BenchSynapticsProfile::encode(const PS2BenchTouch & touch, UInt8 * packet)
+{
+    int    x = 1472 + touch.x * 4000 / kPS2BenchTouchRange;
+    int    y = 1408 + touch.y * 3040 / kPS2BenchTouchRange;
+    int    w = touch.fingers >= 2 ? 0 : 4;
+    UInt8  buttons = touch.buttons & 3;
+
+    packet[0] = 0x80 | ((w & 0x0c) << 2) | ((w & 0x02) << 1) | buttons;
+    packet[1] = ((y >> 4) & 0xf0) | ((x >> 8) & 0x0f);
+    packet[2] = touch.z;
+    packet[3] = 0xc0 | ((y >> 7) & 0x20) | ((x >> 8) & 0x10) | ((w & 0x01) << 2) | buttons;
+    packet[4] = x & 0xff;
+    packet[5] = y & 0xff;
+    return 6;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+PS2BenchProfile * PS2BenchCreateSynapticsProfile()
+{
+    return new PS2BenchSynapticsProfile;
+}
@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "PS2BenchStream.h"
+#include "PS2BenchTime.h"
+
+// =============================================================================
+// PS2DecoderBench
+//
+// Runs the trackpad drivers in user space, against stand-ins for the kernel
+// and the controller, and feeds each one a stream of mouse port bytes: the
+// synthetic script encoded for its protocol, or a capture of the controller's
+// trace buffer.  Reports the decoding time per packet, the events the driver
+// dispatched per packet and what it allocated and logged while streaming.
+//
+// usage: PS2DecoderBench [-d driver] [-n packets] [-c capture] [-1] [-t mask] [-v]
+//
+
+#define kPS2BenchDefaultPackets  200000
+#define kPS2BenchTraceRecords    1024
+
+struct PS2BenchOptions
+{
+    const char * driver;            // profile name, or 0 for all
+    UInt32       packets;           // of the synthetic stream
+    const char * capture;           // capture to play instead
+    bool         perByte;           // ignore the batch interrupt action
+    UInt32       traceMask;         // record types traced while streaming
+};
+
+static PS2BenchProfile * (* const gPS2BenchProfiles[])() =
+{
+    PS2BenchCreateSynapticsProfile,
+    PS2BenchCreateALPSGlidePointProfile,
+    PS2BenchCreateALPSMultiTouchProfile,
+    PS2BenchCreateElanProfile,
+    PS2BenchCreateSentelicProfile
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void usage(const char * program)
+{
+    fprintf(stderr,
+            "usage: %s [-d driver] [-n packets] [-c capture] [-1] [-t mask] [-v]\n"
+            "  -d  synaptics, alpsglidepoint, alpsmultitouch, elan, sentelic or all\n"
+            "  -n  packets of the synthetic stream (%u)\n"
+            "  -c  play a trace buffer dump or record array instead\n"
+            "  -1  deliver byte by byte even to drivers taking batches\n"
+            "  -t  trace record types while streaming (bit mask, 0)\n"
+            "  -v  print the drivers' logs\n",
+            program, kPS2BenchDefaultPackets);
+    exit(2);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static bool runProfile(PS2BenchProfile * profile, const PS2BenchOptions & options)
+{
+    PS2BenchStream stream;
+
+    if (options.capture ? !stream.load(options.capture)
+                        : !stream.generate(profile, options.packets))
+    {
+        fprintf(stderr, "%s: no stream to play\n", profile->name());
+        return false;
+    }
+
+    //
+    // Bring the driver up the way the machine does: the controller identifies
+    // the mouse for its nub, then the driver probes and starts on the nub.
+    //
+
+    PS2BenchMouse *       mouse      = profile->createMouse();
+    ApplePS2Controller *  controller = new ApplePS2Controller;
+    ApplePS2MouseDevice * nub        = new ApplePS2MouseDevice;
+    IOService *           driver     = profile->createDriver();
+    SInt32                score      = 0;
+    bool                  started    = false;
+
+    gPS2BenchClock = 1000000000ULL;
+
+    controller->init();
+    controller->setMouse(mouse);
+    controller->setDeliverPerByte(options.perByte);
+    if (!controller->allocateTrace(kPS2BenchTraceRecords, options.traceMask))
+        fprintf(stderr, "%s: no trace buffer\n", profile->name());
+
+    nub->init();
+    nub->attach(controller);
+    controller->identifyMouse(nub);
+
+    OSDictionary * properties = OSDictionary::withCapacity(0);
+    driver->init(properties);
+    properties->release();
+    if (driver->probe(nub, &score) && driver->attach(nub))
+    {
+        started = driver->start(nub);
+        controller->processRequests();
+        if (!started)
+            driver->detach(nub);
+    }
+    if (!started)
+    {
+        fprintf(stderr, "%s: the driver did not start on the model\n", profile->name());
+        driver->release();
+        nub->detach(controller);
+        nub->release();
+        controller->release();
+        delete mouse;
+        return false;
+    }
+
+    //
+    // Stream, at the stream's own pace on the virtual clock, firing the
+    // driver's timers as their deadlines pass.
+    //
+
+    IOWorkLoop * workLoop = driver->getWorkLoop();
+    UInt64       base     = gPS2BenchClock + 1000000000ULL;
+    UInt64       wallStart;
+    UInt64       wallTime;
+
+    bzero(&gPS2BenchCounters, sizeof(gPS2BenchCounters));
+    gPS2BenchCounting = true;
+    wallStart = PS2BenchWallClock();
+
+    for (UInt32 index = 0; index < stream.chunkCount(); index++)
+    {
+        const PS2BenchChunk & chunk = stream.chunk(index);
+        UInt64                time  = base + chunk.time;
+
+        workLoop->runTimers(time);
+        if (gPS2BenchClock < time)
+            gPS2BenchClock = time;
+        controller->dispatch(stream.bytes(chunk), chunk.length);
+        controller->processRequests();
+    }
+    workLoop->runTimers(gPS2BenchClock + 2000000000ULL);
+    controller->processRequests();
+
+    wallTime = PS2BenchWallClock() - wallStart;
+    gPS2BenchCounting = false;
+
+    //
+    // Report per packet of the protocol, captures being counted in bytes.
+    //
+
+    const PS2BenchCounters & counters = gPS2BenchCounters;
+    double packets = (double) stream.byteCount() / profile->packetLength();
+
+    printf("%-15s %9.0f packets %s%s\n", profile->name(), packets,
+           options.capture ? "captured" : "synthetic",
+           controller->batchInstalled() && !options.perByte ? ", batched" : ", per byte");
+    printf("  %8.1f ns/packet\n", wallTime / packets);
+    printf("  %8.3f pointer, %.3f scroll, %.3f absolute events/packet\n",
+           counters.relativeEvents / packets, counters.scrollEvents / packets,
+           counters.absoluteEvents / packets);
+    printf("  %8llu clicks, %llu counts of motion, %llu timers fired\n",
+           (unsigned long long) counters.clicks, (unsigned long long) counters.motion,
+           (unsigned long long) counters.timers);
+    printf("  %8llu allocations (%llu bytes), %.3f logs/packet\n",
+           (unsigned long long) counters.allocations,
+           (unsigned long long) counters.allocatedBytes, counters.logs / packets);
+
+    driver->stop(nub);
+    driver->detach(nub);
+    driver->release();
+    nub->detach(controller);
+    nub->release();
+    controller->release();
+    delete mouse;
+    return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+int main(int argc, char * argv[])
+{
+    PS2BenchOptions options;
+    int             option;
+    bool            found = false;
+    bool            failed = false;
+
+    bzero(&options, sizeof(options));
+    options.packets = kPS2BenchDefaultPackets;
+
+    while ((option = getopt(argc, argv, "d:n:c:1t:v")) != -1)
+    {
+        switch (option)
+        {
+            case 'd':
+                options.driver = strcmp(optarg, "all") ? optarg : 0;
+                break;
+            case 'n':
+                options.packets = strtoul(optarg, 0, 0);
+                break;
+            case 'c':
+                options.capture = optarg;
+                break;
+            case '1':
+                options.perByte = true;
+                break;
+            case 't':
+                options.traceMask = strtoul(optarg, 0, 0);
+                break;
+            case 'v':
+                gPS2BenchVerbose = true;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind != argc || !options.packets)
+        usage(argv[0]);
+
+    for (unsigned index = 0; index < sizeof(gPS2BenchProfiles) / sizeof(gPS2BenchProfiles[0]); index++)
+    {
+        PS2BenchProfile * profile = gPS2BenchProfiles[index]();
+
+        if (!options.driver || !strcmp(options.driver, profile->name()))
+        {
+            found = true;
+            if (!runProfile(profile, options))
+                failed = true;
+        }
+        delete profile;
+    }
+
+    if (!found)
+        usage(argv[0]);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include "ApplePS2ControllerUserClient.h"
+#include "VoodooPS2Controller.h"
+
+// =============================================================================
+// ApplePS2ControllerUserClient Class Implementation
+//
+
+#define super IOUserClient
+OSDefineMetaClassAndStructors(ApplePS2ControllerUserClient, IOUserClient);
+
+bool ApplePS2ControllerUserClient::initWithTask(task_t         owningTask,
+                                                void *         securityID,
+                                                UInt32         type,
+                                                OSDictionary * properties)
+{
+  //
+  // The trace may hold keystrokes; keep it away from everyone but root.
+  //
+
+  if (clientHasPrivilege(owningTask, kIOClientPrivilegeAdministrator) != kIOReturnSuccess)
+    return false;
+
+  if (!super::initWithTask(owningTask, securityID, type, properties))
+    return false;
+
+  _controller = 0;
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2ControllerUserClient::start(IOService * provider)
+{
+  _controller = OSDynamicCast(ApplePS2Controller, provider);
+  if (!_controller)
+    return false;
+
+  return super::start(provider);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2ControllerUserClient::clientClose()
+{
+  terminate();
+  return kIOReturnSuccess;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2ControllerUserClient::clientMemoryForType(UInt32                type,
+                                                           IOOptionBits *        options,
+                                                           IOMemoryDescriptor ** memory)
+{
+  IOMemoryDescriptor * trace;
+
+  if (type != kPS2TraceMemoryType)
+    return kIOReturnBadArgument;
+
+  trace = _controller->getTraceBuffer()->memory();
+  if (!trace)
+    return kIOReturnNoMemory;
+
+  //
+  // The mapping is read only; tools set the mask with kPS2TraceMethodSetMask.
+  //
+
+  trace->retain();
+  *options = kIOMapReadOnly;
+  *memory  = trace;
+  return kIOReturnSuccess;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2ControllerUserClient::externalMethod(uint32_t                   selector,
+                                                      IOExternalMethodArguments * arguments,
+                                                      IOExternalMethodDispatch *  dispatch,
+                                                      OSObject *                  target,
+                                                      void *                      reference)
+{
+  static const IOExternalMethodDispatch methods[] =
+  {
+    // kPS2TraceMethodReplay: records as (variable size) structure input
+    { (IOExternalMethodAction) &ApplePS2ControllerUserClient::replay,
+      0, kIOUCVariableStructureSize, 0, 0 },
+    // kPS2TraceMethodStopReplay
+    { (IOExternalMethodAction) &ApplePS2ControllerUserClient::stopReplay,
+      0, 0, 0, 0 },
+    // kPS2TraceMethodSetMask: record types to trace as scalar input
+    { (IOExternalMethodAction) &ApplePS2ControllerUserClient::setMask,
+      1, 0, 0, 0 }
+  };
+
+  if (selector < sizeof(methods) / sizeof(methods[0]))
+  {
+    dispatch = (IOExternalMethodDispatch *) &methods[selector];
+    target   = this;
+  }
+  return super::externalMethod(selector, arguments, dispatch, target, reference);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2ControllerUserClient::replay(ApplePS2ControllerUserClient * target,
+                                              void *,
+                                              IOExternalMethodArguments * arguments)
+{
+  //
+  // Small captures come in line, larger ones (over a page) as a descriptor
+  // of the caller's memory, which is copied in here.
+  //
+
+  IOMemoryDescriptor * descriptor = arguments->structureInputDescriptor;
+  IOByteCount          length;
+  PS2TraceRecord *     records;
+  IOReturn             result;
+
+  if (!descriptor)
+  {
+    if (arguments->structureInputSize % sizeof(PS2TraceRecord))
+      return kIOReturnBadArgument;
+    return target->_controller->startReplay(
+                (const PS2TraceRecord *) arguments->structureInput,
+                arguments->structureInputSize / sizeof(PS2TraceRecord));
+  }
+
+  length = descriptor->getLength();
+  if (length % sizeof(PS2TraceRecord) ||
+      length > kReplayMaxRecords * sizeof(PS2TraceRecord))
+    return kIOReturnBadArgument;
+
+  records = (PS2TraceRecord *) IOMalloc(length);
+  if (!records)
+    return kIOReturnNoMemory;
+
+  result = descriptor->prepare();
+  if (result == kIOReturnSuccess)
+  {
+    if (descriptor->readBytes(0, records, length) == length)
+      result = target->_controller->startReplay(records,
+                                                length / sizeof(PS2TraceRecord));
+    else
+      result = kIOReturnIOError;
+    descriptor->complete();
+  }
+
+  IOFree(records, length);
+  return result;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2ControllerUserClient::stopReplay(ApplePS2ControllerUserClient * target,
+                                                  void *,
+                                                  IOExternalMethodArguments *)
+{
+  target->_controller->stopReplay();
+  return kIOReturnSuccess;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2ControllerUserClient::setMask(ApplePS2ControllerUserClient * target,
+                                               void *,
+                                               IOExternalMethodArguments * arguments)
+{
+  target->_controller->getTraceBuffer()->setMask((UInt32) arguments->scalarInput[0]);
+  return kIOReturnSuccess;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef _APPLEPS2CONTROLLERUSERCLIENT_H
+#define _APPLEPS2CONTROLLERUSERCLIENT_H
+
+#include <IOKit/IOUserClient.h>
+
+class ApplePS2Controller;
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// ApplePS2ControllerUserClient Class Declaration
+//
+// Hands the controller's trace buffer (see ApplePS2Trace.h) to diagnostic
+// tools, which map it with IOConnectMapMemory and memory type
+// kPS2TraceMemoryType, and lets them replay a captured stream into the
+// drivers.  Only administrators may open a connection.
+//
+
+class ApplePS2ControllerUserClient : public IOUserClient
+{
+  OSDeclareDefaultStructors(ApplePS2ControllerUserClient);
+
+private:
+  ApplePS2Controller * _controller;
+
+  static IOReturn replay(ApplePS2ControllerUserClient * target, void * reference,
+                         IOExternalMethodArguments * arguments);
+  static IOReturn stopReplay(ApplePS2ControllerUserClient * target, void * reference,
+                             IOExternalMethodArguments * arguments);
+  static IOReturn setMask(ApplePS2ControllerUserClient * target, void * reference,
+                          IOExternalMethodArguments * arguments);
+
+public:
+  virtual bool     initWithTask(task_t owningTask, void * securityID,
+                                UInt32 type, OSDictionary * properties);
+  virtual bool     start(IOService * provider);
+  virtual IOReturn clientClose();
+  virtual IOReturn clientMemoryForType(UInt32                type,
+                                       IOOptionBits *        options,
+                                       IOMemoryDescriptor ** memory);
+  virtual IOReturn externalMethod(uint32_t                   selector,
+                                  IOExternalMethodArguments * arguments,
+                                  IOExternalMethodDispatch *  dispatch,
+                                  OSObject *                  target,
+                                  void *                      reference);
+};
+
+#endif /* !_APPLEPS2CONTROLLERUSERCLIENT_H */
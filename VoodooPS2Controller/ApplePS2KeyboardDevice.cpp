@@ -70,6 +70,21 @@ void ApplePS2KeyboardDevice::uninstallInterruptAction()
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2KeyboardDevice::installBatchInterruptAction(OSObject *              target,
+                                                         PS2BatchInterruptAction action)
+{
+  _controller->installBatchInterruptAction(kDT_Keyboard, target, action);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2KeyboardDevice::uninstallBatchInterruptAction()
+{
+  _controller->uninstallBatchInterruptAction(kDT_Keyboard);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 void ApplePS2KeyboardDevice::installPowerControlAction(
                                                 OSObject *            target,
                                                 PS2PowerControlAction action)
@@ -102,18 +117,45 @@ void ApplePS2KeyboardDevice::freeRequest(PS2Request * request)
 
 bool ApplePS2KeyboardDevice::submitRequest(PS2Request * request)
 {
+  request->device = kDT_Keyboard;
   return _controller->submitRequest(request);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+bool ApplePS2KeyboardDevice::submitRequest(PS2Request *        request,
+                                           void *              target,
+                                           PS2CompletionAction action,
+                                           void *              param)
+{
+  request->device = kDT_Keyboard;
+  return _controller->submitRequest(request, target, action, param);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 void ApplePS2KeyboardDevice::submitRequestAndBlock(PS2Request * request)
 {
+  request->device = kDT_Keyboard;
   _controller->submitRequestAndBlock(request);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2KeyboardDevice::updateCommandByte(UInt8 setBits, UInt8 clearBits)
+{
+  _controller->updateCommandByte(setBits, clearBits);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+PS2TraceBuffer * ApplePS2KeyboardDevice::getTraceBuffer()
+{
+  return _controller->getTraceBuffer();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 OSMetaClassDefineReservedUnused(ApplePS2KeyboardDevice, 0);
 OSMetaClassDefineReservedUnused(ApplePS2KeyboardDevice, 1);
 OSMetaClassDefineReservedUnused(ApplePS2KeyboardDevice, 2);
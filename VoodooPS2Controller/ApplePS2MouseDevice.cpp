@@ -70,6 +70,21 @@ void ApplePS2MouseDevice::uninstallInterruptAction()
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2MouseDevice::installBatchInterruptAction(OSObject *              target,
+                                                      PS2BatchInterruptAction action)
+{
+  _controller->installBatchInterruptAction(kDT_Mouse, target, action);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2MouseDevice::uninstallBatchInterruptAction()
+{
+  _controller->uninstallBatchInterruptAction(kDT_Mouse);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 void ApplePS2MouseDevice::installPowerControlAction(OSObject *            target,
                                                     PS2PowerControlAction action)
 {
@@ -85,6 +100,29 @@ void ApplePS2MouseDevice::uninstallPowerControlAction()
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+bool ApplePS2MouseDevice::getIdentity(PS2MouseIdentity * identity)
+{
+  if (!_identityValid)  return false;
+
+  *identity = _identity;
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2MouseDevice::setIdentity(const PS2MouseIdentity * identity)
+{
+  //
+  // Called by the controller, before the nub is registered, with the results
+  // of the identification queries it sent to the mouse port.
+  //
+
+  _identity      = *identity;
+  _identityValid = true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 PS2Request * ApplePS2MouseDevice::allocateRequest()
 {
   return _controller->allocateRequest();
@@ -101,18 +139,45 @@ void ApplePS2MouseDevice::freeRequest(PS2Request * request)
 
 bool ApplePS2MouseDevice::submitRequest(PS2Request * request)
 {
+  request->device = kDT_Mouse;
   return _controller->submitRequest(request);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+bool ApplePS2MouseDevice::submitRequest(PS2Request *        request,
+                                        void *              target,
+                                        PS2CompletionAction action,
+                                        void *              param)
+{
+  request->device = kDT_Mouse;
+  return _controller->submitRequest(request, target, action, param);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 void ApplePS2MouseDevice::submitRequestAndBlock(PS2Request * request)
 {
+  request->device = kDT_Mouse;
   _controller->submitRequestAndBlock(request);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2MouseDevice::updateCommandByte(UInt8 setBits, UInt8 clearBits)
+{
+  _controller->updateCommandByte(setBits, clearBits);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+PS2TraceBuffer * ApplePS2MouseDevice::getTraceBuffer()
+{
+  return _controller->getTraceBuffer();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 OSMetaClassDefineReservedUnused(ApplePS2MouseDevice, 0);
 OSMetaClassDefineReservedUnused(ApplePS2MouseDevice, 1);
 OSMetaClassDefineReservedUnused(ApplePS2MouseDevice, 2);
@@ -57,6 +57,12 @@ bool VoodooACPIPS2Nub::start(IOService *provider)
 	
     DEBUG_LOG("VoodooACPIPS2Nub::start: provider=%p\n", provider);
 	
+    m_mouseProvider = NULL;
+    m_mouseNotifier = NULL;
+    m_mouseLock = IOLockAlloc();
+    if(m_mouseLock == NULL)
+        return false;
+	
     /* Initialize our interrupt controller/specifier i-vars */
     m_interruptControllers = OSArray::withCapacity(2);
     m_interruptSpecifiers = OSArray::withCapacity(2);
@@ -72,18 +78,11 @@ bool VoodooACPIPS2Nub::start(IOService *provider)
     provider->joinPMtree(this);
 	
     /* Find the mouse provider */
-    m_mouseProvider = findMouseDevice();
-    if(m_mouseProvider != NULL)
+    IOService *mouse = findMouseDevice();
+    if(mouse != NULL)
     {
         DEBUG_LOG("VoodooACPIPS2Nub::start: Found mouse PNP device\n");
-        if(attach(m_mouseProvider))
-        {
-            mergeInterruptProperties(m_mouseProvider, LEGACY_MOUSE_IRQ);
-            if(m_mouseProvider->inPlane(gIOPowerPlane))
-            {
-                m_mouseProvider->joinPMtree(this);
-            }
-        }
+        attachMouseDevice(mouse);
     }
 	
     /* Set our interrupt properties in the IOReigstry */
@@ -103,29 +102,155 @@ bool VoodooACPIPS2Nub::start(IOService *provider)
     setName("ps2controller");
     registerService();
 	
+    /*  Without a mouse, attach to it late should it be published after all, rather than
+     *  holding up the keyboard.  The notification is also called for a mouse nub that was
+     *  published since findMouseDevice looked.
+     */
+    if(m_mouseProvider == NULL)
+    {
+        OSDictionary *matching = IOService::serviceMatching("IOACPIPlatformDevice");
+        OSObject *names = getProperty("MouseNameMatch");
+        if(matching != NULL && names != NULL)
+        {
+            matching->setObject(gIONameMatchKey, names);
+            IONotifier *notifier = addMatchingNotification(gIOPublishNotification, matching,
+                                                           mousePublished, this);
+			
+            /* The mouse may have been attached from the notification already */
+            IOLockLock(m_mouseLock);
+            if(m_mouseProvider == NULL)
+            {
+                m_mouseNotifier = notifier;
+                notifier = NULL;
+            }
+            IOLockUnlock(m_mouseLock);
+            if(notifier != NULL)
+                notifier->remove();
+        }
+        if(matching != NULL)
+            matching->release();
+    }
+	
     DEBUG_LOG("VoodooACPIPS2Nub::start: startup complete\n");
 	
     return true;
 }
 
+void VoodooACPIPS2Nub::stop(IOService *provider)
+{
+    IOLockLock(m_mouseLock);
+    IONotifier *notifier = m_mouseNotifier;
+    m_mouseNotifier = NULL;
+    IOLockUnlock(m_mouseLock);
+    if(notifier != NULL)
+        notifier->remove();
+    super::stop(provider);
+}
+
+void VoodooACPIPS2Nub::free()
+{
+    if(m_mouseLock != NULL)
+    {
+        IOLockFree(m_mouseLock);
+        m_mouseLock = NULL;
+    }
+    super::free();
+}
+
 IOService *VoodooACPIPS2Nub::findMouseDevice()
 {
-    OSObject *prop = getProperty("MouseNameMatch");
-    /* Search from the root of the ACPI plane for the mouse PNP nub */
-    IORegistryIterator *i = IORegistryIterator::iterateOver(gIOACPIPlane, kIORegistryIterateRecursively);
-    IORegistryEntry *entry;
+    OSObject *names = getProperty("MouseNameMatch");
+    IORegistryEntry *entry = NULL;
+    if(names == NULL)
+        return NULL;
+	
+    /* The mouse PNP nub is normally a sibling of the keyboard's, under the LPC bridge */
+    IORegistryEntry *parent = getProvider() ? getProvider()->getParentEntry(gIOACPIPlane) : NULL;
+    OSIterator *i = parent ? parent->getChildIterator(gIOACPIPlane) : NULL;
     if(i != NULL)
     {
-        while(entry = i->getNextObject())
+        while((entry = OSDynamicCast(IORegistryEntry, i->getNextObject())))
         {
-            if(entry->compareNames(prop))
+            if(OSDynamicCast(IOService, entry) && entry->compareNames(names))
                 break;
         }
         i->release();
     }
-    else
-        entry = NULL;
-    return OSDynamicCast(IOService, entry);
+    if(entry != NULL)
+        return OSDynamicCast(IOService, entry);
+	
+    /* Otherwise, take the first registered ACPI nub matching one of the names */
+    OSDictionary *matching = IOService::serviceMatching("IOACPIPlatformDevice");
+    if(matching == NULL)
+        return NULL;
+    matching->setObject(gIONameMatchKey, names);
+    OSIterator *services = getMatchingServices(matching);
+    matching->release();
+    if(services == NULL)
+        return NULL;
+    IOService *mouse = OSDynamicCast(IOService, services->getNextObject());
+    services->release();
+    return mouse;
+}
+
+bool VoodooACPIPS2Nub::attachMouseDevice(IOService *mouse)
+{
+    if(!attach(mouse))
+        return false;
+    m_mouseProvider = mouse;
+    mergeInterruptProperties(mouse, LEGACY_MOUSE_IRQ);
+    if(mouse->inPlane(gIOPowerPlane))
+    {
+        mouse->joinPMtree(this);
+    }
+    return true;
+}
+
+bool VoodooACPIPS2Nub::mousePublished(void *target, void *, IOService *newService, IONotifier *)
+{
+    VoodooACPIPS2Nub *me = (VoodooACPIPS2Nub *)target;
+    IONotifier *done = NULL;
+	
+    IOLockLock(me->m_mouseLock);
+    if(me->m_mouseProvider == NULL)
+    {
+        DEBUG_LOG("VoodooACPIPS2Nub::mousePublished: Found mouse PNP device late\n");
+		
+        /*  Rebuild the interrupt arrays from our properties, with the mouse appended.  The mouse
+         *  must land at index 1, where registerInterrupt looks for it, so the keyboard's entry
+         *  has to be there already; without it the mouse is left alone.
+         */
+        OSArray *controllers = OSDynamicCast(OSArray, me->getProperty(gIOInterruptControllersKey));
+        OSArray *specifiers = OSDynamicCast(OSArray, me->getProperty(gIOInterruptSpecifiersKey));
+        if(controllers != NULL && specifiers != NULL &&
+           controllers->getCount() == 1 && specifiers->getCount() == 1)
+        {
+            me->m_interruptControllers = OSArray::withArray(controllers, 2);
+            me->m_interruptSpecifiers = OSArray::withArray(specifiers, 2);
+        }
+        if(me->m_interruptControllers != NULL && me->m_interruptSpecifiers != NULL &&
+           me->attachMouseDevice(newService))
+        {
+            me->setProperty(gIOInterruptControllersKey, me->m_interruptControllers);
+            me->setProperty(gIOInterruptSpecifiersKey, me->m_interruptSpecifiers);
+			
+            /* Done with the notification; start removes it if it has not returned it yet */
+            done = me->m_mouseNotifier;
+            me->m_mouseNotifier = NULL;
+        }
+        if(me->m_interruptControllers != NULL)
+            me->m_interruptControllers->release();
+        me->m_interruptControllers = NULL;
+        if(me->m_interruptSpecifiers != NULL)
+            me->m_interruptSpecifiers->release();
+        me->m_interruptSpecifiers = NULL;
+    }
+    IOLockUnlock(me->m_mouseLock);
+	
+    /* Outside the lock, as removing waits for handler calls on other threads */
+    if(done != NULL)
+        done->remove();
+    return true;
 }
 
 void VoodooACPIPS2Nub::mergeInterruptProperties(IOService *pnpProvider, long)
@@ -220,8 +345,8 @@ IOReturn VoodooACPIPS2Nub::getResources( void )
 #include <sys/sysctl.h>
 
 #define kextname "PS2Controller"
-#define dbg(args...)    do { kprintf(kextname ": DEBUG " args); IOLog(kextname ": DEBUG " args); IOSleep(50); } while(0)
-#define err(args...)    do { IOLog(kextname ": ERROR " args); IOSleep(50); } while(0)
+#define dbg(args...)    do { kprintf(kextname ": DEBUG " args); IOLog(kextname ": DEBUG " args); } while(0)
+#define err(args...)    do { IOLog(kextname ": ERROR " args); } while(0)
 
 
 #define info(args...)   do { kprintf(kextname ": " args); IOLog(kextname ": " args); } while(0)
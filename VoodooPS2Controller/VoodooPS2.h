@@ -64,6 +64,16 @@ private:
      */
     IOService *m_mouseProvider;
 	
+    /*! @field      m_mouseNotifier
+	 @abstract   Publish notification for a mouse nub that was not found at start
+     */
+    IONotifier *m_mouseNotifier;
+	
+    /*! @field      m_mouseLock
+	 @abstract   Serializes late attaches of the mouse nub
+     */
+    IOLock *m_mouseLock;
+	
     /*! @field      m_interruptControllers
 	 @abstract   Our array of interrupt controllers
      */
@@ -92,12 +102,35 @@ private:
 	
 public:
     virtual bool start(IOService *provider);
+    virtual void stop(IOService *provider);
+    virtual void free();
 	
     /*! @method     findMouseDevice
 	 @abstract   Locates the mouse nub in the IORegistry
+	 @discussion
+	 Looks among the keyboard nub's siblings in the ACPI plane first, where
+	 nearly every DSDT puts the mouse, then among the services already
+	 registered that name-match MouseNameMatch.  Never walks the whole plane.
      */
     virtual IOService *findMouseDevice();
 	
+    /*! @method     attachMouseDevice
+	 @abstract   Attaches to the mouse nub and merges in its interrupt properties
+     */
+    virtual bool attachMouseDevice(IOService *mouse);
+	
+    /*! @method     mousePublished
+	 @abstract   Late attach of a mouse nub published after our start
+	 @discussion
+	 The mouse interrupt is only usable if it arrives before the controller
+	 resolves our interrupts, which it does once a driver installs its
+	 interrupt action.  Until then the keyboard works on its own.  Only
+	 taken when the keyboard interrupt is in place, so the mouse's is the
+	 second; the notification is removed once the mouse is attached.
+     */
+    static bool mousePublished(void *target, void *refCon,
+							   IOService *newService, IONotifier *notifier);
+	
     /*! @method     mergeInterruptProperties
 	 @abstract   Merges the interrupt specifiers and controllers from our two providers
 	 @param  pnpProvider     The provider nub
@@ -21,10 +21,10 @@
  */
 
 #include <IOKit/assert.h>
+#include <IOKit/IOLocks.h>
 #include <IOKit/IOService.h>
-//#include <IOKit/IOSyncer.h>
 #include <IOKit/IOWorkLoop.h>
-#include "IOSyncer.h"
+#include <libkern/OSAtomic.h>
 #include "ApplePS2KeyboardDevice.h"
 #include "ApplePS2MouseDevice.h"
 #include "VoodooPS2Controller.h"
@@ -57,6 +57,13 @@ static ApplePS2Controller * gApplePS2Controller = 0;  // global variable to self
 
 static void interruptHandlerMouse(OSObject *, void *, IOService *, int)
 {
+  if (gApplePS2Controller->_interruptRingEnabled)
+  {
+    // Pull the data off the port right here and queue it for the work loop.
+    gApplePS2Controller->drainDataPort();
+    return;
+  }
+
   //
   // Wake our workloop to service the interrupt.    This is an edge-triggered
   // interrupt, so returning from this routine without clearing the interrupt
@@ -70,6 +77,13 @@ static void interruptHandlerMouse(OSObject *, void *, IOService *, int)
 
 static void interruptHandlerKeyboard(OSObject *, void *, IOService *, int)
 {
+  if (gApplePS2Controller->_interruptRingEnabled)
+  {
+    // Pull the data off the port right here and queue it for the work loop.
+    gApplePS2Controller->drainDataPort();
+    return;
+  }
+
 #if DEBUGGER_SUPPORT
   //
   // The keyboard interrupt handler reads in the pending scan code and stores
@@ -163,6 +177,15 @@ bool ApplePS2Controller::init(OSDictionary * properties)
   _interruptInstalledKeyboard = false;
   _interruptInstalledMouse    = false;
 
+  _batchTargetKeyboard    = 0;
+  _batchTargetMouse       = 0;
+
+  _batchActionKeyboard    = NULL;
+  _batchActionMouse       = NULL;
+
+  _batchInstalledKeyboard = false;
+  _batchInstalledMouse    = false;
+
   _mouseDevice    = 0;
   _keyboardDevice = 0;
   
@@ -172,21 +195,84 @@ bool ApplePS2Controller::init(OSDictionary * properties)
   _newIRQLayout = false;	// turbo
 #endif
 
-  queue_init(&_requestQueue);
+  for (unsigned device = 0; device < 2; device++)
+    for (unsigned priority = 0; priority < kPS2RequestPriorityCount; priority++)
+      queue_init(&_requestQueue[device][priority]);
+  bzero(_requestQueueTurn, sizeof(_requestQueueTurn));
+  _requestCompletionLock = 0;
+
+  _requestTimer          = 0;
+  _parkedRequest         = 0;
+  _parkedIndex           = 0;
+  _parkedDeviceMode      = kDT_Keyboard;
+  _parkedTransmitToMouse = false;
+  _parkedTimedOut        = false;
+  _secondChanceHeld      = false;
+  _secondChanceByte      = 0;
+
+  _dataReadDelay     = kDataDelay;
+  _wakeReadyTimeout  = kWakeReadyTimeout;
+  _mouseWaking       = false;
+  _mouseWakeCount    = 0;
+  _commandByteShadow = 0;
+  bzero(&_mouseIdentity, sizeof(_mouseIdentity));
+  _trace.init();
+  _replayTimer         = 0;
+  _replayRecords       = 0;
+  _replayCount         = 0;
+  _replayUsed          = 0;
+  _replayIndex         = 0;
+  _replayStart         = 0;
+  _replayBytes         = 0;
+  _replayDispatches    = 0;
+  _replayDispatchTime  = 0;
+  _replayPoolAllocated = 0;
+  _replayLiveDropped   = 0;
+  _replayDispatching   = false;
+  _replayMouse         = false;
+  _replayKeyboard      = false;
+  _replayDispatchCost.init();
+
+  queue_init(&_requestPool);
+  _requestPoolLock      = 0;
+  _requestPoolAllocated = 0;
+  _requestPoolInUse     = 0;
+  _requestPoolPeak      = 0;
 
   _currentPowerState = kPS2PowerStateNormal;
+
+  _interruptRingEnabled = false;
+  _inputRingOverflows   = 0;
+  bzero(_inputRing, sizeof(_inputRing));
+
+#if PS2_STATISTICS
+  _statisticsTimer    = 0;
+  _requestQueueLength = 0;
+  _readTimeouts       = 0;
+  _secondChanceHits   = 0;
+  _dispatchLatency.init();
+  _dispatchSize.init();
+  _readWait.init();
+  _requestQueueDepth.init();
+  for (unsigned priority = 0; priority < kPS2RequestPriorityCount; priority++)
+  {
+    _requestClassDepth[priority].init();
+    _requestClassWait[priority].init();
+    _requestClassLength[priority] = 0;
+    _requestsCoalesced[priority]  = 0;
+  }
+#endif
+
+  _controllerLock = IOSimpleLockAlloc();
+  if (!_controllerLock) return false;
   
 #if DEBUGGER_SUPPORT
   _extendedState = false;
   _modifierState = 0x00;
   _debuggingEnabled = false;
 
-  _keyboardQueueAlloc = NULL;
-  queue_init(&_keyboardQueue);
-  queue_init(&_keyboardQueueUnused);
-
-  _controllerLock = IOSimpleLockAlloc();
-  if (!_controllerLock) return false;
+  bzero(&_keyboardQueue, sizeof(_keyboardQueue));
+  _keyboardQueueOverflows = 0;
 #endif //DEBUGGER_SUPPORT
 
   return true;
@@ -194,13 +280,11 @@ bool ApplePS2Controller::init(OSDictionary * properties)
 
 void ApplePS2Controller::free(void)
 {
-#if DEBUGGER_SUPPORT
     if (_controllerLock)
     {
         IOSimpleLockFree(_controllerLock);
         _controllerLock = 0;
     }
-#endif
     super::free();
 }
 
@@ -222,15 +306,6 @@ bool ApplePS2Controller::start(IOService * provider)
   PE_parse_boot_argn("debug", &debugFlag, sizeof(debugFlag));
 #endif
   if (debugFlag) _debuggingEnabled = true;
-
-  _keyboardQueueAlloc = (KeyboardQueueElement *)
-                      IOMalloc(kKeyboardQueueSize*sizeof(KeyboardQueueElement));
-  if (!_keyboardQueueAlloc)  goto fail;
-
-  // Add the allocated keyboard queue entries to "unused" queue.
-  for (int index = 0; index < kKeyboardQueueSize; index++)
-    queue_enter(&_keyboardQueueUnused, &_keyboardQueueAlloc[index],
-                KeyboardQueueElement *, chain);
 #endif //DEBUGGER_SUPPORT
 
 #if !defined(SNOW_LEO) && !defined(TIGER)
@@ -240,6 +315,21 @@ bool ApplePS2Controller::start(IOService * provider)
   }
 #endif
 
+  //
+  // Older machines need a short wait after the controller asserts the output
+  // buffer bit before the data port can be read.  Where that is not the case
+  // the wait can be turned off (0) or tuned per machine, either with the
+  // platform device's "DataReadDelay" property or with our own.
+  //
+
+  {
+    OSNumber * dataReadDelay = OSDynamicCast(OSNumber, provider->getProperty("DataReadDelay"));
+    if (!dataReadDelay)
+      dataReadDelay = OSDynamicCast(OSNumber, getProperty("DataReadDelay"));
+    if (dataReadDelay)
+      _dataReadDelay = dataReadDelay->unsigned32BitValue();
+  }
+
   _suppressTimeout = true;
   UInt8 commandByte;
 
@@ -279,14 +369,27 @@ bool ApplePS2Controller::start(IOService * provider)
   commandByte &= ~(kCB_EnableMouseIRQ | kCB_DisableMouseClock);
   writeCommandPort(kCP_SetCommandByte);
   writeDataPort(commandByte);
+  _commandByteShadow = commandByte;
+
+  //
+  // The keyboard's acknowledge is not waited for; it is discarded along the
+  // way (success irrelevant) while the mouse is being reset and identified,
+  // so the keyboard settles in parallel with the mouse round trips.
+  //
 
   writeDataPort(kDP_SetDefaultsAndDisable);
-  readDataPort(kDT_Keyboard);       // (discard acknowledge; success irrelevant)
 
   writeCommandPort(kCP_TransmitToMouse);
   writeDataPort(kDP_SetDefaultsAndDisable);
   readDataPort(kDT_Mouse);          // (discard acknowledge; success irrelevant)
 
+  //
+  // Run the identification queries all trackpad drivers start out with once,
+  // here, and hand the results to every driver's probe through the nub.
+  //
+
+  identifyMouse(&_mouseIdentity);
+
   //
   // Clear out garbage in the controller's input streams, before starting up
   // the work loop.
@@ -299,6 +402,49 @@ bool ApplePS2Controller::start(IOService * provider)
     IODelay(kDataDelay);
   }
 
+  //
+  // Optionally have the primary interrupt handlers drain the data port into
+  // the input rings, instead of leaving the data in the controller until the
+  // work loop gets around to it.
+  //
+
+  {
+    OSBoolean * interruptRing = OSDynamicCast(OSBoolean, getProperty("InterruptRing"));
+    if (interruptRing && interruptRing->isTrue())
+    {
+      IOLog("%s: Using interrupt-time input rings\n", getName());
+      _interruptRingEnabled = true;
+    }
+  }
+
+  //
+  // Upper bound on the wait for the mouse to answer again after wake.
+  //
+
+  {
+    OSNumber * wakeReadyTimeout = OSDynamicCast(OSNumber, getProperty("WakeReadyTimeout"));
+    if (wakeReadyTimeout)
+      _wakeReadyTimeout = wakeReadyTimeout->unsigned32BitValue();
+  }
+
+  //
+  // Allocate the trace buffer.  Nothing is traced until TraceMask (or a
+  // user space tool, through the user client) turns record types on.
+  //
+
+  {
+    UInt32     records = kTraceRecords;
+    UInt32     mask    = 0;
+    OSNumber * number  = OSDynamicCast(OSNumber, getProperty("TraceRecords"));
+    if (number)
+      records = number->unsigned32BitValue();
+    number = OSDynamicCast(OSNumber, getProperty("TraceMask"));
+    if (number)
+      mask = number->unsigned32BitValue();
+    if (records && !_trace.allocate(records, mask))
+      IOLog("%s: Unable to allocate trace buffer\n", getName());
+  }
+
   //
   // Use a spin lock to protect the client async request queue.
   //
@@ -306,6 +452,32 @@ bool ApplePS2Controller::start(IOService * provider)
   _requestQueueLock = IOSimpleLockAlloc();
   if (!_requestQueueLock) goto fail;
 
+  //
+  // Callers of submitRequestAndBlock sleep on this lock, with the completion
+  // flag on their own stack, until the work loop has processed the request.
+  //
+
+  _requestCompletionLock = IOLockAlloc();
+  if (!_requestCompletionLock) goto fail;
+
+  //
+  // Preallocate the request structures handed out by allocateRequest, so
+  // that the command path (and wake from sleep in particular) does not need
+  // to go to the allocator.
+  //
+
+  _requestPoolLock = IOSimpleLockAlloc();
+  if (!_requestPoolLock) goto fail;
+
+  for (int index = 0; index < kRequestPoolSize; index++)
+  {
+    PS2Request * request = (PS2Request *) IOMalloc(sizeof(PS2Request));
+    if (!request) goto fail;
+    queue_enter(&_requestPool, request, PS2Request *, chain);
+    _requestPoolAllocated++;
+  }
+  publishRequestPoolStatistics();
+
   //
   // Initialize our work loop, our command gate, and our interrupt event
   // sources.  The work loop can accept requests after this step.
@@ -329,6 +501,43 @@ bool ApplePS2Controller::start(IOService * provider)
 
   _interruptSourceQueue->enable();
 
+  //
+  // The timer bounds the wait of a request parked on input from the rings.
+  //
+
+  if (_interruptRingEnabled)
+  {
+    _requestTimer = IOTimerEventSource::timerEventSource( this,
+			OSMemberFunctionCast(IOTimerEventSource::Action, this, &ApplePS2Controller::requestTimedOut));
+    if ( !_requestTimer ||
+         _workLoop->addEventSource(_requestTimer) != kIOReturnSuccess )
+      goto fail;
+  }
+
+  //
+  // The replay timer paces a captured stream fed back to the drivers.
+  //
+
+  _replayTimer = IOTimerEventSource::timerEventSource( this,
+			OSMemberFunctionCast(IOTimerEventSource::Action, this, &ApplePS2Controller::replayOccurred));
+  if ( !_replayTimer ||
+       _workLoop->addEventSource(_replayTimer) != kIOReturnSuccess )
+    goto fail;
+
+#if PS2_STATISTICS
+  //
+  // The statistics are published off a timer, not from the paths that
+  // collect them.
+  //
+
+  _statisticsTimer = IOTimerEventSource::timerEventSource( this,
+			OSMemberFunctionCast(IOTimerEventSource::Action, this, &ApplePS2Controller::publishStatistics));
+  if ( !_statisticsTimer ||
+       _workLoop->addEventSource(_statisticsTimer) != kIOReturnSuccess )
+    goto fail;
+  _statisticsTimer->setTimeoutMS(kStatisticsInterval);
+#endif
+
   //
   // Since there is a calling path from the PS/2 driver stack to power
   // management for activity tickles.  We must create a thread callout
@@ -390,7 +599,10 @@ bool ApplePS2Controller::start(IOService * provider)
   if (_keyboardDevice)
 	_keyboardDevice->registerService();
   if (_mouseDevice)
+  {
+	_mouseDevice->setIdentity(&_mouseIdentity);
 	_mouseDevice->registerService();
+  }
 
   return true; // success
 
@@ -415,6 +627,8 @@ void ApplePS2Controller::stop(IOService * provider)
   // Ensure that the interrupt handlers have been uninstalled (ie. no clients).
   assert(_interruptInstalledKeyboard    == false);
   assert(_interruptInstalledMouse       == false);
+  assert(_batchInstalledKeyboard        == false);
+  assert(_batchInstalledMouse           == false);
   assert(_powerControlInstalledKeyboard == false);
   assert(_powerControlInstalledMouse    == false);
 
@@ -422,6 +636,33 @@ void ApplePS2Controller::stop(IOService * provider)
   RELEASE(_keyboardDevice);
   RELEASE(_mouseDevice);
 
+  // Free the parked request timer.
+  if (_requestTimer)
+  {
+    _requestTimer->cancelTimeout();
+    if (_workLoop)  _workLoop->removeEventSource(_requestTimer);
+    RELEASE(_requestTimer);
+  }
+
+  // Free the replay timer, and any replay left.
+  if (_replayTimer)
+  {
+    _replayTimer->cancelTimeout();
+    if (_workLoop)  _workLoop->removeEventSource(_replayTimer);
+    RELEASE(_replayTimer);
+  }
+  freeReplay();
+
+#if PS2_STATISTICS
+  // Free the statistics timer.
+  if (_statisticsTimer)
+  {
+    _statisticsTimer->cancelTimeout();
+    if (_workLoop)  _workLoop->removeEventSource(_statisticsTimer);
+    RELEASE(_statisticsTimer);
+  }
+#endif
+
   // Free the work loop.
   RELEASE(_workLoop);
 
@@ -439,6 +680,28 @@ void ApplePS2Controller::stop(IOService * provider)
     _requestQueueLock = 0;
   }
 
+  // Free the request pool, now that all outstanding requests are back.
+  if (_requestPoolLock)
+  {
+    assert(_requestPoolInUse == 0);
+    while (!queue_empty(&_requestPool))
+    {
+      PS2Request * request;
+      queue_remove_first(&_requestPool, request, PS2Request *, chain);
+      IOFree(request, sizeof(PS2Request));
+    }
+    _requestPoolAllocated = 0;
+    IOSimpleLockFree(_requestPoolLock);
+    _requestPoolLock = 0;
+  }
+
+  // Free the blocking request completion lock.
+  if (_requestCompletionLock)
+  {
+    IOLockFree(_requestCompletionLock);
+    _requestCompletionLock = 0;
+  }
+
   // Free the power management thread call.
   if (_powerChangeThreadCall)
   {
@@ -449,11 +712,8 @@ void ApplePS2Controller::stop(IOService * provider)
   // Detach from power management plane.
   PMstop();
 
-#if DEBUGGER_SUPPORT
-  // Free the keyboard queue allocation space (after disabling interrupt).
-  if (_keyboardQueueAlloc)
-    IOFree(_keyboardQueueAlloc,kKeyboardQueueSize*sizeof(KeyboardQueueElement));
-#endif //DEBUGGER_SUPPORT
+  // Free the trace buffer (our user clients, being our clients, are gone).
+  _trace.free();
 
   gApplePS2Controller = 0;
 
@@ -462,25 +722,100 @@ void ApplePS2Controller::stop(IOService * provider)
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-IOWorkLoop * ApplePS2Controller::getWorkLoop() const
+void ApplePS2Controller::identifyMouse(PS2MouseIdentity * identity)
 {
-    return _workLoop;
+  //
+  // Send the standard identification queries to the mouse port: Synaptics'
+  // "Identify TouchPad" and ALPS' "E6" and "E7" reports.  Each is a short
+  // knock sequence followed by kDP_GetMouseInformation, whose three status
+  // bytes are the answer.  The mouse is set back to its defaults afterwards.
+  //
+  // This method is only called from start, before the work loop is up.
+  //
+
+  static const UInt8 synapticsKnock[] = { kDP_SetMouseResolution, 0,
+                                          kDP_SetMouseResolution, 0,
+                                          kDP_SetMouseResolution, 0,
+                                          kDP_SetMouseResolution, 0 };
+  static const UInt8 e6Knock[]        = { kDP_SetMouseResolution, 0,
+                                          kDP_SetMouseScaling1To1,
+                                          kDP_SetMouseScaling1To1,
+                                          kDP_SetMouseScaling1To1 };
+  static const UInt8 e7Knock[]        = { kDP_SetMouseResolution, 0,
+                                          kDP_SetMouseScaling2To1,
+                                          kDP_SetMouseScaling2To1,
+                                          kDP_SetMouseScaling2To1 };
+
+  bzero(identity, sizeof(*identity));
+
+  identity->synapticsValid = getMouseInformation(synapticsKnock,
+                                                 sizeof(synapticsKnock),
+                                                 identity->synaptics);
+  identity->e6Valid        = getMouseInformation(e6Knock, sizeof(e6Knock),
+                                                 identity->e6);
+  identity->e7Valid        = getMouseInformation(e7Knock, sizeof(e7Knock),
+                                                 identity->e7);
+
+  writeCommandPort(kCP_TransmitToMouse);
+  writeDataPort(kDP_SetDefaultsAndDisable);
+  readDataPort(kDT_Mouse);          // (discard acknowledge; success irrelevant)
+
+  IOLog("%s: Mouse identity %02x %02x %02x, E6 %02x %02x %02x, E7 %02x %02x %02x\n",
+        getName(),
+        identity->synaptics[0], identity->synaptics[1], identity->synaptics[2],
+        identity->e6[0], identity->e6[1], identity->e6[2],
+        identity->e7[0], identity->e7[1], identity->e7[2]);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-IOSyncer *ApplePS2Controller::CreateIOSyncer(bool twoRetains)
+bool ApplePS2Controller::getMouseInformation(const UInt8 * knock,
+                                             unsigned      knockCount,
+                                             UInt8         info[3])
 {
-    IOSyncer *me = new IOSyncer;
+  //
+  // Send the given mouse commands, then kDP_GetMouseInformation, and return
+  // the three bytes of the answer.  Returns false if a command was not
+  // acknowledged, leaving the answer zeroed.
+  //
 
-    if ((me) && (!me->init(twoRetains)))
-	{
-        me->release();
+  PS2Request request;
+  unsigned   index;
 
-        return(0);
-    }
-	
-    return(me);
+  bzero(&request, sizeof(request));
+
+  for (index = 0; index < knockCount; index++)
+  {
+    request.commands[index].command = kPS2C_SendMouseCommandAndCompareAck;
+    request.commands[index].inOrOut = knock[index];
+  }
+  request.commands[index].command   = kPS2C_SendMouseCommandAndCompareAck;
+  request.commands[index++].inOrOut = kDP_GetMouseInformation;
+  request.commands[index++].command = kPS2C_ReadDataPort;
+  request.commands[index++].command = kPS2C_ReadDataPort;
+  request.commands[index++].command = kPS2C_ReadDataPort;
+  request.commandsCount = index;
+
+  // (a completion routine keeps processRequest from freeing our request)
+  request.completionTarget = this;
+  request.completionAction = submitRequestAndBlockCompletion;
+  request.completionParam  = 0;
+
+  processRequest(&request);
+
+  if (request.commandsCount != index)  return false;
+
+  info[0] = request.commands[index - 3].inOrOut;
+  info[1] = request.commands[index - 2].inOrOut;
+  info[2] = request.commands[index - 1].inOrOut;
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOWorkLoop * ApplePS2Controller::getWorkLoop() const
+{
+    return _workLoop;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -582,14 +917,94 @@ void ApplePS2Controller::uninstallInterruptAction(PS2DeviceType deviceType)
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2Controller::installBatchInterruptAction(
+                                          PS2DeviceType           deviceType,
+                                          OSObject *              target,
+                                          PS2BatchInterruptAction action)
+{
+  //
+  // Install the keyboard or mouse batch interrupt handler.  While installed,
+  // data drained off the input stream is delivered to it in contiguous runs
+  // instead of byte by byte through the regular interrupt action.
+  //
+  // Same single-client assumptions as installInterruptAction.
+  //
+
+  if (deviceType == kDT_Keyboard && _batchInstalledKeyboard == false)
+  {
+    target->retain();
+    _batchTargetKeyboard    = target;
+    _batchActionKeyboard    = action;
+    _batchInstalledKeyboard = true;
+  }
+  else if (deviceType == kDT_Mouse && _batchInstalledMouse == false)
+  {
+    target->retain();
+    _batchTargetMouse    = target;
+    _batchActionMouse    = action;
+    _batchInstalledMouse = true;
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::uninstallBatchInterruptAction(PS2DeviceType deviceType)
+{
+  if (deviceType == kDT_Keyboard && _batchInstalledKeyboard == true)
+  {
+    _batchInstalledKeyboard = false;
+    _batchActionKeyboard    = NULL;
+    _batchTargetKeyboard->release();
+    _batchTargetKeyboard    = 0;
+  }
+  else if (deviceType == kDT_Mouse && _batchInstalledMouse == true)
+  {
+    _batchInstalledMouse = false;
+    _batchActionMouse    = NULL;
+    _batchTargetMouse->release();
+    _batchTargetMouse    = 0;
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 PS2Request * ApplePS2Controller::allocateRequest()
 {
   //
   // Allocate a request structure.  Blocks until successful.  Request structure
   // is guaranteed to be zeroed.
   //
+  // Requests come off the preallocated pool; should the pool run dry, a new
+  // one is allocated, and joins the pool once it is freed.
+  //
+
+  PS2Request * request = 0;
+  bool         grown   = false;
+  bool         peaked  = false;
+
+  IOSimpleLockLock(_requestPoolLock);
+  if (!queue_empty(&_requestPool))
+    queue_remove_first(&_requestPool, request, PS2Request *, chain);
+  IOSimpleLockUnlock(_requestPoolLock);
+
+  if (!request)
+  {
+    request = (PS2Request *) IOMalloc(sizeof(PS2Request));
+    grown   = true;
+  }
+
+  IOSimpleLockLock(_requestPoolLock);
+  if (grown)  _requestPoolAllocated++;
+  if (++_requestPoolInUse > _requestPoolPeak)
+  {
+    _requestPoolPeak = _requestPoolInUse;
+    peaked           = true;
+  }
+  IOSimpleLockUnlock(_requestPoolLock);
+
+  // Only publish when the high-water marks move, which is rare.
+  if (grown || peaked)  publishRequestPoolStatistics();
 
-  PS2Request * request = (PS2Request *) IOMalloc(sizeof(PS2Request));
   bzero(request, sizeof(PS2Request));
   return request; 
 }
@@ -599,24 +1014,222 @@ PS2Request * ApplePS2Controller::allocateRequest()
 void ApplePS2Controller::freeRequest(PS2Request * request)
 {
   //
-  // Deallocate a request structure.
+  // Deallocate a request structure.  It goes back onto the request pool.
+  //
+
+  IOSimpleLockLock(_requestPoolLock);
+  queue_enter(&_requestPool, request, PS2Request *, chain);
+  _requestPoolInUse--;
+  IOSimpleLockUnlock(_requestPoolLock);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::publishRequestPoolStatistics()
+{
+  //
+  // Export the request pool counters through the registry, as the
+  // "RequestPool" dictionary: Allocated (structures owned by the pool),
+  // InUse and Peak (high-water mark of InUse).
+  //
+
+  OSDictionary * dict = OSDictionary::withCapacity(3);
+  if (!dict)  return;
+
+  IOSimpleLockLock(_requestPoolLock);
+  UInt32 allocated = _requestPoolAllocated;
+  UInt32 inUse     = _requestPoolInUse;
+  UInt32 peak      = _requestPoolPeak;
+  IOSimpleLockUnlock(_requestPoolLock);
+
+  OSNumber * number;
+  if ((number = OSNumber::withNumber(allocated, 32)))
+  {
+    dict->setObject("Allocated", number);
+    number->release();
+  }
+  if ((number = OSNumber::withNumber(inUse, 32)))
+  {
+    dict->setObject("InUse", number);
+    number->release();
+  }
+  if ((number = OSNumber::withNumber(peak, 32)))
+  {
+    dict->setObject("Peak", number);
+    number->release();
+  }
+
+  setProperty("RequestPool", dict);
+  dict->release();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+#if PS2_STATISTICS
+
+void ApplePS2Controller::publishStatistics(IOTimerEventSource *)
+{
   //
+  // Export the hot-path statistics through the registry, as the "Statistics"
+  // dictionary.  Histograms: DispatchLatency (usec from the primary interrupt
+  // to the driver dispatch, input rings only), DispatchSize (bytes handed to
+  // a driver per dispatch), ReadWait (usec spent polling for each byte read
+  // by readDataPort) and RequestQueueDepth (queued requests, sampled as each
+  // is submitted).  Counters: ReadTimeouts and SecondChanceHits (bytes put
+  // aside by the out-of-order data correction, correctly).  RequestClasses
+  // holds a dictionary per request class (Interactive, Configuration and
+  // Background) of Depth (requests of the class queued, sampled as each is
+  // submitted), Wait (usec from submission until the request started) and
+  // Coalesced (requests dropped as superseded).  Runs on the work loop, which
+  // serializes it with the paths collecting the data.
+  //
+
+  OSDictionary * dict = OSDictionary::withCapacity(7);
+  if (dict)
+  {
+    PS2Histogram classDepth[kPS2RequestPriorityCount];
+    PS2Histogram classWait[kPS2RequestPriorityCount];
+    UInt32       coalesced[kPS2RequestPriorityCount];
+
+    IOSimpleLockLock(_requestQueueLock);
+    PS2Histogram queueDepth = _requestQueueDepth;
+    for (unsigned priority = 0; priority < kPS2RequestPriorityCount; priority++)
+    {
+      classDepth[priority] = _requestClassDepth[priority];
+      classWait[priority]  = _requestClassWait[priority];
+      coalesced[priority]  = _requestsCoalesced[priority];
+    }
+    IOSimpleLockUnlock(_requestQueueLock);
+
+    const char *         keys[]       = { "DispatchLatency", "DispatchSize",
+                                          "ReadWait", "RequestQueueDepth" };
+    const PS2Histogram * histograms[] = { &_dispatchLatency, &_dispatchSize,
+                                          &_readWait, &queueDepth };
+
+    for (unsigned index = 0; index < sizeof(keys) / sizeof(keys[0]); index++)
+    {
+      OSDictionary * histogram = histograms[index]->copyDictionary();
+      if (histogram)
+      {
+        dict->setObject(keys[index], histogram);
+        histogram->release();
+      }
+    }
+
+    OSNumber * number;
+    if ((number = OSNumber::withNumber(_readTimeouts, 32)))
+    {
+      dict->setObject("ReadTimeouts", number);
+      number->release();
+    }
+    if ((number = OSNumber::withNumber(_secondChanceHits, 32)))
+    {
+      dict->setObject("SecondChanceHits", number);
+      number->release();
+    }
 
-  IOFree(request, sizeof(PS2Request));
+    OSDictionary * classes = OSDictionary::withCapacity(kPS2RequestPriorityCount);
+    if (classes)
+    {
+      const char * names[] = { "Configuration", "Interactive", "Background" };
+
+      for (unsigned priority = 0; priority < kPS2RequestPriorityCount; priority++)
+      {
+        OSDictionary * entry = OSDictionary::withCapacity(3);
+        if (!entry)  continue;
+
+        OSDictionary * histogram;
+        if ((histogram = classDepth[priority].copyDictionary()))
+        {
+          entry->setObject("Depth", histogram);
+          histogram->release();
+        }
+        if ((histogram = classWait[priority].copyDictionary()))
+        {
+          entry->setObject("Wait", histogram);
+          histogram->release();
+        }
+        if ((number = OSNumber::withNumber(coalesced[priority], 32)))
+        {
+          entry->setObject("Coalesced", number);
+          number->release();
+        }
+        classes->setObject(names[priority], entry);
+        entry->release();
+      }
+      dict->setObject("RequestClasses", classes);
+      classes->release();
+    }
+
+    setProperty("Statistics", dict);
+    dict->release();
+  }
+
+  _statisticsTimer->setTimeoutMS(kStatisticsInterval);
 }
 
+#endif //PS2_STATISTICS
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 bool ApplePS2Controller::submitRequest(PS2Request * request)
 {
   //
   // Submit the request to the controller for processing, asynchronously.
+  // It joins the queue of its device and class.  Should a request waiting
+  // there be one it supersedes (same coalesce key, no completion routine),
+  // that one is dropped, wherever it is.  The new request still goes to the
+  // end, so it never runs ahead of one submitted before it in the same queue.
   //
 
+  PS2Request *   superseded = 0;
+  queue_head_t * queue;
+
+  if (request->priority >= kPS2RequestPriorityCount)
+    request->priority = kPS2RequestConfiguration;
+  if (request->device != kDT_Mouse)
+    request->device = kDT_Keyboard;
+#if PS2_STATISTICS
+  clock_get_uptime(&request->submitTime);
+#endif
+
   IOSimpleLockLock(_requestQueueLock);
-  queue_enter(&_requestQueue, request, PS2Request *, chain);
+  queue = &_requestQueue[request->device][request->priority];
+  if (request->coalesceKey != kPS2CoalesceNone)
+  {
+    PS2Request * queued;
+
+    for (queued = (PS2Request *) queue_first(queue);
+         !queue_end(queue, (queue_entry_t) queued);
+         queued = (PS2Request *) queue_next(&queued->chain))
+    {
+      if (queued->coalesceKey == request->coalesceKey &&
+          !(queued->completionTarget && queued->completionAction))
+      {
+        superseded = queued;
+        queue_remove(queue, superseded, PS2Request *, chain);
+        break;
+      }
+    }
+  }
+  queue_enter(queue, request, PS2Request *, chain);
+#if PS2_STATISTICS
+  if (superseded)
+  {
+    _requestsCoalesced[request->priority]++;
+  }
+  else
+  {
+    _requestQueueLength++;
+    _requestClassLength[request->priority]++;
+  }
+  _requestQueueDepth.add(_requestQueueLength);
+  _requestClassDepth[request->priority].add(_requestClassLength[request->priority]);
+#endif
   IOSimpleLockUnlock(_requestQueueLock);
 
+  if (superseded)  freeRequest(superseded);
+
   _interruptSourceQueue->interruptOccurred(0, 0, 0);
 
   return true;
@@ -624,6 +1237,28 @@ bool ApplePS2Controller::submitRequest(PS2Request * request)
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+bool ApplePS2Controller::submitRequest(PS2Request *        request,
+                                       void *              target,
+                                       PS2CompletionAction action,
+                                       void *              param)
+{
+  //
+  // Submit the request to the controller for processing, asynchronously,
+  // and call back the given completion routine once it is done.  The
+  // completion routine may submit the next request of a sequence (but
+  // must not block on it), which lets drivers pipeline multi-command
+  // sequences without a thread wake-up per command.
+  //
+
+  request->completionTarget = target;
+  request->completionAction = action;
+  request->completionParam  = param;
+
+  return submitRequest(request);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 void ApplePS2Controller::submitRequestAndBlock(PS2Request * request)
 {
   //
@@ -642,33 +1277,75 @@ void ApplePS2Controller::submitRequestAndBlock(PS2Request * request)
     request->completionAction = submitRequestAndBlockCompletion;
     request->completionParam  = 0;
 
-    processRequestQueue(0, 0);
+    runRequestQueue(false);
     processRequest(request);
   }
   else
   {
-    IOSyncer * completionSyncer = CreateIOSyncer(true);
+    //
+    // The completion flag lives on our stack; the completion routine sets it
+    // and wakes us up from the work loop once the request has been processed.
+    //
+
+    volatile bool completed = false;
 
-    assert(completionSyncer);
     request->completionTarget = this;
     request->completionAction = submitRequestAndBlockCompletion;
-    request->completionParam  = completionSyncer;
+    request->completionParam  = (void *) &completed;
 
     submitRequest(request);
 
-    completionSyncer->wait();                               // wait 'till done
+    IOLockLock(_requestCompletionLock);
+    while (!completed)                                      // wait 'till done
+      IOLockSleep(_requestCompletionLock, (void *) &completed, THREAD_UNINT);
+    IOLockUnlock(_requestCompletionLock);
   }
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2Controller::submitRequestAndBlockCompletion(void *, void * param)
+void ApplePS2Controller::submitRequestAndBlockCompletion(void * target,
+                                                         void * param)
 {                                                      // PS2CompletionAction
   if (param)
   {
-    IOSyncer * completionSyncer = (IOSyncer *) param;
-    completionSyncer->signal();
-  }
+    //
+    // The waiter may return (and its stack frame go away) as soon as we drop
+    // the lock, so the flag must not be touched after the unlock.
+    //
+
+    ApplePS2Controller * me = (ApplePS2Controller *) target;
+
+    IOLockLock(me->_requestCompletionLock);
+    *(volatile bool *) param = true;
+    IOLockWakeup(me->_requestCompletionLock, param, true);
+    IOLockUnlock(me->_requestCompletionLock);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::updateCommandByte(UInt8 setBits, UInt8 clearBits)
+{
+  //
+  // Sets the bits setBits and clears the bits clearBits in the controller's
+  // Command Byte.  This goes through the request queue like any request, so
+  // it is ordered with the drivers' other requests, and is executed against
+  // the command byte we wrote last (see kPS2C_ModifyCommandByte): no port
+  // reads, and no port writes at all if the bits are already as requested.
+  //
+  // Do NOT issue this request from the interrupt/completion context.
+  //
+
+  PS2Request * request = allocateRequest();
+
+  request->commands[0].command = kPS2C_ModifyCommandByte;
+  request->commands[0].inOrOut = setBits;
+  request->commands[1].command = kPS2C_ModifyCommandByte;
+  request->commands[1].inOrOut = clearBits;
+  request->commandsCount = 2;
+  submitRequestAndBlock(request);
+  freeRequest(request);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -680,6 +1357,11 @@ void ApplePS2Controller::interruptOccurred(IOInterruptEventSource *, int)
   // data has arrived on our input stream.  Read the data and dispatch it
   // to the appropriate driver.
   //
+  // Consecutive bytes for the same device are collected into a local buffer
+  // and handed over in one dispatch, which is flushed whenever the stream
+  // switches devices (or the buffer fills), so the relative order of all
+  // bytes is exactly that of the input stream.
+  //
   // This method should only be called from our single-threaded work loop.
   //
 
@@ -690,7 +1372,68 @@ void ApplePS2Controller::interruptOccurred(IOInterruptEventSource *, int)
     return;
   }
 
-  UInt8 status;
+  UInt8         buffer[kDrainBufferSize];
+  UInt32        count      = 0;
+  PS2DeviceType bufferType = kDT_Keyboard;
+  PS2DeviceType deviceType;
+  UInt8         data;
+
+  if (_interruptRingEnabled)
+  {
+    //
+    // The primary interrupt handlers already took the data off the port;
+    // just empty the rings, one device at a time.  No lock is required as
+    // we are the only consumer.  Bytes are copied out before the ring slots
+    // are released, since a driver may re-enter readDataPort and the ring
+    // from its interrupt routine.
+    //
+    // Input that a parked request is waiting on goes to that request first,
+    // then the requests queued up behind it get their turn.  While it stays
+    // parked, the ring of the device it waits on is left alone.
+    //
+
+    if (_parkedRequest && dequeueInputRing(_parkedDeviceMode, &data, 0))
+    {
+      resumeParkedRequest(data, true);
+      runRequestQueue(true);
+    }
+
+    for (int ring = kDT_Keyboard; ring <= kDT_Mouse; ring++)
+    {
+      deviceType = (PS2DeviceType) ring;
+      if (_parkedRequest && _parkedDeviceMode == deviceType)  continue;
+      do
+      {
+        UInt64 timestamp = 0;
+
+        for (count = 0; count < kDrainBufferSize; count++)
+          if (!dequeueInputRing(deviceType, &buffer[count],
+                                count ? 0 : &timestamp))  break;
+
+        if (count)
+        {
+#if PS2_STATISTICS
+          // Latency of the oldest byte in the batch.
+          uint64_t now, latency;
+          clock_get_uptime(&now);
+          absolutetime_to_nanoseconds(now - timestamp, &latency);
+          _dispatchLatency.add((UInt32) (latency / 1000));
+#endif
+          dispatchDriverInterrupt(deviceType, buffer, count);
+        }
+      } while (count == kDrainBufferSize);
+    }
+
+    UInt32 overflows = _inputRing[kDT_Keyboard].overflows +
+                       _inputRing[kDT_Mouse].overflows;
+    if (overflows != _inputRingOverflows)
+    {
+      _inputRingOverflows = overflows;
+      setProperty("InputRingOverflows", overflows, 32);
+    }
+    return;
+  }
+
 #if DEBUGGER_SUPPORT
   int state;
   lockController(&state);              // (lock out interrupt + access to queue)
@@ -700,37 +1443,63 @@ void ApplePS2Controller::interruptOccurred(IOInterruptEventSource *, int)
     // we do not read keyboard data from the real data port if it should
     // be available. 
 
-    if (dequeueKeyboardData(&status))
+    if (dequeueKeyboardData(&data))
     {
-      unlockController(state);
-      dispatchDriverInterrupt(kDT_Keyboard, status);
-      lockController(&state);
+      deviceType = kDT_Keyboard;
     }
 
     // See if data is available on the mouse input stream (off real port).
 
     else if ( (inb(kCommandPort) & (kOutputReady | kMouseData)) ==
                                    (kOutputReady | kMouseData))
+    {
+      deviceType = kDT_Mouse;
+      data       = inb(kDataPort);
+    }
+    else break; // out of loop
+
+    if (count && (deviceType != bufferType || count == kDrainBufferSize))
     {
       unlockController(state);
-      dispatchDriverInterrupt(kDT_Mouse, inb(kDataPort));
+      dispatchDriverInterrupt(bufferType, buffer, count);
+      count = 0;
       lockController(&state);
     }
-    else break; // out of loop
+
+    bufferType      = deviceType;
+    buffer[count++] = data;
   }
+  UInt32 keyboardOverflows = _keyboardQueue.overflows;
   unlockController(state);      // (release interrupt lockout + access to queue)
+
+  if (keyboardOverflows != _keyboardQueueOverflows)
+  {
+    _keyboardQueueOverflows = keyboardOverflows;
+    setProperty("KeyboardQueueOverflows", keyboardOverflows, 32);
+  }
 #else
+  UInt8 status;
+
   // Loop only while there is data currently on the input stream.
 
   while ( ((status = inb(kCommandPort)) & kOutputReady) )
   {
-    // Read in and dispatch the data, but only if it isn't what is required
-    // by the active command.
+    deviceType = (status & kMouseData) ? kDT_Mouse : kDT_Keyboard;
+
+    if (count && (deviceType != bufferType || count == kDrainBufferSize))
+    {
+      dispatchDriverInterrupt(bufferType, buffer, count);
+      count = 0;
+    }
 
-    dispatchDriverInterrupt((status&kMouseData)?kDT_Mouse:kDT_Keyboard,
-                            inb(kDataPort));
+    bufferType      = deviceType;
+    buffer[count++] = inb(kDataPort);
   }
 #endif //DEBUGGER_SUPPORT
+
+  // Dispatch whatever is left over from the last run.
+
+  if (count)  dispatchDriverInterrupt(bufferType, buffer, count);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -745,17 +1514,87 @@ void ApplePS2Controller::dispatchDriverInterrupt(PS2DeviceType deviceType,
   // This method should only be called from our single-threaded work loop.
   //
 
+  dispatchDriverInterrupt(deviceType, &data, 1);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::dispatchDriverInterrupt(PS2DeviceType deviceType,
+                                                 const UInt8 * data,
+                                                 UInt32        count)
+{
+  //
+  // The supplied run of data is passed onto the batch interrupt handler in
+  // the appropriate driver if one is registered, otherwise it is fed to the
+  // regular interrupt handler one byte at a time.  Without any interrupt
+  // handler registered, the data is thrown away.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  //
+  // While the mouse is being waited for on wake, its answers to our status
+  // queries must not reach the driver; hold them for waitForMouseReady.
+  //
+
+  if ( deviceType == kDT_Mouse && _mouseWaking )
+  {
+    for (UInt32 index = 0; index < count && _mouseWakeCount < kWakeHeldBytes; index++)
+      _mouseWakeBytes[_mouseWakeCount++] = data[index];
+    return;
+  }
+
+  //
+  // A replay has the replayed devices' drivers to itself, as if the real
+  // port were idle; their live input meanwhile would corrupt both streams,
+  // so it is dropped.  The drivers' own requests still get their answers
+  // through readDataPort.  Someone typing on a replayed keyboard ends the
+  // replay rather than talk to a dead keyboard.
+  //
+
+  if ( _replayRecords && !_replayDispatching )
+  {
+    if ( deviceType == kDT_Keyboard && _replayKeyboard )
+    {
+      endReplay();
+    }
+    else if ( deviceType == kDT_Mouse ? _replayMouse : _replayKeyboard )
+    {
+      _replayLiveDropped += count;
+      return;
+    }
+  }
+
+#if PS2_STATISTICS
+  _dispatchSize.add(count);
+#endif
+
+  _trace.add(deviceType == kDT_Mouse ? kPS2TraceMouseByte : kPS2TraceKeyboardByte,
+             _replayDispatching ? kPS2TraceCodeReplay : 0, data, count);
+
   if ( deviceType == kDT_Mouse )
   {
     // Dispatch the data to the mouse driver.
     if (_interruptInstalledMouse)
-      (*_interruptActionMouse)(_interruptTargetMouse, data);
+    {
+      if (_batchInstalledMouse)
+        (*_batchActionMouse)(_batchTargetMouse, data, count);
+      else
+        for (UInt32 index = 0; index < count; index++)
+          (*_interruptActionMouse)(_interruptTargetMouse, data[index]);
+    }
   }
   else if ( deviceType == kDT_Keyboard )
   {
     // Dispatch the data to the keyboard driver.
-    if (_interruptInstalledKeyboard)       
-      (*_interruptActionKeyboard)(_interruptTargetKeyboard, data);
+    if (_interruptInstalledKeyboard)
+    {
+      if (_batchInstalledKeyboard)
+        (*_batchActionKeyboard)(_batchTargetKeyboard, data, count);
+      else
+        for (UInt32 index = 0; index < count; index++)
+          (*_interruptActionKeyboard)(_interruptTargetKeyboard, data[index]);
+    }
   }
 }
 
@@ -765,46 +1604,78 @@ void ApplePS2Controller::processRequest(PS2Request * request)
 {
   //
   // Our work loop has informed us of a request submission. Process
-  // the request.  Note that this code "figures out" when the mouse
-  // input stream should be read over the keyboard input stream.
+  // the request to completion, synchronously.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  executeRequest(request, 0, kDT_Keyboard, false, 0, false);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::executeRequest(PS2Request *  request,
+                                        unsigned      index,
+                                        PS2DeviceType deviceMode,
+                                        bool          transmitToMouse,
+                                        const UInt8 * resumeByte,
+                                        bool          mayPark)
+{
+  //
+  // Process the request's commands, starting at the given index.  Note that
+  // this code "figures out" when the mouse input stream should be read over
+  // the keyboard input stream.
+  //
+  // When resuming a parked request, resumeByte holds the input that the
+  // command at the given index was waiting on.  When parking is allowed and
+  // a read would have to wait for input that arrives by IRQ, the request is
+  // parked instead and this method returns without completing it.  Input
+  // taken off the ring gets the same second chance as readDataPort gives it
+  // (see takeSecondChance), for which the request may park again.
   //
   // This method should only be called from our single-threaded work loop.
   //
 
   UInt8         byte;
-  PS2DeviceType deviceMode      = kDT_Keyboard;
   bool          failed          = false;
-  bool          transmitToMouse = false;
-  unsigned      index;
+  bool          setCommandByte  = false;
+  bool          timedOut;
 
   if (_hardwareOffline)
   {
+    _secondChanceHeld = false;
+    _parkedTimedOut   = false;
     failed = true;
-    index  = 0;
     goto hardware_offline;
   }
 
   // Process each of the commands in the list.
 
-  for (index = 0; index < request->commandsCount; index++)
+  for (; index < request->commandsCount; index++)
   {
-    switch (request->commands[index].command)
+    UInt8 command = request->commands[index].command;
+
+    if (resumeByte)
     {
-      case kPS2C_ReadDataPort:
-        request->commands[index].inOrOut = readDataPort(deviceMode);
-        break;
+      // The write half (if any) of this command was done before parking.
+      byte       = *resumeByte;
+      resumeByte = 0;
+      goto parked_input;
+    }
 
+    switch (command)
+    {
+      case kPS2C_ReadDataPort:
       case kPS2C_ReadDataPortAndCompare:
-#if OUT_OF_ORDER_DATA_CORRECTION_FEATURE
-        byte = readDataPort(deviceMode, request->commands[index].inOrOut);
-#else 
-        byte = readDataPort(deviceMode);
-#endif
-        failed = (byte != request->commands[index].inOrOut);
         break;
 
       case kPS2C_WriteDataPort:
         writeDataPort(request->commands[index].inOrOut);
+        if (setCommandByte)      // keep track of the IRQs that are enabled
+        {
+          _commandByteShadow = request->commands[index].inOrOut;
+          setCommandByte     = false;
+        }
         if (transmitToMouse)     // next reads from mouse input stream
         {
           deviceMode      = kDT_Mouse;
@@ -814,13 +1685,14 @@ void ApplePS2Controller::processRequest(PS2Request * request)
         {
            deviceMode   = kDT_Keyboard;
         }
-        break;
+        continue;
 
       case kPS2C_WriteCommandPort:
         writeCommandPort(request->commands[index].inOrOut);
+        setCommandByte = (request->commands[index].inOrOut == kCP_SetCommandByte);
         if (request->commands[index].inOrOut == kCP_TransmitToMouse)
           transmitToMouse = true; // preparing to transmit data to mouse
-        break;
+        continue;
 
       //
       // Send a composite mouse command that is equivalent to the following
@@ -835,15 +1707,100 @@ void ApplePS2Controller::processRequest(PS2Request * request)
         writeCommandPort(kCP_TransmitToMouse);
         writeDataPort(request->commands[index].inOrOut);
         deviceMode = kDT_Mouse;
+        break;
+
+      //
+      // Read-modify-write of the command byte against the shadow.  Requests
+      // are executed one at a time on our work loop, so nothing can change
+      // the command byte between the read and the write.
+      //
+
+      case kPS2C_ModifyCommandByte:
+      {
+        UInt8 setBits     = request->commands[index].inOrOut;
+        UInt8 clearBits   = (index + 1 < request->commandsCount) ?
+                            request->commands[index + 1].inOrOut : 0;
+        UInt8 commandByte = (_commandByteShadow | setBits) & ~clearBits;
+
+        index++;
+        deviceMode = kDT_Keyboard;
+
+        if (commandByte == _commandByteShadow)
+          continue;      // nothing changes, skip the port round trip
+
+        writeCommandPort(kCP_SetCommandByte);
+        writeDataPort(commandByte);
+        _commandByteShadow = commandByte;
+        continue;
+      }
+
+      default:
+        continue;
+    }
+
+    //
+    // The command is waiting on a byte of input.  Take it off the input ring
+    // if it is already there, otherwise either park the request until the
+    // byte arrives or poll for it.
+    //
+
+    if (mayPark && canParkRequest(deviceMode))
+    {
+      while (1)
+      {
+        if (!dequeueInputRing(deviceMode, &byte, 0))
+        {
+          if (!mayPark || !canParkRequest(deviceMode))
+          {
+            byte = readDataPort(deviceMode);      // (resumed, must finish)
+          }
+          else
+          {
+            _parkedRequest         = request;
+            _parkedIndex           = index;
+            _parkedDeviceMode      = deviceMode;
+            _parkedTransmitToMouse = transmitToMouse;
+            _requestTimer->setTimeoutMS(kParkedReadTimeout);
+            return;
+          }
+        }
+
+parked_input:
+        timedOut        = _parkedTimedOut;
+        _parkedTimedOut = false;
 #if OUT_OF_ORDER_DATA_CORRECTION_FEATURE
-        byte = readDataPort(kDT_Mouse, kSC_Acknowledge);
-#else 
-        byte = readDataPort(kDT_Mouse);
+        if (!timedOut && command != kPS2C_ReadDataPort &&
+            !takeSecondChance(deviceMode,
+                              (command == kPS2C_ReadDataPortAndCompare) ?
+                              request->commands[index].inOrOut :
+                              kSC_Acknowledge, &byte))
+          continue;                                 // (wait for the next byte)
 #endif
-        failed = (byte != kSC_Acknowledge);
         break;
+      }
+    }
+    else if (command == kPS2C_ReadDataPort)
+    {
+      byte = readDataPort(deviceMode);
+    }
+    else
+    {
+#if OUT_OF_ORDER_DATA_CORRECTION_FEATURE
+      byte = readDataPort(deviceMode, (command == kPS2C_ReadDataPortAndCompare) ?
+                                      request->commands[index].inOrOut :
+                                      kSC_Acknowledge);
+#else
+      byte = readDataPort(deviceMode);
+#endif
     }
 
+    if (command == kPS2C_ReadDataPort)
+      request->commands[index].inOrOut = byte;
+    else if (command == kPS2C_ReadDataPortAndCompare)
+      failed = (byte != request->commands[index].inOrOut);
+    else
+      failed = (byte != kSC_Acknowledge);
+
     if (failed) break;
   }
 
@@ -869,31 +1826,163 @@ hardware_offline:
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+bool ApplePS2Controller::canParkRequest(PS2DeviceType deviceType)
+{
+  //
+  // A request can only wait for input to be delivered through the IRQ if the
+  // primary interrupt handlers fill the input rings, and if the IRQ is both
+  // registered and enabled in the controller's command byte.
+  //
+
+  if (!_interruptRingEnabled || !_requestTimer || _suppressTimeout)
+    return false;
+
+  if (deviceType == kDT_Mouse)
+    return _interruptInstalledMouse &&
+           (_commandByteShadow & kCB_EnableMouseIRQ);
+  else
+    return _interruptInstalledKeyboard &&
+           (_commandByteShadow & kCB_EnableKeyboardIRQ);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::resumeParkedRequest(UInt8 data, bool mayPark)
+{
+  //
+  // Hand the input the parked request was waiting on to it, and carry on
+  // with the rest of its commands.  Without mayPark, the request is run to
+  // completion.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  PS2Request * request = _parkedRequest;
+
+  if (!request)  return;
+
+  _parkedRequest = 0;
+  if (_requestTimer)  _requestTimer->cancelTimeout();
+
+  executeRequest(request, _parkedIndex, _parkedDeviceMode,
+                 _parkedTransmitToMouse, &data, mayPark);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::requestTimedOut(IOTimerEventSource *)
+{                                                      // IOTimerEventSource::Action
+  //
+  // The input a parked request was waiting on did not arrive in time.  Check
+  // the ring one last time, otherwise resume it with a fake value, just like
+  // readDataPort does on a timeout, or with the mismatched byte if one is
+  // held for a second chance.
+  //
+
+  UInt8 data = 0;
+
+  if (!_parkedRequest)  return;
+
+  if (!dequeueInputRing(_parkedDeviceMode, &data, 0))
+  {
+    if (_secondChanceHeld)
+    {
+      data              = _secondChanceByte;
+      _secondChanceHeld = false;
+    }
+    else
+    {
+      IOLog("%s: Timed out on %s input stream.\n", getName(),
+            (_parkedDeviceMode == kDT_Keyboard) ? "keyboard" : "mouse");
+    }
+    _parkedTimedOut = true;
+  }
+
+  resumeParkedRequest(data, true);
+  runRequestQueue(true);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 void ApplePS2Controller::processRequestQueue(IOInterruptEventSource *, int)
 {
-  queue_head_t localQueue;
+  runRequestQueue(true);
+}
 
-  // Transfer queued (async) requests to a local queue.
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-  IOSimpleLockLock(_requestQueueLock);
+void ApplePS2Controller::runRequestQueue(bool mayPark)
+{
+  //
+  // Process the queued (async) requests, in the order dequeueRequest picks
+  // them.  Should a request get parked, the rest of them stay queued behind
+  // it until it completes.
+  // Without mayPark, any parked request is run to completion first.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
 
-  if (!queue_empty(&_requestQueue))
+  if (_parkedRequest && (!mayPark || _hardwareOffline))
   {
-    queue_assign(&localQueue, &_requestQueue, PS2Request *, chain);
-    queue_init(&_requestQueue);
+    resumeParkedRequest(_hardwareOffline ? 0 : readDataPort(_parkedDeviceMode),
+                        false);
   }
-  else queue_init(&localQueue);
 
-  IOSimpleLockUnlock(_requestQueueLock);
+  while (!_parkedRequest)
+  {
+    PS2Request * request = dequeueRequest();
+
+    if (!request)  break;
+
+    executeRequest(request, 0, kDT_Keyboard, false, 0, mayPark);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+PS2Request * ApplePS2Controller::dequeueRequest()
+{
+  //
+  // Take the next request to run off the queues: the interactive class
+  // first, then configuration, then background.  Within a class, the
+  // keyboard and the mouse take turns, so that a long run of requests from
+  // one of them cannot hold up the other.
+  //
+  // Returns 0 if all the queues are empty.
+  //
 
-  // Process each request in order.
+  static const unsigned order[kPS2RequestPriorityCount] =
+    { kPS2RequestInteractive, kPS2RequestConfiguration, kPS2RequestBackground };
 
-  while (!queue_empty(&localQueue))
+  PS2Request * request = 0;
+
+  IOSimpleLockLock(_requestQueueLock);
+  for (unsigned index = 0; index < kPS2RequestPriorityCount && !request; index++)
   {
-    PS2Request * request;
-    queue_remove_first(&localQueue, request, PS2Request *, chain);
-    processRequest(request);
+    unsigned priority = order[index];
+    unsigned device   = _requestQueueTurn[priority];
+
+    if (queue_empty(&_requestQueue[device][priority]))
+      device ^= 1;
+    if (queue_empty(&_requestQueue[device][priority]))
+      continue;
+
+    queue_remove_first(&_requestQueue[device][priority], request,
+                       PS2Request *, chain);
+    _requestQueueTurn[priority] = device ^ 1;
+
+#if PS2_STATISTICS
+    uint64_t now, wait;
+    clock_get_uptime(&now);
+    absolutetime_to_nanoseconds(now - request->submitTime, &wait);
+    _requestClassWait[priority].add((UInt32) (wait / 1000));
+    _requestClassLength[priority]--;
+    _requestQueueLength--;
+#endif
   }
+  IOSimpleLockUnlock(_requestQueueLock);
+
+  return request;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -913,15 +2002,25 @@ UInt8 ApplePS2Controller::readDataPort(PS2DeviceType deviceType)
   // This method should only be called from our single-threaded work loop.
   //
 
-  UInt8  readByte;
-  UInt8  status;
-  UInt32 timeoutCounter = 10000;    // (timeoutCounter * kDataDelay = 70 ms)
+  UInt8         readByte;
+  UInt8         status;
+  UInt32        timeoutCounter = 10000; // (timeoutCounter * kDataDelay = 70 ms)
+  PS2DeviceType otherType;
+  uint64_t      now;
+#if PS2_STATISTICS
+  UInt32        waitCounter;
+#endif
 
   while (1)
   {
-#if DEBUGGER_SUPPORT
     int state;
     lockController(&state);            // (lock out interrupt + access to queue)
+    if (_interruptRingEnabled && dequeueInputRing(deviceType, &readByte, 0))
+    {
+      unlockController(state);
+      return readByte;
+    }
+#if DEBUGGER_SUPPORT
     if (deviceType == kDT_Keyboard && dequeueKeyboardData(&readByte))
     {
       unlockController(state);
@@ -933,21 +2032,27 @@ UInt8 ApplePS2Controller::readDataPort(PS2DeviceType deviceType)
     // Wait for the controller's output buffer to become ready.
     //
 
+#if PS2_STATISTICS
+    waitCounter = timeoutCounter;
+#endif
     while (timeoutCounter && !((status = inb(kCommandPort)) & kOutputReady))
     {
       timeoutCounter--;
       IODelay(kDataDelay);
     }
 
+#if PS2_STATISTICS
+    _readWait.add((waitCounter - timeoutCounter) * kDataDelay);
+    if (timeoutCounter == 0)  _readTimeouts++;
+#endif
+
     //
     // If we timed out, something went awfully wrong; return a fake value.
     //
 
     if (timeoutCounter == 0)
     {
-#if DEBUGGER_SUPPORT
       unlockController(state);  // (release interrupt lockout + access to queue)
-#endif //DEBUGGER_SUPPORT
 
 	  if (!_suppressTimeout)
 		IOLog("%s: Timed out on %s input stream.\n", getName(),
@@ -958,21 +2063,38 @@ UInt8 ApplePS2Controller::readDataPort(PS2DeviceType deviceType)
     //
     // For older machines, it is necessary to wait a while after the controller
     // has asserted the output buffer bit before reading the data port. No more
-    // data will be available if this wait is not performed.
+    // data will be available if this wait is not performed.  The wait is
+    // configurable (DataReadDelay), and skipped on machines set to zero.
     //
 
-    IODelay(kDataDelay);
+    if (_dataReadDelay)  IODelay(_dataReadDelay);
 
     //
     // Read in the data.  We return the data, however, only if it arrived on
     // the requested input stream.
     //
 
-    readByte = inb(kDataPort);
+    readByte  = inb(kDataPort);
+    otherType = (deviceType == kDT_Keyboard) ? kDT_Mouse : kDT_Keyboard;
+
+    //
+    // With the input rings in use, data for the other input stream is put on
+    // that stream's ring, behind whatever the primary interrupt handler may
+    // already have queued there, to keep the stream in order.  Holding the
+    // controller lock makes us the producer for the moment.
+    //
+
+    if ( _interruptRingEnabled && !_suppressTimeout &&
+         ((status & kMouseData) ? kDT_Mouse : kDT_Keyboard) == otherType )
+    {
+      clock_get_uptime(&now);
+      enqueueInputRing(otherType, readByte, now);
+      unlockController(state);
+      wakeInputRing(otherType);
+      continue;
+    }
 
-#if DEBUGGER_SUPPORT
     unlockController(state);    // (release interrupt lockout + access to queue)
-#endif //DEBUGGER_SUPPORT
 
 	if (_suppressTimeout)		// startup mode w/o interrupts
 		return readByte;
@@ -991,8 +2113,7 @@ UInt8 ApplePS2Controller::readDataPort(PS2DeviceType deviceType)
     // that was requested, so dispatch other device's interrupt handler.
     //
 
-    dispatchDriverInterrupt((deviceType==kDT_Keyboard)?kDT_Mouse:kDT_Keyboard,
-                            readByte);
+    dispatchDriverInterrupt(otherType, readByte);
   } // while (forever)
 }
 
@@ -1038,12 +2159,22 @@ UInt8 ApplePS2Controller::readDataPort(PS2DeviceType deviceType,
   bool   requestedStream;
   UInt8  status;
   UInt32 timeoutCounter = 10000;    // (timeoutCounter * kDataDelay = 70 ms)
+  PS2DeviceType otherType = (deviceType==kDT_Keyboard)?kDT_Mouse:kDT_Keyboard;
+  uint64_t      now;
+#if PS2_STATISTICS
+  UInt32        waitCounter;
+#endif
 
   while (1)
   {
-#if DEBUGGER_SUPPORT
     int state;
     lockController(&state);            // (lock out interrupt + access to queue)
+    if (_interruptRingEnabled && dequeueInputRing(deviceType, &readByte, 0))
+    {
+      requestedStream = true;
+      goto skipForwardToY;
+    }
+#if DEBUGGER_SUPPORT
     if (deviceType == kDT_Keyboard && dequeueKeyboardData(&readByte))
     {
       requestedStream = true;
@@ -1055,12 +2186,20 @@ UInt8 ApplePS2Controller::readDataPort(PS2DeviceType deviceType,
     // Wait for the controller's output buffer to become ready.
     //
 
+#if PS2_STATISTICS
+    waitCounter = timeoutCounter;
+#endif
     while (timeoutCounter && !((status = inb(kCommandPort)) & kOutputReady))
     {
       timeoutCounter--;
       IODelay(kDataDelay);
     }
 
+#if PS2_STATISTICS
+    _readWait.add((waitCounter - timeoutCounter) * kDataDelay);
+    if (timeoutCounter == 0)  _readTimeouts++;
+#endif
+
     //
     // If we timed out, we return the first byte we read, unless THIS IS the
     // first byte we are trying to read,  then something went awfully wrong
@@ -1069,9 +2208,7 @@ UInt8 ApplePS2Controller::readDataPort(PS2DeviceType deviceType,
 
     if (timeoutCounter == 0)
     {
-#if DEBUGGER_SUPPORT
       unlockController(state);  // (release interrupt lockout + access to queue)
-#endif //DEBUGGER_SUPPORT
 
       if (firstByteHeld)  return firstByte;
 
@@ -1083,10 +2220,11 @@ UInt8 ApplePS2Controller::readDataPort(PS2DeviceType deviceType,
     //
     // For older machines, it is necessary to wait a while after the controller
     // has asserted the output buffer bit before reading the data port. No more
-    // data will be available if this wait is not performed.
+    // data will be available if this wait is not performed.  The wait is
+    // configurable (DataReadDelay), and skipped on machines set to zero.
     //
 
-    IODelay(kDataDelay);
+    if (_dataReadDelay)  IODelay(_dataReadDelay);
 
     //
     // Read in the data.  We process the data, however, only if it arrived on
@@ -1105,10 +2243,22 @@ UInt8 ApplePS2Controller::readDataPort(PS2DeviceType deviceType,
       if (deviceType == kDT_Keyboard)  requestedStream = true;
     }
 
-#if DEBUGGER_SUPPORT
+    //
+    // Other-stream data goes onto its input ring while we still hold the
+    // lock, if the rings are in use (see the plain readDataPort).
+    //
+
+    if (_interruptRingEnabled && !requestedStream)
+    {
+      clock_get_uptime(&now);
+      enqueueInputRing(otherType, readByte, now);
+      unlockController(state);
+      wakeInputRing(otherType);
+      continue;
+    }
+
 skipForwardToY:
     unlockController(state);    // (release interrupt lockout + access to queue)
-#endif //DEBUGGER_SUPPORT
 
     if (requestedStream)
     {
@@ -1129,6 +2279,9 @@ skipForwardToY:
           // the first byte to the interrupt handler, and return the second.
           //
 
+#if PS2_STATISTICS
+          _secondChanceHits++;
+#endif
           dispatchDriverInterrupt(deviceType, firstByte);
           return readByte;
         }
@@ -1164,12 +2317,57 @@ skipForwardToY:
       // so dispatch appropriate interrupt handler.
       //
 
-      dispatchDriverInterrupt((deviceType==kDT_Keyboard)?kDT_Mouse:kDT_Keyboard,
-                              readByte);
+      dispatchDriverInterrupt(otherType, readByte);
     }
   } // while (forever)
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2Controller::takeSecondChance(PS2DeviceType deviceType,
+                                          UInt8         expectedByte,
+                                          UInt8 *       byte)
+{
+  //
+  // The second chance of readDataPort:expecting:, for input that a parked
+  // request takes off the ring one byte at a time.  Returns true with the
+  // byte the command gets in *byte, or false if the byte was put aside and
+  // the next one has to be waited for.  The held byte survives the request
+  // being parked; on a timeout the request gets the held byte instead.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  if (*byte == expectedByte)
+  {
+    if (_secondChanceHeld)
+    {
+      // The first byte was input for the driver after all.
+
+#if PS2_STATISTICS
+      _secondChanceHits++;
+#endif
+      _secondChanceHeld = false;
+      dispatchDriverInterrupt(deviceType, _secondChanceByte);
+    }
+    return true;
+  }
+
+  if (!_secondChanceHeld)
+  {
+    _secondChanceHeld = true;
+    _secondChanceByte = *byte;
+    return false;
+  }
+
+  // The second byte mismatched as well; as readDataPort:expecting: does.
+
+  _secondChanceHeld = false;
+  dispatchDriverInterrupt(deviceType, *byte);
+  *byte = _secondChanceByte;
+  return true;
+}
+
 #endif
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -1222,9 +2420,29 @@ void ApplePS2Controller::writeCommandPort(UInt8 byte)
 #define kModifierAltMask      (kModifierAltLeft     | kModifierAltRight    )
 #define kModifierWindowsMask  (kModifierWindowsLeft | kModifierWindowsRight)
 
+static inline UInt16 modifierOfScancode(UInt8 scancode, bool extended)
+{
+  //
+  // The modifier bit of a (make) scancode, or 0 if it is no modifier key.
+  // A switch rather than a walk down the table below, as it runs on every
+  // keystroke with the controller locked.
+  //
+
+  switch (scancode)
+  {
+    case kSC_Alt:          return extended ? kModifierAltRight : kModifierAltLeft;
+    case kSC_Ctrl:         return extended ? kModifierCtrlRight : kModifierCtrlLeft;
+    case kSC_ShiftLeft:    return extended ? 0 : kModifierShiftLeft;
+    case kSC_ShiftRight:   return extended ? 0 : kModifierShiftRight;
+    case kSC_WindowsLeft:  return extended ? kModifierWindowsLeft : 0;
+    case kSC_WindowsRight: return extended ? kModifierWindowsRight : 0;
+  }
+  return 0;
+}
+
 bool ApplePS2Controller::doEscape(UInt8 scancode)
 {
-  static struct
+  static const struct
   {
     UInt8  scancode;
     UInt8  extended;
@@ -1240,6 +2458,7 @@ bool ApplePS2Controller::doEscape(UInt8 scancode)
                          { 0,                0,   0                     } };
 
   UInt32 index;
+  UInt16 modifier;
   bool   releaseModifiers = false;
   bool   upBit            = (scancode & kSC_UpBit) ? true : false;
 
@@ -1259,18 +2478,14 @@ bool ApplePS2Controller::doEscape(UInt8 scancode)
 
   scancode &= ~kSC_UpBit;
 
-  for (index = 0; modifierTable[index].scancode; index++)
+  if ( (modifier = modifierOfScancode(scancode, _extendedState)) )
   {
-    if ( modifierTable[index].scancode == scancode &&
-         modifierTable[index].extended == _extendedState )
-    {
-      if (upBit)  _modifierState &= ~modifierTable[index].modifier;
-      else        _modifierState |=  modifierTable[index].modifier;
+    if (upBit)  _modifierState &= ~modifier;
+    else        _modifierState |=  modifier;
 
-      _extendedState = false;
-      return false;
-    }
-  } 
+    _extendedState = false;
+    return false;
+  }
 
   //
   // Call the debugger function, if applicable.
@@ -1328,48 +2543,158 @@ bool ApplePS2Controller::doEscape(UInt8 scancode)
 void ApplePS2Controller::enqueueKeyboardData(UInt8 key)
 {
   //
-  // Enqueue the supplied keyboard data onto our internal queues.  The
+  // Enqueue the supplied keyboard data onto our internal queue.  Should the
+  // queue be full, the key is dropped and counted as an overflow.  The
   // controller must already be locked. 
   //
 
-  KeyboardQueueElement * element;
-
-  // Obtain an unused keyboard data element. 
-  if (!queue_empty(&_keyboardQueueUnused))
+  // The keyboard stream lives on its input ring when the rings are in use.
+  if (_interruptRingEnabled)
   {
-    queue_remove_first(&_keyboardQueueUnused,
-                       element, KeyboardQueueElement *, chain);
+    uint64_t now;
+    clock_get_uptime(&now);
+    enqueueInputRing(kDT_Keyboard, key, now);
+    return;
+  }
 
-    // Store the new keyboard data element on the queue. 
-    element->data = key; 
-    queue_enter(&_keyboardQueue, element, KeyboardQueueElement *, chain); 
+  if (_keyboardQueue.head - _keyboardQueue.tail >= kKeyboardQueueSize)
+  {
+    _keyboardQueue.overflows++;
+    return;
   }
+  _keyboardQueue.data[_keyboardQueue.head++ & (kKeyboardQueueSize - 1)] = key;
 }
 
 bool ApplePS2Controller::dequeueKeyboardData(UInt8 * key)
 {
   //
-  // Dequeue keyboard data from our internal queues, if the queue is not
+  // Dequeue keyboard data from our internal queue, if the queue is not
   // empty.  Should the queue be empty, false is returned.  The controller
   // must already be locked. 
   //
 
-  KeyboardQueueElement * element;
+  if (_keyboardQueue.head == _keyboardQueue.tail)
+    return false;
+
+  *key = _keyboardQueue.data[_keyboardQueue.tail++ & (kKeyboardQueueSize - 1)];
+  return true;
+}
+
+#endif //DEBUGGER_SUPPORT
+
+// =============================================================================
+// Interrupt-Time Input Rings
+//
+
+void ApplePS2Controller::drainDataPort()
+{
+  //
+  // Move all data waiting in the controller's output buffer onto the input
+  // ring of the device it came from,  stamped with the time it was read, and
+  // wake the work loop to consume it.  Called from the primary interrupt
+  // handlers when the input rings are in use.
+  //
+
+  UInt8    data;
+  UInt8    status;
+  uint64_t now;
+  bool     wakeKeyboard = false;
+  bool     wakeMouse    = false;
+  int      state;
 
-  // Obtain an unused keyboard data element.
-  if (!queue_empty(&_keyboardQueue))
+  lockController(&state);              // (lock out interrupt + access to rings)
+
+  clock_get_uptime(&now);
+
+  while ( ((status = inb(kCommandPort)) & kOutputReady) )
   {
-    queue_remove_first(&_keyboardQueue, element, KeyboardQueueElement *, chain);
-    *key = element->data;
+    data = inb(kDataPort);
+
+    if ( (status & kMouseData) )
+    {
+      enqueueInputRing(kDT_Mouse, data, now);
+      wakeMouse = true;
+    }
+    else
+    {
+#if DEBUGGER_SUPPORT
+      // Same debugger-key-sequence check as the non-ring keyboard handler.
+      if (_debuggingEnabled == false || doEscape(data) == false)
+#endif //DEBUGGER_SUPPORT
+        enqueueInputRing(kDT_Keyboard, data, now);
+      wakeKeyboard = true;
+    }
+  }
 
-    // Place the unused keyboard data element onto the unused queue.
-    queue_enter(&_keyboardQueueUnused, element, KeyboardQueueElement *, chain);
+  unlockController(state);
 
-    return true;
+  if (wakeKeyboard)  wakeInputRing(kDT_Keyboard);
+  if (wakeMouse)     wakeInputRing(kDT_Mouse);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2Controller::enqueueInputRing(PS2DeviceType deviceType,
+                                          UInt8         data,
+                                          UInt64        timestamp)
+{
+  //
+  // Producer side.  The controller must already be locked.  Should the ring
+  // be full, the byte is counted as an overflow and dropped.
+  //
+
+  PS2InputRing * ring = &_inputRing[deviceType];
+  UInt32         head = ring->head;
+
+  if (head - ring->tail == kInputRingSize)
+  {
+    ring->overflows++;
+    return false;
   }
-  return false;
+
+  ring->data[head & (kInputRingSize - 1)]      = data;
+  ring->timestamp[head & (kInputRingSize - 1)] = timestamp;
+  OSMemoryBarrier();                   // (publish the entry before the index)
+  ring->head = head + 1;
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2Controller::dequeueInputRing(PS2DeviceType deviceType,
+                                          UInt8 *       data,
+                                          UInt64 *      timestamp)
+{
+  //
+  // Consumer side.  Should only be called from our single-threaded work
+  // loop; no lock is required.  Returns false if the ring is empty.
+  //
+
+  PS2InputRing * ring = &_inputRing[deviceType];
+  UInt32         tail = ring->tail;
+
+  if (tail == ring->head)  return false;
+
+  OSMemoryBarrier();                   // (read the entry after the index)
+  *data = ring->data[tail & (kInputRingSize - 1)];
+  if (timestamp)  *timestamp = ring->timestamp[tail & (kInputRingSize - 1)];
+  OSMemoryBarrier();                   // (done with the entry before freeing)
+  ring->tail = tail + 1;
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::wakeInputRing(PS2DeviceType deviceType)
+{
+  IOInterruptEventSource * source = (deviceType == kDT_Mouse) ?
+                                    _interruptSourceMouse :
+                                    _interruptSourceKeyboard;
+  if (source)  source->interruptOccurred(0, 0, 0);
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 void ApplePS2Controller::unlockController(int state)
 {
   IOSimpleLockUnlockEnableInterrupt(_controllerLock, state);
@@ -1380,8 +2705,6 @@ void ApplePS2Controller::lockController(int * state)
   *state = IOSimpleLockLockDisableInterrupt(_controllerLock);
 }
 
-#endif //DEBUGGER_SUPPORT
-
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 //
 // Power Management support.
@@ -1453,6 +2776,8 @@ void ApplePS2Controller::setPowerStateGated( UInt32 powerState )
 
   if ( _currentPowerState != powerState )
   {
+    _trace.addState(kTraceStatePower, _currentPowerState, powerState);
+
     switch ( powerState )
     {
       case kPS2PowerStateSleep:
@@ -1471,6 +2796,14 @@ void ApplePS2Controller::setPowerStateGated( UInt32 powerState )
 
         _hardwareOffline = true;
 
+        if (_parkedRequest)  resumeParkedRequest(0, false);
+
+        if (_replayRecords)
+        {
+          _replayTimer->cancelTimeout();
+          freeReplay();
+        }
+
         // 3. Disable the PS/2 port.
 
 #if 0
@@ -1513,6 +2846,7 @@ void ApplePS2Controller::setPowerStateGated( UInt32 powerState )
                           kCB_EnableMouseIRQ );
         writeCommandPort( kCP_SetCommandByte );
         writeDataPort( commandByte );
+        _commandByteShadow = commandByte;
 
         // 2. Unblock the request queue and wake up all driver threads
         //    that were blocked by submitRequest().
@@ -1545,6 +2879,29 @@ void ApplePS2Controller::setPowerStateGated( UInt32 powerState )
 
 void ApplePS2Controller::dispatchDriverPowerControl( UInt32 whatToDo )
 {
+  if ( whatToDo == kPS2C_EnableDevice )
+  {
+    //
+    // Put the first status query to the mouse, then bring the keyboard back
+    // while the mouse runs its power-on self-test; whatever the mouse answers
+    // meanwhile is held back.  Tell the mouse driver as soon as the mouse
+    // has answered, rather than having it sleep for a fixed time.
+    //
+
+    if (_powerControlInstalledMouse)
+      beginMouseReady();
+
+    if (_powerControlInstalledKeyboard)
+      (*_powerControlActionKeyboard)(_powerControlTargetKeyboard, whatToDo);
+
+    if (_powerControlInstalledMouse)
+    {
+      waitForMouseReady( _wakeReadyTimeout );
+      (*_powerControlActionMouse)(_powerControlTargetMouse, whatToDo);
+    }
+    return;
+  }
+
   if (_powerControlInstalledMouse)
     (*_powerControlActionMouse)(_powerControlTargetMouse, whatToDo);
 
@@ -1554,6 +2911,169 @@ void ApplePS2Controller::dispatchDriverPowerControl( UInt32 whatToDo )
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2Controller::beginMouseReady()
+{
+  //
+  // Send the first status query of waitForMouseReady, and hold back mouse
+  // input from the driver until waitForMouseReady is done.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  _mouseWakeCount = 0;
+  _mouseWaking    = true;
+
+  writeCommandPort( kCP_TransmitToMouse );
+  writeDataPort( kDP_GetMouseInformation );
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2Controller::waitForMouseReady( UInt32 timeoutMS )
+{
+  //
+  // Wait for the mouse to come out of its power-on self-test, for at most
+  // timeoutMS milliseconds, beginMouseReady having sent the first query.  The
+  // mouse is ready once it acknowledges a status query (kDP_GetMouseInformation).
+  // Should it report a completed self-test (kSC_Reset, then its ID) instead,
+  // the answer to the outstanding query is waited for before another one is
+  // sent.  Whatever is still coming from the mouse once it has answered is
+  // dropped, so that no stray answers are left for the driver.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  uint64_t deadline;
+  uint64_t now;
+  bool     pending = true;
+  bool     ready   = false;
+  UInt8    byte;
+
+  clock_interval_to_deadline( timeoutMS, kMillisecondScale, &deadline );
+
+  while ( 1 )
+  {
+    if ( !pending )
+    {
+      writeCommandPort( kCP_TransmitToMouse );
+      writeDataPort( kDP_GetMouseInformation );
+      pending = true;
+    }
+
+    if ( pollMouseData( &byte, kWakeReadyByteTimeout ) )
+    {
+      if ( byte == kSC_Acknowledge )
+      {
+        ready = pollMouseData( &byte, kWakeReadyByteTimeout ) &&   // (discard
+                pollMouseData( &byte, kWakeReadyByteTimeout ) &&   //  the three
+                pollMouseData( &byte, kWakeReadyByteTimeout );     //  status bytes)
+        if ( ready )  break;
+        pending = false;
+      }
+      else if ( byte == kSC_Reset )
+      {
+        pollMouseData( &byte, kWakeReadyByteTimeout );     // (discard the device ID)
+      }
+      else
+      {
+        pending = false;                                    // (resend request)
+      }
+    }
+    else
+    {
+      pending = false;
+    }
+
+    clock_get_uptime( &now );
+    if ( now >= deadline )  break;
+
+    // No answer, or a resend request: ask again in a little while.
+
+    if ( !pending )  IOSleep( kWakeReadyPollInterval );
+  }
+
+  while ( pollMouseData( &byte, kWakeReadyByteTimeout ) )  {}   // (drop strays)
+
+  _mouseWaking    = false;
+  _mouseWakeCount = 0;
+
+  if ( !ready )
+    IOLog( "%s: Mouse not ready after %u ms\n", getName(), (unsigned) timeoutMS );
+  return ready;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2Controller::pollMouseData( UInt8 * data, UInt32 timeoutMS )
+{
+  //
+  // Wait at most timeoutMS milliseconds for a byte from the mouse, without
+  // the timeout logging of readDataPort; the mouse not answering is normal
+  // here.  Mouse bytes held back while the keyboard was being restored come
+  // first.  Keyboard data is passed on as readDataPort does.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  UInt32 timeoutCounter = timeoutMS * 1000 / kDataDelay;
+  UInt8  readByte;
+  UInt8  status;
+  int    state;
+
+  if ( _mouseWakeCount )
+  {
+    *data = _mouseWakeBytes[0];
+    _mouseWakeCount--;
+    for (UInt32 index = 0; index < _mouseWakeCount; index++)
+      _mouseWakeBytes[index] = _mouseWakeBytes[index + 1];
+    return true;
+  }
+
+  while ( timeoutCounter )
+  {
+    lockController(&state);
+    if ( _interruptRingEnabled && dequeueInputRing(kDT_Mouse, data, 0) )
+    {
+      unlockController(state);
+      return true;
+    }
+
+    if ( !((status = inb(kCommandPort)) & kOutputReady) )
+    {
+      unlockController(state);
+      timeoutCounter--;
+      IODelay(kDataDelay);
+      continue;
+    }
+
+    if (_dataReadDelay)  IODelay(_dataReadDelay);
+    readByte = inb(kDataPort);
+
+    if ( status & kMouseData )
+    {
+      unlockController(state);
+      *data = readByte;
+      return true;
+    }
+
+    if ( _interruptRingEnabled )
+    {
+      uint64_t now;
+      clock_get_uptime(&now);
+      enqueueInputRing(kDT_Keyboard, readByte, now);
+      unlockController(state);
+      wakeInputRing(kDT_Keyboard);
+      continue;
+    }
+
+    unlockController(state);
+    dispatchDriverInterrupt(kDT_Keyboard, readByte);
+  }
+  return false;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 void ApplePS2Controller::installPowerControlAction(
                                           PS2DeviceType         deviceType,
                                           OSObject *            target, 
@@ -1594,3 +3114,265 @@ void ApplePS2Controller::uninstallPowerControlAction( PS2DeviceType deviceType )
     _powerControlTargetMouse = 0;
   }
 }
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+PS2TraceBuffer * ApplePS2Controller::getTraceBuffer()
+{
+  //
+  // The drivers record their packets and state transitions into the same
+  // buffer, through the nubs.  The buffer lives as long as the controller.
+  //
+
+  return &_trace;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2Controller::startReplay(const PS2TraceRecord * records,
+                                         UInt32                 count)
+{
+  //
+  // Feed a captured stream (see ApplePS2Trace.h) back to the drivers.  The
+  // raw byte records are copied and the replay set up on the work loop; a
+  // replay still running is replaced.  The records must be in capture order,
+  // their timestamps never going backwards.
+  //
+
+  PS2TraceRecord * copy;
+  UInt32           kept = 0;
+  IOReturn         result;
+
+  if (count == 0 || count > kReplayMaxRecords)
+    return kIOReturnBadArgument;
+
+  copy = (PS2TraceRecord *) IOMalloc(count * sizeof(PS2TraceRecord));
+  if (!copy)
+    return kIOReturnNoMemory;
+
+  for (UInt32 index = 0; index < count; index++)
+  {
+    if (records[index].type != kPS2TraceKeyboardByte &&
+        records[index].type != kPS2TraceMouseByte)
+      continue;
+    if (kept && records[index].timestamp < copy[kept - 1].timestamp)
+    {
+      IOFree(copy, count * sizeof(PS2TraceRecord));
+      return kIOReturnBadArgument;
+    }
+    copy[kept] = records[index];
+    if (copy[kept].length > kPS2TraceDataSize)
+      copy[kept].length = kPS2TraceDataSize;
+    kept++;
+  }
+
+  result = kIOReturnBadArgument;
+  if (kept)
+    result = _workLoop->runAction( /* Action */ replayAction,
+                                   /* target */ this,
+                                   /*   arg0 */ copy,
+                                   /*   arg1 */ (void *)(uintptr_t) kept,
+                                   /*   arg2 */ (void *)(uintptr_t) count );
+  if (result != kIOReturnSuccess)
+    IOFree(copy, count * sizeof(PS2TraceRecord));
+  return result;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::stopReplay()
+{
+  _workLoop->runAction(replayAction, this);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2Controller::replayAction(OSObject * target,
+                                          void * arg0, void * arg1,
+                                          void * arg2, void * arg3)
+{
+  //
+  // Runs on the work loop.  Without records, just cancels the replay.  On
+  // success the records array (arg2 entries allocated, the first arg1 of
+  // them holding raw bytes) is ours.
+  //
+
+  ApplePS2Controller * me = (ApplePS2Controller *) target;
+
+  me->_replayTimer->cancelTimeout();
+  me->freeReplay();
+
+  if (!arg0)
+    return kIOReturnSuccess;
+
+  if (me->_hardwareOffline)
+    return kIOReturnOffline;
+
+  me->_replayRecords       = (PS2TraceRecord *) arg0;
+  me->_replayCount         = (UInt32)(uintptr_t) arg2;
+  me->_replayUsed          = (UInt32)(uintptr_t) arg1;
+  me->_replayIndex         = 0;
+  me->_replayBytes         = 0;
+  me->_replayDispatches    = 0;
+  me->_replayDispatchTime  = 0;
+  me->_replayDispatchCost.init();
+  me->_replayPoolAllocated = me->_requestPoolAllocated;
+  me->_replayLiveDropped   = 0;
+  me->_replayMouse         = false;
+  me->_replayKeyboard      = false;
+  clock_get_uptime(&me->_replayStart);
+
+  for (UInt32 index = 0; index < me->_replayUsed; index++)
+  {
+    if (me->_replayRecords[index].type == kPS2TraceMouseByte)
+      me->_replayMouse = true;
+    else
+      me->_replayKeyboard = true;
+  }
+
+  me->replayOccurred(me->_replayTimer);
+  return kIOReturnSuccess;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::replayOccurred(IOTimerEventSource *)
+{
+  //
+  // Dispatch the records that are due, keeping their captured spacing
+  // relative to the first one, and wait for the next, at most kReplayMaxWait
+  // at a time.  startReplay made sure the timestamps ascend.  A replay
+  // running past kReplayMaxDuration is cut short.
+  //
+
+  uint64_t now, start, elapsed, due, ns, limit;
+
+  if (!_replayRecords)
+    return;
+
+  clock_get_uptime(&now);
+  elapsed = now - _replayStart;
+
+  nanoseconds_to_absolutetime((uint64_t) kReplayMaxDuration * 1000000000ULL, &limit);
+  if (elapsed > limit)
+  {
+    endReplay();
+    return;
+  }
+
+  while (_replayIndex < _replayUsed)
+  {
+    PS2TraceRecord * record = &_replayRecords[_replayIndex];
+
+    due = record->timestamp - _replayRecords[0].timestamp;
+    if (due > elapsed)
+    {
+      absolutetime_to_nanoseconds(due - elapsed, &ns);
+      ns = ns / 1000 + 1;
+      _replayTimer->setTimeoutUS(ns < kReplayMaxWait ? (UInt32) ns : kReplayMaxWait);
+      return;
+    }
+
+    clock_get_uptime(&start);
+    _replayDispatching = true;
+    dispatchDriverInterrupt(record->type == kPS2TraceMouseByte ? kDT_Mouse : kDT_Keyboard,
+                            record->data, record->length);
+    _replayDispatching = false;
+    clock_get_uptime(&now);
+    absolutetime_to_nanoseconds(now - start, &ns);
+    _replayDispatchCost.add((UInt32) ns);
+    _replayDispatchTime += now - start;
+    _replayBytes        += record->length;
+    _replayDispatches++;
+    _replayIndex++;
+  }
+
+  endReplay();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::endReplay()
+{
+  //
+  // Finish the replay, whether it ran out of records or was cut short, and
+  // give the drivers back their live input.
+  //
+
+  _replayTimer->cancelTimeout();
+  publishReplayStatistics();
+  freeReplay();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::publishReplayStatistics()
+{
+  //
+  // Export what the last replay cost the drivers, as the "ReplayStatistics"
+  // dictionary: Bytes and Dispatches replayed, DispatchTime (usec in the
+  // drivers, all dispatches), DispatchCost (histogram of nsec per dispatch,
+  // see ApplePS2Histogram.h), RequestAllocations (request structures the
+  // pool had to allocate meanwhile, which should stay 0) and LiveDropped
+  // (live input bytes held back from the drivers during the replay).
+  //
+
+  OSDictionary * dict = OSDictionary::withCapacity(6);
+  OSDictionary * cost;
+  OSNumber *     number;
+  uint64_t       ns;
+
+  if (!dict)  return;
+
+  absolutetime_to_nanoseconds(_replayDispatchTime, &ns);
+
+  if ((number = OSNumber::withNumber(_replayBytes, 32)))
+  {
+    dict->setObject("Bytes", number);
+    number->release();
+  }
+  if ((number = OSNumber::withNumber(_replayDispatches, 32)))
+  {
+    dict->setObject("Dispatches", number);
+    number->release();
+  }
+  if ((number = OSNumber::withNumber(ns / 1000, 64)))
+  {
+    dict->setObject("DispatchTime", number);
+    number->release();
+  }
+  if ((cost = _replayDispatchCost.copyDictionary()))
+  {
+    dict->setObject("DispatchCost", cost);
+    cost->release();
+  }
+  if ((number = OSNumber::withNumber(_requestPoolAllocated - _replayPoolAllocated, 32)))
+  {
+    dict->setObject("RequestAllocations", number);
+    number->release();
+  }
+  if ((number = OSNumber::withNumber(_replayLiveDropped, 32)))
+  {
+    dict->setObject("LiveDropped", number);
+    number->release();
+  }
+
+  setProperty("ReplayStatistics", dict);
+  dict->release();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::freeReplay()
+{
+  if (_replayRecords)
+  {
+    IOFree(_replayRecords, _replayCount * sizeof(PS2TraceRecord));
+    _replayRecords = 0;
+  }
+  _replayCount    = 0;
+  _replayUsed     = 0;
+  _replayIndex    = 0;
+  _replayMouse    = false;
+  _replayKeyboard = false;
+}
@@ -25,10 +25,11 @@
 
 #include <IOKit/IOInterruptEventSource.h>
 #include <IOKit/IOService.h>
+#include <IOKit/IOTimerEventSource.h>
 #include <IOKit/IOWorkLoop.h>
-//#include <IOKit/IOSyncer.h>
-#include "IOSyncer.h"
 #include "ApplePS2Device.h"
+#include "ApplePS2Histogram.h"
+#include "ApplePS2Trace.h"
 
 class ApplePS2KeyboardDevice;
 class ApplePS2MouseDevice;
@@ -124,6 +125,47 @@ typedef enum { kDT_Keyboard, kDT_Mouse } PS2DeviceType;
 // Port timings.
 
 #define kDataDelay              7       // usec to delay before data is valid
+#define kParkedReadTimeout      70      // msec to wait for a parked read
+#define kWakeReadyTimeout       1000    // msec to wait for the mouse on wake
+#define kWakeReadyPollInterval  10      // msec between mouse status queries
+#define kWakeReadyByteTimeout   5       // msec to wait for each answer byte
+#define kWakeHeldBytes          8       // mouse bytes held back during wake
+
+// Maximum number of bytes collected off the input stream before they are
+// handed to a driver's batch interrupt action in one call.
+
+#define kDrainBufferSize        64
+
+// Default number of records in the trace buffer (see ApplePS2Trace.h).
+
+#define kTraceRecords           1024
+
+// Maximum number of records taken by a replay (see ApplePS2Trace.h).
+
+#define kReplayMaxRecords       16384
+
+// Longest single timer wait of a replay; longer gaps take several.
+
+#define kReplayMaxWait          1000000 // usec
+
+// Longest a whole replay may hold back live input before it is cut short.
+
+#define kReplayMaxDuration      60      // sec
+
+// Trace codes of the controller's own kPS2TraceState records.
+
+#define kTraceStatePower        1       // power state, kPS2PowerState*
+
+// Number of request structures preallocated at start.  The pool grows beyond
+// this on demand and never shrinks until the controller stops.
+
+#define kRequestPoolSize        16
+
+#if PS2_STATISTICS
+// Interval at which the statistics (see ApplePS2Histogram.h) are published.
+
+#define kStatisticsInterval     5000    // msec
+#endif
 
 // Ports used to control the PS/2 keyboard/mouse and read data from it.
 
@@ -141,18 +183,39 @@ typedef enum { kDT_Keyboard, kDT_Mouse } PS2DeviceType;
 
 #if DEBUGGER_SUPPORT
 // Definitions for our internal keyboard queue (holds keys processed by the
-// interrupt-time mini-monitor-key-sequence detection code).
+// interrupt-time mini-monitor-key-sequence detection code).  Both ends are
+// only touched with the controller locked.  The indices run freely and are
+// masked on access, so head - tail is the number of keys queued.
 
-#define kKeyboardQueueSize 32            // number of KeyboardQueueElements
+#define kKeyboardQueueSize 32            // keys, power of two
 
-typedef struct KeyboardQueueElement KeyboardQueueElement;
-struct KeyboardQueueElement
+typedef struct PS2KeyboardQueue PS2KeyboardQueue;
+struct PS2KeyboardQueue
 {
-  queue_chain_t chain;
-  UInt8         data;
+  UInt32 head;                           // next key to fill
+  UInt32 tail;                           // next key to drain
+  UInt32 overflows;                      // keys dropped on a full queue
+  UInt8  data[kKeyboardQueueSize];
 };
 #endif //DEBUGGER_SUPPORT
 
+// Definitions for the per-device input rings, filled from the primary
+// interrupt handlers when the "InterruptRing" property is set.  Each ring has
+// a single producer (whoever holds the controller lock) and a single consumer
+// (the work loop), so the consumer side never needs to take the lock.
+
+#define kInputRingSize 256               // entries per ring, power of two
+
+typedef struct PS2InputRing PS2InputRing;
+struct PS2InputRing
+{
+  volatile UInt32 head;                  // next entry to fill  (producer)
+  volatile UInt32 tail;                  // next entry to drain (consumer)
+  UInt32          overflows;             // bytes dropped on a full ring
+  UInt8           data[kInputRingSize];
+  UInt64          timestamp[kInputRingSize];  // uptime when byte was read
+};
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 // ApplePS2Controller Class Declaration
 //
@@ -166,12 +229,18 @@ public:                                // interrupt-time variables and functions
   IOInterruptEventSource * _interruptSourceMouse;
   IOInterruptEventSource * _interruptSourceQueue;
 
-#if DEBUGGER_SUPPORT
-  bool                     _debuggingEnabled;
+  bool                     _interruptRingEnabled;
 
   void lockController(int * state);
   void unlockController(int state);
 
+  void drainDataPort();
+  bool enqueueInputRing(PS2DeviceType deviceType, UInt8 data, UInt64 timestamp);
+  bool dequeueInputRing(PS2DeviceType deviceType, UInt8 * data, UInt64 * timestamp);
+
+#if DEBUGGER_SUPPORT
+  bool                     _debuggingEnabled;
+
   bool doEscape(UInt8 key);
   bool dequeueKeyboardData(UInt8 * key);
   void enqueueKeyboardData(UInt8 key);
@@ -179,8 +248,16 @@ public:                                // interrupt-time variables and functions
 
 private:
   IOWorkLoop *             _workLoop;
-  queue_head_t             _requestQueue;
-  IOSimpleLock *           _requestQueueLock;
+  queue_head_t             _requestQueue[2][kPS2RequestPriorityCount];
+  unsigned                 _requestQueueTurn[kPS2RequestPriorityCount];
+  IOSimpleLock *           _requestQueueLock;     // queues and turns
+  IOLock *                 _requestCompletionLock; // submitRequestAndBlock
+
+  queue_head_t             _requestPool;          // free request structures
+  IOSimpleLock *           _requestPoolLock;
+  UInt32                   _requestPoolAllocated; // total ever allocated
+  UInt32                   _requestPoolInUse;
+  UInt32                   _requestPoolPeak;      // high-water mark of in use
 
   OSObject *               _interruptTargetKeyboard;
   OSObject *               _interruptTargetMouse;
@@ -189,6 +266,13 @@ private:
   bool                     _interruptInstalledKeyboard;
   bool                     _interruptInstalledMouse;
 
+  OSObject *               _batchTargetKeyboard;
+  OSObject *               _batchTargetMouse;
+  PS2BatchInterruptAction  _batchActionKeyboard;
+  PS2BatchInterruptAction  _batchActionMouse;
+  bool                     _batchInstalledKeyboard;
+  bool                     _batchInstalledMouse;
+
   OSObject *               _powerControlTargetKeyboard;
   OSObject *               _powerControlTargetMouse;
   PS2PowerControlAction    _powerControlActionKeyboard;
@@ -199,12 +283,29 @@ private:
   ApplePS2MouseDevice *    _mouseDevice;          // mouse nub
   ApplePS2KeyboardDevice * _keyboardDevice;       // keyboard nub
 
-#if DEBUGGER_SUPPORT
   IOSimpleLock *           _controllerLock;       // mach simple spin lock
 
-  KeyboardQueueElement *   _keyboardQueueAlloc;   // queues' allocation space
-  queue_head_t             _keyboardQueue;        // queue of available keys
-  queue_head_t             _keyboardQueueUnused;  // queue of unused entries
+  PS2InputRing             _inputRing[2];         // indexed by PS2DeviceType
+  UInt32                   _inputRingOverflows;   // last published total
+
+#if PS2_STATISTICS
+  IOTimerEventSource *     _statisticsTimer;
+  PS2Histogram             _dispatchLatency;      // usec, interrupt to driver
+  PS2Histogram             _dispatchSize;         // bytes per dispatch
+  PS2Histogram             _readWait;             // usec polling data port
+  PS2Histogram             _requestQueueDepth;    // sampled at submission
+  UInt32                   _requestQueueLength;   // (under request queue lock)
+  PS2Histogram             _requestClassDepth[kPS2RequestPriorityCount];
+  UInt32                   _requestClassLength[kPS2RequestPriorityCount];
+  PS2Histogram             _requestClassWait[kPS2RequestPriorityCount]; // usec
+  UInt32                   _requestsCoalesced[kPS2RequestPriorityCount];
+  UInt32                   _readTimeouts;
+  UInt32                   _secondChanceHits;
+#endif
+
+#if DEBUGGER_SUPPORT
+  PS2KeyboardQueue         _keyboardQueue;        // (under controller lock)
+  UInt32                   _keyboardQueueOverflows; // last published total
 
   bool                     _extendedState;
   UInt16                   _modifierState;
@@ -214,23 +315,97 @@ private:
   UInt32                   _currentPowerState;
   bool                     _hardwareOffline;
   bool   				   _suppressTimeout;
+  UInt32                   _dataReadDelay;        // usec before data port read
+  UInt32                   _wakeReadyTimeout;     // msec, mouse after wake
+  bool                     _mouseWaking;          // mouse input held back
+  UInt8                    _mouseWakeCount;
+  UInt8                    _mouseWakeBytes[kWakeHeldBytes];
+  UInt8                    _commandByteShadow;    // last command byte written
+  PS2MouseIdentity         _mouseIdentity;        // see identifyMouse
+  PS2TraceBuffer           _trace;                // see ApplePS2Trace.h
+
+  //
+  // Replay of a captured stream, run off the timer on the work loop.
+  //
+
+  IOTimerEventSource *     _replayTimer;
+  PS2TraceRecord *         _replayRecords;
+  UInt32                   _replayCount;          // records allocated
+  UInt32                   _replayUsed;           // holding raw bytes
+  UInt32                   _replayIndex;          // next record to dispatch
+  UInt64                   _replayStart;          // uptime replay started
+  UInt32                   _replayBytes;
+  UInt32                   _replayDispatches;
+  UInt64                   _replayDispatchTime;   // absolute time in drivers
+  PS2Histogram             _replayDispatchCost;   // nsec per dispatch
+  UInt32                   _replayPoolAllocated;  // pool size at start
+  UInt32                   _replayLiveDropped;    // live bytes held back
+  bool                     _replayDispatching;    // (traced as replayed)
+  bool                     _replayMouse;          // records for each device,
+  bool                     _replayKeyboard;       // whose live input is held
+
+  //
+  // With the input rings in use, a request that has to wait for input from
+  // a device whose IRQ is enabled is parked here, rather than busy-polling
+  // the status port, and resumed once the byte has been delivered through
+  // the IRQ (or the timer fires).  Out of order correction carries on
+  // across parking: a mismatched byte is held while the request waits for
+  // the next one.
+  //
+
+  IOTimerEventSource *     _requestTimer;
+  PS2Request *             _parkedRequest;
+  unsigned                 _parkedIndex;          // command waiting on input
+  PS2DeviceType            _parkedDeviceMode;
+  bool                     _parkedTransmitToMouse;
+  bool                     _parkedTimedOut;       // take the input as it is
+  bool                     _secondChanceHeld;
+  UInt8                    _secondChanceByte;     // first, mismatched byte
 
 #ifndef SNOW_LEO
   bool   				   _newIRQLayout;
 #endif
 
   virtual void  dispatchDriverInterrupt(PS2DeviceType deviceType, UInt8 data);
+  virtual void  dispatchDriverInterrupt(PS2DeviceType deviceType,
+                                        const UInt8 * data, UInt32 count);
   virtual void  interruptOccurred(IOInterruptEventSource *, int);
   virtual void  processRequest(PS2Request * request);
   virtual void  processRequestQueue(IOInterruptEventSource *, int);
+  virtual void  runRequestQueue(bool mayPark);
+  virtual PS2Request * dequeueRequest();
+  virtual void  executeRequest(PS2Request *  request,
+                               unsigned      index,
+                               PS2DeviceType deviceMode,
+                               bool          transmitToMouse,
+                               const UInt8 * resumeByte,
+                               bool          mayPark);
+  virtual bool  canParkRequest(PS2DeviceType deviceType);
+  virtual void  resumeParkedRequest(UInt8 data, bool mayPark);
+  virtual void  requestTimedOut(IOTimerEventSource *);
+  virtual void  replayOccurred(IOTimerEventSource *);
+  virtual void  endReplay();
+  virtual void  freeReplay();
+  virtual void  publishReplayStatistics();
+
+  virtual void  identifyMouse(PS2MouseIdentity * identity);
+  virtual bool  getMouseInformation(const UInt8 * knock, unsigned knockCount,
+                                    UInt8 info[3]);
   static  void  submitRequestAndBlockCompletion(void *, void * param);
 
   virtual UInt8 readDataPort(PS2DeviceType deviceType);
+  virtual void  wakeInputRing(PS2DeviceType deviceType);
+  virtual void  publishRequestPoolStatistics();
+#if PS2_STATISTICS
+  virtual void  publishStatistics(IOTimerEventSource *);
+#endif
   virtual void  writeCommandPort(UInt8 byte);
   virtual void  writeDataPort(UInt8 byte);
 
 #if OUT_OF_ORDER_DATA_CORRECTION_FEATURE
   virtual UInt8 readDataPort(PS2DeviceType deviceType, UInt8 expectedByte);
+  virtual bool  takeSecondChance(PS2DeviceType deviceType, UInt8 expectedByte,
+                                 UInt8 * byte);
 #endif
 
   static void setPowerStateCallout(thread_call_param_t param0,
@@ -240,9 +415,16 @@ private:
                                       void * arg0, void * arg1,
                                       void * arg2, void * arg3);
 
+  static IOReturn replayAction(OSObject * target,
+                               void * arg0, void * arg1,
+                               void * arg2, void * arg3);
+
   virtual void setPowerStateGated(UInt32 newPowerState);
 
   virtual void dispatchDriverPowerControl(UInt32 whatToDo);
+  virtual void beginMouseReady();
+  virtual bool waitForMouseReady(UInt32 timeoutMS);
+  virtual bool pollMouseData(UInt8 * data, UInt32 timeoutMS);
 
   virtual void free(void);
 
@@ -252,16 +434,24 @@ public:
   virtual void stop(IOService * provider);
 
   virtual IOWorkLoop * getWorkLoop() const;
-  virtual IOSyncer * CreateIOSyncer(bool twoRetains);
   virtual void installInterruptAction(PS2DeviceType      deviceType,
                                       OSObject *         target,
                                       PS2InterruptAction action);
   virtual void uninstallInterruptAction(PS2DeviceType deviceType);
+  virtual void installBatchInterruptAction(PS2DeviceType           deviceType,
+                                           OSObject *              target,
+                                           PS2BatchInterruptAction action);
+  virtual void uninstallBatchInterruptAction(PS2DeviceType deviceType);
 
   virtual PS2Request * allocateRequest();
   virtual void         freeRequest(PS2Request * request);
   virtual bool         submitRequest(PS2Request * request);
+  virtual bool         submitRequest(PS2Request *        request,
+                                     void *              target,
+                                     PS2CompletionAction action,
+                                     void *              param);
   virtual void         submitRequestAndBlock(PS2Request * request);
+  virtual void         updateCommandByte(UInt8 setBits, UInt8 clearBits);
 
   virtual IOReturn setPowerState(unsigned long powerStateOrdinal,
                                  IOService *   policyMaker);
@@ -271,6 +461,11 @@ public:
                                          PS2PowerControlAction action);
 
   virtual void uninstallPowerControlAction(PS2DeviceType deviceType);
+
+  virtual PS2TraceBuffer * getTraceBuffer();
+  virtual IOReturn         startReplay(const PS2TraceRecord * records,
+                                       UInt32                 count);
+  virtual void             stopReplay();
 };
 
 #endif /* _APPLEPS2CONTROLLER_H */
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include "ApplePS2ElanUserClient.h"
+#include "VoodooPS2ElanTrackpad.h"
+
+// =============================================================================
+// ApplePS2ElanUserClient Class Implementation
+//
+
+#define super IOUserClient
+OSDefineMetaClassAndStructors(ApplePS2ElanUserClient, IOUserClient);
+
+bool ApplePS2ElanUserClient::initWithTask(task_t         owningTask,
+                                          void *         securityID,
+                                          UInt32         type,
+                                          OSDictionary * properties)
+{
+  //
+  // A daemon in frame mode drives the pointer; keep it to root.
+  //
+
+  if (clientHasPrivilege(owningTask, kIOClientPrivilegeAdministrator) != kIOReturnSuccess)
+    return false;
+
+  if (!super::initWithTask(owningTask, securityID, type, properties))
+    return false;
+
+  _frames        = 0;
+  _framesStarted = false;
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2ElanUserClient::start(IOService * provider)
+{
+  ApplePS2ElanTrackpad * trackpad = OSDynamicCast(ApplePS2ElanTrackpad, provider);
+  if (!trackpad)
+    return false;
+
+  _frames        = trackpad->getFrameChannel();
+  _framesStarted = false;
+  return super::start(provider);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2ElanUserClient::clientClose()
+{
+  //
+  // A daemon that goes away hands the gestures back to the driver.
+  //
+
+  if (_framesStarted)
+    _frames->stop();
+  _framesStarted = false;
+
+  terminate();
+  return kIOReturnSuccess;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2ElanUserClient::clientMemoryForType(UInt32                type,
+                                                     IOOptionBits *        options,
+                                                     IOMemoryDescriptor ** memory)
+{
+  IOMemoryDescriptor * ring;
+
+  if (type != kPS2FrameMemoryType)
+    return kIOReturnBadArgument;
+
+  ring = _frames->memory();
+  if (!ring)
+    return kIOReturnNoMemory;
+
+  //
+  // Mapped writable, for the reader to set the doorbell; nothing else in the
+  // ring is read back.
+  //
+
+  ring->retain();
+  *options = 0;
+  *memory  = ring;
+  return kIOReturnSuccess;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2ElanUserClient::externalMethod(uint32_t                   selector,
+                                                IOExternalMethodArguments * arguments,
+                                                IOExternalMethodDispatch *  dispatch,
+                                                OSObject *                  target,
+                                                void *                      reference)
+{
+  static const IOExternalMethodDispatch methods[] =
+  {
+    // kPS2FrameMethodStart: asynchronous, the doorbell replies to it
+    { (IOExternalMethodAction) &ApplePS2ElanUserClient::startFrames,
+      0, 0, 0, 0 },
+    // kPS2FrameMethodStop
+    { (IOExternalMethodAction) &ApplePS2ElanUserClient::stopFrames,
+      0, 0, 0, 0 }
+  };
+
+  if (selector < sizeof(methods) / sizeof(methods[0]))
+  {
+    dispatch = (IOExternalMethodDispatch *) &methods[selector];
+    target   = this;
+  }
+  return super::externalMethod(selector, arguments, dispatch, target, reference);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2ElanUserClient::startFrames(ApplePS2ElanUserClient * target,
+                                             void *,
+                                             IOExternalMethodArguments * arguments)
+{
+  IOReturn result;
+
+  if (!arguments->asyncWakePort)
+    return kIOReturnBadArgument;
+
+  result = target->_frames->start(arguments->asyncReference,
+                                  arguments->asyncReferenceCount);
+  if (result == kIOReturnSuccess)
+    target->_framesStarted = true;
+  return result;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2ElanUserClient::stopFrames(ApplePS2ElanUserClient * target,
+                                            void *,
+                                            IOExternalMethodArguments *)
+{
+  if (target->_framesStarted)
+    target->_frames->stop();
+  target->_framesStarted = false;
+  return kIOReturnSuccess;
+}
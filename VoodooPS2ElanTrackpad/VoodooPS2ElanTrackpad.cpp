@@ -33,6 +33,17 @@
 #define DEBUG_LOG(fmt, args...)
 #endif
 
+// Per packet diagnostics cost an IOLog for every packet; the packets
+// themselves are in the trace buffer, so these are only built on request.
+
+#define DEBUG_PACKETS 0
+
+#if DEBUG && DEBUG_PACKETS
+#define PACKET_LOG(fmt, args...) DEBUG_LOG(fmt, ## args)
+#else
+#define PACKET_LOG(fmt, args...)
+#endif
+
 /*
  * determine hardware version and set some properties according to it.
  */
@@ -132,6 +143,59 @@ static int elantech_packet_check_v3(struct elantech_data *etd, UInt8* packet)
 	return PACKET_UNKNOWN;
 }
 
+/*
+ * When we encounter packet that matches this exactly, it means the
+ * hardware is in debounce status. Just ignore the whole packet.
+ */
+static int elantech_debounce_check_v2(UInt8* packet)
+{
+	const UInt8 debounce_packet[] = { 0x84, 0xff, 0xff, 0x02, 0xff, 0xff };
+    
+	return !memcmp(packet, debounce_packet, sizeof(debounce_packet));
+}
+
+static int elantech_packet_check_v2(struct elantech_data *etd, UInt8* packet)
+{
+	/*
+	 * V2 hardware has two flavors. Older ones that do not report pressure,
+	 * and newer ones that reports pressure and width. With newer ones, all
+	 * packets (1, 2, 3 finger touch) have the same constant bits. With
+	 * older ones, 1/3 finger touch packets and 2 finger touch packets
+	 * have different constant bits.
+	 * With all three cases, if the constant bits are not exactly what I
+	 * expected, I consider them invalid.
+	 */
+	if (etd->reports_pressure)
+		return (packet[0] & 0x0c) == 0x04 &&
+               (packet[3] & 0x0f) == 0x02;
+    
+	if ((packet[0] & 0xc0) == 0x80)
+		return (packet[0] & 0x0c) == 0x0c &&
+               (packet[3] & 0x0e) == 0x08;
+    
+	return (packet[0] & 0x3c) == 0x3c &&
+           (packet[1] & 0xf0) == 0x00 &&
+           (packet[3] & 0x3e) == 0x38 &&
+           (packet[4] & 0xf0) == 0x00;
+}
+
+static int elantech_packet_check_v4(UInt8* packet)
+{
+	if ((packet[0] & 0x0c) != 0x04)
+		return PACKET_UNKNOWN;
+    
+	switch (packet[3] & 0x1f) {
+        case 0x10:
+            return PACKET_V4_STATUS;
+        case 0x11:
+            return PACKET_V4_HEAD;
+        case 0x12:
+            return PACKET_V4_MOTION;
+	}
+    
+	return PACKET_UNKNOWN;
+}
+
 // =============================================================================
 // ApplePS2ElanTrackpad Class Implementation
 //
@@ -143,6 +207,7 @@ UInt32 ApplePS2ElanTrackpad::deviceType() { return NX_EVS_DEVICE_TYPE_MOUSE; };
 UInt32 ApplePS2ElanTrackpad::interfaceID(){ return NX_EVS_DEVICE_INTERFACE_BUS_ACE; };
 IOItemCount ApplePS2ElanTrackpad::buttonCount() { return 2; };
 IOFixed     ApplePS2ElanTrackpad::resolution()  { return _resolution; };
+PS2FrameChannel * ApplePS2ElanTrackpad::getFrameChannel() { return &_frames; };
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
@@ -155,7 +220,11 @@ bool ApplePS2ElanTrackpad::init( OSDictionary * properties )
     if (!super::init(properties))  return false;
     DEBUG_LOG("init");
     _device                    = 0;
-    _packetByteCount           = 0;
+    _packets.init();
+    _packets.validator().hwVersion = 0;
+    _registers.invalidate();
+    _frames.init();
+    _frameButtons              = 0;
     _resolution                = (100) << 16; // (100 dpi, 4 counts/mm) On init should be on default
     etd                        = &e_data;
     return true;
@@ -384,13 +453,24 @@ int ApplePS2ElanTrackpad::elantech_set_absolute_mode( IOService * provider )
 {
 	UInt8 val;
     int rc = 0;
+    PS2CommandBatch batch;
+
+    //
+    // All register writes go out as one batch, behind a single disable, so
+    // no packets are streamed in between.  Reporting is enabled again once
+    // the driver is ready for packets.
+    //
+
+    _device = (ApplePS2MouseDevice *) provider;
+    batch.init(_device);
+    batch.addMouseCommand(kDP_SetDefaultsAndDisable);
     
 	switch (etd->hw_version) {
         case 1:
             etd->reg_10 = 0x16;
             etd->reg_11 = 0x8f;
-            if (elantech_write_reg(provider, 0x10, etd->reg_10) ||
-                elantech_write_reg(provider, 0x11, etd->reg_11)) {
+            if (elantech_write_reg(&batch, 0x10, etd->reg_10) ||
+                elantech_write_reg(&batch, 0x11, etd->reg_11)) {
                 rc = -1;
             }
             break;
@@ -400,27 +480,32 @@ int ApplePS2ElanTrackpad::elantech_set_absolute_mode( IOService * provider )
             etd->reg_10 = 0x54;
             etd->reg_11 = 0x88;	/* 0x8a */
             etd->reg_21 = 0x60;	/* 0x00 */
-            if (elantech_write_reg(provider, 0x10, etd->reg_10) ||
-                elantech_write_reg(provider, 0x11, etd->reg_11) ||
-                elantech_write_reg(provider, 0x21, etd->reg_21)) {
+            if (elantech_write_reg(&batch, 0x10, etd->reg_10) ||
+                elantech_write_reg(&batch, 0x11, etd->reg_11) ||
+                elantech_write_reg(&batch, 0x21, etd->reg_21)) {
                 rc = -1;
             }
             break;
             
         case 3:
             etd->reg_10 = 0x0b;
-            if (elantech_write_reg(provider, 0x10, etd->reg_10))
+            if (elantech_write_reg(&batch, 0x10, etd->reg_10))
                 rc = -1;
             
             break;
             
         case 4:
             etd->reg_07 = 0x01;
-            if (elantech_write_reg(provider, 0x07, etd->reg_07))
+            if (elantech_write_reg(&batch, 0x07, etd->reg_07))
                 rc = -1;
             
             /* v4 has no reg 0x10 to read */
 	}
+
+    if (!batch.commit()) {
+        _registers.invalidate();
+        rc = -1;
+    }
     
     switch (etd->hw_version) {
         case 1 ... 3:
@@ -499,6 +584,7 @@ bool ApplePS2ElanTrackpad::start( IOService * provider )
     
     _device = (ApplePS2MouseDevice *) provider;
     _device->retain();
+    _trace  = _device->getTraceBuffer();
     
     if (send_cmd(provider, ETP_CAPABILITIES_QUERY, etd->capabilities, etd->send_cmd)) {
         DEBUG_LOG("failed to query capabilities.");
@@ -532,6 +618,8 @@ bool ApplePS2ElanTrackpad::start( IOService * provider )
     bounds.maxy = y_max;
     
     last_fingers = 0;
+    last_id = -1;
+    etd->mt_active = 0;
     tapToClick = true;
     validLastPoint = false;
     for (int i = 0; i < ETP_MAX_FINGERS; ++i) {
@@ -559,6 +647,9 @@ bool ApplePS2ElanTrackpad::start( IOService * provider )
 	etd->width = width;
     
     pktsize = etd->hw_version > 1 ? 6 : 4;
+    _packets.setLength(pktsize);
+    _packets.validator().setDevice(etd);
+    _processPacket = packetHandlers[etd->hw_version - 1];
 
     DEBUG_LOG("pktsize result %d.", pktsize);
 
@@ -594,6 +685,14 @@ bool ApplePS2ElanTrackpad::start( IOService * provider )
     
     setProperty(kIOHIDPointerAccelerationTypeKey, kIOHIDTrackpadAccelerationType);
     
+    //
+    // The frame ring for a gesture daemon (see ApplePS2FrameRing.h), unused
+    // until one turns frame mode on.
+    //
+    
+    if (!_frames.allocate(256, kPS2FrameSourceElan))
+        IOLog("ApplePS2ElanTrackpad: Unable to allocate frame ring\n");
+    
     //
     // Install our driver's interrupt handler, for asynchronous data delivery.
     //
@@ -606,7 +705,7 @@ bool ApplePS2ElanTrackpad::start( IOService * provider )
     // Enable the mouse clock (should already be so) and the mouse IRQ line.
     //
     
-    setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
+    _device->updateCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
     
     //
     // Finally, we enable the trackpad itself, so that it may start reporting
@@ -628,70 +727,10 @@ bool ApplePS2ElanTrackpad::start( IOService * provider )
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2ElanTrackpad::setCommandByte( UInt8 setBits, UInt8 clearBits )
-{
-    //
-    // Sets the bits setBits and clears the bits clearBits "atomically" in the
-    // controller's Command Byte.   Since the controller does not provide such
-    // a read-modify-write primitive, we resort to a test-and-set try loop.
-    //
-    // Do NOT issue this request from the interrupt/completion context.
-    //
-	
-    UInt8        commandByte;
-    UInt8        commandByteNew;
-    PS2Request * request = _device->allocateRequest();
-	
-    if ( !request ) return;
-	
-    do
-    {
-        // (read command byte)
-        request->commands[0].command = kPS2C_WriteCommandPort;
-        request->commands[0].inOrOut = kCP_GetCommandByte;
-        request->commands[1].command = kPS2C_ReadDataPort;
-        request->commands[1].inOrOut = 0;
-        request->commandsCount = 2;
-        _device->submitRequestAndBlock(request);
-		
-        //
-        // Modify the command byte as requested by caller.
-        //
-		
-        commandByte    = request->commands[1].inOrOut;
-        commandByteNew = (commandByte | setBits) & (~clearBits);
-		
-        // ("test-and-set" command byte)
-        request->commands[0].command = kPS2C_WriteCommandPort;
-        request->commands[0].inOrOut = kCP_GetCommandByte;
-        request->commands[1].command = kPS2C_ReadDataPortAndCompare;
-        request->commands[1].inOrOut = commandByte;
-        request->commands[2].command = kPS2C_WriteCommandPort;
-        request->commands[2].inOrOut = kCP_SetCommandByte;
-        request->commands[3].command = kPS2C_WriteDataPort;
-        request->commands[3].inOrOut = commandByteNew;
-        request->commandsCount = 4;
-        _device->submitRequestAndBlock(request);
-		
-        //
-        // Repeat this loop if last command failed, that is, if the
-        // old command byte was modified since we first read it.
-        //
-		
-    } while (request->commandsCount != 4);
-	
-    _device->freeRequest(request);
-}
-
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-
 void ApplePS2ElanTrackpad::interruptOccurred( UInt8 data )
 {
     //DEBUG_LOG("interruptOccurred");
 
-	if (etd->debug > 1)
-		elantech_packet_dump(data);
-
     //
     // This will be invoked automatically from our device when asynchronous
     // events need to be delivered. Process the trackpad data. Do NOT issue
@@ -701,69 +740,73 @@ void ApplePS2ElanTrackpad::interruptOccurred( UInt8 data )
     // packets may get out of sequence and things will get very confusing.
     //
 
-    _packetBuffer[_packetByteCount++] = data;
-
-	if(_packetByteCount == pktsize) // Absolute mode
+    if (_packets.add(data) == kPS2PacketComplete) // Absolute mode
 	{
-        //DEBUG_LOG("pktsize = %d", pktsize);
-        int packet_type;
-        switch (etd->hw_version) {
-            case 1:
-                /*
-                if (etd->paritycheck && !elantech_packet_check_v1(etd, _packetBuffer)) {
-                    
-                } else {
-                    elantech_report_absolute_v1(psmouse);                    
-                }
-                 */
-                
-                break;
-                
-            case 2:
-                /* ignore debounce */
-                /*
-                if (elantech_debounce_check_v2(psmouse))
-                    return PSMOUSE_FULL_PACKET;
-                
-                if (etd->paritycheck && !elantech_packet_check_v2(psmouse))
-                    return PSMOUSE_BAD_DATA;
-                
-                elantech_report_absolute_v2(psmouse);
-                 */
-                break;
-                
-            case 3:
-                packet_type = elantech_packet_check_v3(etd, _packetBuffer);
-                /* ignore debounce */
-                if (packet_type != PACKET_DEBOUNCE && packet_type != PACKET_UNKNOWN)
-                    elantech_report_absolute_v3(_packetBuffer, pktsize, packet_type);
-                break;
-                
-            case 4:
-                /*
-                packet_type = elantech_packet_check_v4(psmouse);
-                if (packet_type == PACKET_UNKNOWN)
-                    return PSMOUSE_BAD_DATA;
-                
-                elantech_report_absolute_v4(psmouse, packet_type);
-                 */
-                break;
-        }
+        _trace->add(kPS2TracePacket, etd->hw_version, _packets.packet(), pktsize);
+        (this->*_processPacket)(_packets.packet());
         
+        _packets.publishStatistics(this);
 		return;
 	}
 	return;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+/*
+ * Packet handlers by hardware version, one of which start() picks as
+ * _processPacket, so the interrupt path does not switch on the version
+ * for every packet.  Each checks a complete packet and reports it.
+ */
+
+const ApplePS2ElanTrackpad::PacketHandler ApplePS2ElanTrackpad::packetHandlers[] = {
+    &ApplePS2ElanTrackpad::elantech_process_packet_v1,
+    &ApplePS2ElanTrackpad::elantech_process_packet_v2,
+    &ApplePS2ElanTrackpad::elantech_process_packet_v3,
+    &ApplePS2ElanTrackpad::elantech_process_packet_v4
+};
+
+void ApplePS2ElanTrackpad::elantech_process_packet_v1(UInt8* packet)
+{
+	if (etd->paritycheck && !elantech_packet_check_v1(etd, packet))
+		_packets.noteBadPacket();
+	else
+		elantech_report_absolute_v1(packet);
+}
+
+void ApplePS2ElanTrackpad::elantech_process_packet_v2(UInt8* packet)
+{
+	/* ignore debounce */
+	if (elantech_debounce_check_v2(packet))
+		return;
+    
+	if (etd->paritycheck && !elantech_packet_check_v2(etd, packet))
+		_packets.noteBadPacket();
+	else
+		elantech_report_absolute_v2(packet);
+}
+
+void ApplePS2ElanTrackpad::elantech_process_packet_v3(UInt8* packet)
+{
+	int packet_type = elantech_packet_check_v3(etd, packet);
+    
+	if (packet_type == PACKET_UNKNOWN)
+		_packets.noteBadPacket();
+	/* ignore debounce */
+	else if (packet_type != PACKET_DEBOUNCE)
+		elantech_report_absolute_v3(packet, pktsize, packet_type);
+}
 
-void ApplePS2ElanTrackpad::elantech_packet_dump( UInt8 data )
+void ApplePS2ElanTrackpad::elantech_process_packet_v4(UInt8* packet)
 {
-	static int i = 0;
-    //DEBUG_LOG("%d: 0x%02x", i, data);
-    i++;
+	int packet_type = elantech_packet_check_v4(packet);
+    
+	if (packet_type == PACKET_UNKNOWN)
+		_packets.noteBadPacket();
+	else
+		elantech_report_absolute_v4(packet, packet_type);
 }
 
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 /*
  * Interpret complete data packets and report absolute mode input events for
@@ -786,7 +829,6 @@ void ApplePS2ElanTrackpad::elantech_report_absolute_v3(UInt8* packet, UInt32 pac
     
     unsigned int fingers = 0, x1 = 0, y1 = 0, x2 = 0, y2 = 0;
     int x_diff, y_diff;
-	unsigned int width = 0, pres = 0;
     
 	UInt32       buttons = 0;
     
@@ -799,16 +841,36 @@ void ApplePS2ElanTrackpad::elantech_report_absolute_v3(UInt8* packet, UInt32 pac
 	/* byte 0: n1  n0   .   .   .   .   R   L */
 	fingers = (packet[0] & 0xc0) >> 6;
     
-	pres = (packet[1] & 0xf0) | ((packet[4] & 0xf0) >> 4);
-	width = ((packet[0] & 0x30) >> 2) | ((packet[3] & 0x30) >> 4);
-    
     if ( (packet[0] & 0x1) ) buttons |= 0x1;  // left button   (bit 0 in packet)
     if ( (packet[0] & 0x2) ) buttons |= 0x2;  // right button  (bit 1 in packet)
 
+	if (_frames.active()) {
+		IOGPoint point[2];
+		unsigned int active = 0;
+        
+		point[0].x = ((packet[1] & 0x0f) << 8) | packet[2];
+		point[0].y = etd->y_max - (((packet[4] & 0x0f) << 8) | packet[5]);
+		if (fingers == 1) {
+			active = 0x1;
+		} else if (fingers == 2) {
+			/* two fingers come as head and tail packet, report both at once */
+			if (packet_type == PACKET_V3_HEAD) {
+				etd->mt[0] = point[0];
+				return;
+			}
+			point[1] = point[0];
+			point[0] = etd->mt[0];
+			active = 0x3;
+		}
+		elantech_report_frame(fingers, point, active, buttons);
+		last_fingers = fingers;
+		return;
+	}
+
 	switch (fingers) {
         case 0:
             if (tapToClick && last_fingers <= 2 && last_fingers > 0) {
-                DEBUG_LOG("old buttons 0x%02x", buttons);
+                PACKET_LOG("old buttons 0x%02x", buttons);
                 switch (last_fingers) {
                     case 1:
                         buttons |= 0x1;
@@ -817,7 +879,7 @@ void ApplePS2ElanTrackpad::elantech_report_absolute_v3(UInt8* packet, UInt32 pac
                         buttons |= 0x2;
                         break;
                 }
-                DEBUG_LOG("new buttons 0x%02x", buttons);
+                PACKET_LOG("new buttons 0x%02x", buttons);
                 tapToClick = false;
             }
             
@@ -856,19 +918,19 @@ void ApplePS2ElanTrackpad::elantech_report_absolute_v3(UInt8* packet, UInt32 pac
                     if (tapInRange) {
                         x_diff = x1 - startPoint[0].x;
                         y_diff = y1 - startPoint[0].y;
-                        DEBUG_LOG("x_diff %d, y_diff %d", x_diff, y_diff);
+                        PACKET_LOG("x_diff %d, y_diff %d", x_diff, y_diff);
                     
-                        DEBUG_LOG("before check tapToClick %d, tapInRange[0] %d", tapToClick, tapInRange[0]);
+                        PACKET_LOG("before check tapToClick %d, tapInRange[0] %d", tapToClick, tapInRange[0]);
                         
                         if (((x_diff < -ETP_TAPTOCLICK_DIST) || (x_diff > ETP_TAPTOCLICK_DIST) || (y_diff < -ETP_TAPTOCLICK_DIST) || (y_diff > ETP_TAPTOCLICK_DIST))) {
-                            DEBUG_LOG("tapInRange[0] is false now %d", ((x_diff < -ETP_TAPTOCLICK_DIST) || (x_diff > ETP_TAPTOCLICK_DIST) || (y_diff < -ETP_TAPTOCLICK_DIST) || (y_diff > ETP_TAPTOCLICK_DIST)));
+                            PACKET_LOG("tapInRange[0] is false now %d", ((x_diff < -ETP_TAPTOCLICK_DIST) || (x_diff > ETP_TAPTOCLICK_DIST) || (y_diff < -ETP_TAPTOCLICK_DIST) || (y_diff > ETP_TAPTOCLICK_DIST)));
                             tapInRange[0] = false;
                         }
                     
                         if (!tapInRange[0])
                             tapToClick = false;
                         
-                        DEBUG_LOG("after check tapToClick %d, tapInRange[0] %d", tapToClick, tapInRange[0]);
+                        PACKET_LOG("after check tapToClick %d, tapInRange[0] %d", tapToClick, tapInRange[0]);
                     }
                 }
                 
@@ -877,7 +939,7 @@ void ApplePS2ElanTrackpad::elantech_report_absolute_v3(UInt8* packet, UInt32 pac
                     startPoint[0].y = y1;
                     
                     validStartPoint[0] = true;
-                    DEBUG_LOG("start point %d, x %d, y %d", validStartPoint[0], startPoint[0].x, startPoint[0].y);
+                    PACKET_LOG("start point %d, x %d, y %d", validStartPoint[0], startPoint[0].x, startPoint[0].y);
                 }
             }
             break;
@@ -900,19 +962,19 @@ void ApplePS2ElanTrackpad::elantech_report_absolute_v3(UInt8* packet, UInt32 pac
                         if (tapInRange[0]) {
                             x_diff = x1 - startPoint[0].x;
                             y_diff = y1 - startPoint[0].y;
-                            DEBUG_LOG("x_diff %d, y_diff %d", x_diff, y_diff);
+                            PACKET_LOG("x_diff %d, y_diff %d", x_diff, y_diff);
                         
-                            DEBUG_LOG("before check tapToClick %d, tapInRange[0] %d", tapToClick, tapInRange[0]);
+                            PACKET_LOG("before check tapToClick %d, tapInRange[0] %d", tapToClick, tapInRange[0]);
                             
                             if (((x_diff < -ETP_TAPTOCLICK_DIST) || (x_diff > ETP_TAPTOCLICK_DIST) || (y_diff < -ETP_TAPTOCLICK_DIST) || (y_diff > ETP_TAPTOCLICK_DIST))) {
-                                DEBUG_LOG("tapInRange[0] is false now %d", ((x_diff < -ETP_TAPTOCLICK_DIST) || (x_diff > ETP_TAPTOCLICK_DIST) || (y_diff < -ETP_TAPTOCLICK_DIST) || (y_diff > ETP_TAPTOCLICK_DIST)));
+                                PACKET_LOG("tapInRange[0] is false now %d", ((x_diff < -ETP_TAPTOCLICK_DIST) || (x_diff > ETP_TAPTOCLICK_DIST) || (y_diff < -ETP_TAPTOCLICK_DIST) || (y_diff > ETP_TAPTOCLICK_DIST)));
                                 tapInRange[0] = false;
                             }
                             
                             if (!tapInRange[0])
                                 tapToClick = false;
                             
-                            DEBUG_LOG("after check tapToClick %d, tapInRange[0] %d", tapToClick, tapInRange[0]);
+                            PACKET_LOG("after check tapToClick %d, tapInRange[0] %d", tapToClick, tapInRange[0]);
                         }
                     }
                     
@@ -921,7 +983,7 @@ void ApplePS2ElanTrackpad::elantech_report_absolute_v3(UInt8* packet, UInt32 pac
                         startPoint[0].y = y1;
                         
                         validStartPoint[0] = true;
-                        DEBUG_LOG("start point 0: %d, x %d, y %d", validStartPoint[0], startPoint[0].x, startPoint[0].y);
+                        PACKET_LOG("start point 0: %d, x %d, y %d", validStartPoint[0], startPoint[0].x, startPoint[0].y);
                     }
                 }
                 
@@ -940,19 +1002,19 @@ void ApplePS2ElanTrackpad::elantech_report_absolute_v3(UInt8* packet, UInt32 pac
                         if (tapInRange[1]) {
                             x_diff = x2 - startPoint[1].x;
                             y_diff = y2 - startPoint[1].y;
-                            DEBUG_LOG("x_diff %d, y_diff %d", x_diff, y_diff);
+                            PACKET_LOG("x_diff %d, y_diff %d", x_diff, y_diff);
                             
-                            DEBUG_LOG("before check tapToClick %d, tapInRange[1] %d", tapToClick, tapInRange[1]);
+                            PACKET_LOG("before check tapToClick %d, tapInRange[1] %d", tapToClick, tapInRange[1]);
                             
                             if (((x_diff < -ETP_TAPTOCLICK_DIST) || (x_diff > ETP_TAPTOCLICK_DIST) || (y_diff < -ETP_TAPTOCLICK_DIST) || (y_diff > ETP_TAPTOCLICK_DIST))) {
-                                DEBUG_LOG("tapInRange[0] is false now %d", ((x_diff < -ETP_TAPTOCLICK_DIST) || (x_diff > ETP_TAPTOCLICK_DIST) || (y_diff < -ETP_TAPTOCLICK_DIST) || (y_diff > ETP_TAPTOCLICK_DIST)));
+                                PACKET_LOG("tapInRange[0] is false now %d", ((x_diff < -ETP_TAPTOCLICK_DIST) || (x_diff > ETP_TAPTOCLICK_DIST) || (y_diff < -ETP_TAPTOCLICK_DIST) || (y_diff > ETP_TAPTOCLICK_DIST)));
                                 tapInRange[1] = false;
                             }
                             
                             if (!tapInRange[1])
                                 tapToClick = false;
                             
-                            DEBUG_LOG("after check tapToClick %d, tapInRange[1] %d", tapToClick, tapInRange[1]);
+                            PACKET_LOG("after check tapToClick %d, tapInRange[1] %d", tapToClick, tapInRange[1]);
                         }
                     }
                     
@@ -961,7 +1023,7 @@ void ApplePS2ElanTrackpad::elantech_report_absolute_v3(UInt8* packet, UInt32 pac
                         startPoint[1].y = y2;
                         
                         validStartPoint[1] = true;
-                        DEBUG_LOG("start point 1: %d, x %d, y %d", validStartPoint[1], startPoint[1].x, startPoint[1].y);
+                        PACKET_LOG("start point 1: %d, x %d, y %d", validStartPoint[1], startPoint[1].x, startPoint[1].y);
                     }
                 }
                 
@@ -970,12 +1032,334 @@ void ApplePS2ElanTrackpad::elantech_report_absolute_v3(UInt8* packet, UInt32 pac
 	}
 
     if (etd->debug > 1) {
-        DEBUG_LOG("fingers %d, x1 %d, y1 %d, x2 %d, y2 %d, width %d, pres %d",
-                  fingers, x1, y1, x2, y2, width, pres);
+        PACKET_LOG("fingers %d, x1 %d, y1 %d, x2 %d, y2 %d, width %d, pres %d",
+                  fingers, x1, y1, x2, y2,
+                  ((packet[0] & 0x30) >> 2) | ((packet[3] & 0x30) >> 4),
+                  (packet[1] & 0xf0) | ((packet[4] & 0xf0) >> 4));
     }
     
     last_fingers = fingers;
-    _packetByteCount = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+/*
+ * Common tail of the v1, v2 and v4 reports: move the pointer with one
+ * finger, and turn a short touch that stayed in place into a click, a
+ * right click for two fingers, as v3 does.
+ */
+
+void ApplePS2ElanTrackpad::elantech_report_pointer(unsigned int fingers, int x, int y, UInt32 buttons)
+{
+    int x_diff, y_diff;
+    
+#if APPLESDK
+	clock_get_uptime(&now);
+#else
+	clock_get_uptime((uint64_t*)&now);
+#endif
+    
+    if (fingers == 0) {
+        if (tapToClick && last_fingers <= 2 && last_fingers > 0)
+            buttons |= last_fingers == 1 ? 0x1 : 0x2;
+        
+        dispatchRelativePointerEvent(0, 0, buttons, now);
+        validLastPoint = false;
+        for (int i = 0; i < ETP_MAX_FINGERS; ++i) {
+            validStartPoint[i] = false;
+            tapInRange[i] = true;
+        }
+        tapToClick = true;
+        last_fingers = 0;
+        return;
+    }
+    
+    if (fingers == 1) {
+        if (validLastPoint)
+            dispatchRelativePointerEvent(x - lastPoint.x, y - lastPoint.y, buttons, now);
+        else
+            dispatchRelativePointerEvent(0, 0, buttons, now);
+        
+        lastPoint.x = x;
+        lastPoint.y = y;
+        validLastPoint = true;
+    } else {
+        /* no pointer motion with more fingers; resume cleanly with one */
+        dispatchRelativePointerEvent(0, 0, buttons, now);
+        validLastPoint = false;
+    }
+    
+    if (validStartPoint[0]) {
+        x_diff = x - startPoint[0].x;
+        y_diff = y - startPoint[0].y;
+        if ((x_diff < -ETP_TAPTOCLICK_DIST) || (x_diff > ETP_TAPTOCLICK_DIST) ||
+            (y_diff < -ETP_TAPTOCLICK_DIST) || (y_diff > ETP_TAPTOCLICK_DIST)) {
+            tapInRange[0] = false;
+            tapToClick = false;
+        }
+    } else {
+        startPoint[0].x = x;
+        startPoint[0].y = y;
+        validStartPoint[0] = true;
+    }
+    
+    if (fingers > 2)
+        tapToClick = false;
+    
+    last_fingers = fingers;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+/*
+ * Frame mode counterpart of elantech_report_pointer: hand the fingers down
+ * (bit i of active for point[i]) to the gesture daemon, and only report the
+ * physical buttons when they change.
+ */
+
+void ApplePS2ElanTrackpad::elantech_report_frame(unsigned int fingers, const IOGPoint *point,
+                                                 unsigned int active, UInt32 buttons)
+{
+    PS2Frame *frame;
+    
+#if APPLESDK
+	clock_get_uptime(&now);
+#else
+	clock_get_uptime((uint64_t*)&now);
+#endif
+    
+    frame = _frames.begin(*(uint64_t*)&now);
+    frame->fingers = fingers;
+    frame->buttons = buttons;
+    for (int id = 0; active && frame->points < kPS2FrameMaxFingers; id++, active >>= 1) {
+        if (active & 1) {
+            PS2FrameFinger *finger = &frame->finger[frame->points++];
+            finger->x = point[id].x;
+            finger->y = point[id].y;
+            finger->z = 0;
+            finger->width = 0;
+            finger->id = id;
+        }
+    }
+    _frames.commit(frame);
+    
+    if (buttons != _frameButtons)
+        dispatchRelativePointerEvent(0, 0, buttons, now);
+    _frameButtons = buttons;
+    
+    /* resume without a jump when frame mode ends */
+    validLastPoint = false;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+/*
+ * Interpret complete data packets and report absolute mode input events for
+ * hardware version 1. (4 byte packets)
+ */
+
+void ApplePS2ElanTrackpad::elantech_report_absolute_v1(UInt8* packet)
+{
+	unsigned int fingers;
+	int x = 0, y = 0;
+	UInt32 buttons = 0;
+    
+	if (etd->fw_version < 0x020000) {
+		/*
+		 * byte 0:  D   U  p1  p2   1  p3   R   L
+		 * byte 1:  f   0  th  tw  x9  x8  y9  y8
+		 */
+		fingers = ((packet[1] & 0x80) >> 7) +
+                  ((packet[1] & 0x30) >> 4);
+	} else {
+		/*
+		 * byte 0: n1  n0  p2  p1   1  p3   R   L
+		 * byte 1:  0   0   0   0  x9  x8  y9  y8
+		 */
+		fingers = (packet[0] & 0xc0) >> 6;
+	}
+    
+	if (etd->jumpy_cursor) {
+		if (fingers != 1) {
+			etd->single_finger_reports = 0;
+		} else if (etd->single_finger_reports < 2) {
+			/* Discard first 2 reports of one finger, bogus */
+			etd->single_finger_reports++;
+			PACKET_LOG("discarding packet");
+			return;
+		}
+	}
+    
+	if (fingers) {
+		/*
+		 * byte 2: x7  x6  x5  x4  x3  x2  x1  x0
+		 * byte 3: y7  y6  y5  y4  y3  y2  y1  y0
+		 */
+		x = ((packet[1] & 0x0c) << 6) | packet[2];
+		y = etd->y_max - (((packet[1] & 0x03) << 8) | packet[3]);
+	}
+    
+	if ( (packet[0] & 0x1) ) buttons |= 0x1;  // left button   (bit 0 in packet)
+	if ( (packet[0] & 0x2) ) buttons |= 0x2;  // right button  (bit 1 in packet)
+    
+	if (_frames.active()) {
+		IOGPoint point = { (SInt16) x, (SInt16) y };
+		elantech_report_frame(fingers, &point, fingers ? 0x1 : 0, buttons);
+		return;
+	}
+    
+	elantech_report_pointer(fingers, x, y, buttons);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+/*
+ * Interpret complete data packets and report absolute mode input events for
+ * hardware version 2. (6 byte packets)
+ */
+
+void ApplePS2ElanTrackpad::elantech_report_absolute_v2(UInt8* packet)
+{
+	unsigned int fingers, x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+	UInt32 buttons = 0;
+    
+	/* byte 0: n1  n0   .   .   .   .   R   L */
+	fingers = (packet[0] & 0xc0) >> 6;
+    
+	switch (fingers) {
+        case 3:
+            /*
+             * Same as one finger, except report of more fingers.
+             */
+            if (packet[3] & 0x80)
+                fingers = 4;
+            /* pass through... */
+        case 1:
+            /*
+             * byte 1:  .   .   .   .  x11 x10 x9  x8
+             * byte 2: x7  x6  x5  x4  x4  x2  x1  x0
+             */
+            x1 = ((packet[1] & 0x0f) << 8) | packet[2];
+            /*
+             * byte 4:  .   .   .   .  y11 y10 y9  y8
+             * byte 5: y7  y6  y5  y4  y3  y2  y1  y0
+             */
+            y1 = etd->y_max - (((packet[4] & 0x0f) << 8) | packet[5]);
+            break;
+            
+        case 2:
+            /*
+             * The coordinate of each finger is reported separately
+             * with a lower resolution for two finger touches:
+             * byte 0:  .   .  ay8 ax8  .   .   .   .
+             * byte 1: ax7 ax6 ax5 ax4 ax3 ax2 ax1 ax0
+             */
+            x1 = (((packet[0] & 0x10) << 4) | packet[1]) << 2;
+            /* byte 2: ay7 ay6 ay5 ay4 ay3 ay2 ay1 ay0 */
+            y1 = etd->y_max - ((((packet[0] & 0x20) << 3) | packet[2]) << 2);
+            /*
+             * byte 3:  .   .  by8 bx8  .   .   .   .
+             * byte 4: bx7 bx6 bx5 bx4 bx3 bx2 bx1 bx0
+             */
+            x2 = (((packet[3] & 0x10) << 4) | packet[4]) << 2;
+            /* byte 5: by7 by8 by5 by4 by3 by2 by1 by0 */
+            y2 = etd->y_max - ((((packet[3] & 0x20) << 3) | packet[5]) << 2);
+            break;
+	}
+    
+	if ( (packet[0] & 0x1) ) buttons |= 0x1;  // left button   (bit 0 in packet)
+	if ( (packet[0] & 0x2) ) buttons |= 0x2;  // right button  (bit 1 in packet)
+    
+	if (etd->debug > 1) {
+		PACKET_LOG("fingers %d, x1 %d, y1 %d, x2 %d, y2 %d",
+                   fingers, x1, y1, x2, y2);
+	}
+    
+	if (_frames.active()) {
+		IOGPoint point[2] = { { (SInt16) x1, (SInt16) y1 }, { (SInt16) x2, (SInt16) y2 } };
+		elantech_report_frame(fingers, point, fingers == 2 ? 0x3 : fingers ? 0x1 : 0, buttons);
+		return;
+	}
+    
+	elantech_report_pointer(fingers, x1, y1, buttons);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+/*
+ * Interpret complete data packets and report absolute mode input events for
+ * hardware version 4.  Head packets give the position of one finger, motion
+ * packets move up to two fingers, status packets tell which fingers are
+ * down.  The fingers are tracked in etd->mt, with etd->mt_active holding a
+ * bit per finger down; the lowest one moves the pointer.
+ */
+
+void ApplePS2ElanTrackpad::elantech_report_absolute_v4(UInt8* packet, int packet_type)
+{
+	int id, sid, weight;
+	unsigned int fingers, active;
+	UInt32 buttons = 0;
+    
+	switch (packet_type) {
+        case PACKET_V4_STATUS:
+            /* notify finger state change */
+            etd->mt_active = packet[1] & 0x1f;
+            break;
+            
+        case PACKET_V4_HEAD:
+            id = ((packet[3] & 0xe0) >> 5) - 1;
+            if (id < 0 || id >= ETP_MAX_FINGERS)
+                return;
+            
+            etd->mt[id].x = ((packet[1] & 0x0f) << 8) | packet[2];
+            etd->mt[id].y = etd->y_max - (((packet[4] & 0x0f) << 8) | packet[5]);
+            etd->mt_active |= 1 << id;
+            break;
+            
+        case PACKET_V4_MOTION:
+            id = ((packet[0] & 0xe0) >> 5) - 1;
+            if (id < 0 || id >= ETP_MAX_FINGERS)
+                return;
+            
+            sid = ((packet[3] & 0xe0) >> 5) - 1;
+            weight = (packet[0] & 0x10) ? ETP_WEIGHT_VALUE : 1;
+            
+            /*
+             * Motion packets give us the delta of x, y values of specific
+             * fingers, but in two's complement.
+             */
+            etd->mt[id].x += (SInt8)packet[1] * weight;
+            etd->mt[id].y -= (SInt8)packet[2] * weight;
+            
+            if (sid >= 0 && sid < ETP_MAX_FINGERS) {
+                etd->mt[sid].x += (SInt8)packet[4] * weight;
+                etd->mt[sid].y -= (SInt8)packet[5] * weight;
+            }
+            break;
+	}
+    
+	if ( (packet[0] & 0x1) ) buttons |= 0x1;  // left button   (bit 0 in packet)
+	if ( (packet[0] & 0x2) ) buttons |= 0x2;  // right button  (bit 1 in packet)
+    
+	fingers = 0;
+	id = -1;
+	for (active = etd->mt_active, sid = 0; active; active >>= 1, sid++) {
+		if (active & 1) {
+			if (id < 0)
+				id = sid;
+			fingers++;
+		}
+	}
+    
+	if (_frames.active()) {
+		elantech_report_frame(fingers, etd->mt, etd->mt_active, buttons);
+		return;
+	}
+    
+	/* the pointer finger changed, don't jump to the new one */
+	if (id != last_id)
+		validLastPoint = false;
+	last_id = id;
+    
+	if (id < 0)
+		elantech_report_pointer(0, 0, 0, buttons);
+	else
+		elantech_report_pointer(fingers, etd->mt[id].x, etd->mt[id].y, buttons);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -991,12 +1375,13 @@ void ApplePS2ElanTrackpad::setDevicePowerState( UInt32 whatToDo )
             //
             
             setTouchPadEnable( false );
+            _registers.invalidate();    // lost while powered off
             break;
             
         case kPS2C_EnableDevice:
 		case 2:  //Slice :)
 			
-			IOSleep(1000);
+			// (the controller holds off this call until the device answers)
             
             //setTapEnable( _touchPadModeByte );
             
@@ -1006,7 +1391,7 @@ void ApplePS2ElanTrackpad::setDevicePowerState( UInt32 whatToDo )
             // mouse IRQ line.
             //
             
-            setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
+            _device->updateCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
             
 			//DEBUG_LOG(" ABMod Waking up Touchpad setting setTapEnable to %d\n",_touchPadModeByte);
             
@@ -1056,7 +1441,7 @@ void ApplePS2ElanTrackpad::stop( IOService * provider )
     // Disable the mouse clock and the mouse IRQ line.
     //
     
-    setCommandByte( kCB_DisableMouseClock, kCB_EnableMouseIRQ );
+    _device->updateCommandByte( kCB_DisableMouseClock, kCB_EnableMouseIRQ );
     
     //
     // Uninstall the interrupt handler.
@@ -1072,6 +1457,12 @@ void ApplePS2ElanTrackpad::stop( IOService * provider )
     if ( _powerControlHandlerInstalled ) _device->uninstallPowerControlAction();
     _powerControlHandlerInstalled = false;
     
+    //
+    // Release the frame ring, our user clients being gone by now.
+    //
+    
+    _frames.free();
+    
 	super::stop(provider);
 }
 
@@ -1096,6 +1487,18 @@ int ApplePS2ElanTrackpad::psmouse_sliced_command( PS2Request * request, int &j,
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2ElanTrackpad::psmouse_sliced_command( PS2CommandBatch * batch, UInt command )
+{
+    batch->reserve(9);
+    batch->addMouseCommand(kDP_SetMouseScaling1To1);
+    for (int i = 6; i >= 0; i -= 2) {
+        batch->addMouseCommand(kDP_SetMouseResolution);
+        batch->addMouseCommand((command >> i) & 3);
+    }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 int ApplePS2ElanTrackpad::send_cmd( IOService * provider, UInt8 c, UInt8 *param, bool s )
 {
     if (s)
@@ -1168,121 +1571,86 @@ int ApplePS2ElanTrackpad::elantech_ps2_command(IOService * provider, UInt8 *para
 
 int ApplePS2ElanTrackpad::elantech_write_reg( IOService * provider, UInt8 reg, UInt8 val )
 {
+    PS2CommandBatch batch;
+
+    _device = (ApplePS2MouseDevice *) provider;
+    batch.init(_device);
+    if (elantech_write_reg(&batch, reg, val))
+        return -1;
+
+    if (!batch.commit()) {
+        _registers.invalidate();
+        return -1;
+    }
+	return 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+int ApplePS2ElanTrackpad::elantech_write_reg( PS2CommandBatch * batch, UInt8 reg, UInt8 val )
+{
+    //
+    // Queues the write of one register, unless it is known to hold the value
+    // already.  The caller commits the batch, and must invalidate _registers
+    // should the commit fail.
+    //
+
 	if (reg < 0x07 || reg > 0x26)
 		return -1;
     
 	if (reg > 0x11 && reg < 0x20)
 		return -1;
-    
-    _device = (ApplePS2MouseDevice *) provider;
-    
-    PS2Request * request = _device->allocateRequest();
-    
-    if ( !request ) return -1;
+
+    if (_registers.matches(reg, val))
+        return 0;
+
     DEBUG_LOG("elantech_write_reg: reg = 0x%02x, val = 0x%02x", reg, val);
     
-    int j = 0;
 	switch (etd->hw_version) {
         case 1:
-            psmouse_sliced_command(request, j, ETP_REGISTER_WRITE); j++;
-            psmouse_sliced_command(request, j, reg); j++;
-            psmouse_sliced_command(request, j, val); j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = kDP_SetMouseScaling1To1;
-            j++;
-            request->commandsCount = j;
-            _device->submitRequestAndBlock(request);
-            
+            psmouse_sliced_command(batch, ETP_REGISTER_WRITE);
+            psmouse_sliced_command(batch, reg);
+            psmouse_sliced_command(batch, val);
+            batch->addMouseCommand(kDP_SetMouseScaling1To1);
             break;
             
         case 2:
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = ETP_PS2_CUSTOM_COMMAND;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = ETP_REGISTER_WRITE;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = ETP_PS2_CUSTOM_COMMAND;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = reg;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = ETP_PS2_CUSTOM_COMMAND;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = val;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = kDP_SetMouseScaling1To1;
-            j++;
-            request->commandsCount = j;
-            _device->submitRequestAndBlock(request);
-            
+            batch->reserve(7);
+            batch->addMouseCommand(ETP_PS2_CUSTOM_COMMAND);
+            batch->addMouseCommand(ETP_REGISTER_WRITE);
+            batch->addMouseCommand(ETP_PS2_CUSTOM_COMMAND);
+            batch->addMouseCommand(reg);
+            batch->addMouseCommand(ETP_PS2_CUSTOM_COMMAND);
+            batch->addMouseCommand(val);
+            batch->addMouseCommand(kDP_SetMouseScaling1To1);
             break;
             
         case 3:
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = ETP_PS2_CUSTOM_COMMAND;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = ETP_REGISTER_READWRITE;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = ETP_PS2_CUSTOM_COMMAND;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = reg;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = ETP_PS2_CUSTOM_COMMAND;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = val;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = kDP_SetMouseScaling1To1;
-            j++;
-            request->commandsCount = j;
-            _device->submitRequestAndBlock(request);
-            
+            batch->reserve(7);
+            batch->addMouseCommand(ETP_PS2_CUSTOM_COMMAND);
+            batch->addMouseCommand(ETP_REGISTER_READWRITE);
+            batch->addMouseCommand(ETP_PS2_CUSTOM_COMMAND);
+            batch->addMouseCommand(reg);
+            batch->addMouseCommand(ETP_PS2_CUSTOM_COMMAND);
+            batch->addMouseCommand(val);
+            batch->addMouseCommand(kDP_SetMouseScaling1To1);
             break;
             
         case 4:
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = ETP_PS2_CUSTOM_COMMAND;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = ETP_REGISTER_READWRITE;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = ETP_PS2_CUSTOM_COMMAND;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = reg;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = ETP_PS2_CUSTOM_COMMAND;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = ETP_REGISTER_READWRITE;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = ETP_PS2_CUSTOM_COMMAND;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = val;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = kDP_SetMouseScaling1To1;
-            j++;
-            request->commandsCount = j;
-            _device->submitRequestAndBlock(request);
-            
+            batch->reserve(9);
+            batch->addMouseCommand(ETP_PS2_CUSTOM_COMMAND);
+            batch->addMouseCommand(ETP_REGISTER_READWRITE);
+            batch->addMouseCommand(ETP_PS2_CUSTOM_COMMAND);
+            batch->addMouseCommand(reg);
+            batch->addMouseCommand(ETP_PS2_CUSTOM_COMMAND);
+            batch->addMouseCommand(ETP_REGISTER_READWRITE);
+            batch->addMouseCommand(ETP_PS2_CUSTOM_COMMAND);
+            batch->addMouseCommand(val);
+            batch->addMouseCommand(kDP_SetMouseScaling1To1);
             break;
 	}
-    
+
+    _registers.store(reg, val);
 	return 0;
 }
 
@@ -1292,6 +1660,7 @@ int ApplePS2ElanTrackpad::elantech_write_reg( IOService * provider, UInt8 reg, U
 int ApplePS2ElanTrackpad::elantech_read_reg( IOService * provider, UInt8 reg, UInt8 *val )
 {
 	UInt8 param[3];
+    PS2CommandBatch batch;
     
 	if (reg < 0x07 || reg > 0x26)
 		return -1;
@@ -1300,71 +1669,36 @@ int ApplePS2ElanTrackpad::elantech_read_reg( IOService * provider, UInt8 reg, UI
 		return -1;
 
     _device = (ApplePS2MouseDevice *) provider;
-    
-    PS2Request * request = _device->allocateRequest();
-    
-    if ( !request ) return -1;
+    batch.init(_device);
     DEBUG_LOG("elantech_read_reg: reg = 0x%02x", reg);
     
-    int j = 0;
 	switch (etd->hw_version) {
         case 1:
-            psmouse_sliced_command(request, j, ETP_REGISTER_READ); j++;
-            psmouse_sliced_command(request, j, reg); j++;
-
+            psmouse_sliced_command(&batch, ETP_REGISTER_READ);
+            psmouse_sliced_command(&batch, reg);
             break;
             
         case 2:
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = ETP_PS2_CUSTOM_COMMAND;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = ETP_REGISTER_READ;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = ETP_PS2_CUSTOM_COMMAND;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = reg;
-            j++;
-
+            batch.addMouseCommand(ETP_PS2_CUSTOM_COMMAND);
+            batch.addMouseCommand(ETP_REGISTER_READ);
+            batch.addMouseCommand(ETP_PS2_CUSTOM_COMMAND);
+            batch.addMouseCommand(reg);
             break;
             
         case 3 ... 4:
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = ETP_PS2_CUSTOM_COMMAND;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = ETP_REGISTER_READWRITE;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = ETP_PS2_CUSTOM_COMMAND;
-            j++;
-            request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-            request->commands[j].inOrOut = reg;
-            j++;
-
+            batch.addMouseCommand(ETP_PS2_CUSTOM_COMMAND);
+            batch.addMouseCommand(ETP_REGISTER_READWRITE);
+            batch.addMouseCommand(ETP_PS2_CUSTOM_COMMAND);
+            batch.addMouseCommand(reg);
             break;
 	}
-    request->commands[j].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[j].inOrOut = kDP_GetMouseInformation;
-    j++;
-    request->commands[j].command = kPS2C_ReadDataPort;
-    request->commands[j].inOrOut = 0;
-    j++;
-    request->commands[j].command = kPS2C_ReadDataPort;
-    request->commands[j].inOrOut = 0;
-    j++;
-    request->commands[j].command = kPS2C_ReadDataPort;
-    request->commands[j].inOrOut = 0;
-    j++;
-    request->commandsCount = j;
-    _device->submitRequestAndBlock(request);
-    
-    param[0] = request->commands[j-3].inOrOut;
-    param[1] = request->commands[j-2].inOrOut;
-    param[2] = request->commands[j-1].inOrOut;
-    _device->freeRequest(request);
+    batch.reserve(4);
+    batch.addMouseCommand(kDP_GetMouseInformation);
+    batch.addCommand(kPS2C_ReadDataPort, 0);
+    batch.addCommand(kPS2C_ReadDataPort, 0);
+    batch.addCommand(kPS2C_ReadDataPort, 0);
+    if (!batch.commit(param))
+        return -1;
     
     if (etd->hw_version != 4)
 		*val = param[0];
@@ -24,6 +24,10 @@
 #define _APPLEPS2ELANTOUCHPAD_H
 
 #include "ApplePS2MouseDevice.h"
+#include "ApplePS2CommandBatch.h"
+#include "ApplePS2FrameRing.h"
+#include "ApplePS2PacketAssembler.h"
+#include "ApplePS2Trace.h"
 #include <IOKit/hidsystem/IOHIPointing.h>
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -147,27 +151,94 @@ struct elantech_data {
 	unsigned int y_max;
 	unsigned int width;
 	struct IOGPoint mt[ETP_MAX_FINGERS];
+	unsigned char mt_active;	/* v4: bit per finger down in mt[] */
 	unsigned char parity[256];
 	bool send_cmd;
 };
 // copy from elan linux driver, drivers/input/mouse/elantech.h -- end
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Packet framing by hardware version, from the constant bits the Linux
+// elantech_packet_check_* functions test: bit 3 of byte 0 for v1, and the
+// constant bits of bytes 0 and 3 for the later versions (for v3, those of a
+// head or a tail packet, as byte 0 tells).  Until setDevice() is called,
+// only command acks are kept out.  The v1 parity bits are checked once the
+// packet is complete.
+//
+
+struct ElanPacketValidator
+{
+    UInt32 hwVersion;
+    bool   reportsPressure;
+
+    void setDevice(const elantech_data * etd)
+    {
+        hwVersion       = etd->hw_version == 2 && !etd->paritycheck ? 0 : etd->hw_version;
+        reportsPressure = etd->reports_pressure;
+    }
+
+    bool isPacketStart(UInt8 byte) const
+    {
+        if (byte == kSC_Acknowledge)
+            return false;
+
+        switch (hwVersion) {
+            case 1:  return (byte & 0x08);
+            case 2:  return (byte & 0x0c) == (reportsPressure ? 0x04 : 0x0c) ||
+                            byte == 0x84;       /* debounce */
+            case 3:  return (byte & 0x04);      /* head 0x04, tail 0x0c */
+            case 4:  return (byte & 0x0c) == 0x04;
+        }
+        return true;
+    }
+
+    bool isPacketByte(const UInt8 * packet, UInt32 index, UInt8 byte) const
+    {
+        if (index != 3)
+            return true;
+
+        switch (hwVersion) {
+            case 2:
+                if (reportsPressure || packet[0] == 0x84)
+                    return (byte & 0x0f) == 0x02;
+                if ((packet[0] & 0xc0) == 0x80)
+                    return (byte & 0x0e) == 0x08;
+                return (byte & 0x3e) == 0x38;
+            case 3:
+                if ((packet[0] & 0x0c) == 0x04)
+                    return (byte & 0xcf) == 0x02;
+                return (byte & 0xce) == 0x0c;
+            case 4:
+                return (byte & 0x1f) >= 0x10 && (byte & 0x1f) <= 0x12;
+        }
+        return true;
+    }
+};
+
 class ApplePS2ElanTrackpad : public IOHIPointing 
 {
     OSDeclareDefaultStructors( ApplePS2ElanTrackpad );
 
 private:
+    typedef void (ApplePS2ElanTrackpad::*PacketHandler)(UInt8* packet);
+    static const PacketHandler packetHandlers[];
+
     ApplePS2MouseDevice * _device;
+    PS2TraceBuffer *      _trace;
     UInt32                _interruptHandlerInstalled:1;
     UInt32                _powerControlHandlerInstalled:1;
-    UInt8                 _packetBuffer[6];
-    UInt32                _packetByteCount;
+    PS2PacketAssembler<6, ElanPacketValidator> _packets;
+    PS2RegisterCache<8>   _registers;         // values written to the pad
+    PS2FrameChannel       _frames;
+    UInt32                _frameButtons;      // last reported in frame mode
     IOFixed               _resolution;
     elantech_data         e_data;
     elantech_data         *etd;
     UInt8                 pktsize;
     IOGBounds             bounds;
     unsigned int          last_fingers;
+    int                   last_id;
+    PacketHandler         _processPacket;
     bool                  tapToClick;
     bool                  tapInRange[ETP_MAX_FINGERS];
     AbsoluteTime          now;
@@ -182,7 +253,6 @@ protected:
     virtual void   free();
     virtual void   interruptOccurred( UInt8 data );
     virtual void   setDevicePowerState(UInt32 whatToDo);
-    virtual void   setCommandByte( UInt8 setBits, UInt8 clearBits );
     virtual void   setTouchPadEnable( bool enable );
 
 private:
@@ -192,8 +262,10 @@ private:
     int send_cmd( IOService * provider, UInt8 c, UInt8 *param, bool s );
     //int elantech_ps2_command(IOService * provider, UInt8 *param, UInt command);
     int elantech_write_reg( IOService * provider, UInt8 reg, UInt8 val );
+    int elantech_write_reg( PS2CommandBatch * batch, UInt8 reg, UInt8 val );
     int elantech_read_reg( IOService * provider, UInt8 reg, UInt8 *val );
     int psmouse_sliced_command( PS2Request * request, int &j, UInt command );
+    void psmouse_sliced_command( PS2CommandBatch * batch, UInt command );
     int elantech_set_absolute_mode( IOService * provider );
     int elantech_set_range(IOService * provider,
                            unsigned int *x_min, unsigned int *y_min,
@@ -203,8 +275,17 @@ private:
     int elantech_get_resolution_v4(IOService * provider,
                                    unsigned int *x_res,
                                    unsigned int *y_res);
-    void elantech_packet_dump( UInt8 data );
+    void elantech_process_packet_v1(UInt8* packet);
+    void elantech_process_packet_v2(UInt8* packet);
+    void elantech_process_packet_v3(UInt8* packet);
+    void elantech_process_packet_v4(UInt8* packet);
+    void elantech_report_pointer(unsigned int fingers, int x, int y, UInt32 buttons);
+    void elantech_report_frame(unsigned int fingers, const IOGPoint *point,
+                               unsigned int active, UInt32 buttons);
+    void elantech_report_absolute_v1(UInt8* packet);
+    void elantech_report_absolute_v2(UInt8* packet);
     void elantech_report_absolute_v3(UInt8* packet, UInt32 packetSize, int packet_type);
+    void elantech_report_absolute_v4(UInt8* packet, int packet_type);
     
 public:
     virtual bool init( OSDictionary * properties );
@@ -214,6 +295,8 @@ public:
     virtual void stop( IOService * provider );
     virtual UInt32 deviceType();
     virtual UInt32 interfaceID();
+
+    virtual PS2FrameChannel * getFrameChannel();
 };
 
 #endif /* _APPLEPS2ELANTOUCHPAD_H */
@@ -60,6 +60,7 @@ bool ApplePS2Keyboard::init(OSDictionary * properties)
   _ledState                  = 0;
 
   for (int index = 0; index < KBV_NUNITS; index++)  _keyBitVector[index] = 0;
+  bzero(_keyMap, sizeof(_keyMap));
 
   return true;
 }
@@ -120,6 +121,7 @@ bool ApplePS2Keyboard::start(IOService * provider)
 
   _device = (ApplePS2KeyboardDevice *)provider;
   _device->retain();
+  _trace  = _device->getTraceBuffer();
 
 
   if (kOSBooleanTrue == getProperty("Make capslock into control")) {
@@ -132,6 +134,7 @@ bool ApplePS2Keyboard::start(IOService * provider)
   } else {
     macintoshMode = false;
   }
+  buildKeyMap();
 	logScan = false;
   //
   // Reset and enable the keyboard.
@@ -180,7 +183,7 @@ void ApplePS2Keyboard::stop(IOService * provider)
   // Disable the keyboard clock and the keyboard IRQ line.
   //
 
-  setCommandByte(kCB_DisableKeyboardClock, kCB_EnableKeyboardIRQ);
+  _device->updateCommandByte(kCB_DisableKeyboardClock, kCB_EnableKeyboardIRQ);
 
   //
   // Uninstall the interrupt handler.
@@ -269,7 +272,6 @@ bool ApplePS2Keyboard::dispatchKeyboardEventWithScancode(UInt8 scanCode)
   // Returns true if a key event was indeed dispatched.
   //
 
-  unsigned int keyCode;
   bool         goingDown;
   //uint64_t now;
   AbsoluteTime now;
@@ -278,10 +280,6 @@ bool ApplePS2Keyboard::dispatchKeyboardEventWithScancode(UInt8 scanCode)
   // See if this scan code introduces an extended key sequence.  If so, note
   // it and then return.  Next time we get a key we'll finish the sequence.
   //
-	if (logScan) {
-		IOLog("_%02x", scanCode);
-	}
-	
   if (scanCode == kSC_Extend)
   {
     _extendCount = 1;
@@ -316,12 +314,131 @@ bool ApplePS2Keyboard::dispatchKeyboardEventWithScancode(UInt8 scanCode)
   }
 
   //
-  // Convert the scan code into a key code.
+  // Convert the scan code into a key code, and the key code into an ADB key
+  // code, with one lookup in the map buildKeyMap made for the current modes.
+  // Scancodes without a key code are left to dispatchSpecialScancode.
   //
 
-  if (_extendCount == 0)
+  bool extended = false;
+
+  if (_extendCount)
+  {
+    _extendCount--;
+    if (_extendCount)  return false;
+    extended = true;
+  }
+
+  const PS2KeyMapEntry * entry = &_keyMap[extended][scanCode & ~kSC_UpBit];
+
+  if (entry->keyCode == 0)
+  {
+    dispatchSpecialScancode(scanCode, extended);
+    return false;
+  }
+
+  //
+  // Update our key bit vector, which maintains the up/down status of all keys.
+  //
+
+  goingDown = !(scanCode & kSC_UpBit);
+
+  if (goingDown)
+  {
+    //
+    // Verify that this is not an autorepeated key -- discard it if it is.
+    //
+
+    if (KBV_IS_KEYDOWN(entry->keyCode, _keyBitVector))  return false;
+
+    KBV_KEYDOWN(entry->keyCode, _keyBitVector);
+  }
+  else
+  {
+    KBV_KEYUP(entry->keyCode, _keyBitVector);
+  }
+
+  //
+  // We have a valid key event -- dispatch it to our superclass.
+  //
+#if APPLESDK
+	clock_get_uptime(&now);
+#else 
+  clock_get_uptime((uint64_t*)&now);
+#endif
+
+  if (entry->adbCode == DEADKEY)
+  {
+	IOLog("%s: Unknown ADB key for PS2 key: 0x%x\n", getName(), entry->keyCode);
+  }
+
+  dispatchKeyboardEvent( entry->adbCode,
+           /*direction*/ goingDown,
+           /*timeStamp*/ *((AbsoluteTime*)&now) );
+
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Keyboard::dispatchSpecialScancode(UInt8 scanCode, bool extended)
+{
+  //
+  // Handles the scancodes which have no key code in the key map: the ones
+  // acted on right here, and unknown ones.
+  //
+
+  if (!extended)
+  {
+	IOLog("%s: Unknown scan code: 0x%x\n", getName(), scanCode);
+	return;
+  }
+
+	 if (scanCode == 0xAA) {
+		 // The controller records the scan codes in its trace buffer,
+		 // rather than us logging each one.
+		 logScan = !logScan;
+		 if (logScan)
+			 _trace->setMask(_trace->mask() | (1 << kPS2TraceKeyboardByte));
+		 else
+			 _trace->setMask(_trace->mask() & ~(1 << kPS2TraceKeyboardByte));
+	 } 
+
+	  switch (scanCode & ~kSC_UpBit)
+	  {
+		  case 0x5f:                                   // E05F = sleep
+			  if (!(scanCode & kSC_UpBit))
+			  {
+				  IOPMrootDomain * rootDomain = getPMRootDomain();
+				  if (rootDomain)
+					  rootDomain->receivePowerNotification( kIOPMSleepNow );
+			  }
+			  IOLog("%s: Unknown scan code: 0x%x\n", getName(), scanCode);
+			  break;
+		  case 0x12:  //Slice - it is nightmare! Do not use!!! It is hard reset.
+			  cold_reboot();
+			  break;
+		  case 0x2A:             // header or trailer for PrintScreen
+		  default:
+			  IOLog("%s: Unknown extended scan code: 0x%x\n", getName(), scanCode);
+			  break;
+	  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+UInt8 ApplePS2Keyboard::keyCodeOfScancode(UInt8 scanCode, bool extended)
+{
+  //
+  // Key code of a scancode (up bit clear) under the current modes, or 0 for
+  // one which dispatchSpecialScancode has to deal with.  Only used to build
+  // the key map.
+  //
+
+  unsigned int keyCode = 0;
+
+  if (!extended)
   {
-    keyCode = scanCode & ~kSC_UpBit;
+    keyCode = scanCode;
 
     // from "The Undocumented PC" chapter 8, The Keyboard System some
     // keyboard scan codes are single byte, some are multi-byte
@@ -345,22 +462,15 @@ bool ApplePS2Keyboard::dispatchKeyboardEventWithScancode(UInt8 scanCode)
 	}
 	break;		// left alt becomes left windows
     }
+    return keyCode;
   }
-  else
-  {
-    _extendCount--;
-    if (_extendCount)  return false;
 
     //
     // Convert certain extended codes on the PC keyboard into single scancodes.
     // Refer to the conversion table in defaultKeymapOfLength.
     //
-	 if (scanCode == 0xAA) {
-		 logScan = !logScan;
-		 IOLog("\n");
-	 } 
 
-	  switch (scanCode & ~kSC_UpBit)
+	  switch (scanCode)
 	  {
 			  // scancodes from running showkey -s (under Linux) for extra keys on keyboard
 		  case 0x30: keyCode = 0x7d; break;		   // E030 = volume up
@@ -380,18 +490,6 @@ bool ApplePS2Keyboard::dispatchKeyboardEventWithScancode(UInt8 scanCode)
 			  //	  case 0x32: keyCode = 0x5B; break;		//E032 = WWW
 			  
 		  case 0x5e: keyCode = 0x7c; break;            // E05E = power
-		  case 0x5f:                                   // E05F = sleep
-			  keyCode = 0;
-			  if (!(scanCode & kSC_UpBit))
-			  {
-				  IOPMrootDomain * rootDomain = getPMRootDomain();
-				  if (rootDomain)
-					  rootDomain->receivePowerNotification( kIOPMSleepNow );
-			  }
-			  break;
-		  case 0x12:  //Slice - it is nightmare! Do not use!!! It is hard reset.
-			  cold_reboot();
-			  break;
 			  
 		  case 0x1D: keyCode = 0x60; break;            // ctrl
 		  case 0x38:             			   // right alt may become right command
@@ -430,61 +528,29 @@ bool ApplePS2Keyboard::dispatchKeyboardEventWithScancode(UInt8 scanCode)
 			  }
 			  break;
 		  case 0x5D: keyCode = 0x72; break;            // Application
-		  case 0x2A:             // header or trailer for PrintScreen
-		  default:
-			  IOLog("%s: Unknown extended scan code: 0x%x\n", getName(), scanCode);
-			  return false;
 	  }
-  }
-	
-  if (keyCode == 0)
-  {
-	IOLog("%s: Unknown scan code: 0x%x\n", getName(), scanCode);
-	return false;
-  }
-
-  //
-  // Update our key bit vector, which maintains the up/down status of all keys.
-  //
-
-  goingDown = !(scanCode & kSC_UpBit);
-
-  if (goingDown)
-  {
-    //
-    // Verify that this is not an autorepeated key -- discard it if it is.
-    //
-
-    if (KBV_IS_KEYDOWN(keyCode, _keyBitVector))  return false;
+  return keyCode;
+}
 
-    KBV_KEYDOWN(keyCode, _keyBitVector);
-  }
-  else
-  {
-    KBV_KEYUP(keyCode, _keyBitVector);
-  }
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2Keyboard::buildKeyMap()
+{
   //
-  // We have a valid key event -- dispatch it to our superclass.
+  // Fill in the key map for the current emacsMode and macintoshMode, so the
+  // per-key path is a single lookup.  Call whenever either mode changes.
   //
-#if APPLESDK
-	clock_get_uptime(&now);
-#else 
-  clock_get_uptime((uint64_t*)&now);
-#endif
 
-  UInt8 adbKeyCode = PS2ToADBMap[keyCode];
-  
-  if (adbKeyCode == DEADKEY)
+  for (int extended = 0; extended < 2; extended++)
   {
-	IOLog("%s: Unknown ADB key for PS2 key: 0x%x\n", getName(), keyCode);
-  }
-
-  dispatchKeyboardEvent( adbKeyCode,
-           /*direction*/ goingDown,
-           /*timeStamp*/ *((AbsoluteTime*)&now) );
+    for (int scanCode = 0; scanCode < kKeyMapScancodes; scanCode++)
+    {
+      UInt8 keyCode = keyCodeOfScancode(scanCode, extended);
 
-  return true;
+      _keyMap[extended][scanCode].keyCode = keyCode;
+      _keyMap[extended][scanCode].adbCode = PS2ToADBMap[keyCode];
+    }
+  }
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -521,6 +587,8 @@ void ApplePS2Keyboard::setLEDs(UInt8 ledState)
 {
   //
   // Asynchronously instructs the controller to set the keyboard LED state.
+  // The request goes in the interactive class, ahead of any configuration
+  // traffic, and replaces a queued LED update it supersedes.
   //
   // It is safe to issue this request from the interrupt/completion context.
   //
@@ -537,8 +605,9 @@ void ApplePS2Keyboard::setLEDs(UInt8 ledState)
   request->commands[3].command = kPS2C_ReadDataPortAndCompare;
   request->commands[3].inOrOut = kSC_Acknowledge;
   request->commandsCount = 4;
-  _device->submitRequestAndBlock(request);
-  _device->freeRequest(request);
+  request->priority      = kPS2RequestInteractive;
+  request->coalesceKey   = kPS2CoalesceLEDs;
+  _device->submitRequest(request); // asynchronous, auto-free'd
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -568,61 +637,6 @@ void ApplePS2Keyboard::setKeyboardEnable(bool enable)
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2Keyboard::setCommandByte(UInt8 setBits, UInt8 clearBits)
-{
-  //
-  // Sets the bits setBits and clears the bits clearBits "atomically" in the
-  // controller's Command Byte.   Since the controller does not provide such
-  // a read-modify-write primitive, we resort to a test-and-set try loop.
-  //
-  // Do NOT issue this request from the interrupt/completion context.
-  //
-
-  UInt8        commandByte;
-  UInt8        commandByteNew;
-  PS2Request * request = _device->allocateRequest();
-
-  do
-  {
-    // (read command byte)
-    request->commands[0].command = kPS2C_WriteCommandPort;
-    request->commands[0].inOrOut = kCP_GetCommandByte;
-    request->commands[1].command = kPS2C_ReadDataPort;
-    request->commands[1].inOrOut = 0;
-    request->commandsCount = 2;
-    _device->submitRequestAndBlock(request);
-
-    //
-    // Modify the command byte as requested by caller.
-    //
-
-    commandByte    = request->commands[1].inOrOut;
-    commandByteNew = (commandByte | setBits) & (~clearBits);
-
-    // ("test-and-set" command byte)
-    request->commands[0].command = kPS2C_WriteCommandPort;
-    request->commands[0].inOrOut = kCP_GetCommandByte;
-    request->commands[1].command = kPS2C_ReadDataPortAndCompare;
-    request->commands[1].inOrOut = commandByte;
-    request->commands[2].command = kPS2C_WriteCommandPort;
-    request->commands[2].inOrOut = kCP_SetCommandByte;
-    request->commands[3].command = kPS2C_WriteDataPort;
-    request->commands[3].inOrOut = commandByteNew;
-    request->commandsCount = 4;
-    _device->submitRequestAndBlock(request);
-
-    //
-    // Repeat this loop if last command failed, that is, if the old command byte
-    // was modified since we first read it.
-    //
-
-  } while (request->commandsCount != 4);  
-
-  _device->freeRequest(request);
-}
-
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-
 const unsigned char * ApplePS2Keyboard::defaultKeymapOfLength(UInt32 * length)
 {
 	//
@@ -756,7 +770,7 @@ void ApplePS2Keyboard::setDevicePowerState( UInt32 whatToDo )
 
       setKeyboardEnable( false );
 
-	  setCommandByte(kCB_DisableKeyboardClock, kCB_EnableKeyboardIRQ);
+	  _device->updateCommandByte(kCB_DisableKeyboardClock, kCB_EnableKeyboardIRQ);
 
       if ( _interruptHandlerInstalled )
 		  _device->uninstallInterruptAction();
@@ -813,8 +827,8 @@ void ApplePS2Keyboard::initKeyboard()
   // and the keyboard Kscan -> scan code translation mode.
   //
 
-  setCommandByte(kCB_EnableKeyboardIRQ | kCB_TranslateMode,
-                 kCB_DisableKeyboardClock);
+  _device->updateCommandByte(kCB_EnableKeyboardIRQ | kCB_TranslateMode,
+                             kCB_DisableKeyboardClock);
 
   //
   // Finally, we enable the keyboard itself, so that it may start reporting
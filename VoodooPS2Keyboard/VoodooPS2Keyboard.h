@@ -26,6 +26,7 @@
 #include <libkern/c++/OSBoolean.h>
 #include <libkern/OSBase.h>
 #include "ApplePS2KeyboardDevice.h"
+#include "ApplePS2Trace.h"
 #include <IOKit/hidsystem/IOHIKeyboard.h>
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -50,6 +51,19 @@
 #define KBV_IS_KEYDOWN(n, bits) \
       (((bits)[((n)>>KBV_BITS_SHIFT)] & (1 << ((n) & KBV_BITS_MASK))) != 0)
 
+// Scancode translation for the current modes, filled in by buildKeyMap and
+// indexed by [extended][scancode without the up bit].  A key code of 0 marks
+// a scancode that is handled by dispatchSpecialScancode.
+
+#define kKeyMapScancodes        128
+
+typedef struct PS2KeyMapEntry PS2KeyMapEntry;
+struct PS2KeyMapEntry
+{
+  UInt8 keyCode;                        // bit in _keyBitVector
+  UInt8 adbCode;                        // PS2ToADBMap[keyCode]
+};
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 // ApplePS2Keyboard Class Declaration
 //
@@ -60,7 +74,9 @@ class ApplePS2Keyboard : public IOHIKeyboard
 
 private:
   ApplePS2KeyboardDevice * _device;
+  PS2TraceBuffer *         _trace;
   UInt32                   _keyBitVector[KBV_NUNITS];
+  PS2KeyMapEntry           _keyMap[2][kKeyMapScancodes];
   UInt8                    _extendCount;
   UInt8                    _interruptHandlerInstalled:1;
   UInt8                    _powerControlHandlerInstalled:1;
@@ -68,10 +84,12 @@ private:
 
   bool			    emacsMode;		// make caps lock into a control key
   bool			    macintoshMode;	// swap alt and windows key meaning
-	bool logScan; //enable/disable log scan codes
+	bool logScan; //enable/disable trace of scan codes
 
   virtual bool dispatchKeyboardEventWithScancode(UInt8 scanCode);
-  virtual void setCommandByte(UInt8 setBits, UInt8 clearBits);
+  virtual void dispatchSpecialScancode(UInt8 scanCode, bool extended);
+  virtual UInt8 keyCodeOfScancode(UInt8 scanCode, bool extended);
+  virtual void buildKeyMap();
   virtual void setLEDs(UInt8 ledState);
   virtual void setKeyboardEnable(bool enable);
   virtual void initKeyboard();
@@ -53,8 +53,12 @@ bool ApplePS2Mouse::init(OSDictionary * properties)
 
   _device                    = 0;
   _interruptHandlerInstalled = false;
-  _packetByteCount           = 0;
-  _packetLength              = kPacketLengthStandard;
+  _typeNegotiated            = false;
+  _mouseResetCount           = 0;
+  _resyncBytes               = 0;
+  _streamRestartCount        = 0;
+  _cleanPackets              = 0;
+  _packets.init(kPacketLengthStandard);
   defres					 = (150) << 16; // (default is 150 dpi; 6 counts/mm)
   forceres					 = false;
   inverty					 = false;
@@ -143,7 +147,7 @@ bool ApplePS2Mouse::start(IOService * provider)
   // Reset and enable the mouse.
   //
 
-  resetMouse();
+  resetMouse(true);
 
   //
   // Install our driver's interrupt handler, for asynchronous data delivery.
@@ -186,7 +190,7 @@ void ApplePS2Mouse::stop(IOService * provider)
   // Disable the mouse clock and the mouse IRQ line.
   //
 
-  setCommandByte(kCB_DisableMouseClock, kCB_EnableMouseIRQ);
+  _device->updateCommandByte(kCB_DisableMouseClock, kCB_EnableMouseIRQ);
 
   //
   // Uninstall the interrupt handler.
@@ -214,12 +218,14 @@ void ApplePS2Mouse::stop(IOService * provider)
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2Mouse::resetMouse()
+void ApplePS2Mouse::resetMouse(bool renegotiate)
 {
   PS2MouseId type;
 
   //
-  // Reset the mouse to its default state.
+  // Reset the mouse to its default state.  Unless asked to renegotiate, a
+  // mouse whose type was found before is put back in that mode directly,
+  // without the ID queries and the pauses they need.
   //
 
   PS2Request * request = _device->allocateRequest();
@@ -260,9 +266,20 @@ void ApplePS2Mouse::resetMouse()
   // Enable the Intellimouse mode, should this be an Intellimouse.
   //
 
-  if ( (type = setIntellimouseMode()) != kMouseTypeStandard )
+  if (renegotiate || !_typeNegotiated)
+  {
+    type            = setIntellimouseMode();
+    _typeNegotiated = true;
+  }
+  else
+  {
+    type = _type;
+    restoreIntellimouseMode(type);
+  }
+
+  if ( type != kMouseTypeStandard )
   {
-    _packetLength = kPacketLengthIntellimouse;
+    _packets.setLength(kPacketLengthIntellimouse);
     _type         = type;
 
     if (_type == kMouseTypeIntellimouseExplorer)
@@ -278,20 +295,20 @@ void ApplePS2Mouse::resetMouse()
   }
   else
   {
-    _packetLength = kPacketLengthStandard;
+    _packets.setLength(kPacketLengthStandard);
     _type         = kMouseTypeStandard;
     _buttonCount  = 3;
 
     removeProperty(kIOHIDScrollResolutionKey);
   }
 
-  _packetByteCount = 0;
+  _packets.reset();
 
   //
   // Enable the mouse clock (should already be so) and the mouse IRQ line.
   //
 
-  setCommandByte(kCB_EnableMouseIRQ, kCB_DisableMouseClock);
+  _device->updateCommandByte(kCB_EnableMouseIRQ, kCB_DisableMouseClock);
 
   //
   // Finally, we enable the mouse itself, so that it may start reporting
@@ -320,6 +337,95 @@ void ApplePS2Mouse::scheduleMouseReset()
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2Mouse::recoverStream()
+{
+  //
+  // A byte was thrown away by the packet assembler.  Escalate through the
+  // recovery tiers (see kResyncBytesMax): let the assembler resync on bit 3
+  // of the first byte by itself, then restart the stream, and only as the
+  // last resort reset the mouse.
+  //
+
+  _cleanPackets = 0;
+
+  if (++_resyncBytes <= kResyncBytesMax)
+    return;
+  _resyncBytes = 0;
+
+  if (_streamRestartCount < kStreamRestartMax)
+  {
+    _streamRestartCount++;
+    IOLog("%s: Unexpected data from PS/2 controller, restarting stream.\n",
+          getName());
+    restartStream();
+    return;
+  }
+  _streamRestartCount = 0;
+
+  //
+  // Limit the number of consecutive resets to guard against flaky hardware.
+  //
+
+  if (_mouseResetCount < kMouseResetMax)
+  {
+    _mouseResetCount++;
+    IOLog("%s: Unexpected data from PS/2 controller, resetting mouse.\n",
+          getName());
+    scheduleMouseReset();
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Mouse::restartStream()
+{
+  //
+  // Stop and restart the reporting of mouse events, which makes the mouse
+  // drop whatever packet it was in the middle of.  The packet assembler is
+  // reset once the mouse acknowledged both, so that the next byte starts a
+  // packet; if it did not, the mouse is reset.  Mode, rate and resolution
+  // are left alone.
+  //
+  // It is safe to issue this request from the interrupt/completion context.
+  //
+
+  PS2Request * request = _device->allocateRequest();
+
+  request->commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
+  request->commands[0].inOrOut = kDP_SetDefaultsAndDisable;
+  request->commands[1].command = kPS2C_SendMouseCommandAndCompareAck;
+  request->commands[1].inOrOut = kDP_Enable;
+  request->commandsCount = 2;
+  request->priority      = kPS2RequestBackground;
+  _device->submitRequest(request, this, restartStreamCompletion, request);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Mouse::restartStreamCompletion(void * target, void * param)
+{                                                      // PS2CompletionAction
+  ApplePS2Mouse * me      = (ApplePS2Mouse *) target;
+  PS2Request *    request = (PS2Request *) param;
+  bool            success = (request->commandsCount == 2);
+
+  me->_packets.reset();
+  me->_device->freeRequest(request);
+
+  //
+  // Should the mouse not have taken the enable, it stays disabled and no
+  // byte ever comes to escalate on, so go on to the next tier right away.
+  //
+
+  if (!success && me->_mouseResetCount < kMouseResetMax)
+  {
+    me->_mouseResetCount++;
+    IOLog("%s: Stream restart failed, resetting mouse.\n", me->getName());
+    me->scheduleMouseReset();
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 void ApplePS2Mouse::interruptOccurred(UInt8 data)      // PS2InterruptAction
 {
   //
@@ -329,45 +435,41 @@ void ApplePS2Mouse::interruptOccurred(UInt8 data)      // PS2InterruptAction
   // We ignore all bytes until we see the start of a packet, otherwise the mouse
   // packets may get out of sequence and things will get very confusing.
   //
-  if (_packetByteCount == 0 && ((data == kSC_Acknowledge) || !(data & 0x08)))
-  {
-    IOLog("%s: Unexpected data from PS/2 controller.\n", getName());
+  PS2PacketStatus status = _packets.add(data);
 
-    //
-    // Reset the mouse when packet synchronization is lost. Limit the number
-    // of consecutive resets to guard against flaky hardware.
-    //
-
-    if (_mouseResetCount < 5)
-    {
-        _mouseResetCount++;
-        scheduleMouseReset();
-    }
+  if (status == kPS2PacketDiscarded)
+  {
+    recoverStream();
     return;
   }
 
   //
-  // Add this byte to the packet buffer.  If the packet is complete, that is,
-  // we have the three (or four) bytes, dispatch this packet for processing.
+  // If the packet is complete, that is, we have the three (or four) bytes,
+  // dispatch this packet for processing.
   //
 
-  _packetBuffer[_packetByteCount++] = data;
-
-  if (_packetByteCount == _packetLength)
+  if (status == kPS2PacketComplete)
   {
-    dispatchRelativePointerEventWithPacket(_packetBuffer, _packetLength);
-    _packetByteCount = 0;
-    _mouseResetCount = 0;
+    dispatchRelativePointerEventWithPacket(_packets.packet(), _packets.length());
+    _resyncBytes = 0;
+    if (++_cleanPackets >= kRecoveredPackets)
+    {
+      _streamRestartCount = 0;
+      _mouseResetCount    = 0;
+    }
+    _packets.publishStatistics(this);
   }
-  else if (_packetByteCount == 2 && _packetBuffer[0] == 0xAA)
+  else if (_packets.count() == 2 && _packets.packet()[0] == 0xAA)
   {
     //
     // "0xAA 0x00" 2-byte packet is sent following a mouse hardware reset.
     // This can happen if the user removed and then inserted the same or a
     // different mouse to the mouse port. Reset the mouse and hope for the
     // best. KVM switches should not trigger this when switching stations.
+    // It may be a different mouse, so its type has to be found again.
     //
 
+    _typeNegotiated = false;
     scheduleMouseReset();
   }
 }
@@ -665,6 +767,41 @@ PS2MouseId ApplePS2Mouse::setIntellimouseMode()
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2Mouse::restoreIntellimouseMode(PS2MouseId type)
+{
+  //
+  // Put a mouse whose type setIntellimouseMode found before back into that
+  // mode after a reset: the same sample rate knocks, then the original rate,
+  // in one request.  The mouse ID is not queried again.
+  //
+  // Do NOT issue this request from the interrupt/completion context.
+  //
+
+  static const UInt8 knock[] = { 200, 100, 80, 200, 200, 80 };
+
+  unsigned rates = (type == kMouseTypeIntellimouseExplorer) ? 6 :
+                   (type == kMouseTypeIntellimouse)         ? 3 : 0;
+  unsigned index = 0;
+
+  if (rates == 0)  return;
+
+  PS2Request * request = _device->allocateRequest();
+
+  for (unsigned rate = 0; rate <= rates; rate++)
+  {
+    request->commands[index].command   = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[index++].inOrOut = kDP_SetMouseSampleRate;
+    request->commands[index].command   = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[index++].inOrOut = (rate < rates) ? knock[rate] :
+                                         (_mouseInfoBytes & 0x0000FF);
+  }
+  request->commandsCount = index;
+  _device->submitRequestAndBlock(request);
+  _device->freeRequest(request);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 UInt32 ApplePS2Mouse::getMouseInformation()
 {
   //
@@ -743,61 +880,6 @@ UInt8 ApplePS2Mouse::getMouseID()
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2Mouse::setCommandByte(UInt8 setBits, UInt8 clearBits)
-{
-  //
-  // Sets the bits setBits and clears the bits clearBits "atomically" in the
-  // controller's Command Byte.   Since the controller does not provide such
-  // a read-modify-write primitive, we resort to a test-and-set try loop.
-  //
-  // Do NOT issue this request from the interrupt/completion context.
-  //
-
-  UInt8        commandByte;
-  UInt8        commandByteNew;
-  PS2Request * request = _device->allocateRequest();
-
-  do
-  {
-    // (read command byte)
-    request->commands[0].command = kPS2C_WriteCommandPort;
-    request->commands[0].inOrOut = kCP_GetCommandByte;
-    request->commands[1].command = kPS2C_ReadDataPort;
-    request->commands[1].inOrOut = 0;
-    request->commandsCount = 2;
-    _device->submitRequestAndBlock(request);
-
-    //
-    // Modify the command byte as requested by caller.
-    //
-
-    commandByte    = request->commands[1].inOrOut;
-    commandByteNew = (commandByte | setBits) & (~clearBits);
-
-    // ("test-and-set" command byte)
-    request->commands[0].command = kPS2C_WriteCommandPort;
-    request->commands[0].inOrOut = kCP_GetCommandByte;
-    request->commands[1].command = kPS2C_ReadDataPortAndCompare;
-    request->commands[1].inOrOut = commandByte;
-    request->commands[2].command = kPS2C_WriteCommandPort;
-    request->commands[2].inOrOut = kCP_SetCommandByte;
-    request->commands[3].command = kPS2C_WriteDataPort;
-    request->commands[3].inOrOut = commandByteNew;
-    request->commandsCount = 4;
-    _device->submitRequestAndBlock(request);
-
-    //
-    // Repeat this loop if last command failed, that is, if the old command byte
-    // was modified since we first read it.
-    //
-
-  } while (request->commandsCount != 4);  
-
-  _device->freeRequest(request);
-}
-
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-
 void ApplePS2Mouse::setDevicePowerState( UInt32 whatToDo )
 {
     switch ( whatToDo )
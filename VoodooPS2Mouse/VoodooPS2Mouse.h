@@ -24,6 +24,7 @@
 #define _APPLEPS2MOUSE_H
 
 #include "ApplePS2MouseDevice.h"
+#include "ApplePS2PacketAssembler.h"
 #include <IOKit/hidsystem/IOHIPointing.h>
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -34,6 +35,17 @@
 #define kPacketLengthStandard     3
 #define kPacketLengthIntellimouse 4
 
+// Recovery from a garbled stream goes through three tiers: up to
+// kResyncBytesMax bytes are left to the packet assembler to resync on,
+// then the stream is disabled and re-enabled up to kStreamRestartMax times,
+// and only then is the mouse reset, up to kMouseResetMax times.  The tiers
+// start over once kRecoveredPackets packets in a row came through cleanly.
+
+#define kResyncBytesMax           (2 * kPacketLengthMax)
+#define kStreamRestartMax         2
+#define kMouseResetMax            5
+#define kRecoveredPackets         16
+
 typedef enum
 {
   kMouseTypeStandard             = 0x00,
@@ -53,14 +65,16 @@ private:
   ApplePS2MouseDevice * _device;
   unsigned              _interruptHandlerInstalled:1;
   unsigned              _powerControlHandlerInstalled:1;
-  UInt8                 _packetBuffer[kPacketLengthMax];
-  UInt32                _packetByteCount;
-  UInt32                _packetLength;
+  unsigned              _typeNegotiated:1;          // _type valid after reset
+  PS2PacketAssembler<kPacketLengthMax, PS2StandardPacketValidator> _packets;
   IOFixed               _resolution;                // (dots per inch)
   PS2MouseId            _type;
   IOItemCount           _buttonCount;
   UInt32                _mouseInfoBytes;
   UInt32                _mouseResetCount;
+  UInt32                _resyncBytes;               // discarded since recovery
+  UInt32                _streamRestartCount;
+  UInt32                _cleanPackets;              // in a row, since discard
   IOFixed				defres;
   bool					forceres;
   bool					inverty;
@@ -69,13 +83,16 @@ private:
                                                         UInt32  packetSize);
   virtual UInt8  getMouseID();
   virtual UInt32 getMouseInformation();
-  virtual void   setCommandByte(UInt8 setBits, UInt8 clearBits);
   virtual PS2MouseId setIntellimouseMode();
+  virtual void   restoreIntellimouseMode(PS2MouseId type);
   virtual void   setMouseEnable(bool enable);
   virtual void   setMouseSampleRate(UInt8 sampleRate);
   virtual void   setMouseResolution(UInt8 resolution);
   virtual void   scheduleMouseReset();
-  virtual void   resetMouse();
+  virtual void   resetMouse(bool renegotiate = false);
+  virtual void   recoverStream();
+  virtual void   restartStream();
+  static  void   restartStreamCompletion(void * target, void * param);
   virtual void   setDevicePowerState(UInt32 whatToDo);
 
 protected:
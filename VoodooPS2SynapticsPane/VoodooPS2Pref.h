@@ -34,6 +34,7 @@
 
 - (void) mainViewDidLoad;
 - (void) awakeFromNib;
+- (void) willSelect;
 - (void) didUnselect;
 - (IBAction) SlideSpeedAction: (id) sender;
 - (IBAction) TapAction: (id) sender;
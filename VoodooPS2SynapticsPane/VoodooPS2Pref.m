@@ -3,10 +3,44 @@
 #include <CoreFoundation/CoreFoundation.h>
 #include <IOKit/IOCFPlugIn.h>
 #include <IOKit/IOKitLib.h>
+#include "ApplePS2ParameterPage.h"
 
 static io_service_t io_service=0;
+static io_connect_t param_connect=0;
+static PS2ParameterPage * param_page=0;	// slider settings, see sendParameter
 static CFMutableDictionaryRef dict=0; 
+static CFMutableDictionaryRef pending=0;	// batch being built, see beginProperties
 
+// Between beginProperties and commitProperties the send* functions only
+// collect their settings, which then reach the driver in one setProperties
+// call, so that it is reconfigured once for all of them.
+
+void beginProperties (void)
+{
+	pending=CFDictionaryCreateMutable(NULL,0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+}
+
+IOReturn commitProperties (io_service_t service)
+{
+	IOReturn retvalue = kIOReturnError;
+	if (pending)
+	{
+		retvalue = IORegistryEntrySetCFProperties(service, pending);
+		CFRelease(pending);
+		pending=0;
+	}
+	return retvalue;
+}
+
+IOReturn sendProperty (io_service_t service, CFStringRef cf_key, CFTypeRef value)
+{
+	if (pending)
+	{
+		CFDictionarySetValue (pending, cf_key, value);
+		return kIOReturnSuccess;
+	}
+	return IORegistryEntrySetCFProperty(service, cf_key, value);
+}
 
 
 IOReturn sendNumber (const char * key, unsigned int number, io_service_t service)
@@ -16,7 +50,7 @@ IOReturn sendNumber (const char * key, unsigned int number, io_service_t service
 	CFNumberRef cf_number = CFNumberCreate(kCFAllocatorDefault, kCFNumberIntType, &number);
 	if (cf_number) 
 	{ 
-		retvalue = IORegistryEntrySetCFProperty(service, cf_key, cf_number); 
+		retvalue = sendProperty(service, cf_key, cf_number); 
 		CFDictionarySetValue (dict, cf_key, cf_number);
 //		CFRelease(cf_number); 
 	}
@@ -47,13 +81,75 @@ IOReturn sendLongNumber (const char * key, unsigned long long number, io_service
 	if (cf_number) 
 	{ 
 		CFDictionarySetValue (dict, cf_key, cf_number);
-		retvalue = IORegistryEntrySetCFProperty(service, cf_key, cf_number); 
+		retvalue = sendProperty(service, cf_key, cf_number); 
 //		CFRelease(cf_number); 
 	}
 //	if (cf_key) CFRelease(cf_key);
 	return retvalue;
 }
 
+// The Synaptics driver shares the slider settings through a parameter page,
+// which it checks once per packet.  Dragging a slider then only stores into
+// the page, where each step used to be a setProperties call.  Without a page
+// (the ALPS drivers, older drivers) this falls back to sendNumber.
+
+void openParameterPage (void)
+{
+	mach_vm_address_t address=0;
+	mach_vm_size_t size=0;
+
+	if (param_page || !IOObjectConformsTo(io_service, "ApplePS2SynapticsTouchPad"))
+		return;
+	if (IOServiceOpen(io_service, mach_task_self(), 0, &param_connect)!=KERN_SUCCESS)
+	{
+		param_connect=0;
+		return;
+	}
+	if (IOConnectMapMemory64(param_connect, kPS2ParameterMemoryType, mach_task_self(),
+							 &address, &size, kIOMapAnywhere)==KERN_SUCCESS)
+	{
+		param_page=(PS2ParameterPage *) address;
+		if (size<sizeof(PS2ParameterPage) || param_page->magic!=kPS2ParameterMagic ||
+			param_page->version!=kPS2ParameterVersion || param_page->count<kPS2ParamCount)
+		{
+			IOConnectUnmapMemory64(param_connect, kPS2ParameterMemoryType, mach_task_self(), address);
+			param_page=0;
+		}
+	}
+	if (!param_page)
+	{
+		IOServiceClose(param_connect);
+		param_connect=0;
+	}
+}
+
+void closeParameterPage (void)
+{
+	if (param_page)
+		IOConnectUnmapMemory64(param_connect, kPS2ParameterMemoryType, mach_task_self(),
+							   (mach_vm_address_t) param_page);
+	if (param_connect)
+		IOServiceClose(param_connect);
+	param_page=0;
+	param_connect=0;
+}
+
+IOReturn sendParameter (const char * key, int index, unsigned int number, io_service_t service)
+{
+	if (!param_page || pending)
+		return sendNumber(key, number, service);
+
+	CFStringRef cf_key = CFStringCreateWithCString(kCFAllocatorDefault, key, CFStringGetSystemEncoding());
+	CFNumberRef cf_number = CFNumberCreate(kCFAllocatorDefault, kCFNumberIntType, &number);
+	if (cf_number)
+		CFDictionarySetValue (dict, cf_key, cf_number);
+
+	param_page->value[index]=number;
+	OSAtomicOr32Barrier(1U<<index, &param_page->changed);
+	OSAtomicIncrement32Barrier((volatile int32_t *) &param_page->generation);
+	return kIOReturnSuccess;
+}
+
 long long getLongNumber (const char * key, io_service_t io_service)
 {
 	CFNumberRef num; 
@@ -74,7 +170,7 @@ IOReturn sendBoolean (const char * key, int bl, io_service_t service)
 	IOReturn retvalue = kIOReturnError;
 	CFStringRef cf_key = CFStringCreateWithCString(kCFAllocatorDefault, key, CFStringGetSystemEncoding());
 	CFDictionarySetValue (dict, cf_key, bl?kCFBooleanTrue:kCFBooleanFalse);
-	retvalue = IORegistryEntrySetCFProperty(service, cf_key, bl?kCFBooleanTrue:kCFBooleanFalse); 
+	retvalue = sendProperty(service, cf_key, bl?kCFBooleanTrue:kCFBooleanFalse); 
 //	if (cf_key) CFRelease(cf_key);
 	return retvalue;
 }
@@ -169,6 +265,7 @@ int getBoolean (const char * key, io_service_t io_service)
 	CFDataRef dat1;
 	UInt8 *dat2;
 	
+	closeParameterPage();
 	if (!dict)
 		return;
 	dat1=CFPropertyListCreateXMLData (kCFAllocatorDefault, dict);
@@ -206,7 +303,7 @@ int getBoolean (const char * key, io_service_t io_service)
 
 - (IBAction) SlideSpeedAction: (id) sender
 {
-	sendNumber("Divisor", 101-[speedSlider doubleValue], io_service);
+	sendParameter("Divisor", kPS2ParamDivisor, 101-[speedSlider doubleValue], io_service);
 }
 
 - (IBAction) ButtonHighRateAction: (id) sender
@@ -216,41 +313,43 @@ int getBoolean (const char * key, io_service_t io_service)
 
 - (IBAction) SlideFingerZAction: (id) sender
 {
-	sendNumber("FingerZ", [fingerZSlider doubleValue], io_service);
+	sendParameter("FingerZ", kPS2ParamFingerZ, [fingerZSlider doubleValue], io_service);
 }
 
 - (IBAction) SlideTEdgeAction: (id) sender
 {
-	sendNumber("TopEdge", [tedgeSlider doubleValue]*70, io_service);
+	sendParameter("TopEdge", kPS2ParamTopEdge, [tedgeSlider doubleValue]*70, io_service);
 }
 - (IBAction) SlideBEdgeAction: (id) sender
 {
-	sendNumber("BottomEdge", [bedgeSlider doubleValue]*70, io_service);
+	sendParameter("BottomEdge", kPS2ParamBottomEdge, [bedgeSlider doubleValue]*70, io_service);
 }
 - (IBAction) SlideLEdgeAction: (id) sender
 {
-	sendNumber("LeftEdge", [ledgeSlider doubleValue]*70, io_service);
+	sendParameter("LeftEdge", kPS2ParamLeftEdge, [ledgeSlider doubleValue]*70, io_service);
 }
 
 - (IBAction) SlideREdgeAction: (id) sender
 {
-	sendNumber("RightEdge", [redgeSlider doubleValue]*70, io_service);
+	sendParameter("RightEdge", kPS2ParamRightEdge, [redgeSlider doubleValue]*70, io_service);
 }
 
 - (IBAction) SlideCenterXAction: (id) sender
 {
-	sendNumber("CenterX", [centerXSlider doubleValue]*70, io_service);
+	sendParameter("CenterX", kPS2ParamCenterX, [centerXSlider doubleValue]*70, io_service);
 }
 
 - (IBAction) SlideCenterYAction: (id) sender
 {
-	sendNumber("CenterY", [centerYSlider doubleValue]*70, io_service);
+	sendParameter("CenterY", kPS2ParamCenterY, [centerYSlider doubleValue]*70, io_service);
 }
 
 - (IBAction) TapAction: (id) sender
 {
+	beginProperties();
 	sendLongNumber("MaxTapTime", [maxTapTimeSlider doubleValue]*2500000.0,io_service);
 	sendBoolean("StabilizeTapping", [stabTapButton state], io_service);
+	commitProperties(io_service);
 }
 
 - (IBAction) HscrollAction: (id) sender
@@ -259,8 +358,10 @@ int getBoolean (const char * key, io_service_t io_service)
 	{
 		[hscrollSlider setEnabled:1];
 		[hsScrollButton setEnabled:1];
+		beginProperties();
 		sendNumber("HorizontalScrollDivisor", 101-[hscrollSlider doubleValue],io_service);
 		sendBoolean("StickyHorizontalScrolling", [hsScrollButton state], io_service);
+		commitProperties(io_service);
 	}
 	else
 	{
@@ -276,8 +377,10 @@ int getBoolean (const char * key, io_service_t io_service)
 	{
 		[cscrollSlider setEnabled:1];
 		[cTrigger setEnabled:1];
+		beginProperties();
 		sendNumber("CircularScrollDivisor", 101-[hscrollSlider doubleValue],io_service);
 		sendNumber("CircularScrollTrigger", [cTrigger indexOfSelectedItem]+1, io_service);
+		commitProperties(io_service);
 	}
 	else
 	{
@@ -293,8 +396,10 @@ int getBoolean (const char * key, io_service_t io_service)
 	{
 		[vscrollSlider setEnabled:1];
 		[vsScrollButton setEnabled:1];
+		beginProperties();
 		sendNumber("VerticalScrollDivisor", 101-[vscrollSlider doubleValue],io_service);
 		sendBoolean("StickyVerticalScrolling", [vsScrollButton state], io_service);
+		commitProperties(io_service);
 	}
 	else
 	{
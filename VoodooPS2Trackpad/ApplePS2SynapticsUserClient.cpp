@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include "ApplePS2SynapticsUserClient.h"
+#include "VoodooPS2SynapticsTouchPad.h"
+#include "VoodooPS2ALPSGlidePoint.h"
+
+// =============================================================================
+// ApplePS2SynapticsUserClient Class Implementation
+//
+
+#define super IOUserClient
+OSDefineMetaClassAndStructors(ApplePS2SynapticsUserClient, IOUserClient);
+
+bool ApplePS2SynapticsUserClient::initWithTask(task_t         owningTask,
+                                               void *         securityID,
+                                               UInt32         type,
+                                               OSDictionary * properties)
+{
+  if (!super::initWithTask(owningTask, securityID, type, properties))
+    return false;
+
+  //
+  // Anyone may open the prefpane's connection, but a daemon in frame mode
+  // drives the pointer; the frame ring is kept to root.
+  //
+
+  _privileged    = clientHasPrivilege(owningTask, kIOClientPrivilegeAdministrator) == kIOReturnSuccess;
+  _touchPad      = 0;
+  _frames        = 0;
+  _framesStarted = false;
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2SynapticsUserClient::start(IOService * provider)
+{
+  ApplePS2ALPSGlidePoint * glidePoint;
+
+  _framesStarted = false;
+  _touchPad      = OSDynamicCast(ApplePS2SynapticsTouchPad, provider);
+  if (_touchPad)
+    _frames = _touchPad->getFrameChannel();
+  else if ((glidePoint = OSDynamicCast(ApplePS2ALPSGlidePoint, provider)))
+    _frames = glidePoint->getFrameChannel();
+  else
+    return false;
+
+  return super::start(provider);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2SynapticsUserClient::clientClose()
+{
+  //
+  // A daemon that goes away hands the gestures back to the driver.
+  //
+
+  if (_framesStarted)
+    _frames->stop();
+  _framesStarted = false;
+
+  terminate();
+  return kIOReturnSuccess;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2SynapticsUserClient::clientMemoryForType(UInt32                type,
+                                                          IOOptionBits *        options,
+                                                          IOMemoryDescriptor ** memory)
+{
+  IOMemoryDescriptor * page;
+
+  if (type == kPS2FrameMemoryType)
+  {
+    if (!_privileged)
+      return kIOReturnNotPrivileged;
+
+    page = _frames->memory();
+    if (!page)
+      return kIOReturnNoMemory;
+
+    //
+    // Mapped writable too, for the reader to set the doorbell; nothing else
+    // in the ring is read back.
+    //
+
+    page->retain();
+    *options = 0;
+    *memory  = page;
+    return kIOReturnSuccess;
+  }
+
+  if (type != kPS2ParameterMemoryType || !_touchPad)
+    return kIOReturnBadArgument;
+
+  page = _touchPad->getParameterMemory();
+  if (!page)
+    return kIOReturnNoMemory;
+
+  //
+  // Mapped writable; the prefpane writes the settings straight into it.
+  //
+
+  page->retain();
+  *options = 0;
+  *memory  = page;
+  return kIOReturnSuccess;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2SynapticsUserClient::externalMethod(uint32_t                   selector,
+                                                     IOExternalMethodArguments * arguments,
+                                                     IOExternalMethodDispatch *  dispatch,
+                                                     OSObject *                  target,
+                                                     void *                      reference)
+{
+  static const IOExternalMethodDispatch methods[] =
+  {
+    // kPS2FrameMethodStart: asynchronous, the doorbell replies to it
+    { (IOExternalMethodAction) &ApplePS2SynapticsUserClient::startFrames,
+      0, 0, 0, 0 },
+    // kPS2FrameMethodStop
+    { (IOExternalMethodAction) &ApplePS2SynapticsUserClient::stopFrames,
+      0, 0, 0, 0 }
+  };
+
+  if (selector < sizeof(methods) / sizeof(methods[0]))
+  {
+    dispatch = (IOExternalMethodDispatch *) &methods[selector];
+    target   = this;
+  }
+  return super::externalMethod(selector, arguments, dispatch, target, reference);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2SynapticsUserClient::startFrames(ApplePS2SynapticsUserClient * target,
+                                                  void *,
+                                                  IOExternalMethodArguments * arguments)
+{
+  IOReturn result;
+
+  if (!target->_privileged)
+    return kIOReturnNotPrivileged;
+  if (!arguments->asyncWakePort)
+    return kIOReturnBadArgument;
+
+  result = target->_frames->start(arguments->asyncReference,
+                                  arguments->asyncReferenceCount);
+  if (result == kIOReturnSuccess)
+    target->_framesStarted = true;
+  return result;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2SynapticsUserClient::stopFrames(ApplePS2SynapticsUserClient * target,
+                                                 void *,
+                                                 IOExternalMethodArguments *)
+{
+  if (target->_framesStarted)
+    target->_frames->stop();
+  target->_framesStarted = false;
+  return kIOReturnSuccess;
+}
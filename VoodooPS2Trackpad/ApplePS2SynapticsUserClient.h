@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef _APPLEPS2SYNAPTICSUSERCLIENT_H
+#define _APPLEPS2SYNAPTICSUSERCLIENT_H
+
+#include <IOKit/IOUserClient.h>
+
+class ApplePS2SynapticsTouchPad;
+class PS2FrameChannel;
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// ApplePS2SynapticsUserClient Class Declaration
+//
+// Hands the touchpad's parameter page (see ApplePS2ParameterPage.h) to the
+// prefpane, which maps it with IOConnectMapMemory and memory type
+// kPS2ParameterMemoryType.  Anyone may already change these settings through
+// setProperties, so the connection is not restricted.
+//
+// Also hands the frame ring (see ApplePS2FrameRing.h) of the Synaptics driver
+// or the ALPS GlidePoint driver to a gesture daemon, memory type
+// kPS2FrameMemoryType, and turns their frame mode on and off.  Frame mode
+// takes the pointer away from the driver, so the ring and frame mode are only
+// available to administrators.
+//
+
+class ApplePS2SynapticsUserClient : public IOUserClient
+{
+  OSDeclareDefaultStructors(ApplePS2SynapticsUserClient);
+
+private:
+  ApplePS2SynapticsTouchPad * _touchPad;       // 0 for ALPS
+  PS2FrameChannel *           _frames;
+  bool                        _framesStarted;
+  bool                        _privileged;     // administrator
+
+  static IOReturn startFrames(ApplePS2SynapticsUserClient * target, void * reference,
+                              IOExternalMethodArguments * arguments);
+  static IOReturn stopFrames(ApplePS2SynapticsUserClient * target, void * reference,
+                             IOExternalMethodArguments * arguments);
+
+public:
+  virtual bool     initWithTask(task_t owningTask, void * securityID,
+                                UInt32 type, OSDictionary * properties);
+  virtual bool     start(IOService * provider);
+  virtual IOReturn clientClose();
+  virtual IOReturn clientMemoryForType(UInt32                type,
+                                       IOOptionBits *        options,
+                                       IOMemoryDescriptor ** memory);
+  virtual IOReturn externalMethod(uint32_t                   selector,
+                                  IOExternalMethodArguments * arguments,
+                                  IOExternalMethodDispatch *  dispatch,
+                                  OSObject *                  target,
+                                  void *                      reference);
+};
+
+#endif /* !_APPLEPS2SYNAPTICSUSERCLIENT_H */
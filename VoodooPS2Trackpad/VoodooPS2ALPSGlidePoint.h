@@ -20,12 +20,49 @@
  * @APPLE_LICENSE_HEADER_END@
  */
 
-#ifndef _APPLEPS2SYNAPTICSTOUCHPAD_H
-#define _APPLEPS2SYNAPTICSTOUCHPAD_H
+#ifndef _APPLEPS2ALPSGLIDEPOINT_H
+#define _APPLEPS2ALPSGLIDEPOINT_H
 
 #include "ApplePS2MouseDevice.h"
+#include "ApplePS2ClickScheduler.h"
+#include "ApplePS2CommandBatch.h"
+#include "ApplePS2EventFilter.h"
+#include "ApplePS2FrameRing.h"
+#include "ApplePS2GestureEngine.h"
+#include "ApplePS2PacketAssembler.h"
 #include <IOKit/hidsystem/IOHIPointing.h>
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Absolute mode packet framing: bit 3 set in the first byte, bit 7 clear in
+// all the others.
+//
+
+struct ALPSPacketValidator
+{
+    static bool isPacketStart(UInt8 byte)
+    {
+        return byte != kSC_Acknowledge && (byte & 0x08);
+    }
+
+    static bool isPacketByte(const UInt8 *, UInt32, UInt8 byte)
+    {
+        return !(byte & 0x80);
+    }
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Absolute mode coordinates.  y grows downwards on the pad; the samples for
+// the gesture engine are flipped to grow upwards, like the Synaptics ones.
+// A hardware tap (gesture bit without the finger bit) is handed on as a touch
+// of kALPSTapZ, followed by a lift should a finger come next (tap and drag),
+// and a touch of kALPSTwoFingerZ or more is two fingers, as the pad does not
+// count them.
+//
+
+#define kALPSMaxY           1023
+#define kALPSTapZ           40
+#define kALPSTwoFingerZ     100
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 // ApplePS2ALPSGlidePoint Class Declaration
 //
@@ -37,88 +74,48 @@ typedef struct ALPSStatus {
 	UInt8 byte2;
 } ALPSStatus_t;
 
-#define SCROLL_NONE  0
-#define SCROLL_HORIZ 1
-#define SCROLL_VERT  2
-
 class ApplePS2ALPSGlidePoint : public IOHIPointing 
 {
 	OSDeclareDefaultStructors( ApplePS2ALPSGlidePoint );
+	friend class PS2GestureEngine;
 
 private:
     ApplePS2MouseDevice * _device;
     UInt32                _interruptHandlerInstalled:1;
     UInt32                _powerControlHandlerInstalled:1;
-    UInt8                 _packetBuffer[6];
-    UInt32                _packetByteCount;
+    PS2PacketAssembler<6, ALPSPacketValidator> _packets;
     IOFixed               _resolution;
     UInt16                _touchPadVersion;
     UInt8                 _touchPadModeByte;
-
-	bool				  _dragging;
-	bool				  _edgehscroll;
-	bool				  _edgevscroll;
-    UInt32                _edgeaccell;
-    double                _edgeaccellvalue;
-	bool				  _draglock;
-	AbsoluteTime		_time;
-//from synaptic
-	int z_finger;
-	int divisor;
-	int ledge;
-	int redge;
-	int tedge;
-	int bedge;
-	int vscrolldivisor, hscrolldivisor, cscrolldivisor;
-	int ctrigger;
-	int centerx;
-	int centery;
-	int lastx, lasty;
-	int xrest, yrest, scrollrest;
-	int inited;
-	uint64_t maxtaptime;
-	uint64_t touchtime;
-	uint64_t untouchtime;
-	uint64_t maxdragtime;
-	int hsticky,vsticky, wsticky, tapstable;
-	int wlimit, wvdivisor, whdivisor;
-	int xmoved,ymoved,xscrolled, yscrolled;
-	bool clicking;
-	bool dragging;
-	bool draglock;
-	bool hscroll, scroll;
-	bool wasdouble;
-	bool rtap;
-	
-	
-private:
-    SInt32				  _xpos, _xscrollpos;
-    SInt32				  _ypos, _yscrollpos;
-    SInt32				  _zpos, _zscrollpos;
-    int                   _xdiffold, _ydiffold;
-    short                 _scrolling;
-	int					_movedelay;
+    PS2ClickScheduler     _clickScheduler;
+    PS2EventFilter        _events;
+    PS2FrameChannel       _frames;
+    PS2RegisterCache<8>   _ecRegisters;       // values written in EC mode
+	PS2GestureEngine _gestures;		// absolute mode touch state machine
+	bool				_hardwareTap;	// last packet a tap without finger
 	bool				_absolute; 
-	enum {MODE_NOTOUCH, MODE_MOVE, MODE_VSCROLL, MODE_HSCROLL, MODE_CSCROLL, MODE_MTOUCH, 
-		MODE_PREDRAG, MODE_DRAG, MODE_DRAGNOTOUCH, MODE_DRAGLOCK} touchmode;
 
     
 protected:
 	virtual void   dispatchRelativePointerEventWithPacket( UInt8 * packet,
                                                            UInt32  packetSize );
 	virtual void   dispatchAbsolutePointerEventWithPacket(UInt8 *packet,UInt32 packetSize);
+	virtual void   clickReleaseOccurred(IOTimerEventSource * sender);
+	virtual void   postRelativePointerEvent(int dx, int dy, UInt32 buttons, AbsoluteTime now);
+	virtual void   postScrollWheelEvent(int deltaVert, int deltaHoriz, AbsoluteTime now);
+	virtual void   flushEvents(AbsoluteTime now);
 	virtual void   getModel(ALPSStatus_t *e6,ALPSStatus_t *e7);
 	virtual void   setAbsoluteMode();
 	virtual bool   setECMode(bool enable);
 	virtual void	setMisc( UInt16 val );
 	
 	virtual void	AlpsECNibble(PS2Request * request, int * index, uint8_t nibble);
+	virtual void	AlpsECNibble(PS2CommandBatch * batch, uint8_t nibble);
 	virtual int		AlpsECWrite(uint16_t addr, uint8_t value);
+	virtual void	AlpsECWrite(PS2CommandBatch * batch, uint16_t addr, uint8_t value);
 	
 	virtual void   getStatus(ALPSStatus_t *status);
-	virtual int    insideScrollArea(int x,int y);
 
-    virtual void   setCommandByte( UInt8 setBits, UInt8 clearBits );
 	virtual void   setSampleRateAndResolution(uint8_t rate, uint8_t res );
 
 	virtual void   setTapEnable( bool enable );
@@ -148,6 +145,8 @@ public:
     virtual UInt32 interfaceID();
 
 	virtual IOReturn setParamProperties( OSDictionary * dict );
+
+	virtual PS2FrameChannel * getFrameChannel();
 };
 
 const int cmds[] = {
@@ -171,4 +170,4 @@ const unsigned char params[] = {
 	0xff, 0xff, 0xff, 10, 20, 40, 60, 80, 100, 200, 0xff, 0,  1,  2,  3, 0xff };
 //  F0,   F6,   E7,   F3, F3, F3, F3, F3, F3,  F3,  E9,   E8, E8, E8, E8, E6
 //   0     1    2      3   4   5   6   7   8    9    a     b   c   d   e   f
-#endif /* _APPLEPS2SYNAPTICSTOUCHPAD_H */
+#endif /* _APPLEPS2ALPSGLIDEPOINT_H */
@@ -59,7 +59,7 @@ bool ApplePS2SentelicFSP::init( OSDictionary * properties )
 	
     _device                    = 0;
     _interruptHandlerInstalled = false;
-    _packetByteCount           = 0;
+    _packets.init(3);
     _resolution                = (100) << 16; // (100 dpi, 4 counts/mm)
     _touchPadModeByte          = kModeByteValueGesturesDisabled;
 	
@@ -302,7 +302,7 @@ bool ApplePS2SentelicFSP::start( IOService * provider )
     // Default to 3-byte packets, will try and enable 4-byte packets later
     //
 
-    _packetSize = 3;
+    _packets.setLength(3);
 
     //
     // Advertise the current state of the tapping feature.
@@ -330,7 +330,7 @@ bool ApplePS2SentelicFSP::start( IOService * provider )
     // Enable the mouse clock (should already be so) and the mouse IRQ line.
     //
 	
-    setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
+    _device->updateCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
 	
     //
     // Finally, we enable the trackpad itself, so that it may start reporting
@@ -371,7 +371,7 @@ void ApplePS2SentelicFSP::stop( IOService * provider )
     // Disable the mouse clock and the mouse IRQ line.
     //
 	
-    setCommandByte( kCB_DisableMouseClock, kCB_EnableMouseIRQ );
+    _device->updateCommandByte( kCB_DisableMouseClock, kCB_EnableMouseIRQ );
 	
     //
     // Uninstall the interrupt handler.
@@ -418,23 +418,14 @@ void ApplePS2SentelicFSP::interruptOccurred( UInt8 data )
     //
     // Ignore all bytes until we see the start of a packet, otherwise the
     // packets may get out of sequence and things will get very confusing.
+    // The packet assembler takes care of that; once it has the three (or
+    // four) bytes of a packet, dispatch it for processing.
     //
-    if (_packetByteCount == 0 && ((data == kSC_Acknowledge) || !(data & 0x08)))
-    {
-        return;
-    }
-	
-    //
-    // Add this byte to the packet buffer. If the packet is complete, that is,
-    // we have the three bytes, dispatch this packet for processing.
-    //
-	
-    _packetBuffer[_packetByteCount++] = data;
-    
-    if (_packetByteCount == _packetSize)
+
+    if (_packets.add(data) == kPS2PacketComplete)
     {
-        dispatchRelativePointerEventWithPacket(_packetBuffer, _packetSize);
-        _packetByteCount = 0;
+        dispatchRelativePointerEventWithPacket(_packets.packet(), _packets.length());
+        _packets.publishStatistics(this);
     }
 }
 
@@ -507,7 +498,7 @@ void ApplePS2SentelicFSP::setTouchPadEnable( bool enable )
 
     // turn on intellimouse mode (4 bytes per packet)
     if (fsp_intellimouse_mode(_device, request) == 4)
-        _packetSize = 4;
+        _packets.setLength(4);
 
     _device->freeRequest(request);
 }
@@ -573,63 +564,6 @@ UInt32 ApplePS2SentelicFSP::getTouchPadData( UInt8 dataSelector )
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2SentelicFSP::setCommandByte( UInt8 setBits, UInt8 clearBits )
-{
-    //
-    // Sets the bits setBits and clears the bits clearBits "atomically" in the
-    // controller's Command Byte.   Since the controller does not provide such
-    // a read-modify-write primitive, we resort to a test-and-set try loop.
-    //
-    // Do NOT issue this request from the interrupt/completion context.
-    //
-	
-    UInt8        commandByte;
-    UInt8        commandByteNew;
-    PS2Request * request = _device->allocateRequest();
-	
-    if ( !request ) return;
-	
-    do
-    {
-        // (read command byte)
-        request->commands[0].command = kPS2C_WriteCommandPort;
-        request->commands[0].inOrOut = kCP_GetCommandByte;
-        request->commands[1].command = kPS2C_ReadDataPort;
-        request->commands[1].inOrOut = 0;
-        request->commandsCount = 2;
-        _device->submitRequestAndBlock(request);
-		
-        //
-        // Modify the command byte as requested by caller.
-        //
-		
-        commandByte    = request->commands[1].inOrOut;
-        commandByteNew = (commandByte | setBits) & (~clearBits);
-		
-        // ("test-and-set" command byte)
-        request->commands[0].command = kPS2C_WriteCommandPort;
-        request->commands[0].inOrOut = kCP_GetCommandByte;
-        request->commands[1].command = kPS2C_ReadDataPortAndCompare;
-        request->commands[1].inOrOut = commandByte;
-        request->commands[2].command = kPS2C_WriteCommandPort;
-        request->commands[2].inOrOut = kCP_SetCommandByte;
-        request->commands[3].command = kPS2C_WriteDataPort;
-        request->commands[3].inOrOut = commandByteNew;
-        request->commandsCount = 4;
-        _device->submitRequestAndBlock(request);
-		
-        //
-        // Repeat this loop if last command failed, that is, if the
-        // old command byte was modified since we first read it.
-        //
-		
-    } while (request->commandsCount != 4);  
-	
-    _device->freeRequest(request);
-}
-
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-
 IOReturn ApplePS2SentelicFSP::setParamProperties( OSDictionary * dict )
 {
     OSNumber * clicking = OSDynamicCast( OSNumber, dict->getObject("Clicking") );
@@ -675,24 +609,23 @@ void ApplePS2SentelicFSP::setDevicePowerState( UInt32 whatToDo )
 			
             //
             // Must not issue any commands before the device has
-            // completed its power-on self-test and calibration.
+            // completed its power-on self-test and calibration; the
+            // controller holds off this call until the device answers.
             //
 			
-            IOSleep(1000);
-			
             //
             // Enable the mouse clock (should already be so) and the
             // mouse IRQ line.
             //
 			
-            setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
+            _device->updateCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
 			
             //
             // Clear packet buffer pointer to avoid issues caused by
             // stale packet fragments.
             //
 			
-            _packetByteCount = 0;
+            _packets.reset();
 			
             //
             // Finally, we enable the trackpad itself, so that it may
@@ -24,6 +24,7 @@
 #define _APPLEPS2SENTILICSFSP_H
 
 #include "ApplePS2MouseDevice.h"
+#include "ApplePS2PacketAssembler.h"
 #include <IOKit/hidsystem/IOHIPointing.h>
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -38,15 +39,12 @@ class ApplePS2SentelicFSP : public IOHIPointing
 		ApplePS2MouseDevice * _device;
 		UInt32                _interruptHandlerInstalled:1;
 		UInt32                _powerControlHandlerInstalled:1;
-		UInt8                 _packetBuffer[4];
-		UInt32                _packetByteCount;
-		UInt8                 _packetSize;
+		PS2PacketAssembler<4, PS2StandardPacketValidator> _packets;
 		IOFixed               _resolution;
 		UInt16                _touchPadVersion;
 		UInt8                 _touchPadModeByte;
 		
 		virtual void   dispatchRelativePointerEventWithPacket( UInt8 * packet, UInt32  packetSize ); 
-		virtual void   setCommandByte( UInt8 setBits, UInt8 clearBits );
 		
 		virtual void   setTouchPadEnable( bool enable );
 		virtual UInt32 getTouchPadData( UInt8 dataSelector );
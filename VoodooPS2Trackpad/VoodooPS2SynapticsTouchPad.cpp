@@ -56,44 +56,59 @@ bool ApplePS2SynapticsTouchPad::init( OSDictionary * properties )
 
     _device                    = 0;
     _interruptHandlerInstalled = false;
-    _packetByteCount           = 0;
+    _clickScheduler.init();
+    _rateGovernor.init();
+    _events.init();
+    _params.init();
+    _frames.init();
+    _batchHandlerInstalled     = false;
+    _packets.init();
     _resolution                = (2400) << 16; // 2400 dpi default was (100 dpi, 4 counts/mm)
     _touchPadModeByte          = 0x80; //default: absolute, low-rate, no w-mode
-	z_finger=30;
-	divisor=1; // Standard was 23, changed for high res fix
-	ledge=1700;
-	redge=5200;
-	tedge=4200;
-	bedge=1700;
-	vscrolldivisor=30;
-	hscrolldivisor=30;
-	cscrolldivisor=0;
-	ctrigger=0;
-	centerx=3000;
-	centery=3000;
-	lastx=0;
-	lasty=0;
-	xrest=0; 
-	yrest=0; 
-	scrollrest=0;
+    _capabilities              = 0;
+    _extendedCapabilities      = 0;
+    _continuedCapabilities     = 0;
+    _advancedGestures          = false;
+    _secondFingerValid         = false;
+    _contacts                  = 0;
 	inited=0;
-	maxtaptime=100000000;
-	clicking=true;
-	maxdragtime=300000000;
-	dragging=false;
-	draglock=false;
-	hscroll=false;
-	scroll=true;
-	hsticky=0;
-	vsticky=0;
-	wsticky=1;
-	tapstable=1;
-	wlimit=9;
-	wvdivisor=30;
-	whdivisor=30;
-	xmoved=ymoved=xscrolled=yscrolled=0;
-	touchmode=MODE_NOTOUCH;
-	wasdouble=false;
+	_gestures.init();
+	PS2GestureSettings & settings = _gestures.settings();
+	settings.fingerZ=30;
+	settings.divisor=1; // Standard was 23, changed for high res fix
+	settings.leftEdge=1700;
+	settings.rightEdge=5200;
+	settings.topEdge=4200;
+	settings.bottomEdge=1700;
+	settings.vscrollDivisor=30;
+	settings.hscrollDivisor=30;
+	settings.cscrollDivisor=0;
+	settings.cscrollTrigger=0;
+	settings.centerX=3000;
+	settings.centerY=3000;
+	settings.maxTapTime=100000000;
+	settings.clicking=true;
+	settings.maxDragTime=300000000;
+	settings.dragging=false;
+	settings.dragLock=false;
+	settings.hscroll=false;
+	settings.scroll=true;
+	settings.stickyHScroll=0;
+	settings.stickyVScroll=0;
+	settings.stickyMultiFinger=1;
+	settings.stableTap=1;
+	settings.wLimit=9;
+	settings.wvDivisor=30;
+	settings.whDivisor=30;
+	_gestures.configure();
+	_paramVars[kPS2ParamDivisor]=&settings.divisor;
+	_paramVars[kPS2ParamFingerZ]=&settings.fingerZ;
+	_paramVars[kPS2ParamTopEdge]=&settings.topEdge;
+	_paramVars[kPS2ParamBottomEdge]=&settings.bottomEdge;
+	_paramVars[kPS2ParamLeftEdge]=&settings.leftEdge;
+	_paramVars[kPS2ParamRightEdge]=&settings.rightEdge;
+	_paramVars[kPS2ParamCenterX]=&settings.centerX;
+	_paramVars[kPS2ParamCenterY]=&settings.centerY;
 	
 	inited=1;
     return true;
@@ -113,53 +128,72 @@ ApplePS2SynapticsTouchPad::probe( IOService * provider, SInt32 * score )
     //
 
     ApplePS2MouseDevice * device  = (ApplePS2MouseDevice *) provider;
-    PS2Request *          request = device->allocateRequest();
+    PS2MouseIdentity      identity;
     bool                  success = false;
     
-    if (!super::probe(provider, score) || !request) return 0;
+    if (!super::probe(provider, score)) return 0;
 
     //
-    // Send an "Identify TouchPad" command and see if the device is
-    // a Synaptics TouchPad based on its response.  End the command
-    // chain with a "Set Defaults" command to clear all state.
+    // The controller has normally identified the device already; only send
+    // the "Identify TouchPad" sequence ourselves if it did not, or if its
+    // query failed.
     //
 
-    request->commands[0].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[0].inOrOut  = kDP_SetDefaultsAndDisable;
-    request->commands[1].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[1].inOrOut  = kDP_SetMouseResolution;
-    request->commands[2].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[2].inOrOut  = 0;
-    request->commands[3].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[3].inOrOut  = kDP_SetMouseResolution;
-    request->commands[4].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[4].inOrOut  = 0;
-    request->commands[5].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[5].inOrOut  = kDP_SetMouseResolution;
-    request->commands[6].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[6].inOrOut  = 0;
-    request->commands[7].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[7].inOrOut  = kDP_SetMouseResolution;
-    request->commands[8].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[8].inOrOut  = 0;
-    request->commands[9].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[9].inOrOut  = kDP_GetMouseInformation;
-    request->commands[10].command = kPS2C_ReadDataPort;
-    request->commands[10].inOrOut = 0;
-    request->commands[11].command = kPS2C_ReadDataPort;
-    request->commands[11].inOrOut = 0;
-    request->commands[12].command = kPS2C_ReadDataPort;
-    request->commands[12].inOrOut = 0;
-    request->commands[13].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[13].inOrOut = kDP_SetDefaultsAndDisable;
-    request->commandsCount = 14;
-    device->submitRequestAndBlock(request);
+    if (!device->getIdentity(&identity) || !identity.synapticsValid)
+    {
+        PS2Request * request = device->allocateRequest();
+        if (!request) return 0;
+
+        //
+        // Send an "Identify TouchPad" command and see if the device is
+        // a Synaptics TouchPad based on its response.  End the command
+        // chain with a "Set Defaults" command to clear all state.
+        //
+
+        request->commands[0].command  = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[0].inOrOut  = kDP_SetDefaultsAndDisable;
+        request->commands[1].command  = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[1].inOrOut  = kDP_SetMouseResolution;
+        request->commands[2].command  = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[2].inOrOut  = 0;
+        request->commands[3].command  = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[3].inOrOut  = kDP_SetMouseResolution;
+        request->commands[4].command  = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[4].inOrOut  = 0;
+        request->commands[5].command  = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[5].inOrOut  = kDP_SetMouseResolution;
+        request->commands[6].command  = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[6].inOrOut  = 0;
+        request->commands[7].command  = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[7].inOrOut  = kDP_SetMouseResolution;
+        request->commands[8].command  = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[8].inOrOut  = 0;
+        request->commands[9].command  = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[9].inOrOut  = kDP_GetMouseInformation;
+        request->commands[10].command = kPS2C_ReadDataPort;
+        request->commands[10].inOrOut = 0;
+        request->commands[11].command = kPS2C_ReadDataPort;
+        request->commands[11].inOrOut = 0;
+        request->commands[12].command = kPS2C_ReadDataPort;
+        request->commands[12].inOrOut = 0;
+        request->commands[13].command = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[13].inOrOut = kDP_SetDefaultsAndDisable;
+        request->commandsCount = 14;
+        device->submitRequestAndBlock(request);
+
+        bzero(&identity, sizeof(identity));
+        identity.synapticsValid = (request->commandsCount == 14);
+        identity.synaptics[0]   = request->commands[10].inOrOut;
+        identity.synaptics[1]   = request->commands[11].inOrOut;
+        identity.synaptics[2]   = request->commands[12].inOrOut;
+        device->freeRequest(request);
+    }
 
-    if ( request->commandsCount == 14 &&
-		request->commands[11].inOrOut == 0x47 )
+    if ( identity.synapticsValid &&
+		identity.synaptics[1] == 0x47 )
     {
-        _touchPadVersion = (request->commands[12].inOrOut & 0x0f) << 8
-		|  request->commands[10].inOrOut;
+        _touchPadVersion = (identity.synaptics[2] & 0x0f) << 8
+		|  identity.synaptics[0];
 		
         //
         // Only support 4.x or later touchpads.
@@ -170,7 +204,6 @@ ApplePS2SynapticsTouchPad::probe( IOService * provider, SInt32 * score )
 	int v1, v2;
 	v1 = _touchPadVersion >> 8;
 	v2 = _touchPadVersion & 0xff;
-    device->freeRequest(request);
 	if (v1>0) {
 		IOLog ("VoodooPS2SynapticsTouchPad version %d.%d %s supported \n", v1, v2, success?"":"no");
 	}
@@ -255,6 +288,15 @@ bool ApplePS2SynapticsTouchPad::start( IOService * provider )
     IOLog("VoodooPS2Trackpad: Synaptics TouchPad v%d.%d\n",
           (UInt8)(_touchPadVersion >> 8), (UInt8)(_touchPadVersion));
 
+    //
+    // Read the capability pages, once.  Advanced gesture mode depends on W
+    // mode, so pads that get it have W mode on whatever the settings.
+    //
+
+    queryCapabilities();
+    if (_advancedGestures)
+        _touchPadModeByte |= 1<<0;
+
     //
     // Write the TouchPad mode byte value.
     //
@@ -277,6 +319,40 @@ bool ApplePS2SynapticsTouchPad::start( IOService * provider )
 	
 	setProperty(kIOHIDScrollResolutionKey, (100 << 16), 32);
     //
+    // Share the slider settings with the prefpane (see ApplePS2ParameterPage.h).
+    // Without the page, it falls back to setting properties.
+    //
+
+    if (_params.allocate())
+        publishParameterPage();
+    else
+        IOLog("VoodooPS2Trackpad: Unable to allocate parameter page\n");
+
+    //
+    // The frame ring for a gesture daemon (see ApplePS2FrameRing.h), unused
+    // until one turns frame mode on.
+    //
+
+    if (!_frames.allocate(256, kPS2FrameSourceSynaptics))
+        IOLog("VoodooPS2Trackpad: Unable to allocate frame ring\n");
+
+    //
+    // Set up the timer that reports the button release after a tap click.
+    //
+
+    if ( !_clickScheduler.start(this, getWorkLoop(),
+            OSMemberFunctionCast(IOTimerEventSource::Action, this, &ApplePS2SynapticsTouchPad::clickReleaseOccurred)) )
+        return false;
+
+    //
+    // Set up the timer that drops the pad to its low report rate when idle.
+    //
+
+    if ( !_rateGovernor.start(this, getWorkLoop(),
+            OSMemberFunctionCast(IOTimerEventSource::Action, this, &ApplePS2SynapticsTouchPad::idleRateOccurred)) )
+        return false;
+
+    //
     // Install our driver's interrupt handler, for asynchronous data delivery.
     //
 
@@ -284,11 +360,20 @@ bool ApplePS2SynapticsTouchPad::start( IOService * provider )
         OSMemberFunctionCast(PS2InterruptAction,this,&ApplePS2SynapticsTouchPad::interruptOccurred));
     _interruptHandlerInstalled = true;
 
+    //
+    // Have the controller hand us whole runs of bytes rather than one byte
+    // per call; interruptOccurred remains as the per-byte fallback.
+    //
+
+    _device->installBatchInterruptAction(this,
+        OSMemberFunctionCast(PS2BatchInterruptAction,this,&ApplePS2SynapticsTouchPad::packetsOccurred));
+    _batchHandlerInstalled = true;
+
     //
     // Enable the mouse clock (should already be so) and the mouse IRQ line.
     //
 
-    setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
+    _device->updateCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
 
     //
     // Finally, we enable the trackpad itself, so that it may start reporting
@@ -330,7 +415,7 @@ void ApplePS2SynapticsTouchPad::stop( IOService * provider )
     // Disable the mouse clock and the mouse IRQ line.
     //
 
-    setCommandByte( kCB_DisableMouseClock, kCB_EnableMouseIRQ );
+    _device->updateCommandByte( kCB_DisableMouseClock, kCB_EnableMouseIRQ );
 
     //
     // Uninstall the interrupt handler.
@@ -339,6 +424,16 @@ void ApplePS2SynapticsTouchPad::stop( IOService * provider )
     if ( _interruptHandlerInstalled )  _device->uninstallInterruptAction();
     _interruptHandlerInstalled = false;
 
+    //
+    // Drop any pending click release along with its timer.
+    //
+
+    _clickScheduler.stop();
+    _rateGovernor.stop();
+
+    if ( _batchHandlerInstalled )  _device->uninstallBatchInterruptAction();
+    _batchHandlerInstalled = false;
+
     //
     // Uninstall the power control handler.
     //
@@ -346,6 +441,13 @@ void ApplePS2SynapticsTouchPad::stop( IOService * provider )
     if ( _powerControlHandlerInstalled ) _device->uninstallPowerControlAction();
     _powerControlHandlerInstalled = false;
 
+    //
+    // Release the parameter page, our user clients being gone by now.
+    //
+
+    _params.free();
+    _frames.free();
+
 	super::stop(provider);
 }
 
@@ -378,23 +480,30 @@ void ApplePS2SynapticsTouchPad::interruptOccurred( UInt8 data )
     // Ignore all bytes until we see the start of a packet, otherwise the
     // packets may get out of sequence and things will get very confusing.
     //
-    if (_packetByteCount == 0 && ((data == kSC_Acknowledge) || ((data & 0xc0)!=0x80)))
+    // Add this byte to the packet. If the packet is complete, that is, we have
+    // the six bytes, dispatch this packet for processing.
+    //
+
+    if (_packets.add(data) == kPS2PacketComplete)
     {
-        return;
+        dispatchRelativePointerEventWithPacket(_packets.packet(), 6);
+        _packets.publishStatistics(this);
     }
+}
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2SynapticsTouchPad::packetsOccurred( const UInt8 * data, UInt32 count )
+{
     //
-    // Add this byte to the packet buffer. If the packet is complete, that is,
-    // we have the three bytes, dispatch this packet for processing.
+    // Batch flavour of interruptOccurred: the controller delivers every byte
+    // it drained for us in one call. The same resync rules apply as above,
+    // but without an indirect call per byte.
     //
 
-    _packetBuffer[_packetByteCount++] = data;
-    
-    if (_packetByteCount == 6)
-    {
-        dispatchRelativePointerEventWithPacket(_packetBuffer, 6);
-        _packetByteCount = 0;
-    }
+    if (_packets.addBytes(data, count, this,
+            &ApplePS2SynapticsTouchPad::dispatchRelativePointerEventWithPacket))
+        _packets.publishStatistics(this);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -414,185 +523,251 @@ void ApplePS2SynapticsTouchPad::
     // Y7 Y6 Y5 Y4 Y3 Y2 Y1 Y0  (Y delta)
     //
 
-    UInt32       buttons = 0;
-	AbsoluteTime now;
-	int x,y,z,w;
+	PS2GestureSample sample;
+	UInt32 result;
+
+	sample.w=((packet[3]&0x4)>>2)|((packet[0]&0x4)>>1)|((packet[0]&0x30)>>2);
+
+	//
+	// In advanced gesture mode a W 2 packet, ahead of the primary one, holds
+	// the second finger.  Keep it for the packet that follows.
+	//
+
+	if (_advancedGestures && sample.w == 2)
+	{
+		decodeAdvancedGesturePacket(packet);
+		return;
+	}
 
 #if APPLESDK
-	clock_get_uptime(&now);
+	clock_get_uptime(&sample.time);
 #else 
-	clock_get_uptime((uint64_t*)&now);
+	clock_get_uptime((uint64_t*)&sample.time);
 #endif
-    if ( (packet[0] & 0x1)) buttons |= 0x1;  // left button   (bit 0 in packet)
-    if ( (packet[0] & 0x2) ) buttons |= 0x2;  // right button  (bit 1 in packet)
-    
-	x=packet[4]|((packet[1]&0xf)<<8)|((packet[3]&0x10)<<8);
-	y=packet[5]|((packet[1]&0xf0)<<4)|((packet[3]&0x20)<<7);
-	z=packet[2];
-	w=((packet[3]&0x4)>>2)|((packet[0]&0x4)>>1)|((packet[0]&0x30)>>2);
-	if (z < z_finger && touchmode!=MODE_NOTOUCH && touchmode!=MODE_PREDRAG && touchmode!=MODE_DRAGNOTOUCH)
+	sample.buttons = 0;
+	if ( (packet[0] & 0x1)) sample.buttons |= 0x1;  // left button   (bit 0 in packet)
+	if ( (packet[0] & 0x2) ) sample.buttons |= 0x2;  // right button  (bit 1 in packet)
+
+	// The packet reports the button state itself, a pending release is moot.
+	_clickScheduler.cancel();
+
+	// Pick up settings the prefpane changed on the parameter page.
+	if (_params.pending())
+		applyParameterPage();
+
+	sample.x=packet[4]|((packet[1]&0xf)<<8)|((packet[3]&0x10)<<8);
+	sample.y=packet[5]|((packet[1]&0xf0)<<4)|((packet[3]&0x20)<<7);
+	sample.z=packet[2];
+	if (_gestures.touching(sample.z) && _rateGovernor.touch())
+		submitTouchPadModeByte(_touchPadModeByte);
+
+	//
+	// W is 0 with two fingers down and 1 with three or more (image sensors
+	// count them exactly), any other W being one finger.  Only pads in
+	// advanced gesture mode that report the multi finger capability are
+	// trusted with this; for the others the gesture engine goes by W alone.
+	//
+
+	sample.fingers = 0;
+	if (!sample.z)
 	{
-		xrest=yrest=scrollrest=0;
-		untouchtime=(*(uint64_t*)&now);
-		if ((*(uint64_t*)&now)-touchtime<maxtaptime && clicking)
-			switch (touchmode)
-			{
-				case MODE_DRAG:
-					buttons&=~0x3;
-					dispatchRelativePointerEvent(0, 0, buttons|0x1, now);
-					dispatchRelativePointerEvent(0, 0, buttons, now);
-					if (wasdouble && rtap)
-						buttons|=0x2;
-					else
-						buttons|=0x1;
-					touchmode = MODE_NOTOUCH;
-					break;
-				case MODE_DRAGLOCK:
-					touchmode=MODE_NOTOUCH;
-					break;
-				default:
-					if (wasdouble && rtap)
-					{
-						buttons|=0x2;
-						touchmode=MODE_NOTOUCH;
-					}
-					else
-					{
-						buttons|=0x1;
-						touchmode = dragging?MODE_PREDRAG:MODE_NOTOUCH;
-					}
-			}
-		else
+		_secondFingerValid = false;
+		_contacts = 0;
+	}
+	else if (_advancedGestures && (_capabilities & kSynapticsCapMultiFinger))
+	{
+		if (sample.w >= 3)
 		{
-			xmoved=ymoved=xscrolled=yscrolled=0;
-			if ((touchmode==MODE_DRAG || touchmode==MODE_DRAGLOCK) && draglock)
-				touchmode = MODE_DRAGNOTOUCH;
-			else
-				touchmode = MODE_NOTOUCH;
+			sample.fingers = 1;
+			_secondFingerValid = false;
 		}
-		wasdouble=false;
+		else if (sample.w == 1)
+			sample.fingers = _contacts > 3 ? _contacts : 3;
+		else
+			sample.fingers = 2;
 	}
-	if (touchmode==MODE_PREDRAG && (*(uint64_t*)&now)-untouchtime>maxdragtime)
-		touchmode = MODE_NOTOUCH;
-	switch (touchmode)
+
+	//
+	// In frame mode the gesture daemon gets the touch as is, with the second
+	// finger if the pad reported one, and only the physical buttons are
+	// reported from here.
+	//
+
+	if (_frames.active())
 	{
-		case MODE_DRAG:
-		case MODE_DRAGLOCK:
-			buttons|=0x1;
-		case MODE_MOVE:
-			if (!divisor)
-				break;
-			dispatchRelativePointerEvent((x-lastx+xrest)/divisor, (lasty-y+yrest)/divisor, buttons, now);
-			xmoved+=(x-lastx+xrest)/divisor;
-			ymoved+=(lasty-y+yrest)/divisor;
-			xrest=(x-lastx+xrest)%divisor;
-			yrest=(lasty-y+yrest)%divisor;
-			break;
-		case MODE_MTOUCH:
-			if (!wsticky && w<wlimit && w>=3)
-			{
-				touchmode=MODE_MOVE;
-				break;
-			}			
-			dispatchScrollWheelEvent(wvdivisor?(y-lasty+yrest)/wvdivisor:0, 
-									 (whdivisor&&hscroll)?(lastx-x+xrest)/whdivisor:0, 0, now);
-			xscrolled+=wvdivisor?(y-lasty+yrest)/wvdivisor:0;
-			yscrolled+=whdivisor?(lastx-x+xrest)/whdivisor:0;
-			xrest=whdivisor?(lastx-x+xrest)%whdivisor:0;
-			yrest=wvdivisor?(y-lasty+yrest)%wvdivisor:0;
-			dispatchRelativePointerEvent(0, 0, buttons, now);
-			break;
-			
-		case MODE_VSCROLL:
-			if (!vsticky && x<redge)
+		PS2Frame * frame = _frames.begin(*(uint64_t*)&sample.time);
+		if (sample.z)
+		{
+			frame->fingers = sample.fingers ? sample.fingers :
+			                 sample.w == 0 ? 2 : sample.w == 1 ? 3 : 1;
+			frame->points = 1;
+			frame->finger[0].x = sample.x;
+			frame->finger[0].y = sample.y;
+			frame->finger[0].z = sample.z;
+			frame->finger[0].width = sample.w;
+			frame->finger[0].id = 0;
+			if (sample.fingers > 1 && _secondFingerValid)
 			{
-				touchmode=MODE_MOVE;
-				break;
+				frame->finger[1] = _secondFinger;
+				frame->points = 2;
 			}
-			dispatchScrollWheelEvent((y-lasty+scrollrest)/vscrolldivisor, 0, 0, now);
-			xscrolled+=(y-lasty+scrollrest)/vscrolldivisor;
-			scrollrest=(y-lasty+scrollrest)%vscrolldivisor;
-			dispatchRelativePointerEvent(0, 0, buttons, now);
-			break;			
-		case MODE_HSCROLL:
-			if (!hsticky && y>bedge)
-			{
-				touchmode=MODE_MOVE;
-				break;
-			}			
-			dispatchScrollWheelEvent(0,(lastx-x+scrollrest)/hscrolldivisor, 0, now);
-			yscrolled+=(lastx-x+scrollrest)/hscrolldivisor;
-			scrollrest=(lastx-x+scrollrest)%hscrolldivisor;
-			dispatchRelativePointerEvent(0, 0, buttons, now);
-			break;			
-		case MODE_CSCROLL:
-		{
-			int mov=0;
-			if (y<centery)
-				mov=x-lastx;
-			else
-				mov=lastx-x;
-			if (x<centerx)
-				mov+=lasty-y;
-			else
-				mov+=y-lasty;
-			
-			dispatchScrollWheelEvent((mov+scrollrest)/cscrolldivisor, 0, 0, now);
-			xscrolled+=(mov+scrollrest)/cscrolldivisor;
-			scrollrest=(mov+scrollrest)%cscrolldivisor;
 		}
-			dispatchRelativePointerEvent(0, 0, buttons, now);
-			break;			
-
-		case MODE_PREDRAG:
-		case MODE_DRAGNOTOUCH:
-			buttons |= 0x1;
-		case MODE_NOTOUCH:
-			if (!tapstable)
-				xmoved=ymoved=xscrolled=yscrolled=0;
-			dispatchScrollWheelEvent(-xscrolled, -yscrolled, 0, now);			
-			dispatchRelativePointerEvent(-xmoved, -ymoved, buttons, now);
-			xmoved=ymoved=xscrolled=yscrolled=0;
-			break;
+		frame->buttons = sample.buttons;
+		_frames.commit(frame);
+		_gestures.reset();
+		postRelativePointerEvent(0, 0, sample.buttons, sample.time);
+		return;
 	}
-	lastx=x;
-	lasty=y;
-	if ((touchmode==MODE_NOTOUCH || touchmode==MODE_PREDRAG || touchmode==MODE_DRAGNOTOUCH) && z>z_finger)
-		touchtime=*(uint64_t*)&now;
-	if ((w>=wlimit || w<3) && z>z_finger)
-		wasdouble=true;
-	if ((w>=wlimit || w<3) && z>z_finger && scroll && (wvdivisor || (hscroll && whdivisor)))
-		touchmode=MODE_MTOUCH;
-	if (touchmode==MODE_PREDRAG && z>z_finger)
-		touchmode=MODE_DRAG;
-	if (touchmode==MODE_DRAGNOTOUCH && z>z_finger)
-		touchmode=MODE_DRAGLOCK;
-	
-	if (scroll && cscrolldivisor)
+
+	result = _gestures.process(this, sample);
+
+	if ((result & kPS2GestureLifted) && (_touchPadModeByte & (1<<6)))
+		_rateGovernor.release();
+
+	//
+	// The trackpad stops reporting soon after the finger lifts, so the release
+	// of a tap click (or of a tap waiting to become a drag) can't wait for the
+	// next packet.  Have the click timer report it instead.
+	//
+
+	if (result & kPS2GestureRelease)
+		_clickScheduler.schedule(sample.buttons, _gestures.releaseDelay());
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2SynapticsTouchPad::clickReleaseOccurred(IOTimerEventSource * sender)
+{
+	UInt32 buttons;
+	AbsoluteTime now;
+
+	//
+	// Report the button release for the last tap, unless a packet arrived in
+	// the meantime.  A tap that was waiting to become a drag has now expired.
+	//
+
+	if (!_clickScheduler.fire(&buttons))
+		return;
+
+	_gestures.expireTap();
+
+#if APPLESDK
+	clock_get_uptime(&now);
+#else 
+	clock_get_uptime((uint64_t*)&now);
+#endif
+	postRelativePointerEvent(0, 0, buttons, now);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2SynapticsTouchPad::idleRateOccurred(IOTimerEventSource * sender)
+{
+	//
+	// The pad has been idle for a while; drop it to the low report rate until
+	// the next touch.  Not while a drag is still holding the button, as the
+	// drag resumes with the next touch.
+	//
+
+	if (_gestures.holdsButton())
 	{
-		if (touchmode==MODE_NOTOUCH && z>z_finger && y>tedge && (ctrigger==1 || ctrigger==9))
-			touchmode=MODE_CSCROLL;
-		if (touchmode==MODE_NOTOUCH && z>z_finger && y>tedge && x>redge && (ctrigger==2))
-			touchmode=MODE_CSCROLL;
-		if (touchmode==MODE_NOTOUCH && z>z_finger && x>redge && (ctrigger==3 || ctrigger==9))
-			touchmode=MODE_CSCROLL;
-		if (touchmode==MODE_NOTOUCH && z>z_finger && x>redge && y<bedge && (ctrigger==4))
-			touchmode=MODE_CSCROLL;
-		if (touchmode==MODE_NOTOUCH && z>z_finger && y<bedge && (ctrigger==5 || ctrigger==9))
-			touchmode=MODE_CSCROLL;
-		if (touchmode==MODE_NOTOUCH && z>z_finger && y<bedge && x<ledge && (ctrigger==6))
-			touchmode=MODE_CSCROLL;
-		if (touchmode==MODE_NOTOUCH && z>z_finger && x<ledge && (ctrigger==7 || ctrigger==9))
-			touchmode=MODE_CSCROLL;
-		if (touchmode==MODE_NOTOUCH && z>z_finger && x<ledge && y>tedge && (ctrigger==8))
-			touchmode=MODE_CSCROLL;
+		_rateGovernor.release();
+		return;
 	}
-	if (touchmode==MODE_NOTOUCH && z>z_finger && x>redge && vscrolldivisor && scroll)
-		touchmode=MODE_VSCROLL;
-	if (touchmode==MODE_NOTOUCH && z>z_finger && y<bedge && hscrolldivisor && hscroll && scroll)
-		touchmode=MODE_HSCROLL;
-	if (touchmode==MODE_NOTOUCH && z>z_finger)
-		touchmode=MODE_MOVE;
+
+	if (_rateGovernor.expire())
+		submitTouchPadModeByte(_touchPadModeByte & ~(1<<6));
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2SynapticsTouchPad::postRelativePointerEvent(int dx, int dy, UInt32 buttons, AbsoluteTime now)
+{
+	//
+	// All pointer events go through the event filter, which drops the ones
+	// that change nothing and merges motion within the coalescing window.
+	//
+
+	if (_events.addPointer(&dx, &dy, buttons, *(uint64_t*)&now))
+		dispatchRelativePointerEvent(dx, dy, buttons, now);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2SynapticsTouchPad::postScrollWheelEvent(int deltaVert, int deltaHoriz, AbsoluteTime now)
+{
+	if (_events.addScroll(&deltaVert, &deltaHoriz, *(uint64_t*)&now))
+		dispatchScrollWheelEvent(deltaVert, deltaHoriz, 0, now);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2SynapticsTouchPad::flushEvents(AbsoluteTime now)
+{
+	int deltaVert, deltaHoriz, dx, dy;
+	UInt32 buttons;
+
+	//
+	// Report whatever the filter still holds back; called when the finger
+	// lifts, as no more events may follow to carry it.
+	//
+
+	if (_events.flushScroll(&deltaVert, &deltaHoriz))
+		dispatchScrollWheelEvent(deltaVert, deltaHoriz, 0, now);
+	if (_events.flushPointer(&dx, &dy, &buttons))
+		dispatchRelativePointerEvent(dx, dy, buttons, now);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static const char * const parameterNames[kPS2ParamCount] = {
+	"Divisor", "FingerZ", "TopEdge", "BottomEdge",
+	"LeftEdge", "RightEdge", "CenterX", "CenterY"
+};
+
+void ApplePS2SynapticsTouchPad::applyParameterPage()
+{
+	//
+	// Apply the values the prefpane changed on the parameter page, between
+	// two packets.  Unlike setParamProperties this leaves the touch going,
+	// as the user may be trying the setting out while moving the slider.
+	//
+
+	SInt32 values[kPS2ParamCount];
+	UInt32 changed = _params.take(values);
+
+	if (!changed)
+		return;
+
+	for (int i=0;i<kPS2ParamCount;i++)
+		if (changed & (1<<i))
+		{
+			*_paramVars[i] = values[i];
+			setProperty (parameterNames[i], values[i], 32);
+		}
+	_gestures.configure();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2SynapticsTouchPad::publishParameterPage()
+{
+	for (int i=0;i<kPS2ParamCount;i++)
+		_params.publish(i, *_paramVars[i]);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOMemoryDescriptor * ApplePS2SynapticsTouchPad::getParameterMemory()
+{
+	return _params.memory();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+PS2FrameChannel * ApplePS2SynapticsTouchPad::getFrameChannel()
+{
+	return &_frames;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -676,14 +851,189 @@ UInt32 ApplePS2SynapticsTouchPad::getTouchPadData( UInt8 dataSelector )
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2SynapticsTouchPad::queryCapabilities()
+{
+    //
+    // Read the capability pages the pad answers, once from start; they don't
+    // change, so waking up and reconfiguring go by the cached values.  A page
+    // the pad doesn't answer stays 0.
+    //
+
+    UInt32 data;
+
+    data = getTouchPadData(kSynapticsQueryCapabilities);
+    _capabilities = kSynapticsCapValid(data) ? data : 0;
+
+    if (kSynapticsCapExtendedQueries(_capabilities) >= 1 &&
+        (data = getTouchPadData(kSynapticsQueryExtendedCapabilities)) != (UInt32)(-1))
+        _extendedCapabilities = data;
+
+    if (kSynapticsCapExtendedQueries(_capabilities) >= 4 &&
+        (data = getTouchPadData(kSynapticsQueryContinuedCapabilities)) != (UInt32)(-1))
+        _continuedCapabilities = data;
+
+    _advancedGestures = (_capabilities & kSynapticsCapExtended) &&
+                        (_continuedCapabilities & (kSynapticsCapAdvancedGesture |
+                                                   kSynapticsCapImageSensor));
+
+    setProperty("Capabilities", _capabilities, 32);
+    setProperty("ExtendedCapabilities", _extendedCapabilities, 32);
+    setProperty("ContinuedCapabilities", _continuedCapabilities, 32);
+    setProperty("AdvancedGestureMode", _advancedGestures ? kOSBooleanTrue : kOSBooleanFalse);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2SynapticsTouchPad::decodeAdvancedGesturePacket( const UInt8 * packet )
+{
+    //
+    // The W 2 packet of advanced gesture mode.  Bits 5-4 of the last byte
+    // tell its type: 1 is the second finger, at half resolution, and 2 (from
+    // image sensors) the number of fingers down.
+    //
+
+    switch ((packet[5] & 0x30) >> 4)
+    {
+        case 1:
+            _secondFinger.x     = (packet[1] | ((packet[4] & 0x0f) << 8)) << 1;
+            _secondFinger.y     = (packet[2] | ((packet[4] & 0xf0) << 4)) << 1;
+            _secondFinger.z     = ((packet[3] & 0x30) | (packet[5] & 0x0f)) << 1;
+            _secondFinger.width = 0;
+            _secondFinger.id    = 1;
+            _secondFingerValid  = true;
+            break;
+
+        case 2:
+            _contacts = packet[1];
+            break;
+    }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 bool ApplePS2SynapticsTouchPad::setTouchPadModeByte( UInt8 modeByteValue,
                                                      bool  enableStreamMode )
 {
     PS2Request * request = _device->allocateRequest();
     bool         success;
 
+    bool         agm     = _advancedGestures && (modeByteValue & (1<<0));
+
     if ( !request ) return false;
 
+    buildTouchPadModeByteRequest( request, modeByteValue, enableStreamMode && !agm );
+    _device->submitRequestAndBlock(request);
+
+    success = (request->commandsCount == 12);
+
+    //
+    // Advanced gesture mode rides on W mode; switch it on again after every
+    // mode byte write, and re-enable stream mode after that.
+    //
+
+    if ( success && agm )
+    {
+        buildAdvancedGestureModeRequest( request, enableStreamMode );
+        _device->submitRequestAndBlock(request);
+
+        success = (request->commandsCount == 12);
+    }
+
+    _device->freeRequest(request);
+    
+    return success;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2SynapticsTouchPad::submitTouchPadModeByte( UInt8 modeByteValue )
+{
+    //
+    // Reprogram the mode byte and re-enable stream mode without waiting for
+    // the outcome, so this may be called from the interrupt path.
+    //
+
+    PS2Request * request = _device->allocateRequest();
+    PS2Request * agm     = 0;
+    PS2Request * enable  = 0;
+    bool         withAgm = _advancedGestures && (modeByteValue & (1<<0));
+
+    if ( !request ) return;
+
+    //
+    // As above, advanced gesture mode follows in a request of its own, and
+    // stream mode is enabled last, in one more, whose completion checks that
+    // the pad took it.  Those have no coalescing key, so they keep the mode
+    // byte ahead of them.
+    //
+
+    if ( withAgm )
+        agm = _device->allocateRequest();
+    enable = _device->allocateRequest();
+
+    if ( !enable || (withAgm && !agm) )
+    {
+        if ( agm )     _device->freeRequest(agm);
+        if ( enable )  _device->freeRequest(enable);
+        _device->freeRequest(request);
+        return;
+    }
+
+    buildTouchPadModeByteRequest( request, modeByteValue, false );
+    request->coalesceKey = kPS2CoalesceModeByte;
+    _device->submitRequest(request); // asynchronous, auto-free'd
+
+    if ( agm )
+    {
+        buildAdvancedGestureModeRequest( agm, false );
+        _device->submitRequest(agm); // asynchronous, auto-free'd
+    }
+
+    enable->commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
+    enable->commands[0].inOrOut = kDP_Enable;
+    enable->commandsCount = 1;
+    _device->submitRequest(enable, this, submitTouchPadModeByteCompletion, enable);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2SynapticsTouchPad::submitTouchPadModeByteCompletion( void * target,
+                                                                  void * param )
+{                                                      // PS2CompletionAction
+    ApplePS2SynapticsTouchPad * me      = (ApplePS2SynapticsTouchPad *) target;
+    PS2Request *                request = (PS2Request *) param;
+    bool                        success = (request->commandsCount == 1);
+
+    me->_device->freeRequest(request);
+
+    //
+    // A sequence that failed part way leaves the pad with stream mode off,
+    // and then no touch ever comes to switch the rate again.  Enable it once
+    // more, and let the governor start over from the high rate, which the
+    // next idle time reprograms either way.
+    //
+
+    if ( !success )
+    {
+        me->_rateGovernor.reset();
+
+        request = me->_device->allocateRequest();
+        if ( !request ) return;
+
+        request->commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
+        request->commands[0].inOrOut = kDP_Enable;
+        request->commandsCount = 1;
+        request->coalesceKey   = kPS2CoalesceEnable;
+        me->_device->submitRequest(request); // asynchronous, auto-free'd
+    }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2SynapticsTouchPad::buildTouchPadModeByteRequest( PS2Request * request,
+                                                              UInt8        modeByteValue,
+                                                              bool         enableStreamMode )
+{
     // Disable stream mode before the command sequence.
     request->commands[0].command  = kPS2C_SendMouseCommandAndCompareAck;
     request->commands[0].inOrOut  = kDP_SetDefaultsAndDisable;
@@ -722,70 +1072,50 @@ bool ApplePS2SynapticsTouchPad::setTouchPadModeByte( UInt8 modeByteValue,
                                      kDP_SetMouseScaling1To1; /* Nop */
 
     request->commandsCount = 12;
-    _device->submitRequestAndBlock(request);
-
-    success = (request->commandsCount == 12);
-
-    _device->freeRequest(request);
-    
-    return success;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2SynapticsTouchPad::setCommandByte( UInt8 setBits, UInt8 clearBits )
+void ApplePS2SynapticsTouchPad::buildAdvancedGestureModeRequest( PS2Request * request,
+                                                                 bool         enableStreamMode )
 {
-    //
-    // Sets the bits setBits and clears the bits clearBits "atomically" in the
-    // controller's Command Byte.   Since the controller does not provide such
-    // a read-modify-write primitive, we resort to a test-and-set try loop.
-    //
-    // Do NOT issue this request from the interrupt/completion context.
-    //
-
-    UInt8        commandByte;
-    UInt8        commandByteNew;
-    PS2Request * request = _device->allocateRequest();
+    // Start a new argument sequence.
+    request->commands[0].command  = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[0].inOrOut  = kDP_SetMouseScaling1To1;
 
-    if ( !request ) return;
+    // 4 set resolution commands encode the model query (0x03) ...
+    request->commands[1].command  = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[1].inOrOut  = kDP_SetMouseResolution;
+    request->commands[2].command  = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[2].inOrOut  = (kSynapticsQueryModel >> 6) & 0x3;
 
-    do
-    {
-        // (read command byte)
-        request->commands[0].command = kPS2C_WriteCommandPort;
-        request->commands[0].inOrOut = kCP_GetCommandByte;
-        request->commands[1].command = kPS2C_ReadDataPort;
-        request->commands[1].inOrOut = 0;
-        request->commandsCount = 2;
-        _device->submitRequestAndBlock(request);
+    request->commands[3].command  = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[3].inOrOut  = kDP_SetMouseResolution;
+    request->commands[4].command  = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[4].inOrOut  = (kSynapticsQueryModel >> 4) & 0x3;
 
-        //
-        // Modify the command byte as requested by caller.
-        //
+    request->commands[5].command  = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[5].inOrOut  = kDP_SetMouseResolution;
+    request->commands[6].command  = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[6].inOrOut  = (kSynapticsQueryModel >> 2) & 0x3;
 
-        commandByte    = request->commands[1].inOrOut;
-        commandByteNew = (commandByte | setBits) & (~clearBits);
-
-        // ("test-and-set" command byte)
-        request->commands[0].command = kPS2C_WriteCommandPort;
-        request->commands[0].inOrOut = kCP_GetCommandByte;
-        request->commands[1].command = kPS2C_ReadDataPortAndCompare;
-        request->commands[1].inOrOut = commandByte;
-        request->commands[2].command = kPS2C_WriteCommandPort;
-        request->commands[2].inOrOut = kCP_SetCommandByte;
-        request->commands[3].command = kPS2C_WriteDataPort;
-        request->commands[3].inOrOut = commandByteNew;
-        request->commandsCount = 4;
-        _device->submitRequestAndBlock(request);
+    request->commands[7].command  = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[7].inOrOut  = kDP_SetMouseResolution;
+    request->commands[8].command  = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[8].inOrOut  = (kSynapticsQueryModel >> 0) & 0x3;
 
-        //
-        // Repeat this loop if last command failed, that is, if the
-        // old command byte was modified since we first read it.
-        //
+    // ... which set sample rate 200 turns into "set advanced gesture mode".
+    request->commands[9].command  = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[9].inOrOut  = kDP_SetMouseSampleRate;
+    request->commands[10].command = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[10].inOrOut = 200;
 
-    } while (request->commandsCount != 4);  
+    request->commands[11].command  = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[11].inOrOut  = enableStreamMode ?
+                                     kDP_Enable :
+                                     kDP_SetMouseScaling1To1; /* Nop */
 
-    _device->freeRequest(request);
+    request->commandsCount = 12;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -795,28 +1125,29 @@ IOReturn ApplePS2SynapticsTouchPad::setParamProperties( OSDictionary * config )
 	OSNumber *num;
 	OSBoolean *bl;
 	uint8_t oldmode=_touchPadModeByte;
+	PS2GestureSettings & settings = _gestures.settings();
 	struct {const char *name; int *var;} int32vars[]={
-		{"FingerZ",							&z_finger		},
-		{"Divisor",							&divisor		},
-		{"RightEdge",						&redge			},
-		{"LeftEdge",						&ledge			},
-		{"TopEdge",							&tedge			},
-		{"BottomEdge",						&bedge			},
-		{"VerticalScrollDivisor",			&vscrolldivisor	},
-		{"HorizontalScrollDivisor",			&hscrolldivisor	},
-		{"CircularScrollDivisor",			&cscrolldivisor	},
-		{"CenterX",							&centerx		},
-		{"CenterY",							&centery		},
-		{"CircularScrollTrigger",			&ctrigger		},
-		{"MultiFingerWLimit",				&wlimit			},
-		{"MultiFingerVerticalDivisor",		&wvdivisor		},
-		{"MultiFingerHorizontalDivisor",	&whdivisor		}
+		{"FingerZ",							&settings.fingerZ	},
+		{"Divisor",							&settings.divisor	},
+		{"RightEdge",						&settings.rightEdge	},
+		{"LeftEdge",						&settings.leftEdge	},
+		{"TopEdge",							&settings.topEdge	},
+		{"BottomEdge",						&settings.bottomEdge	},
+		{"VerticalScrollDivisor",			&settings.vscrollDivisor},
+		{"HorizontalScrollDivisor",			&settings.hscrollDivisor},
+		{"CircularScrollDivisor",			&settings.cscrollDivisor},
+		{"CenterX",							&settings.centerX	},
+		{"CenterY",							&settings.centerY	},
+		{"CircularScrollTrigger",			&settings.cscrollTrigger},
+		{"MultiFingerWLimit",				&settings.wLimit	},
+		{"MultiFingerVerticalDivisor",		&settings.wvDivisor	},
+		{"MultiFingerHorizontalDivisor",	&settings.whDivisor	}
 	};
 	struct {const char *name; int *var;} boolvars[]={
-		{"StickyHorizontalScrolling",		&hsticky},
-		{"StickyVerticalScrolling",			&vsticky},
-		{"StickyMultiFingerScrolling",		&wsticky},
-		{"StabilizeTapping",				&tapstable}
+		{"StickyHorizontalScrolling",		&settings.stickyHScroll},
+		{"StickyVerticalScrolling",			&settings.stickyVScroll},
+		{"StickyMultiFingerScrolling",		&settings.stickyMultiFinger},
+		{"StabilizeTapping",				&settings.stableTap}
 	};
 	int i;
 	if (!config)
@@ -828,22 +1159,26 @@ IOReturn ApplePS2SynapticsTouchPad::setParamProperties( OSDictionary * config )
 			_touchPadModeByte &=~(1<<6);
 
 	if (num=OSDynamicCast (OSNumber, config->getObject ("TrackpadRightClick")))
-		rtap = (num->unsigned32BitValue()&0x1)?true:false;
+		settings.rightTap = (num->unsigned32BitValue()&0x1)?true:false;
 	if (num=OSDynamicCast (OSNumber, config->getObject ("Clicking")))
-		clicking = (num->unsigned32BitValue()&0x1)?true:false;
+		settings.clicking = (num->unsigned32BitValue()&0x1)?true:false;
 	if (num=OSDynamicCast (OSNumber, config->getObject ("Dragging")))	
-		dragging = (num->unsigned32BitValue()&0x1)?true:false;
+		settings.dragging = (num->unsigned32BitValue()&0x1)?true:false;
 	if (num=OSDynamicCast (OSNumber, config->getObject ("DragLock")))
-		draglock = (num->unsigned32BitValue()&0x1)?true:false;
+		settings.dragLock = (num->unsigned32BitValue()&0x1)?true:false;
 	if (num=OSDynamicCast (OSNumber, config->getObject ("TrackpadHorizScroll")))
-		hscroll = (num->unsigned32BitValue()&0x1)?true:false;
+		settings.hscroll = (num->unsigned32BitValue()&0x1)?true:false;
 	if (num=OSDynamicCast (OSNumber, config->getObject ("TrackpadScroll")))
-		scroll = (num->unsigned32BitValue()&0x1)?true:false;
+		settings.scroll = (num->unsigned32BitValue()&0x1)?true:false;
 	
 	if (num=OSDynamicCast (OSNumber, config->getObject ("MaxTapTime")))
-		maxtaptime = num->unsigned64BitValue();
+		settings.maxTapTime = num->unsigned64BitValue();
 	if (num=OSDynamicCast (OSNumber, config->getObject ("HIDClickTime")))
-		maxdragtime = num->unsigned64BitValue();
+		settings.maxDragTime = num->unsigned64BitValue();
+	if (num=OSDynamicCast (OSNumber, config->getObject ("EventCoalesceTime")))
+		_events.setWindow(num->unsigned64BitValue());
+	if (num=OSDynamicCast (OSNumber, config->getObject ("LowRateIdleTime")))
+		_rateGovernor.setIdleTime(num->unsigned32BitValue());
 	for (i=0;(unsigned)i<sizeof (boolvars)/sizeof(boolvars[0]);i++)		
 		if (bl=OSDynamicCast (OSBoolean,config->getObject (boolvars[i].name)))
 			*(boolvars[i].var) = bl->isTrue();	
@@ -851,31 +1186,36 @@ IOReturn ApplePS2SynapticsTouchPad::setParamProperties( OSDictionary * config )
 		if (num=OSDynamicCast (OSNumber,config->getObject (int32vars[i].name)))
 			*(int32vars[i].var) = num->unsigned32BitValue();
 	
-	if (whdivisor || wvdivisor)
+	if (_advancedGestures || settings.whDivisor || settings.wvDivisor)
 		_touchPadModeByte |= 1<<0;
 	else
 		_touchPadModeByte &=~(1<<0);
 	
 	if (_touchPadModeByte!=oldmode && inited)
+	{
 		setTouchPadModeByte (_touchPadModeByte);
-	_packetByteCount=0;
-	touchmode = MODE_NOTOUCH;
+		_rateGovernor.reset();
+	}
+	_packets.reset();
+	_gestures.reset();
+	_gestures.configure();
+	publishParameterPage();
 	
 	for (i=0;(unsigned)i<sizeof (int32vars)/sizeof(int32vars[0]);i++)		
 		setProperty (int32vars[i].name,*(int32vars[i].var),32);
 	for (i=0;(unsigned)i<sizeof (boolvars)/sizeof(int32vars[0]);i++)		
 		setProperty (boolvars[i].name,*(boolvars[i].var)?kOSBooleanTrue:kOSBooleanFalse);
 
-	setProperty ("MaxTapTime", maxtaptime, 64);
-	setProperty ("HIDClickTime", maxdragtime, 64);
+	setProperty ("MaxTapTime", settings.maxTapTime, 64);
+	setProperty ("HIDClickTime", settings.maxDragTime, 64);
 	setProperty ("UseHighRate",_touchPadModeByte&(1<<6)?kOSBooleanTrue:kOSBooleanFalse);
 
-	setProperty ("Clicking", clicking?1:0, 32);
-	setProperty ("Dragging", dragging?1:0, 32);
-	setProperty ("DragLock", draglock?1:0, 32);
-	setProperty ("TrackpadHorizScroll", hscroll?1:0, 32);
-	setProperty ("TrackpadScroll", scroll?1:0, 32);
-	setProperty ("TrackpadRightClick", rtap?1:0, 32);
+	setProperty ("Clicking", settings.clicking?1:0, 32);
+	setProperty ("Dragging", settings.dragging?1:0, 32);
+	setProperty ("DragLock", settings.dragLock?1:0, 32);
+	setProperty ("TrackpadHorizScroll", settings.hscroll?1:0, 32);
+	setProperty ("TrackpadScroll", settings.scroll?1:0, 32);
+	setProperty ("TrackpadRightClick", settings.rightTap?1:0, 32);
 	
     return super::setParamProperties(config);
 }
@@ -907,26 +1247,28 @@ void ApplePS2SynapticsTouchPad::setDevicePowerState( UInt32 whatToDo )
 
             //
             // Must not issue any commands before the device has
-            // completed its power-on self-test and calibration.
+            // completed its power-on self-test and calibration; the
+            // controller holds off this call until the device answers.
             //
 
-            IOSleep(1000);
-
             setTouchPadModeByte( _touchPadModeByte );
+            _rateGovernor.reset();
 
             //
             // Enable the mouse clock (should already be so) and the
             // mouse IRQ line.
             //
 
-            setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
+            _device->updateCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
 
             //
             // Clear packet buffer pointer to avoid issues caused by
             // stale packet fragments.
             //
 
-            _packetByteCount = 0;
+            _packets.reset();
+            _secondFingerValid = false;
+            _contacts = 0;
 
             //
             // Finally, we enable the trackpad itself, so that it may
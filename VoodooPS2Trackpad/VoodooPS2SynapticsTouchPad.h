@@ -24,8 +24,51 @@
 #define _APPLEPS2SYNAPTICSTOUCHPAD_H
 
 #include "ApplePS2MouseDevice.h"
+#include "ApplePS2ClickScheduler.h"
+#include "ApplePS2EventFilter.h"
+#include "ApplePS2FrameRing.h"
+#include "ApplePS2GestureEngine.h"
+#include "ApplePS2PacketAssembler.h"
+#include "ApplePS2ParameterPage.h"
+#include "ApplePS2RateGovernor.h"
 #include <IOKit/hidsystem/IOHIPointing.h>
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Absolute mode packet framing: bits 7-6 are 1 0 in the first byte and 1 1 in
+// the fourth.
+//
+
+struct SynapticsPacketValidator
+{
+    static bool isPacketStart(UInt8 byte)
+    {
+        return (byte & 0xc0) == 0x80;
+    }
+
+    static bool isPacketByte(const UInt8 *, UInt32 index, UInt8 byte)
+    {
+        return index != 3 || (byte & 0xc0) == 0xc0;
+    }
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Capability pages, as returned by getTouchPadData.  Query 0x02 tells whether
+// the pad has W mode and how many extended queries it answers; 0x09 needs at
+// least one of those and 0x0C at least four.
+//
+
+#define kSynapticsQueryCapabilities           0x02
+#define kSynapticsQueryExtendedCapabilities   0x09
+#define kSynapticsQueryContinuedCapabilities  0x0C
+#define kSynapticsQueryModel                  0x03  // also the AGM argument
+
+#define kSynapticsCapValid(c)            (((c) & 0x00ff00) == 0x004700)
+#define kSynapticsCapExtended            0x800000  // 0x02: W mode
+#define kSynapticsCapExtendedQueries(c)  (((c) >> 20) & 0x7)
+#define kSynapticsCapMultiFinger         0x000002  // 0x02: W 0/1 count fingers
+#define kSynapticsCapAdvancedGesture     0x080000  // 0x0C
+#define kSynapticsCapImageSensor         0x000800  // 0x0C
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 // ApplePS2SynapticsTouchPad Class Declaration
 //
@@ -33,57 +76,61 @@
 class ApplePS2SynapticsTouchPad : public IOHIPointing 
 {
 	OSDeclareDefaultStructors( ApplePS2SynapticsTouchPad );
+	friend class PS2GestureEngine;
 
 private:
     ApplePS2MouseDevice * _device;
     UInt32                _interruptHandlerInstalled:1;
+    UInt32                _batchHandlerInstalled:1;
     UInt32                _powerControlHandlerInstalled:1;
-    UInt8                 _packetBuffer[50];
-    UInt32                _packetByteCount;
+    PS2PacketAssembler<6, SynapticsPacketValidator> _packets;
     IOFixed               _resolution;
     UInt16                _touchPadVersion;
     UInt8                 _touchPadModeByte;
-	int z_finger;
-	int divisor;
-	int ledge;
-	int redge;
-	int tedge;
-	int bedge;
-	int vscrolldivisor, hscrolldivisor, cscrolldivisor;
-	int ctrigger;
-	int centerx;
-	int centery;
-	int lastx, lasty;
-	int xrest, yrest, scrollrest;
+    UInt32                _capabilities;            // query 0x02, 0 if unknown
+    UInt32                _extendedCapabilities;    // query 0x09
+    UInt32                _continuedCapabilities;   // query 0x0C
+    UInt32                _advancedGestures:1;      // W 2 packets carry a second finger
+    UInt32                _secondFingerValid:1;
+    PS2FrameFinger        _secondFinger;            // from the last W 2 packet
+    UInt8                 _contacts;                // image sensors: fingers down
+    PS2ClickScheduler     _clickScheduler;
+    PS2EventFilter        _events;
+    PS2RateGovernor       _rateGovernor;
+    PS2ParameterChannel   _params;
+    PS2FrameChannel       _frames;
+	PS2GestureEngine _gestures;		// absolute mode touch state machine
 	int inited;
-	uint64_t maxtaptime;
-	uint64_t touchtime;
-	uint64_t untouchtime;
-	uint64_t maxdragtime;
-	int hsticky,vsticky, wsticky, tapstable;
-	int wlimit, wvdivisor, whdivisor;
-	int xmoved,ymoved,xscrolled, yscrolled;
-	bool clicking;
-	bool dragging;
-	bool draglock;
-	bool hscroll, scroll;
-	bool wasdouble;
-	bool rtap;
-	enum {MODE_NOTOUCH, MODE_MOVE, MODE_VSCROLL, MODE_HSCROLL, MODE_CSCROLL, MODE_MTOUCH, 
-		MODE_PREDRAG, MODE_DRAG, MODE_DRAGNOTOUCH, MODE_DRAGLOCK} touchmode;
+	int *_paramVars[kPS2ParamCount];	// settings on the parameter page
 	
 	virtual void   dispatchRelativePointerEventWithPacket( UInt8 * packet,
                                                            UInt32  packetSize );
+	virtual void   clickReleaseOccurred(IOTimerEventSource * sender);
+	virtual void   idleRateOccurred(IOTimerEventSource * sender);
+	virtual void   postRelativePointerEvent(int dx, int dy, UInt32 buttons, AbsoluteTime now);
+	virtual void   postScrollWheelEvent(int deltaVert, int deltaHoriz, AbsoluteTime now);
+	virtual void   flushEvents(AbsoluteTime now);
+	virtual void   applyParameterPage();
+	virtual void   publishParameterPage();
 
-    virtual void   setCommandByte( UInt8 setBits, UInt8 clearBits );
 
     virtual void   setTouchPadEnable( bool enable );
     virtual UInt32 getTouchPadData( UInt8 dataSelector );
+    virtual void   queryCapabilities();
+    virtual void   decodeAdvancedGesturePacket( const UInt8 * packet );
     virtual bool   setTouchPadModeByte( UInt8 modeByteValue,
                                         bool  enableStreamMode = false );
+    virtual void   submitTouchPadModeByte( UInt8 modeByteValue );
+    static  void   submitTouchPadModeByteCompletion( void * target, void * param );
+    virtual void   buildTouchPadModeByteRequest( PS2Request * request,
+                                                 UInt8        modeByteValue,
+                                                 bool         enableStreamMode );
+    virtual void   buildAdvancedGestureModeRequest( PS2Request * request,
+                                                    bool         enableStreamMode );
 
 	virtual void   free();
 	virtual void   interruptOccurred( UInt8 data );
+	virtual void   packetsOccurred( const UInt8 * data, UInt32 count );
     virtual void   setDevicePowerState(UInt32 whatToDo);
 
 protected:
@@ -103,6 +150,9 @@ public:
 
 	virtual IOReturn setParamProperties( OSDictionary * dict );
 	virtual IOReturn setProperties (OSObject *props);
+
+	virtual IOMemoryDescriptor * getParameterMemory();
+	virtual PS2FrameChannel *    getFrameChannel();
 };
 
 #endif /* _APPLEPS2SYNAPTICSTOUCHPAD_H */
@@ -7,16 +7,14 @@
 int main (int argc, char * const argv[]) {
 	io_service_t io_service;
 	FILE *f;
-	int siz, nkeys;
+	int siz;
 	UInt8 *buf; 
 	CFDataRef dat;
 	CFDictionaryRef plist;
-	CFStringRef *keys;
 	NSString *tmp1, *tmp2;
-	CFTypeRef *vals;
-	int i;
+	kern_return_t kr;
 	
-	io_service = IOServiceGetMatchingService(0, IOServiceMatching("ApplePS2APLSGlidePoint"));
+	io_service = IOServiceGetMatchingService(0, IOServiceMatching("ApplePS2ALPSGlidePoint"));
 	if (!io_service)
 	{
 		printf ("No ApplePS2APLSGlidePoint found\n");
@@ -55,23 +53,15 @@ int main (int argc, char * const argv[]) {
 		return 1;
 	}
 	
-	nkeys = CFDictionaryGetCount(plist);
-	keys = (CFStringRef *) malloc (nkeys*sizeof (CFStringRef));
-	vals = (CFTypeRef *) malloc (nkeys*sizeof (CFTypeRef));
-	if (!keys || !vals)
-	{
-		printf ("Couldn't allocate space\n");
-		free (buf);
-		return 1;
-	}
-	
-	CFDictionaryGetKeysAndValues (plist, (const void **)keys, vals);
-	for (i=0;i<nkeys;i++)
-		IORegistryEntrySetCFProperty(io_service, keys[i], vals[i]);
+	// Hand the whole configuration over at once: the driver applies it in a
+	// single setProperties call, and reprograms the device at most once.
+	kr = IORegistryEntrySetCFProperties(io_service, plist);
+	if (kr != KERN_SUCCESS)
+		printf ("Couldn't apply configuration (0x%x)\n", kr);
 	CFRelease (plist);
 	CFRelease (dat);
 	free (buf);
-	free (keys);
-	free (vals);
+	if (kr != KERN_SUCCESS)
+		return 1;
     return 0;
 }